@@ -0,0 +1,87 @@
+#ifndef RISCVDB_BATCHRUNNER_H
+#define RISCVDB_BATCHRUNNER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "memorymap.h"
+#include "simhost.h"
+
+namespace riscvdb
+{
+
+// Runs executables to completion without the console (riscvdb --batch).
+// Every run gets a SimHost of its own, so that many can run side by side on
+// a pool of threads.
+class BatchRunner {
+public:
+    // Exit codes for runs that don't reach _exit
+    static const int EXIT_LOAD_FAILED = -1;
+    static const int EXIT_LIMIT = 124;    // instruction limit reached (as timeout(1))
+    static const int EXIT_STOPPED = 125;  // illegal instruction or ebreak
+
+    // Seeded runs store their seed in the word at this symbol before starting
+    static const std::string SEED_SYMBOL;
+
+    struct Job
+    {
+        std::string path;
+        bool seeded = false;
+        uint32_t seed = 0;
+    };
+
+    struct Result
+    {
+        int exitCode = EXIT_LOAD_FAILED;  // the argument to _exit (a0), or exit, if it got there
+        unsigned long long instructions = 0;  // by all harts
+        double seconds = 0;
+        std::string output;  // messages from loading and running, for RunJobs
+    };
+
+    BatchRunner(const MemoryMap::Backend memBackend, const bool blockExecution,
+                const unsigned long maxInstructions);
+
+    // Runs every job on count harts (SimHost::SetHarts)
+    void SetHarts(const unsigned int count, const SimHost::HartSync sync, const unsigned long quantum);
+
+    // Every job's UART receives the contents of this file (none if empty)
+    void SetUartInput(const std::string& path);
+
+    // Do newlib's system calls on the host (SimHost::SetSyscalls)
+    void SetSyscalls(const bool enabled);
+
+    // Every job's disk is a snapshot of this image, so that jobs running side
+    // by side don't see each other's writes (none if empty)
+    void SetBlockImage(const std::string& path);
+
+    // Runs a job in the calling thread, with its messages going to out/err
+    Result RunJob(const Job& job, std::ostream& out, std::ostream& err) const;
+
+    // Runs every job on a pool of numThreads threads (0 for one per host
+    // core), returning the results in the same order as the jobs
+    std::vector<Result> RunJobs(const std::vector<Job>& jobs, unsigned int numThreads) const;
+
+    // One line per job, then the totals. Returns the number that failed
+    // (didn't exit with 0).
+    static unsigned int PrintReport(std::ostream& out, const std::vector<Job>& jobs,
+                                    const std::vector<Result>& results,
+                                    const double seconds, const unsigned int numThreads);
+
+    static unsigned int ThreadCount(const unsigned int requested, const size_t numJobs);
+
+private:
+    MemoryMap::Backend m_memBackend;
+    bool m_blockExecution;
+    unsigned long m_maxInstructions;
+    unsigned int m_harts;
+    SimHost::HartSync m_hartSync;
+    unsigned long m_quantum;
+    std::string m_uartInput;
+    bool m_syscalls;
+    std::string m_blockImage;
+};
+
+} // namespace riscvdb
+
+#endif  // RISCVDB_BATCHRUNNER_H
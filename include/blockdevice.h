@@ -0,0 +1,94 @@
+#ifndef RISCVDB_BLOCKDEVICE_H
+#define RISCVDB_BLOCKDEVICE_H
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include "memorymap.h"
+
+namespace riscvdb
+{
+
+// A disk of 512 byte sectors, backed by a host image file. The driver sets
+// the first sector, the number of sectors and the address of a buffer in RAM,
+// then writes a command, which is done before the write returns: there are no
+// interrupts, and STATUS says how it went.
+//
+// The image is mapped into the host's memory whole, so a transfer is a copy
+// between the mapping and guest RAM, a span at a time, and only the parts of
+// the image the guest touches are ever read from the file.
+class BlockDevice
+{
+public:
+    static const MemoryMap::AddrType DEFAULT_BASE = 0xF1000000;
+    static const MemoryMap::AddrType SIZE = 0x100;
+    static const uint32_t SECTOR_SIZE = 512;
+    static const uint32_t MAGIC = 0x4B4C4252;  // "RBLK"
+
+    // Register offsets, all words
+    static const MemoryMap::AddrType REG_MAGIC = 0x00;
+    static const MemoryMap::AddrType REG_SECTOR_SIZE = 0x04;
+    static const MemoryMap::AddrType REG_CAPACITY = 0x08;  // in sectors, 64 bits (low word first)
+    static const MemoryMap::AddrType REG_SECTOR = 0x10;    // 64 bits
+    static const MemoryMap::AddrType REG_ADDRESS = 0x18;
+    static const MemoryMap::AddrType REG_COUNT = 0x1C;
+    static const MemoryMap::AddrType REG_COMMAND = 0x20;
+    static const MemoryMap::AddrType REG_STATUS = 0x24;
+
+    // Commands
+    static const uint32_t CMD_READ = 1;   // from the disk into RAM
+    static const uint32_t CMD_WRITE = 2;  // from RAM onto the disk
+    static const uint32_t CMD_FLUSH = 3;  // writes so far out to the image file
+
+    // Status
+    static const uint32_t STATUS_OK = 0;
+    static const uint32_t STATUS_ERROR = 1;  // no disk, or outside of it or of RAM
+    static const uint32_t STATUS_UNSUPPORTED = 2;
+
+    explicit BlockDevice(MemoryMap& mem);
+    ~BlockDevice();
+
+    BlockDevice(const BlockDevice&) = delete;
+    BlockDevice& operator=(const BlockDevice&) = delete;
+
+    // Uses the image at path as the disk. Writes go to the image file,
+    // unless snapshot, when they're kept in host memory and dropped when the
+    // disk is closed. Any partial sector at the end of the file is left out.
+    // Returns 0 on success.
+    int Open(const std::string& path, const bool snapshot);
+    void Close();
+
+    // in bytes, 0 if there's no disk
+    uint64_t Capacity() const;
+
+    // Any size of access, as MemoryMap's device callbacks
+    uint64_t Read(const MemoryMap::AddrType offset, const unsigned int size);
+    void Write(const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data);
+
+private:
+    MemoryMap& m_mem;
+
+    // harts on several threads can share the disk
+    std::mutex m_mutex;
+
+    std::byte* m_image;
+    uint64_t m_imageSize;  // whole sectors
+    bool m_snapshot;
+
+    uint64_t m_sector;
+    uint32_t m_address;
+    uint32_t m_count;
+    uint32_t m_command;
+    uint32_t m_status;
+
+    void CloseLocked();
+    uint32_t Execute(const uint32_t command);
+
+    // The registers are all made of aligned words
+    uint32_t ReadWord(const MemoryMap::AddrType offset);
+    void WriteWord(const MemoryMap::AddrType offset, const uint32_t data);
+};
+
+} // namespace riscvdb
+
+#endif  // RISCVDB_BLOCKDEVICE_H
@@ -0,0 +1,51 @@
+#ifndef RISCVDB_CLINT_H
+#define RISCVDB_CLINT_H
+
+#include <cstdint>
+#include <vector>
+#include "memorymap.h"
+#include "riscv_processor.h"
+
+namespace riscvdb
+{
+
+// Core local interruptor, laid out as on SiFive parts: a software interrupt
+// (msip) and timer compare (mtimecmp) register per hart, and mtime. The
+// registers themselves live in the harts, this just maps them into memory.
+//
+// Each hart counts mtime in its own retired instructions, so accesses to
+// mtime see the hart running on the calling host thread.
+class Clint
+{
+public:
+    static const MemoryMap::AddrType DEFAULT_BASE = 0xF2000000;
+    static const MemoryMap::AddrType SIZE = 0x10000;
+
+    // Register offsets
+    static const MemoryMap::AddrType MSIP = 0x0000;      // 4 bytes per hart
+    static const MemoryMap::AddrType MTIMECMP = 0x4000;  // 8 bytes per hart
+    static const MemoryMap::AddrType MTIME = 0xBFF8;
+
+    void SetHarts(const std::vector<RiscvProcessor*>& harts);
+
+    // The hart running on this host thread (hart 0 until set)
+    static void SetCurrentHart(const unsigned int hart);
+
+    // Any size of access, as MemoryMap's device callbacks
+    uint64_t Read(const MemoryMap::AddrType offset, const unsigned int size);
+    void Write(const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data);
+
+private:
+    std::vector<RiscvProcessor*> m_harts;
+    static thread_local unsigned int t_currentHart;
+
+    // The registers are all made of aligned words
+    uint32_t ReadWord(const MemoryMap::AddrType offset);
+    void WriteWord(const MemoryMap::AddrType offset, const uint32_t data);
+    RiscvProcessor* HartAt(const MemoryMap::AddrType offset, const MemoryMap::AddrType base,
+                           const unsigned int stride);
+};
+
+} // namespace riscvdb
+
+#endif  // RISCVDB_CLINT_H
@@ -18,8 +18,6 @@ public:
 private:
     SimHost& m_simHost;
 
-    void sigint_handler(int signum);
-
     static const std::string MSG_USAGE;
 };
 
@@ -18,6 +18,8 @@ public:
 private:
     SimHost& m_simHost;
 
+    void printMemory();
+
     static const std::string MSG_USAGE;
 };
 
@@ -19,8 +19,6 @@ public:
 private:
     SimHost& m_simHost;
 
-    void sigint_handler(int signum);
-
     static const std::string MSG_USAGE;
 };
 
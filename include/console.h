@@ -6,8 +6,9 @@
 #include <memory>
 #include <string>
 #include <cassert>
-#include <deque>
-#include <functional>
+#include <atomic>
+#include <thread>
+#include <csignal>
 #include "simhost.h"
 
 namespace riscvdb {
@@ -30,18 +31,24 @@ public:
 };
 
 
+// Calls a handler for each SIGINT (so commands can be Ctrl-C'd). SIGINT is
+// blocked in the constructing thread, and so in the threads it starts after
+// that, and waited for in a thread of its own. This keeps the handler free
+// of signal handler restrictions, and of any global state.
 class SigIntHandler {
 public:
-    SigIntHandler(std::function<void(int)> handler);
+    // The handler returns false if there was nothing to interrupt, in which
+    // case SIGINT gets its default action (ending the process)
+    SigIntHandler(std::function<bool(int)> handler);
     ~SigIntHandler();
 
 private:
-    const std::function<void(int)> m_handler;
+    const std::function<bool(int)> m_handler;
+    sigset_t m_previousMask;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
 
-    // used to handle SIGINTs (so commands can be Ctrl-C'd)
-    void signalHandler(int signum); // individual signal handler
-    static void static_signalHandler(int signum); // actual signal handler
-    static std::deque<SigIntHandler*> s_instances;
+    void waitForSignals();
 };
 
 
@@ -62,6 +69,9 @@ private:
     std::map<std::string, std::shared_ptr<ConsoleCommand>> m_commandsLong;
     std::map<std::string, std::shared_ptr<ConsoleCommand>> m_commandsShort;
 
+    // Ctrl-C pauses the target, if it's running
+    SigIntHandler m_sigint;
+
     ConsoleCommand::CmdRetType runCommand(const std::string& input);
 };
 
@@ -1,6 +1,7 @@
 #ifndef RISCVDB_FILELOADER_H
 #define RISCVDB_FILELOADER_H
 
+#include <iostream>
 #include <string>
 #include <vector>
 #include "elf.h"
@@ -15,7 +16,8 @@ class SimHost;
 
 class FileLoader {
 public:
-    FileLoader(const std::string& pathStr);
+    // Details of what was loaded are written to log
+    FileLoader(const std::string& pathStr, std::ostream& log = std::cout);
     virtual void LoadMemory(SimHost& simHost) = 0;
 
     const std::string& PathStr() const;
@@ -24,6 +26,7 @@ protected:
     void LoadFile(const std::string& path);
 
     const std::string& m_pathStr;
+    std::ostream& m_log;
     std::vector<std::byte> m_filebytes;
 };
 
@@ -35,7 +38,7 @@ public:
         Elf64,
     };
 
-    ElfFileLoader(const std::string& path);
+    ElfFileLoader(const std::string& path, std::ostream& log = std::cout);
 
     void LoadMemory(SimHost& simHost);
 
@@ -3,20 +3,41 @@
 
 #include <vector>
 #include <array>
+#include <atomic>
 #include <memory>
-#include <unordered_map>
+#include <map>
+#include <functional>
+#include <string>
 #include <cctype>
 
 namespace riscvdb
 {
 
-static const unsigned long long DEFAULT_BLOCK_SIZE = 1024; // 1 KiB
+static const unsigned long long DEFAULT_BLOCK_SIZE = 4096; // 4 KiB, as host pages
+static const unsigned long long CODE_PAGE_SIZE = 4096; // 4 KiB
 
 class MemoryMap {
 public:
     typedef unsigned long long AddrType;
 
-    MemoryMap(const AddrType memAddrStart, const AddrType memSize);
+    // Storage for the address range:
+    //  BACKEND_FLAT    one contiguous host mapping, reserved up front (without
+    //                  committing memory) and zero filled lazily by the kernel
+    //  BACKEND_BLOCKS  DEFAULT_BLOCK_SIZE blocks allocated on first write
+    // The flat backend falls back to blocks if the reservation is refused.
+    enum Backend
+    {
+        BACKEND_FLAT,
+        BACKEND_BLOCKS,
+    };
+
+    MemoryMap(const AddrType memAddrStart, const AddrType memSize, const Backend backend = BACKEND_FLAT);
+    ~MemoryMap();
+
+    MemoryMap(const MemoryMap&) = delete;
+    MemoryMap& operator=(const MemoryMap&) = delete;
+
+    Backend GetBackend() const;
 
     std::size_t BlockSize() const;
 
@@ -24,18 +45,159 @@ public:
     void Put(const AddrType address, const std::vector<std::byte>& data);
     void Get(const AddrType address, std::byte& data_out);
 
+    // Little endian accesses of 8/16/32/64 bits. Accesses that stay within a
+    // block go through a single lookup, only those straddling blocks are done
+    // a byte at a time.
+    uint8_t ReadByte(const AddrType address);
+    uint16_t ReadHalfword(const AddrType address);
     uint32_t ReadWord(const AddrType address);
-    void WriteWord(const AddrType address, uint32_t data, uint32_t mask);
+    uint64_t ReadDoubleword(const AddrType address);
+
+    void WriteByte(const AddrType address, const uint8_t data);
+    void WriteHalfword(const AddrType address, const uint16_t data);
+    void WriteWord(const AddrType address, uint32_t data, uint32_t mask = 0xFFFFFFFF);
+    void WriteDoubleword(const AddrType address, const uint64_t data);
+
+    // Instruction fetch, as ReadWord but through its own block cache
+    uint32_t FetchWord(const AddrType address);
+
+    // Atomic read-modify-write of an aligned word, returning the old value.
+    // These are host atomics on the word's storage, so they stay atomic
+    // against harts running on other threads.
+    enum AtomicOp
+    {
+        ATOMIC_SWAP, ATOMIC_ADD, ATOMIC_XOR, ATOMIC_AND, ATOMIC_OR,
+        ATOMIC_MIN, ATOMIC_MAX, ATOMIC_MINU, ATOMIC_MAXU,
+    };
+    uint32_t AtomicWord(const AddrType address, const AtomicOp op, const uint32_t operand);
+    uint32_t AtomicLoadWord(const AddrType address);
+
+    // Writes desired if the aligned word still holds expected, atomically
+    bool CompareExchangeWord(const AddrType address, const uint32_t expected, const uint32_t desired);
 
     void Clear();
 
+    // Memory mapped devices. Accesses to [base, base + size) go to the
+    // device's read and write, given the offset into its range and the access
+    // size in bytes, instead of RAM. RAM below the lowest device is reached
+    // exactly as if there were none, so devices belong near the top of the
+    // address space: only accesses that miss the RAM below them look the
+    // devices up, and RAM above the highest costs one more compare. Ranges
+    // are word aligned and can't overlap, and devices are all added before
+    // any hart runs.
+    typedef std::function<uint64_t(const AddrType offset, const unsigned int size)> DeviceRead;
+    typedef std::function<void(const AddrType offset, const unsigned int size, const uint64_t data)> DeviceWrite;
+    void AddDevice(const std::string& name, const AddrType base, const AddrType size,
+                   DeviceRead read, DeviceWrite write);
+
+    // Whether an access to [address, address + size) might reach a device:
+    // true anywhere between the lowest and the highest, gaps included
+    bool MayTouchDevice(const AddrType address, const AddrType size) const;
+
+    // The block backend keeps small direct mapped caches of recently used
+    // blocks in front of the block map, one for fetches and one for data
+    struct BlockCacheStats
+    {
+        unsigned long long fetchHits = 0;
+        unsigned long long fetchMisses = 0;
+        unsigned long long dataHits = 0;
+        unsigned long long dataMisses = 0;
+    };
+    BlockCacheStats GetBlockCacheStats() const;
+
+    // Visits the memory that is backed by storage, in address order: the
+    // allocated blocks, or for the flat backend the pages written since the
+    // last Clear
+    typedef std::function<void(const AddrType address, const std::byte* data, const AddrType size)> PageVisitor;
+    void ForEachPage(const PageVisitor& visit) const;
+
+    // Host storage for RAM in [address, address + size), in as few spans as
+    // the backend allows (a single one for the flat backend), for bulk
+    // transfers without going a byte at a time. Visiting stops early if visit
+    // returns false. Spans visited forWrite are counted as written to, code
+    // included. Returns false, visiting nothing, unless the range is all RAM.
+    typedef std::function<bool(std::byte* data, const AddrType size)> SpanVisitor;
+    bool ForEachSpan(const AddrType address, const AddrType size, const bool forWrite, const SpanVisitor& visit);
+
+    // Pages marked as code notify the registered handlers when written to, so
+    // that any cached decoding of the instructions in them can be dropped.
+    typedef std::function<void(const AddrType address, const AddrType size)> CodeWriteHandler;
+    unsigned int AddCodeWriteHandler(CodeWriteHandler handler);
+    void RemoveCodeWriteHandler(const unsigned int handlerId);
+    void MarkCodePage(const AddrType address);
+
 private:
     const AddrType m_addrLower;
     const AddrType m_addrUpper;
     const AddrType m_memSize;
 
+    // Devices by base address, where the RAM below them ends (the end of the
+    // address range if there are none), and where the RAM above them starts
+    struct Device
+    {
+        std::string name;
+        AddrType base;
+        AddrType size;
+        DeviceRead read;
+        DeviceWrite write;
+    };
+    std::map<AddrType, Device> m_devices;
+    AddrType m_ramUpper;
+    AddrType m_devicesEnd;
+
+    // The device holding all of [address, address + size), or nullptr.
+    // touched is set if any device holds part of it.
+    Device* FindDevice(const AddrType address, const AddrType size, bool& touched);
+
+    // flat backend (nullptr if using blocks)
+    std::byte* m_flat;
+    AddrType m_flatSize;
+
+    // Blocks are found through a two level radix table. The directory is
+    // indexed by the upper bits of the block number (counted from the start
+    // of the range) and holds tables for BLOCK_TABLE_SIZE blocks each, which
+    // are only allocated once one of their blocks is written to.
     typedef std::array<std::byte, DEFAULT_BLOCK_SIZE> MemBlockType;
-    std::unordered_map<AddrType, std::unique_ptr<MemBlockType>> m_mem;
+    static const unsigned int BLOCK_TABLE_BITS = 10;
+    static const AddrType BLOCK_TABLE_SIZE = 1ULL << BLOCK_TABLE_BITS;
+    typedef std::array<std::unique_ptr<MemBlockType>, BLOCK_TABLE_SIZE> BlockTable;
+    std::vector<std::unique_ptr<BlockTable>> m_blockDirectory;
+
+    static const unsigned int BLOCK_CACHE_SIZE = 64;
+    struct BlockCache
+    {
+        struct Entry
+        {
+            AddrType baseAddress = ~0ULL;
+            MemBlockType* block = nullptr;
+        };
+        std::array<Entry, BLOCK_CACHE_SIZE> entries;
+        unsigned long long hits = 0;
+        unsigned long long misses = 0;
+    };
+    BlockCache m_fetchCache;
+    BlockCache m_dataCache;
+
+    // nullptr if the block was never written to, unless allocating
+    MemBlockType* FindBlock(const AddrType baseAddress, const bool allocate, BlockCache& cache);
+
+    template <typename T> T Read(const AddrType address, BlockCache& cache);
+    template <typename T> void Write(const AddrType address, const T data);
+
+    // Storage of an aligned word, allocating it if need be
+    uint32_t* WordStorage(const AddrType address);
+
+    // one flag per CODE_PAGE_SIZE page of the address range for code, and
+    // one for pages written to (what the flat backend's ForEachPage visits),
+    // atomic as harts on other threads may be marking pages while others write
+    std::vector<std::atomic<bool>> m_codePages;
+    std::vector<std::atomic<bool>> m_writtenPages;
+    std::map<unsigned int, CodeWriteHandler> m_codeWriteHandlers;
+    unsigned int m_codeWriteHandlerCount;
+
+    // Every write to RAM comes through here, to mark the pages written and
+    // let the handlers know if any of them hold code
+    void NoteWrite(const AddrType address, const AddrType size);
 };
 
 } // namespace riscvdb
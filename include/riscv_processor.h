@@ -3,9 +3,20 @@
 
 #include <cctype>
 #include <array>
+#include <atomic>
+#include <bitset>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include "memorymap.h"
+#ifdef RISCVDB_ENABLE_JIT
+#include "x86_emitter.h"
+#endif
 
 namespace riscvdb
 {
@@ -14,7 +25,9 @@ class RiscvProcessor
 {
 public:
     typedef uint32_t Register;
-    RiscvProcessor(MemoryMap& mem);
+    // hartId is what mhartid reads as
+    RiscvProcessor(MemoryMap& mem, const uint32_t hartId = 0);
+    ~RiscvProcessor();
 
     void SetVerbose(const bool verbose);
 
@@ -26,6 +39,10 @@ public:
     Register GetReg(const unsigned regNum) const;
     void SetReg(const unsigned regNum, const Register newValue);
 
+    // Raw floating point registers, singles NaN-boxed in the low half
+    uint64_t GetFReg(const unsigned regNum) const;
+    void SetFReg(const unsigned regNum, const uint64_t newValue);
+
     unsigned long long GetInstructionCount() const;
 
     // Privilege levels
@@ -34,19 +51,39 @@ public:
     void SetPrivilegeLevel(const uint8_t prv);
 
     // CSR registers
-    static const uint32_t csr_mvendorid;
-    static const uint32_t csr_marchid;
-    static const uint32_t csr_mimpid;
-    static const uint32_t csr_mhartid;
-    static const uint32_t csr_mstatus;
-    static const uint32_t csr_misa;
-    static const uint32_t csr_mie;
-    static const uint32_t csr_mtvec;
-    static const uint32_t csr_mscratch;
-    static const uint32_t csr_mepc;
-    static const uint32_t csr_mcause;
-    static const uint32_t csr_mtval;
-    static const uint32_t csr_mip;
+    static constexpr uint32_t csr_fflags = 0x001;
+    static constexpr uint32_t csr_frm = 0x002;
+    static constexpr uint32_t csr_fcsr = 0x003;
+    static constexpr uint32_t csr_cycle = 0xC00;
+    static constexpr uint32_t csr_time = 0xC01;
+    static constexpr uint32_t csr_instret = 0xC02;
+    static constexpr uint32_t csr_hpmcounter3 = 0xC03;   // to hpmcounter31 (0xC1F)
+    static constexpr uint32_t csr_cycleh = 0xC80;
+    static constexpr uint32_t csr_timeh = 0xC81;
+    static constexpr uint32_t csr_instreth = 0xC82;
+    static constexpr uint32_t csr_hpmcounter3h = 0xC83;  // to hpmcounter31h (0xC9F)
+    static constexpr uint32_t csr_mvendorid = 0xF11;
+    static constexpr uint32_t csr_marchid = 0xF12;
+    static constexpr uint32_t csr_mimpid = 0xF13;
+    static constexpr uint32_t csr_mhartid = 0xF14;
+    static constexpr uint32_t csr_mstatus = 0x300;
+    static constexpr uint32_t csr_misa = 0x301;
+    static constexpr uint32_t csr_mie = 0x304;
+    static constexpr uint32_t csr_mtvec = 0x305;
+    static constexpr uint32_t csr_mcounteren = 0x306;
+    static constexpr uint32_t csr_mcountinhibit = 0x320;
+    static constexpr uint32_t csr_mhpmevent3 = 0x323;     // to mhpmevent31 (0x33F)
+    static constexpr uint32_t csr_mscratch = 0x340;
+    static constexpr uint32_t csr_mepc = 0x341;
+    static constexpr uint32_t csr_mcause = 0x342;
+    static constexpr uint32_t csr_mtval = 0x343;
+    static constexpr uint32_t csr_mip = 0x344;
+    static constexpr uint32_t csr_mcycle = 0xB00;
+    static constexpr uint32_t csr_minstret = 0xB02;
+    static constexpr uint32_t csr_mhpmcounter3 = 0xB03;   // to mhpmcounter31 (0xB1F)
+    static constexpr uint32_t csr_mcycleh = 0xB80;
+    static constexpr uint32_t csr_minstreth = 0xB82;
+    static constexpr uint32_t csr_mhpmcounter3h = 0xB83;  // to mhpmcounter31h (0xB9F)
 
     // Exceptions
     struct Exception
@@ -84,121 +121,595 @@ public:
     };
     set_csr_result SetCSRValue(const uint32_t csr_num, const uint32_t new_value);
 
+    // Raise or clear the mip bit of an interrupt from outside the hart (e.g.
+    // a timer or interrupt controller), including the read only bits
+    void SetInterruptPending(const Exception& interrupt, const bool pending);
+
+    // Timer and software interrupts, for a CLINT. mtime is counted in this
+    // hart's retired instructions. mtimecmp and msip can be set from any host
+    // thread, and the hart picks them up before its next block.
+    uint64_t GetTime() const;
+    void SetTime(const uint64_t time);
+    uint64_t GetTimerCompare() const;
+    void SetTimerCompare(const uint64_t compare);
+    bool GetSoftwareInterrupt() const;
+    void SetSoftwareInterrupt(const bool pending);
+
+    // Instruction set
+    enum InstructionId : uint8_t
+    {
+        INST_LUI, INST_AUIPC, INST_JAL, INST_JALR,
+        INST_BEQ, INST_BNE, INST_BLT, INST_BGE, INST_BLTU, INST_BGEU,
+        INST_LB, INST_LH, INST_LW, INST_LBU, INST_LHU,
+        INST_SB, INST_SH, INST_SW,
+        INST_ADDI, INST_SLTI, INST_SLTIU, INST_XORI, INST_ORI, INST_ANDI,
+        INST_SLLI, INST_SRLI, INST_SRAI,
+        INST_ADD, INST_SUB, INST_SLL, INST_SLT, INST_SLTU,
+        INST_XOR, INST_SRL, INST_SRA, INST_OR, INST_AND,
+        INST_FENCE, INST_ECALL, INST_EBREAK, INST_MRET,
+        INST_CSRRW, INST_CSRRS, INST_CSRRC, INST_CSRRWI, INST_CSRRSI, INST_CSRRCI,
+        INST_MUL, INST_MULH, INST_MULHSU, INST_MULHU, INST_DIV, INST_DIVU, INST_REM, INST_REMU,
+        INST_LR_W, INST_SC_W, INST_AMOSWAP_W, INST_AMOADD_W, INST_AMOXOR_W, INST_AMOAND_W,
+        INST_AMOOR_W, INST_AMOMIN_W, INST_AMOMAX_W, INST_AMOMINU_W, INST_AMOMAXU_W,
+        INST_FLW, INST_FSW, INST_FMADD_S, INST_FMSUB_S, INST_FNMSUB_S, INST_FNMADD_S, INST_FADD_S,
+        INST_FSUB_S, INST_FMUL_S, INST_FDIV_S, INST_FSQRT_S, INST_FSGNJ_S, INST_FSGNJN_S, INST_FSGNJX_S,
+        INST_FMIN_S, INST_FMAX_S, INST_FCVT_W_S, INST_FCVT_WU_S, INST_FMV_X_W, INST_FEQ_S, INST_FLT_S,
+        INST_FLE_S, INST_FCLASS_S, INST_FCVT_S_W, INST_FCVT_S_WU, INST_FMV_W_X,
+        INST_FLD, INST_FSD, INST_FMADD_D, INST_FMSUB_D, INST_FNMSUB_D, INST_FNMADD_D, INST_FADD_D,
+        INST_FSUB_D, INST_FMUL_D, INST_FDIV_D, INST_FSQRT_D, INST_FSGNJ_D, INST_FSGNJN_D, INST_FSGNJX_D,
+        INST_FMIN_D, INST_FMAX_D, INST_FCVT_S_D, INST_FCVT_D_S, INST_FEQ_D, INST_FLT_D, INST_FLE_D,
+        INST_FCLASS_D, INST_FCVT_W_D, INST_FCVT_WU_D, INST_FCVT_D_W, INST_FCVT_D_WU,
+        NUM_INSTRUCTIONS,
+        INST_ILLEGAL = NUM_INSTRUCTIONS,
+        INST_BREAKPOINT,  // debugger breakpoint, standing in for the real instruction
+    };
+
+    enum InstructionFormat : uint8_t
+    {
+        FORMAT_R, FORMAT_I, FORMAT_S, FORMAT_B, FORMAT_U, FORMAT_J, FORMAT_NONE,
+        FORMAT_RM,  // R with a rounding mode, kept in imm
+        FORMAT_R4,  // rs3 and the rounding mode, kept in imm as rs3 | rm << 5
+    };
+
+    struct DecodedInstruction
+    {
+        bool valid = false;  // for use by caches
+        InstructionId id = INST_ILLEGAL;
+        uint32_t rd = 0;
+        uint32_t rs1 = 0;
+        uint32_t rs2 = 0;
+        int32_t imm = 0;
+        bool ends_block = true;  // control transfer, system, illegal or breakpoint
+        uint8_t length = 4;  // bytes, 2 if compressed
+#ifdef RISCVDB_ENABLE_THREADED
+        const void* handler = nullptr;  // set when first run in a block
+#endif
+    };
+
+    // Compressed (16 bit) instructions are expanded into the 32 bit
+    // instruction they stand for, so they run the same way. Only the low half
+    // of cmd is looked at for those.
+    static DecodedInstruction Decode(const uint32_t cmd);
+
+    // The 32 bit equivalent of a compressed instruction, or 0 (illegal) if it
+    // isn't one that's supported
+    static uint32_t ExpandCompressed(const uint16_t cmd);
+    static const char* InstructionName(const InstructionId id);
+
     // Run next instruction
     void Step();
 
+    // Run the basic block at the PC, stopping early after maxInstructions
+    // (0 for no limit). Returns the number of steps taken.
+    unsigned long StepBlock(const unsigned long maxInstructions = 0);
+
+    // Debugger breakpoints. These replace the instruction in the predecoded
+    // stream with a trap op, so they cost nothing until hit. Step/StepBlock
+    // stop just before the instruction at a breakpoint, without counting it,
+    // and BreakpointHit() is set until the next step.
+    void AddBreakpoint(const uint32_t address);
+    void RemoveBreakpoint(const uint32_t address);
+    void ClearBreakpoints();
+    bool HasBreakpoint(const uint32_t address) const;
+    bool BreakpointHit() const;
+
+    // Run the instruction at the PC, even if there is a breakpoint on it
+    void StepOverBreakpoint();
+
+    // Compile hot blocks to host code (only if built with RISCVDB_JIT)
+    void SetJitEnabled(const bool enabled);
+    unsigned long GetCompiledBlockCount() const;
+
+    // The host thread that steps this hart. Writes to code from any other
+    // thread (e.g. another hart running alongside) are queued, and dropped
+    // from the caches before the next step here, rather than under the feet
+    // of a running block. Until set, all writes apply straight away.
+    void SetHostThread(const std::thread::id thread);
+
+    // Called for ecall, which only traps if the handler returns false (e.g.
+    // so that the program's system calls can be done on the host)
+    typedef std::function<bool(RiscvProcessor& hart)> EcallHandler;
+    void SetEcallHandler(EcallHandler handler);
+
 private:
     // Basic machine data
     MemoryMap& m_mem;   // main memory
     Register m_pc;  // program counter
     std::array<Register, 32> m_reg; // x0..x31 machine registers
 
+    uint32_t m_hart_id;
+
     // Debug/run info
     unsigned long long m_instruction_count;
     bool m_verbose;
 
-    // Machine mode control and status registers (CSRs)
-    std::unordered_map<uint32_t, uint32_t> m_csr_table;
+    // Machine mode control and status registers (CSRs), stored densely. CSR
+    // numbers map to a slot through a table built at compile time, with
+    // unimplemented numbers all sharing a last slot that always reads 0.
+    // The counters aren't stored at all, but worked out when they're read.
+    enum CsrSlot : uint8_t
+    {
+        CSR_MVENDORID, CSR_MARCHID, CSR_MIMPID, CSR_MHARTID,
+        CSR_MSTATUS, CSR_MISA, CSR_MIE, CSR_MTVEC,
+        CSR_MSCRATCH, CSR_MEPC, CSR_MCAUSE, CSR_MTVAL, CSR_MIP,
+        CSR_FFLAGS, CSR_FRM, CSR_FCSR,
+        CSR_MCOUNTEREN, CSR_MCOUNTINHIBIT,
+        NUM_CSRS,
+        CSR_UNIMPLEMENTED = NUM_CSRS,
+        CSR_COUNTER,
+    };
+    static constexpr unsigned int NUM_CSR_NUMBERS = 4096;
+    static constexpr CsrSlot CsrSlotOf(const uint32_t csr_num);
+    static const std::array<uint8_t, NUM_CSR_NUMBERS> s_csr_slots;
+    std::array<uint32_t, NUM_CSRS + 1> m_csr;
+
+    // Reads a CSR for a CSR instruction, false if it isn't readable at the
+    // current privilege level
+    bool ReadCSR(const uint32_t csr_num, uint32_t& value) const;
+
+    // mcycle and minstret, as an offset from m_instruction_count so that
+    // nothing needs doing per instruction. Every instruction takes one
+    // cycle. While inhibited (mcountinhibit), a counter holds its value.
+    enum CounterId
+    {
+        COUNTER_CYCLE,
+        COUNTER_INSTRET,
+        NUM_COUNTERS,
+    };
+    struct Counter
+    {
+        uint64_t offset;
+        uint64_t held;
+        bool inhibited;
+    };
+    std::array<Counter, NUM_COUNTERS> m_counters;
+    uint64_t CounterValue(const CounterId id) const;
+    void SetCounterValue(const CounterId id, const uint64_t value);
+    void SetCounterInhibited(const CounterId id, const bool inhibited);
+    uint32_t ReadCounterCSR(const uint32_t csr_num) const;
+    set_csr_result WriteCounterCSR(const uint32_t csr_num, const uint32_t new_value);
+
+    // Set when an interrupt is both pending and enabled, so that the common
+    // case costs a single test. Recomputed whenever mip, mie, mstatus or the
+    // privilege level change.
+    bool m_interrupt_pending;
+    void UpdateInterruptPending();
+
+    // The instruction count at which something from outside the hart next
+    // needs looking at: mtime reaching mtimecmp, or a CLINT changing mtimecmp
+    // or msip (which bring it forward to 0). Comparing against it, once per
+    // block, is all the timer costs. Blocks stop short of it.
+    static constexpr uint64_t NO_EVENT = ~0ULL;
+    std::atomic<uint64_t> m_event_deadline;
+    std::atomic<uint64_t> m_timer_compare;
+    std::atomic<bool> m_software_interrupt;
+    uint64_t m_time_offset;  // mtime - m_instruction_count
+    void HandleEvents();
 
     // Exceptions
     void RaiseException(const Exception& exception_data);
 
+    // LR/SC reservation: the word loaded, and what it held. A store
+    // conditional succeeds if the word still holds that, checked and written
+    // by one host compare and swap so no other hart can get in between.
+    bool m_reservation_valid;
+    uint32_t m_reservation_address;
+    uint32_t m_reservation_value;
+
     // Privilege level
     uint8_t m_prv;
 
-    // Instruction implementation: 
-    // Templates for instruction decoding
-    using InstructionDecoder = void (RiscvProcessor::*)(uint32_t);
-    using InstructionExector = void (RiscvProcessor::*)(void);
-    struct Instruction {
-        std::string displayName;
-        InstructionDecoder decoder;
-        InstructionExector executor;
-
-        Instruction() = default;
-
-        Instruction(std::string n, InstructionDecoder d, InstructionExector e)
-        : displayName(n),
-          decoder(d),
-          executor(e)
-        {}
+    // Floating point registers f0..f31, 64 bits for the D extension. Singles
+    // are NaN-boxed: kept in the low half with the upper half all ones, and
+    // anything else reads back as the canonical NaN.
+    std::array<uint64_t, 32> m_freg;
+    float ReadFloat(const unsigned regNum) const;
+    double ReadDouble(const unsigned regNum) const;
+    void WriteFloat(const unsigned regNum, const float value);
+    void WriteDouble(const unsigned regNum, const double value);
+
+    // FP instructions are illegal while mstatus.FS is Off. Returns false
+    // (having raised the exception) if so, or if rm is reserved; otherwise
+    // sets the mode to round with.
+    bool FpEnabled();
+    bool FpRoundingMode(const uint32_t rm, uint32_t& mode);
+    void AccrueFpFlags(const uint32_t flags);  // into fflags, and marks FS dirty
+    void SetFpDirty();
+
+    void ExecuteCmd();
+    const Exception* PendingInterrupt();
+
+    // Predecoded instruction cache, keyed by PC, with a slot per halfword.
+    // Entries are dropped when memory holding them is written to.
+    typedef std::array<DecodedInstruction, CODE_PAGE_SIZE / 2> DecodedPage;
+    std::unordered_map<uint32_t, std::unique_ptr<DecodedPage>> m_decode_cache;
+    uint32_t m_decode_last_page_num;
+    DecodedPage* m_decode_last_page;
+    unsigned int m_code_write_handler;
+
+    std::atomic<std::thread::id> m_host_thread;
+    std::mutex m_invalidation_mutex;
+    std::vector<std::pair<MemoryMap::AddrType, MemoryMap::AddrType>> m_pending_invalidations;
+    std::atomic<bool> m_invalidation_pending;
+    void ApplyPendingInvalidations();
+
+    EcallHandler m_ecall_handler;
+
+    const DecodedInstruction& FetchDecoded(const uint32_t address);
+    uint32_t FetchInstruction(const uint32_t address);  // just the low half if compressed
+    void ExecuteDecoded(const DecodedInstruction& decoded);
+    void InvalidateDecoded(const MemoryMap::AddrType address, const MemoryMap::AddrType size);
+
+    // Breakpoints, as one bit per instruction for each code page that has
+    // any. Only looked at when decoding, so the set can be empty or large
+    // without slowing down execution.
+    typedef std::bitset<CODE_PAGE_SIZE / 2> BreakpointPage;
+    std::unordered_map<uint32_t, BreakpointPage> m_breakpoint_pages;
+    bool m_breakpoint_hit;
+    bool m_breakpoint_skip;  // run the real instruction under a trap op
+    void BreakpointTrap();
+
+    // Basic blocks: straight-line runs of predecoded instructions, ending at
+    // the first control transfer or system instruction. Blocks never cross a
+    // page. Each block remembers the blocks that followed it last time so
+    // that the next one can be found without a lookup.
+    static const unsigned int MAX_BLOCK_LENGTH = 64;
+    struct Block;
+    struct BlockLink
+    {
+        uint32_t pc = 0;
+        Block* block = nullptr;
+        unsigned long epoch = 0;  // link is stale if blocks were retired since
     };
-
-    void VerbosePrintInstruction(const Instruction& inst);
-
-    std::unordered_map<uint32_t, Instruction> cmd_mapping_R;
-    std::unordered_map<uint32_t, Instruction> cmd_mapping_ISB;
-    std::unordered_map<uint32_t, Instruction> cmd_mapping_UJ;
-    std::unordered_map<uint32_t, Instruction> cmd_mapping_SYSTEM;
-
-    void ExecuteCmd(const uint32_t instruction);
+    struct Block
+    {
+        uint32_t start = 0;
+        uint32_t end = 0;  // just past the last instruction
+        bool valid = true;
+        std::vector<DecodedInstruction> ops;
+        std::array<BlockLink, 2> next;
+        unsigned int nextReplace = 0;
+#ifdef RISCVDB_ENABLE_THREADED
+        bool threaded = false;  // ops have their handlers set
+#endif
+#ifdef RISCVDB_ENABLE_JIT
+        unsigned int runCount = 0;
+        bool jitFailed = false;
+        std::unique_ptr<ExecutableMemory> jitCode;
+        // Runs the block from the start, returning how many instructions ran
+        // and leaving the next PC in pc. Stops short of any instruction that
+        // needs the interpreter (e.g. to raise an exception).
+        uint32_t (*jitFunction)(Register* regs, RiscvProcessor* processor,
+                                Register* pc, const bool* valid) = nullptr;
+#endif
+    };
+    std::unordered_map<uint32_t, std::unique_ptr<Block>> m_blocks;
+    std::unordered_map<uint32_t, std::vector<Block*>> m_page_blocks;
+    // Retired blocks may still be running, so they're freed on the next step
+    std::vector<std::unique_ptr<Block>> m_retired_blocks;
+    unsigned long m_block_epoch;
+    Block* m_last_block;
+
+    Block* FetchBlock(const uint32_t address);
+    Block* BuildBlock(const uint32_t address);
+    void RetireBlock(Block* block);
+#ifdef RISCVDB_ENABLE_THREADED
+    unsigned long RunBlockThreaded(Block& block, unsigned long steps, const unsigned long maxInstructions);
+#endif
+
+    // JIT compilation of blocks that have run JIT_THRESHOLD times
+    bool m_jit_enabled;
+    unsigned long m_compiled_blocks;
+#ifdef RISCVDB_ENABLE_JIT
+    static const unsigned int JIT_THRESHOLD = 16;
+    static const uint64_t JIT_FAULT = 1ULL << 32;
+    bool CompileBlock(Block& block);
+    static uint64_t JitLoad(RiscvProcessor* processor, const uint32_t address, const uint32_t funct3);
+    static uint32_t JitStore(RiscvProcessor* processor, const uint32_t address, const uint32_t data, const uint32_t funct3);
+#endif
 
     // Instruction type masks
-    static const uint32_t mask_R = 0xFE00707F;
-    static const uint32_t mask_ISB = 0x707F;
-    static const uint32_t mask_UJ = 0x7F;
-    static const uint32_t mask_SYSTEM = 0xFFF0707F;
-
-    // Decoding functions and temporaries
+    static constexpr uint32_t mask_R = 0xFE00707F;
+    static constexpr uint32_t mask_ISB = 0x707F;
+    static constexpr uint32_t mask_UJ = 0x7F;
+    static constexpr uint32_t mask_SYSTEM = 0xFFF0707F;
+    static constexpr uint32_t mask_AMO = 0xF800707F;  // aq/rl bits ignored
+    static constexpr uint32_t mask_LR = 0xF9F0707F;   // rs2 must be 0
+    static constexpr uint32_t mask_FP_RM = 0xFE00007F;        // funct3 is the rounding mode
+    static constexpr uint32_t mask_FP_UNARY_RM = 0xFFF0007F;  // and rs2 picks the operation
+    static constexpr uint32_t mask_FP_R4 = 0x0600007F;        // fused multiply-add, by opcode and format
+
+    // Operands of the instruction being executed
     int32_t m_decoded_imm;
     uint32_t m_decoded_rs1;
     uint32_t m_decoded_rs2;
     uint32_t m_decoded_rd;
-    void decode_R(uint32_t cmd);
-    void decode_I(uint32_t cmd);
-    void decode_S(uint32_t cmd);
-    void decode_B(uint32_t cmd);
-    void decode_U(uint32_t cmd);
-    void decode_J(uint32_t cmd);
+    uint32_t m_decoded_length;  // what the PC moves on by
 
     // Instruction masks
-    const uint32_t mask_lui = 0x37;
-    const uint32_t mask_auipc = 0x17;
-    const uint32_t mask_jal = 0x6F;
-    const uint32_t mask_jalr = 0x67;
-    const uint32_t mask_beq = 0x63;
-    const uint32_t mask_bne = 0x1063;
-    const uint32_t mask_blt = 0x4063;
-    const uint32_t mask_bge = 0x5063;
-    const uint32_t mask_bltu = 0x6063;
-    const uint32_t mask_bgeu = 0x7063;
-    const uint32_t mask_lb = 0x3;
-    const uint32_t mask_lh = 0x1003;
-    const uint32_t mask_lw = 0x2003;
-    const uint32_t mask_lbu = 0x4003;
-    const uint32_t mask_lhu = 0x5003;
-    const uint32_t mask_sb = 0x23;
-    const uint32_t mask_sh = 0x1023;
-    const uint32_t mask_sw = 0x2023;
-    const uint32_t mask_addi = 0x13;
-    const uint32_t mask_slti = 0x2013;
-    const uint32_t mask_sltiu = 0x3013;
-    const uint32_t mask_xori = 0x4013;
-    const uint32_t mask_ori = 0x6013;
-    const uint32_t mask_andi = 0x7013;
-    const uint32_t mask_slli = 0x1013;
-    const uint32_t mask_srli = 0x5013;
-    const uint32_t mask_srai = 0x40005013;
-    const uint32_t mask_add = 0x33;
-    const uint32_t mask_sub = 0x40000033;
-    const uint32_t mask_sll = 0x1033;
-    const uint32_t mask_slt = 0x2033;
-    const uint32_t mask_sltu = 0x3033;
-    const uint32_t mask_xor = 0x4033;
-    const uint32_t mask_srl = 0x5033;
-    const uint32_t mask_sra = 0x40005033;
-    const uint32_t mask_or = 0x6033;
-    const uint32_t mask_and = 0x7033;
-    const uint32_t mask_fence = 0xF;
-    const uint32_t mask_ecall = 0x73;
-    const uint32_t mask_ebreak = 0x100073;
-    const uint32_t mask_mret = 0x30200073;
-    const uint32_t mask_csrrw = 0x1073;
-    const uint32_t mask_csrrs = 0x2073;
-    const uint32_t mask_csrrc = 0x3073;  
-    const uint32_t mask_csrrwi = 0x5073;
-    const uint32_t mask_csrrsi = 0x6073;
-    const uint32_t mask_csrrci = 0x7073;  
+    static constexpr uint32_t mask_lui = 0x37;
+    static constexpr uint32_t mask_auipc = 0x17;
+    static constexpr uint32_t mask_jal = 0x6F;
+    static constexpr uint32_t mask_jalr = 0x67;
+    static constexpr uint32_t mask_beq = 0x63;
+    static constexpr uint32_t mask_bne = 0x1063;
+    static constexpr uint32_t mask_blt = 0x4063;
+    static constexpr uint32_t mask_bge = 0x5063;
+    static constexpr uint32_t mask_bltu = 0x6063;
+    static constexpr uint32_t mask_bgeu = 0x7063;
+    static constexpr uint32_t mask_lb = 0x3;
+    static constexpr uint32_t mask_lh = 0x1003;
+    static constexpr uint32_t mask_lw = 0x2003;
+    static constexpr uint32_t mask_lbu = 0x4003;
+    static constexpr uint32_t mask_lhu = 0x5003;
+    static constexpr uint32_t mask_sb = 0x23;
+    static constexpr uint32_t mask_sh = 0x1023;
+    static constexpr uint32_t mask_sw = 0x2023;
+    static constexpr uint32_t mask_addi = 0x13;
+    static constexpr uint32_t mask_slti = 0x2013;
+    static constexpr uint32_t mask_sltiu = 0x3013;
+    static constexpr uint32_t mask_xori = 0x4013;
+    static constexpr uint32_t mask_ori = 0x6013;
+    static constexpr uint32_t mask_andi = 0x7013;
+    static constexpr uint32_t mask_slli = 0x1013;
+    static constexpr uint32_t mask_srli = 0x5013;
+    static constexpr uint32_t mask_srai = 0x40005013;
+    static constexpr uint32_t mask_add = 0x33;
+    static constexpr uint32_t mask_sub = 0x40000033;
+    static constexpr uint32_t mask_sll = 0x1033;
+    static constexpr uint32_t mask_slt = 0x2033;
+    static constexpr uint32_t mask_sltu = 0x3033;
+    static constexpr uint32_t mask_xor = 0x4033;
+    static constexpr uint32_t mask_srl = 0x5033;
+    static constexpr uint32_t mask_sra = 0x40005033;
+    static constexpr uint32_t mask_or = 0x6033;
+    static constexpr uint32_t mask_and = 0x7033;
+    static constexpr uint32_t mask_fence = 0xF;
+    static constexpr uint32_t mask_ecall = 0x73;
+    static constexpr uint32_t mask_ebreak = 0x100073;
+    static constexpr uint32_t mask_mret = 0x30200073;
+    static constexpr uint32_t mask_csrrw = 0x1073;
+    static constexpr uint32_t mask_csrrs = 0x2073;
+    static constexpr uint32_t mask_csrrc = 0x3073;
+    static constexpr uint32_t mask_csrrwi = 0x5073;
+    static constexpr uint32_t mask_csrrsi = 0x6073;
+    static constexpr uint32_t mask_csrrci = 0x7073;
+    static constexpr uint32_t mask_mul = 0x2000033;
+    static constexpr uint32_t mask_mulh = 0x2001033;
+    static constexpr uint32_t mask_mulhsu = 0x2002033;
+    static constexpr uint32_t mask_mulhu = 0x2003033;
+    static constexpr uint32_t mask_div = 0x2004033;
+    static constexpr uint32_t mask_divu = 0x2005033;
+    static constexpr uint32_t mask_rem = 0x2006033;
+    static constexpr uint32_t mask_remu = 0x2007033;
+    static constexpr uint32_t mask_lr_w = 0x1000202F;
+    static constexpr uint32_t mask_sc_w = 0x1800202F;
+    static constexpr uint32_t mask_amoswap_w = 0x0800202F;
+    static constexpr uint32_t mask_amoadd_w = 0x0000202F;
+    static constexpr uint32_t mask_amoxor_w = 0x2000202F;
+    static constexpr uint32_t mask_amoand_w = 0x6000202F;
+    static constexpr uint32_t mask_amoor_w = 0x4000202F;
+    static constexpr uint32_t mask_amomin_w = 0x8000202F;
+    static constexpr uint32_t mask_amomax_w = 0xA000202F;
+    static constexpr uint32_t mask_amominu_w = 0xC000202F;
+    static constexpr uint32_t mask_amomaxu_w = 0xE000202F;
+    static constexpr uint32_t mask_flw = 0x2007;
+    static constexpr uint32_t mask_fsw = 0x2027;
+    static constexpr uint32_t mask_fmadd_s = 0x43;
+    static constexpr uint32_t mask_fmsub_s = 0x47;
+    static constexpr uint32_t mask_fnmsub_s = 0x4B;
+    static constexpr uint32_t mask_fnmadd_s = 0x4F;
+    static constexpr uint32_t mask_fadd_s = 0x53;
+    static constexpr uint32_t mask_fsub_s = 0x8000053;
+    static constexpr uint32_t mask_fmul_s = 0x10000053;
+    static constexpr uint32_t mask_fdiv_s = 0x18000053;
+    static constexpr uint32_t mask_fsqrt_s = 0x58000053;
+    static constexpr uint32_t mask_fsgnj_s = 0x20000053;
+    static constexpr uint32_t mask_fsgnjn_s = 0x20001053;
+    static constexpr uint32_t mask_fsgnjx_s = 0x20002053;
+    static constexpr uint32_t mask_fmin_s = 0x28000053;
+    static constexpr uint32_t mask_fmax_s = 0x28001053;
+    static constexpr uint32_t mask_fcvt_w_s = 0xC0000053;
+    static constexpr uint32_t mask_fcvt_wu_s = 0xC0100053;
+    static constexpr uint32_t mask_fmv_x_w = 0xE0000053;
+    static constexpr uint32_t mask_feq_s = 0xA0002053;
+    static constexpr uint32_t mask_flt_s = 0xA0001053;
+    static constexpr uint32_t mask_fle_s = 0xA0000053;
+    static constexpr uint32_t mask_fclass_s = 0xE0001053;
+    static constexpr uint32_t mask_fcvt_s_w = 0xD0000053;
+    static constexpr uint32_t mask_fcvt_s_wu = 0xD0100053;
+    static constexpr uint32_t mask_fmv_w_x = 0xF0000053;
+    static constexpr uint32_t mask_fld = 0x3007;
+    static constexpr uint32_t mask_fsd = 0x3027;
+    static constexpr uint32_t mask_fmadd_d = 0x2000043;
+    static constexpr uint32_t mask_fmsub_d = 0x2000047;
+    static constexpr uint32_t mask_fnmsub_d = 0x200004B;
+    static constexpr uint32_t mask_fnmadd_d = 0x200004F;
+    static constexpr uint32_t mask_fadd_d = 0x2000053;
+    static constexpr uint32_t mask_fsub_d = 0xA000053;
+    static constexpr uint32_t mask_fmul_d = 0x12000053;
+    static constexpr uint32_t mask_fdiv_d = 0x1A000053;
+    static constexpr uint32_t mask_fsqrt_d = 0x5A000053;
+    static constexpr uint32_t mask_fsgnj_d = 0x22000053;
+    static constexpr uint32_t mask_fsgnjn_d = 0x22001053;
+    static constexpr uint32_t mask_fsgnjx_d = 0x22002053;
+    static constexpr uint32_t mask_fmin_d = 0x2A000053;
+    static constexpr uint32_t mask_fmax_d = 0x2A001053;
+    static constexpr uint32_t mask_fcvt_s_d = 0x40100053;
+    static constexpr uint32_t mask_fcvt_d_s = 0x42000053;
+    static constexpr uint32_t mask_feq_d = 0xA2002053;
+    static constexpr uint32_t mask_flt_d = 0xA2001053;
+    static constexpr uint32_t mask_fle_d = 0xA2000053;
+    static constexpr uint32_t mask_fclass_d = 0xE2001053;
+    static constexpr uint32_t mask_fcvt_w_d = 0xC2000053;
+    static constexpr uint32_t mask_fcvt_wu_d = 0xC2100053;
+    static constexpr uint32_t mask_fcvt_d_w = 0xD2000053;
+    static constexpr uint32_t mask_fcvt_d_wu = 0xD2100053;
+
+
+    // Decoding: an instruction matches if (cmd & mask) == match. Listed in
+    // InstructionId order. A lookup table indexed by opcode/funct3 is built
+    // from this at compile time (see Decode).
+    struct Instruction
+    {
+        InstructionId id;
+        const char* displayName;
+        uint32_t mask;
+        uint32_t match;
+        InstructionFormat format;
+    };
+    static constexpr Instruction s_instructions[NUM_INSTRUCTIONS] = {
+        {INST_LUI,    "lui",    mask_UJ,     mask_lui,    FORMAT_U},
+        {INST_AUIPC,  "auipc",  mask_UJ,     mask_auipc,  FORMAT_U},
+        {INST_JAL,    "jal",    mask_UJ,     mask_jal,    FORMAT_J},
+        {INST_JALR,   "jalr",   mask_ISB,    mask_jalr,   FORMAT_I},
+        {INST_BEQ,    "beq",    mask_ISB,    mask_beq,    FORMAT_B},
+        {INST_BNE,    "bne",    mask_ISB,    mask_bne,    FORMAT_B},
+        {INST_BLT,    "blt",    mask_ISB,    mask_blt,    FORMAT_B},
+        {INST_BGE,    "bge",    mask_ISB,    mask_bge,    FORMAT_B},
+        {INST_BLTU,   "bltu",   mask_ISB,    mask_bltu,   FORMAT_B},
+        {INST_BGEU,   "bgeu",   mask_ISB,    mask_bgeu,   FORMAT_B},
+        {INST_LB,     "lb",     mask_ISB,    mask_lb,     FORMAT_I},
+        {INST_LH,     "lh",     mask_ISB,    mask_lh,     FORMAT_I},
+        {INST_LW,     "lw",     mask_ISB,    mask_lw,     FORMAT_I},
+        {INST_LBU,    "lbu",    mask_ISB,    mask_lbu,    FORMAT_I},
+        {INST_LHU,    "lhu",    mask_ISB,    mask_lhu,    FORMAT_I},
+        {INST_SB,     "sb",     mask_ISB,    mask_sb,     FORMAT_S},
+        {INST_SH,     "sh",     mask_ISB,    mask_sh,     FORMAT_S},
+        {INST_SW,     "sw",     mask_ISB,    mask_sw,     FORMAT_S},
+        {INST_ADDI,   "addi",   mask_ISB,    mask_addi,   FORMAT_I},
+        {INST_SLTI,   "slti",   mask_ISB,    mask_slti,   FORMAT_I},
+        {INST_SLTIU,  "sltiu",  mask_ISB,    mask_sltiu,  FORMAT_I},
+        {INST_XORI,   "xori",   mask_ISB,    mask_xori,   FORMAT_I},
+        {INST_ORI,    "ori",    mask_ISB,    mask_ori,    FORMAT_I},
+        {INST_ANDI,   "andi",   mask_ISB,    mask_andi,   FORMAT_I},
+        {INST_SLLI,   "slli",   mask_R,      mask_slli,   FORMAT_I},
+        {INST_SRLI,   "srli",   mask_R,      mask_srli,   FORMAT_I},
+        {INST_SRAI,   "srai",   mask_R,      mask_srai,   FORMAT_I},
+        {INST_ADD,    "add",    mask_R,      mask_add,    FORMAT_R},
+        {INST_SUB,    "sub",    mask_R,      mask_sub,    FORMAT_R},
+        {INST_SLL,    "sll",    mask_R,      mask_sll,    FORMAT_R},
+        {INST_SLT,    "slt",    mask_R,      mask_slt,    FORMAT_R},
+        {INST_SLTU,   "sltu",   mask_R,      mask_sltu,   FORMAT_R},
+        {INST_XOR,    "xor",    mask_R,      mask_xor,    FORMAT_R},
+        {INST_SRL,    "srl",    mask_R,      mask_srl,    FORMAT_R},
+        {INST_SRA,    "sra",    mask_R,      mask_sra,    FORMAT_R},
+        {INST_OR,     "or",     mask_R,      mask_or,     FORMAT_R},
+        {INST_AND,    "and",    mask_R,      mask_and,    FORMAT_R},
+        {INST_FENCE,  "fence",  mask_SYSTEM, mask_fence,  FORMAT_NONE},
+        {INST_ECALL,  "ecall",  mask_SYSTEM, mask_ecall,  FORMAT_NONE},
+        {INST_EBREAK, "ebreak", mask_SYSTEM, mask_ebreak, FORMAT_NONE},
+        {INST_MRET,   "mret",   mask_SYSTEM, mask_mret,   FORMAT_NONE},
+        {INST_CSRRW,  "csrrw",  mask_ISB,    mask_csrrw,  FORMAT_I},
+        {INST_CSRRS,  "csrrs",  mask_ISB,    mask_csrrs,  FORMAT_I},
+        {INST_CSRRC,  "csrrc",  mask_ISB,    mask_csrrc,  FORMAT_I},
+        {INST_CSRRWI, "csrrwi", mask_ISB,    mask_csrrwi, FORMAT_I},
+        {INST_CSRRSI, "csrrsi", mask_ISB,    mask_csrrsi, FORMAT_I},
+        {INST_CSRRCI, "csrrci", mask_ISB,    mask_csrrci, FORMAT_I},
+        {INST_MUL,    "mul",    mask_R,      mask_mul,    FORMAT_R},
+        {INST_MULH,   "mulh",   mask_R,      mask_mulh,   FORMAT_R},
+        {INST_MULHSU, "mulhsu", mask_R,      mask_mulhsu, FORMAT_R},
+        {INST_MULHU,  "mulhu",  mask_R,      mask_mulhu,  FORMAT_R},
+        {INST_DIV,    "div",    mask_R,      mask_div,    FORMAT_R},
+        {INST_DIVU,   "divu",   mask_R,      mask_divu,   FORMAT_R},
+        {INST_REM,    "rem",    mask_R,      mask_rem,    FORMAT_R},
+        {INST_REMU,   "remu",   mask_R,      mask_remu,   FORMAT_R},
+        {INST_LR_W,      "lr.w",      mask_LR,  mask_lr_w,      FORMAT_R},
+        {INST_SC_W,      "sc.w",      mask_AMO, mask_sc_w,      FORMAT_R},
+        {INST_AMOSWAP_W, "amoswap.w", mask_AMO, mask_amoswap_w, FORMAT_R},
+        {INST_AMOADD_W,  "amoadd.w",  mask_AMO, mask_amoadd_w,  FORMAT_R},
+        {INST_AMOXOR_W,  "amoxor.w",  mask_AMO, mask_amoxor_w,  FORMAT_R},
+        {INST_AMOAND_W,  "amoand.w",  mask_AMO, mask_amoand_w,  FORMAT_R},
+        {INST_AMOOR_W,   "amoor.w",   mask_AMO, mask_amoor_w,   FORMAT_R},
+        {INST_AMOMIN_W,  "amomin.w",  mask_AMO, mask_amomin_w,  FORMAT_R},
+        {INST_AMOMAX_W,  "amomax.w",  mask_AMO, mask_amomax_w,  FORMAT_R},
+        {INST_AMOMINU_W, "amominu.w", mask_AMO, mask_amominu_w, FORMAT_R},
+        {INST_AMOMAXU_W, "amomaxu.w", mask_AMO, mask_amomaxu_w, FORMAT_R},
+        {INST_FLW,       "flw",       mask_ISB,         mask_flw,       FORMAT_I},
+        {INST_FSW,       "fsw",       mask_ISB,         mask_fsw,       FORMAT_S},
+        {INST_FMADD_S,   "fmadd.s",   mask_FP_R4,       mask_fmadd_s,   FORMAT_R4},
+        {INST_FMSUB_S,   "fmsub.s",   mask_FP_R4,       mask_fmsub_s,   FORMAT_R4},
+        {INST_FNMSUB_S,  "fnmsub.s",  mask_FP_R4,       mask_fnmsub_s,  FORMAT_R4},
+        {INST_FNMADD_S,  "fnmadd.s",  mask_FP_R4,       mask_fnmadd_s,  FORMAT_R4},
+        {INST_FADD_S,    "fadd.s",    mask_FP_RM,       mask_fadd_s,    FORMAT_RM},
+        {INST_FSUB_S,    "fsub.s",    mask_FP_RM,       mask_fsub_s,    FORMAT_RM},
+        {INST_FMUL_S,    "fmul.s",    mask_FP_RM,       mask_fmul_s,    FORMAT_RM},
+        {INST_FDIV_S,    "fdiv.s",    mask_FP_RM,       mask_fdiv_s,    FORMAT_RM},
+        {INST_FSQRT_S,   "fsqrt.s",   mask_FP_UNARY_RM, mask_fsqrt_s,   FORMAT_RM},
+        {INST_FSGNJ_S,   "fsgnj.s",   mask_R,           mask_fsgnj_s,   FORMAT_R},
+        {INST_FSGNJN_S,  "fsgnjn.s",  mask_R,           mask_fsgnjn_s,  FORMAT_R},
+        {INST_FSGNJX_S,  "fsgnjx.s",  mask_R,           mask_fsgnjx_s,  FORMAT_R},
+        {INST_FMIN_S,    "fmin.s",    mask_R,           mask_fmin_s,    FORMAT_R},
+        {INST_FMAX_S,    "fmax.s",    mask_R,           mask_fmax_s,    FORMAT_R},
+        {INST_FCVT_W_S,  "fcvt.w.s",  mask_FP_UNARY_RM, mask_fcvt_w_s,  FORMAT_RM},
+        {INST_FCVT_WU_S, "fcvt.wu.s", mask_FP_UNARY_RM, mask_fcvt_wu_s, FORMAT_RM},
+        {INST_FMV_X_W,   "fmv.x.w",   mask_SYSTEM,      mask_fmv_x_w,   FORMAT_R},
+        {INST_FEQ_S,     "feq.s",     mask_R,           mask_feq_s,     FORMAT_R},
+        {INST_FLT_S,     "flt.s",     mask_R,           mask_flt_s,     FORMAT_R},
+        {INST_FLE_S,     "fle.s",     mask_R,           mask_fle_s,     FORMAT_R},
+        {INST_FCLASS_S,  "fclass.s",  mask_SYSTEM,      mask_fclass_s,  FORMAT_R},
+        {INST_FCVT_S_W,  "fcvt.s.w",  mask_FP_UNARY_RM, mask_fcvt_s_w,  FORMAT_RM},
+        {INST_FCVT_S_WU, "fcvt.s.wu", mask_FP_UNARY_RM, mask_fcvt_s_wu, FORMAT_RM},
+        {INST_FMV_W_X,   "fmv.w.x",   mask_SYSTEM,      mask_fmv_w_x,   FORMAT_R},
+        {INST_FLD,       "fld",       mask_ISB,         mask_fld,       FORMAT_I},
+        {INST_FSD,       "fsd",       mask_ISB,         mask_fsd,       FORMAT_S},
+        {INST_FMADD_D,   "fmadd.d",   mask_FP_R4,       mask_fmadd_d,   FORMAT_R4},
+        {INST_FMSUB_D,   "fmsub.d",   mask_FP_R4,       mask_fmsub_d,   FORMAT_R4},
+        {INST_FNMSUB_D,  "fnmsub.d",  mask_FP_R4,       mask_fnmsub_d,  FORMAT_R4},
+        {INST_FNMADD_D,  "fnmadd.d",  mask_FP_R4,       mask_fnmadd_d,  FORMAT_R4},
+        {INST_FADD_D,    "fadd.d",    mask_FP_RM,       mask_fadd_d,    FORMAT_RM},
+        {INST_FSUB_D,    "fsub.d",    mask_FP_RM,       mask_fsub_d,    FORMAT_RM},
+        {INST_FMUL_D,    "fmul.d",    mask_FP_RM,       mask_fmul_d,    FORMAT_RM},
+        {INST_FDIV_D,    "fdiv.d",    mask_FP_RM,       mask_fdiv_d,    FORMAT_RM},
+        {INST_FSQRT_D,   "fsqrt.d",   mask_FP_UNARY_RM, mask_fsqrt_d,   FORMAT_RM},
+        {INST_FSGNJ_D,   "fsgnj.d",   mask_R,           mask_fsgnj_d,   FORMAT_R},
+        {INST_FSGNJN_D,  "fsgnjn.d",  mask_R,           mask_fsgnjn_d,  FORMAT_R},
+        {INST_FSGNJX_D,  "fsgnjx.d",  mask_R,           mask_fsgnjx_d,  FORMAT_R},
+        {INST_FMIN_D,    "fmin.d",    mask_R,           mask_fmin_d,    FORMAT_R},
+        {INST_FMAX_D,    "fmax.d",    mask_R,           mask_fmax_d,    FORMAT_R},
+        {INST_FCVT_S_D,  "fcvt.s.d",  mask_FP_UNARY_RM, mask_fcvt_s_d,  FORMAT_RM},
+        {INST_FCVT_D_S,  "fcvt.d.s",  mask_FP_UNARY_RM, mask_fcvt_d_s,  FORMAT_RM},
+        {INST_FEQ_D,     "feq.d",     mask_R,           mask_feq_d,     FORMAT_R},
+        {INST_FLT_D,     "flt.d",     mask_R,           mask_flt_d,     FORMAT_R},
+        {INST_FLE_D,     "fle.d",     mask_R,           mask_fle_d,     FORMAT_R},
+        {INST_FCLASS_D,  "fclass.d",  mask_SYSTEM,      mask_fclass_d,  FORMAT_R},
+        {INST_FCVT_W_D,  "fcvt.w.d",  mask_FP_UNARY_RM, mask_fcvt_w_d,  FORMAT_RM},
+        {INST_FCVT_WU_D, "fcvt.wu.d", mask_FP_UNARY_RM, mask_fcvt_wu_d, FORMAT_RM},
+        {INST_FCVT_D_W,  "fcvt.d.w",  mask_FP_UNARY_RM, mask_fcvt_d_w,  FORMAT_RM},
+        {INST_FCVT_D_WU, "fcvt.d.wu", mask_FP_UNARY_RM, mask_fcvt_d_wu, FORMAT_RM},
+    };
+
+    // Operand decoding for each format
+    static void decode_R(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_I(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_S(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_B(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_U(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_J(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_RM(const uint32_t cmd, DecodedInstruction& decoded);
+    static void decode_R4(const uint32_t cmd, DecodedInstruction& decoded);
+
+    void VerbosePrintInstruction(const DecodedInstruction& decoded);
 
     // Executor functions
     void execute_lui();
@@ -247,6 +758,78 @@ private:
     void execute_csrrwi();
     void execute_csrrsi();
     void execute_csrrci();
+    void execute_mul();
+    void execute_mulh();
+    void execute_mulhsu();
+    void execute_mulhu();
+    void execute_div();
+    void execute_divu();
+    void execute_rem();
+    void execute_remu();
+    void execute_lr_w();
+    void execute_sc_w();
+    void execute_amoswap_w();
+    void execute_amoadd_w();
+    void execute_amoxor_w();
+    void execute_amoand_w();
+    void execute_amoor_w();
+    void execute_amomin_w();
+    void execute_amomax_w();
+    void execute_amominu_w();
+    void execute_amomaxu_w();
+    void ExecuteAmo(const MemoryMap::AtomicOp op);
+    void execute_flw();
+    void execute_fsw();
+    void execute_fmadd_s();
+    void execute_fmsub_s();
+    void execute_fnmsub_s();
+    void execute_fnmadd_s();
+    void execute_fadd_s();
+    void execute_fsub_s();
+    void execute_fmul_s();
+    void execute_fdiv_s();
+    void execute_fsqrt_s();
+    void execute_fsgnj_s();
+    void execute_fsgnjn_s();
+    void execute_fsgnjx_s();
+    void execute_fmin_s();
+    void execute_fmax_s();
+    void execute_fcvt_w_s();
+    void execute_fcvt_wu_s();
+    void execute_fmv_x_w();
+    void execute_feq_s();
+    void execute_flt_s();
+    void execute_fle_s();
+    void execute_fclass_s();
+    void execute_fcvt_s_w();
+    void execute_fcvt_s_wu();
+    void execute_fmv_w_x();
+    void execute_fld();
+    void execute_fsd();
+    void execute_fmadd_d();
+    void execute_fmsub_d();
+    void execute_fnmsub_d();
+    void execute_fnmadd_d();
+    void execute_fadd_d();
+    void execute_fsub_d();
+    void execute_fmul_d();
+    void execute_fdiv_d();
+    void execute_fsqrt_d();
+    void execute_fsgnj_d();
+    void execute_fsgnjn_d();
+    void execute_fsgnjx_d();
+    void execute_fmin_d();
+    void execute_fmax_d();
+    void execute_fcvt_s_d();
+    void execute_fcvt_d_s();
+    void execute_feq_d();
+    void execute_flt_d();
+    void execute_fle_d();
+    void execute_fclass_d();
+    void execute_fcvt_w_d();
+    void execute_fcvt_wu_d();
+    void execute_fcvt_d_w();
+    void execute_fcvt_d_wu();
 };
 
 } // namespace riscvdb
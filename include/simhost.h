@@ -2,10 +2,19 @@
 #define RISCVDB_SIMHOST_H
 
 #include <thread>
+#include <ostream>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <unordered_map>
+#include <vector>
+#include <memory>
 #include "fileloader.h"
 #include "memorymap.h"
+#include "clint.h"
+#include "uart.h"
+#include "blockdevice.h"
+#include "syscalls.h"
 #include "riscv_processor.h"
 
 namespace riscvdb
@@ -18,6 +27,7 @@ class SimHost {
 public:
     static const MemoryMap::AddrType DEFAULT_MEM_ORIGIN = 0x0;
     static const MemoryMap::AddrType DEFAULT_MEM_SIZE = 0x100000000ULL; // 4 GiB
+    static const unsigned long DEFAULT_QUANTUM = 1000; // instructions
 
     enum SimState {
         IDLE,
@@ -26,7 +36,17 @@ public:
         TERMINATED,
     };
 
-    SimHost();
+    // How harts are kept in step with each other, when there's more than one
+    enum HartSync {
+        // each on its own host thread, waiting for the others after every
+        // quantum of instructions
+        HART_SYNC_QUANTUM,
+        // one quantum each in turn on a single host thread, so that runs are
+        // repeatable
+        HART_SYNC_LOCKSTEP,
+    };
+
+    SimHost(const MemoryMap::Backend memBackend = MemoryMap::BACKEND_FLAT);
     ~SimHost();
 
     int LoadFile(const std::string& path);
@@ -34,12 +54,38 @@ public:
 
     SimState GetState() const;
     MemoryMap& Memory();
+    // hart 0
     RiscvProcessor& Processor();
+    RiscvProcessor& Hart(const unsigned int hart);
+    // the UART at Uart::DEFAULT_BASE, transmitting to the output stream
+    Uart& SerialPort();
+    // the disk at BlockDevice::DEFAULT_BASE, empty until an image is opened
+    BlockDevice& Disk();
+
+    // Do newlib's system calls (ecall) on the host, instead of trapping.
+    // Off by default.
+    void SetSyscalls(bool enabled);
+    SyscallProxy& Syscalls();
+
+    unsigned int GetHartCount() const;
+
+    // Replaces the harts with count new ones sharing the memory, with
+    // mhartid 0 to count-1. All of them start at _start. A quantum of 0 is
+    // taken as DEFAULT_QUANTUM.
+    void SetHarts(const unsigned int count, const HartSync sync = HART_SYNC_QUANTUM,
+                  const unsigned long quantum = DEFAULT_QUANTUM);
 
     void ResetSim();
     void Run(unsigned long numInstructions = 0);
+
+    // Asks a running target to stop. This only changes the state, use
+    // WaitForStop to wait for it.
     void Pause();
 
+    // Blocks until the target has stopped running, and returns the state it
+    // stopped in
+    SimState WaitForStop();
+
     // returns breakpoint number
     int AddBreakpoint(const MemoryMap::AddrType address);
     void RemoveBreakpoint(const unsigned int breakpointNumber);
@@ -65,26 +111,82 @@ public:
 
     void SetVerbose(bool verbose);
 
+    // Run whole basic blocks at a time (default), or one instruction at a time
+    void SetBlockExecution(bool enabled);
+
+    // Don't list the contents of files as they are loaded
+    void SetQuiet(bool quiet);
+
+    // Where messages from loading and running the target go (stdout and
+    // stderr by default), so that several targets can run side by side
+    void SetOutput(std::ostream& out, std::ostream& err);
+
 private:
     std::string m_loadedBin;
 
     std::atomic<SimState> m_state;
 
     MemoryMap m_mem;
-    RiscvProcessor m_processor;
+    std::vector<std::unique_ptr<RiscvProcessor>> m_harts;
+    Clint m_clint;
+    Uart m_uart;
+    BlockDevice m_disk;
+    SyscallProxy m_syscalls;
+    bool m_syscallsEnabled;
+    HartSync m_hartSync;
+    unsigned long m_quantum;
 
     // maps Addr -> breakpoint number to have good run-time efficiency (for
     // O(1)  lookup time for searching for instructions when running)
     std::unordered_map<MemoryMap::AddrType, unsigned int> m_breakpoints;
     unsigned int m_breakpointCount;
 
+    bool m_blockExecution;
+    bool m_quiet;
+    std::ostream* m_out;
+    std::ostream* m_err;
+    std::mutex m_outMutex;
+
     SymbolMapType m_symbolMap;
 
     // the virtual CPU runs in this thread:
     std::thread m_simRunner;
 
+    // signalled when the thread stops running
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopped;
+    bool m_workerRunning;
+
+    // where the running target exits, if it has an _exit symbol
+    bool m_hasExit;
+    MemoryMap::AddrType m_exitAddr;
+
+    // a hart's progress through one run
+    struct HartRun
+    {
+        RiscvProcessor* processor = nullptr;
+        unsigned int hart = 0;
+        unsigned long instCounter = 0;
+        bool resuming = false;
+        bool done = false;
+    };
+
     // pass numInstructions=0 to run indefinitely
     void runSimWorker(unsigned long numInstructions);
+    void runLockstep(std::vector<HartRun>& runs, const unsigned long numInstructions);
+    void runParallel(std::vector<HartRun>& runs, const unsigned long numInstructions);
+
+    // points the CLINT's registers at the current harts, and hands their
+    // ecalls to the system call proxy
+    void connectHarts();
+
+    // runs until the target stops, the hart has run numInstructions, or for
+    // one quantum (0 for no limit)
+    void runHart(HartRun& run, const unsigned long numInstructions, const unsigned long quantum);
+    void printHart(const HartRun& run);
+
+    // moves a running target to state, unless it's already terminated
+    void stopTarget(const SimState state);
 
 };
 
@@ -0,0 +1,97 @@
+#ifndef RISCVDB_SYSCALLS_H
+#define RISCVDB_SYSCALLS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <map>
+#include <mutex>
+#include "memorymap.h"
+#include "riscv_processor.h"
+
+namespace riscvdb
+{
+
+// The system calls newlib makes through libgloss, done on the host. libgloss
+// makes them with ecall, the call number in a7 and its arguments from a0, and
+// expects the result, or minus the errno, back in a0.
+//
+// The program's stdout and stderr go to the simulator's output streams, and
+// its stdin is the host's. Files it opens are host files, behind descriptors
+// of the program's own. Reads and writes go straight between guest memory
+// and the host.
+class SyscallProxy
+{
+public:
+    // Linux numbering, as libgloss uses
+    static const uint32_t SYS_OPENAT = 56;
+    static const uint32_t SYS_CLOSE = 57;
+    static const uint32_t SYS_LSEEK = 62;
+    static const uint32_t SYS_READ = 63;
+    static const uint32_t SYS_WRITE = 64;
+    static const uint32_t SYS_FSTAT = 80;
+    static const uint32_t SYS_EXIT = 93;
+    static const uint32_t SYS_GETTIMEOFDAY = 169;
+    static const uint32_t SYS_BRK = 214;
+    static const uint32_t SYS_CLOCK_GETTIME64 = 403;
+    static const uint32_t SYS_OPEN = 1024;
+
+    explicit SyscallProxy(MemoryMap& mem);
+    ~SyscallProxy();
+
+    SyscallProxy(const SyscallProxy&) = delete;
+    SyscallProxy& operator=(const SyscallProxy&) = delete;
+
+    void SetOutput(std::ostream& out, std::ostream& err);
+
+    // Closes the program's files, and puts the heap (brk) back to start,
+    // where it can grow up to limit
+    void Reset(const MemoryMap::AddrType heapStart, const MemoryMap::AddrType heapLimit);
+
+    // Does the call in the hart's registers. Returns false, doing nothing,
+    // if it isn't one of the above.
+    bool Handle(RiscvProcessor& hart);
+
+    // Whether the program has called exit, and with what
+    bool Exited() const;
+    uint32_t ExitCode() const;
+
+private:
+    MemoryMap& m_mem;
+    std::ostream* m_out;
+    std::ostream* m_err;
+
+    // harts on several threads can make calls at once
+    std::mutex m_mutex;
+
+    // the program's descriptors (from 3) to host ones
+    std::map<uint32_t, int> m_files;
+
+    MemoryMap::AddrType m_heapStart;
+    MemoryMap::AddrType m_heapLimit;
+    MemoryMap::AddrType m_brk;
+
+    bool m_exited;
+    uint32_t m_exitCode;
+
+    void CloseFiles();
+
+    // Copies size bytes into guest RAM at address, returning false (with
+    // nothing copied) if any of it isn't RAM
+    bool CopyOut(const uint32_t address, const uint8_t* data, const uint32_t size);
+    bool ReadString(const uint32_t address, std::string& str);
+
+    int32_t Open(const uint32_t pathAddr, const uint32_t flags, const uint32_t mode);
+    int32_t Close(const uint32_t fd);
+    int32_t Read(const uint32_t fd, const uint32_t bufAddr, const uint32_t count);
+    int32_t Write(const uint32_t fd, const uint32_t bufAddr, const uint32_t count);
+    int32_t Lseek(const uint32_t fd, const int32_t offset, const uint32_t whence);
+    int32_t Fstat(const uint32_t fd, const uint32_t statAddr);
+    int32_t Brk(const uint32_t address);
+    int32_t GetTimeOfDay(const uint32_t timevalAddr);
+    int32_t ClockGetTime(const uint32_t timespecAddr);
+};
+
+} // namespace riscvdb
+
+#endif  // RISCVDB_SYSCALLS_H
@@ -0,0 +1,105 @@
+#ifndef RISCVDB_UART_H
+#define RISCVDB_UART_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "memorymap.h"
+
+namespace riscvdb
+{
+
+// 16550 style UART, with its registers a byte apart. Transmitting never has
+// to wait, and there are no interrupts, so drivers poll LSR.
+//
+// Transmitted bytes are buffered on the host until a newline or until the
+// buffer fills, rather than written out one at a time. Received bytes come
+// from a host file or pseudo terminal, read a buffer at a time.
+class Uart
+{
+public:
+    static const MemoryMap::AddrType DEFAULT_BASE = 0xF0000000;
+    static const MemoryMap::AddrType SIZE = 0x100;
+    static const size_t BUFFER_SIZE = 4096;
+
+    // Register offsets
+    static const MemoryMap::AddrType RBR = 0;  // receive (read), or THR transmit (write)
+    static const MemoryMap::AddrType IER = 1;
+    static const MemoryMap::AddrType IIR = 2;  // or FCR (write)
+    static const MemoryMap::AddrType LCR = 3;
+    static const MemoryMap::AddrType MCR = 4;
+    static const MemoryMap::AddrType LSR = 5;
+    static const MemoryMap::AddrType MSR = 6;
+    static const MemoryMap::AddrType SCR = 7;
+
+    static const uint8_t LCR_DLAB = 0x80;
+    static const uint8_t LSR_DR = 0x01;    // data ready
+    static const uint8_t LSR_THRE = 0x20;  // transmit holding register empty
+    static const uint8_t LSR_TEMT = 0x40;  // transmitter empty
+
+    Uart();
+    ~Uart();
+
+    Uart(const Uart&) = delete;
+    Uart& operator=(const Uart&) = delete;
+
+    // Where transmitted bytes go, unless bridged to a pseudo terminal
+    void SetOutput(std::ostream& out);
+
+    // Receive the contents of the file at path. Returns 0 on success.
+    int OpenInput(const std::string& path);
+
+    // Bridge both directions to a new pseudo terminal, for a terminal
+    // program to connect to. Returns the path of the terminal, or an empty
+    // string if one couldn't be made.
+    std::string OpenPty();
+
+    // Writes out anything transmitted since the last newline
+    void Flush();
+
+    // Any size of access, as MemoryMap's device callbacks. Only the byte at
+    // the offset counts.
+    uint64_t Read(const MemoryMap::AddrType offset, const unsigned int size);
+    void Write(const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data);
+
+private:
+    // harts on several threads can share the UART
+    std::mutex m_mutex;
+
+    uint8_t m_ier;
+    uint8_t m_lcr;
+    uint8_t m_mcr;
+    uint8_t m_scr;
+    uint8_t m_dll;
+    uint8_t m_dlm;
+
+    std::ostream* m_out;
+    std::string m_tx;
+
+    // Received bytes not yet read, and where they come from (-1 if nowhere
+    // or after the end of a file)
+    std::vector<uint8_t> m_rx;
+    size_t m_rxPos;
+    int m_rxFd;
+
+    // A pseudo terminal is read from and written to through its master side.
+    // The slave side is kept open so that reads don't fail while nothing is
+    // connected.
+    int m_ptyFd;
+    int m_ptySlaveFd;
+
+    // An empty pseudo terminal isn't read from again for a while, as drivers
+    // poll LSR before every byte they send
+    std::chrono::steady_clock::time_point m_nextPoll;
+
+    void CloseFds();
+    bool RxReady();
+    void FlushLocked();
+};
+
+} // namespace riscvdb
+
+#endif  // RISCVDB_UART_H
@@ -0,0 +1,106 @@
+#ifndef RISCVDB_X86_EMITTER_H
+#define RISCVDB_X86_EMITTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace riscvdb
+{
+
+// Assembles the small subset of x86-64 machine code needed by the JIT
+class X86Emitter
+{
+public:
+    enum Reg
+    {
+        RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+        R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+    };
+
+    // values are the /digit of the immediate forms
+    enum AluOp
+    {
+        ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7,
+    };
+
+    // values are the /digit of the shift group
+    enum ShiftOp
+    {
+        SHL = 4, SHR = 5, SAR = 7,
+    };
+
+    enum Condition
+    {
+        CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD,
+    };
+
+    typedef size_t Label;  // position of a rel32 waiting to be bound
+
+    // 32 bit operations (upper half of the destination is zeroed)
+    void Mov(const Reg dst, const Reg src);
+    void MovImm(const Reg dst, const uint32_t imm);
+    void Load(const Reg dst, const Reg base, const int32_t disp);
+    void Store(const Reg base, const int32_t disp, const Reg src);
+    void StoreImm(const Reg base, const int32_t disp, const uint32_t imm);
+    void Alu(const AluOp op, const Reg dst, const Reg src);
+    void AluImm(const AluOp op, const Reg dst, const int32_t imm);
+    void Shift(const ShiftOp op, const Reg dst);  // shift by cl
+    void ShiftImm(const ShiftOp op, const Reg dst, const uint8_t amount);
+    void Test(const Reg a, const Reg b);
+    void SetCC(const Condition cc, const Reg dst);  // dst = cc ? 1 : 0
+    void CmpByteImm(const Reg base, const int32_t disp, const int8_t imm);
+
+    // 64 bit operations
+    void Mov64(const Reg dst, const Reg src);
+    void MovImm64(const Reg dst, const uint64_t imm);
+    void AddImm64(const Reg dst, const int32_t imm);
+    void MovSx64(const Reg dst, const Reg src);  // sign extend 32 to 64 bits
+    void IMul64(const Reg dst, const Reg src);   // dst *= src
+    void ShiftImm64(const ShiftOp op, const Reg dst, const uint8_t amount);
+    void Cqo();                                   // sign extend rax into rdx
+    void Div64(const Reg divisor);                // rdx:rax / divisor, unsigned
+    void IDiv64(const Reg divisor);               // rdx:rax / divisor, signed
+    void BitTest64(const Reg src, const uint8_t bit);  // CF = bit
+    void Push(const Reg reg);
+    void Pop(const Reg reg);
+    void Call(const Reg target);
+    void Ret();
+
+    // forward jumps
+    Label Jump();
+    Label JumpIf(const Condition cc);
+    void Bind(const Label label);
+
+    const std::vector<uint8_t>& Code() const;
+
+private:
+    std::vector<uint8_t> m_code;
+
+    void Byte(const uint8_t b);
+    void Imm32(const uint32_t imm);
+    void Rex(const bool wide, const unsigned reg, const unsigned base, const bool force = false);
+    void ModRMReg(const unsigned reg, const unsigned rm);
+    void ModRMMem(const unsigned reg, const Reg base, const int32_t disp);
+};
+
+// A block of host memory holding generated code, that can be called into
+class ExecutableMemory
+{
+public:
+    explicit ExecutableMemory(const std::vector<uint8_t>& code);
+    ~ExecutableMemory();
+
+    ExecutableMemory(const ExecutableMemory&) = delete;
+    ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+    const void* Entry() const;
+
+private:
+    void* m_mem;
+    size_t m_size;
+};
+
+} // namespace riscvdb
+
+#endif  // RISCVDB_X86_EMITTER_H
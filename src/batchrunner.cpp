@@ -0,0 +1,218 @@
+#include "batchrunner.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+namespace riscvdb {
+
+const std::string BatchRunner::SEED_SYMBOL = "riscvdb_seed";
+
+BatchRunner::BatchRunner(const MemoryMap::Backend memBackend, const bool blockExecution,
+                         const unsigned long maxInstructions)
+: m_memBackend(memBackend),
+  m_blockExecution(blockExecution),
+  m_maxInstructions(maxInstructions),
+  m_harts(1),
+  m_hartSync(SimHost::HART_SYNC_QUANTUM),
+  m_quantum(SimHost::DEFAULT_QUANTUM),
+  m_syscalls(false)
+{
+    // empty
+}
+
+void BatchRunner::SetHarts(const unsigned int count, const SimHost::HartSync sync, const unsigned long quantum)
+{
+    m_harts = count;
+    m_hartSync = sync;
+    m_quantum = quantum;
+}
+
+void BatchRunner::SetUartInput(const std::string& path)
+{
+    m_uartInput = path;
+}
+
+void BatchRunner::SetSyscalls(const bool enabled)
+{
+    m_syscalls = enabled;
+}
+
+void BatchRunner::SetBlockImage(const std::string& path)
+{
+    m_blockImage = path;
+}
+
+BatchRunner::Result BatchRunner::RunJob(const Job& job, std::ostream& out, std::ostream& err) const
+{
+    Result result;
+
+    SimHost simHost(m_memBackend);
+    simHost.SetBlockExecution(m_blockExecution);
+    simHost.SetQuiet(true);
+    simHost.SetOutput(out, err);
+    simHost.SetHarts(m_harts, m_hartSync, m_quantum);
+    simHost.SetSyscalls(m_syscalls);
+
+    if (!m_uartInput.empty() && simHost.SerialPort().OpenInput(m_uartInput) != 0)
+    {
+        err << "can't open UART input " << m_uartInput << std::endl;
+        return result;
+    }
+
+    if (!m_blockImage.empty() && simHost.Disk().Open(m_blockImage, true) != 0)
+    {
+        err << "can't open disk image " << m_blockImage << std::endl;
+        return result;
+    }
+
+    if (simHost.LoadFile(job.path) != 0)
+    {
+        return result;
+    }
+
+    if (job.seeded)
+    {
+        auto seed_it = simHost.SymbolMap().find(SEED_SYMBOL);
+        if (seed_it == simHost.SymbolMap().end())
+        {
+            err << job.path << " has no " << SEED_SYMBOL << " symbol to seed" << std::endl;
+            return result;
+        }
+        simHost.Memory().WriteWord(seed_it->second.addr, job.seed);
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    simHost.Run(m_maxInstructions);
+    SimHost::SimState state = simHost.WaitForStop();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+
+    // the limit is per hart, the exit code from whichever hart got to _exit
+    auto exit_it = simHost.SymbolMap().find("_exit");
+    bool limitReached = false;
+    result.exitCode = EXIT_STOPPED;
+    for (unsigned int hart = 0; hart < simHost.GetHartCount(); ++hart)
+    {
+        RiscvProcessor& processor = simHost.Hart(hart);
+        result.instructions += processor.GetInstructionCount();
+        limitReached = limitReached ||
+                       (m_maxInstructions > 0 && processor.GetInstructionCount() >= m_maxInstructions);
+
+        if (state == SimHost::TERMINATED && result.exitCode == EXIT_STOPPED &&
+            exit_it != simHost.SymbolMap().end() &&
+            processor.GetPC() == exit_it->second.addr)
+        {
+            result.exitCode = processor.GetReg(10) & 0xFF;
+        }
+    }
+
+    // without an _exit symbol, the program can still exit through the syscall
+    if (state == SimHost::TERMINATED && result.exitCode == EXIT_STOPPED && simHost.Syscalls().Exited())
+    {
+        result.exitCode = simHost.Syscalls().ExitCode() & 0xFF;
+    }
+
+    if (state == SimHost::PAUSED && limitReached)
+    {
+        result.exitCode = EXIT_LIMIT;
+    }
+
+    return result;
+}
+
+std::vector<BatchRunner::Result> BatchRunner::RunJobs(const std::vector<Job>& jobs, unsigned int numThreads) const
+{
+    std::vector<Result> results(jobs.size());
+
+    // Each thread takes the next job that nobody has started yet
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&]()
+    {
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+        {
+            std::ostringstream output;
+            results[i] = RunJob(jobs[i], output, output);
+            results[i].output = output.str();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < ThreadCount(numThreads, jobs.size()); ++i)
+    {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& thread : pool)
+    {
+        thread.join();
+    }
+
+    return results;
+}
+
+unsigned int BatchRunner::PrintReport(std::ostream& out, const std::vector<Job>& jobs,
+                                      const std::vector<Result>& results,
+                                      const double seconds, const unsigned int numThreads)
+{
+    unsigned int failed = 0;
+    unsigned long long instructions = 0;
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const Job& job = jobs[i];
+        const Result& result = results[i];
+
+        std::ostringstream name;
+        name << job.path;
+        if (job.seeded)
+        {
+            name << " seed " << job.seed;
+        }
+
+        out << (result.exitCode == 0 ? "PASS " : "FAIL ");
+        out << std::setw(40) << std::setfill(' ') << std::left << name.str();
+        out << std::setw(12) << std::right << std::dec << result.instructions << " instructions ";
+        out << std::fixed << std::setprecision(3) << result.seconds << " s";
+        if (result.exitCode != 0)
+        {
+            out << " (exit code " << result.exitCode << ")";
+        }
+        out << std::endl;
+
+        // anything it printed, indented under it
+        std::istringstream output(result.output);
+        std::string line;
+        while (std::getline(output, line))
+        {
+            out << "    " << line << std::endl;
+        }
+
+        failed += result.exitCode != 0 ? 1 : 0;
+        instructions += result.instructions;
+    }
+
+    double mips = seconds > 0 ? instructions / seconds / 1e6 : 0;
+    out << jobs.size() << " runs, " << jobs.size() - failed << " passed, " << failed << " failed: ";
+    out << instructions << " instructions, ";
+    out << std::fixed << std::setprecision(3) << seconds << " s, ";
+    out << std::setprecision(1) << mips << " MIPS on " << numThreads;
+    out << (numThreads == 1 ? " thread" : " threads") << std::endl;
+
+    return failed;
+}
+
+unsigned int BatchRunner::ThreadCount(const unsigned int requested, const size_t numJobs)
+{
+    unsigned int count = requested;
+    if (count == 0)
+    {
+        // may not be known, in which case it's 0 too
+        count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    return static_cast<unsigned int>(std::min<size_t>(count, std::max<size_t>(numJobs, 1)));
+}
+
+} // namespace riscvdb
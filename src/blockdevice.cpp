@@ -0,0 +1,208 @@
+#include "blockdevice.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+
+namespace riscvdb {
+
+BlockDevice::BlockDevice(MemoryMap& mem)
+: m_mem(mem),
+  m_image(nullptr),
+  m_imageSize(0),
+  m_snapshot(false),
+  m_sector(0),
+  m_address(0),
+  m_count(0),
+  m_command(0),
+  m_status(STATUS_OK)
+{
+    // empty
+}
+
+BlockDevice::~BlockDevice()
+{
+    CloseLocked();
+}
+
+int BlockDevice::Open(const std::string& path, const bool snapshot)
+{
+    // a snapshot's writes stay in its private copy of the pages, so the file
+    // itself is never written to
+    int fd = open(path.c_str(), snapshot ? O_RDONLY : O_RDWR);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(SECTOR_SIZE))
+    {
+        close(fd);
+        return -1;
+    }
+    uint64_t size = static_cast<uint64_t>(st.st_size) / SECTOR_SIZE * SECTOR_SIZE;
+
+    void* image = mmap(nullptr, size, PROT_READ | PROT_WRITE, snapshot ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    close(fd);  // the mapping keeps the file
+    if (image == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CloseLocked();
+    m_image = static_cast<std::byte*>(image);
+    m_imageSize = size;
+    m_snapshot = snapshot;
+    return 0;
+}
+
+void BlockDevice::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CloseLocked();
+}
+
+void BlockDevice::CloseLocked()
+{
+    if (m_image != nullptr)
+    {
+        munmap(m_image, m_imageSize);
+    }
+    m_image = nullptr;
+    m_imageSize = 0;
+}
+
+uint64_t BlockDevice::Capacity() const
+{
+    return m_imageSize;
+}
+
+uint32_t BlockDevice::Execute(const uint32_t command)
+{
+    if (command == CMD_FLUSH)
+    {
+        if (m_image == nullptr)
+        {
+            return STATUS_ERROR;
+        }
+        if (!m_snapshot && msync(m_image, m_imageSize, MS_SYNC) != 0)
+        {
+            return STATUS_ERROR;
+        }
+        return STATUS_OK;
+    }
+    if (command != CMD_READ && command != CMD_WRITE)
+    {
+        return STATUS_UNSUPPORTED;
+    }
+
+    uint64_t sectors = m_imageSize / SECTOR_SIZE;
+    if (m_image == nullptr || m_sector > sectors || m_count > sectors - m_sector)
+    {
+        return STATUS_ERROR;
+    }
+
+    // straight between the image's pages and RAM's
+    std::byte* disk = m_image + m_sector * SECTOR_SIZE;
+    bool toRam = command == CMD_READ;
+    bool inRange = m_mem.ForEachSpan(m_address, static_cast<MemoryMap::AddrType>(m_count) * SECTOR_SIZE, toRam,
+        [&](std::byte* data, const MemoryMap::AddrType size)
+        {
+            if (toRam)
+            {
+                std::memcpy(data, disk, size);
+            }
+            else
+            {
+                std::memcpy(disk, data, size);
+            }
+            disk += size;
+            return true;
+        });
+    return inRange ? STATUS_OK : STATUS_ERROR;
+}
+
+uint64_t BlockDevice::Read(const MemoryMap::AddrType offset, const unsigned int size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // the words the access covers, then its bytes out of them
+    MemoryMap::AddrType first = offset & ~3ULL;
+    uint64_t words = ReadWord(first);
+    if (offset % 4 + size > 4)
+    {
+        words |= static_cast<uint64_t>(ReadWord(first + 4)) << 32;
+    }
+
+    uint64_t value = words >> (8 * (offset % 4));
+    return size >= 8 ? value : value & ((1ULL << (8 * size)) - 1);
+}
+
+void BlockDevice::Write(const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (size == 8 && offset % 4 == 0)
+    {
+        WriteWord(offset, static_cast<uint32_t>(data));
+        WriteWord(offset + 4, static_cast<uint32_t>(data >> 32));
+        return;
+    }
+
+    // part of a word, merged into what's there
+    MemoryMap::AddrType first = offset & ~3ULL;
+    unsigned int shift = 8 * (offset % 4);
+    uint64_t mask = (size >= 4 ? 0xFFFFFFFFULL : (1ULL << (8 * size)) - 1) << shift;
+    uint64_t word = ReadWord(first);
+    word = (word & ~mask) | ((data << shift) & mask);
+    WriteWord(first, static_cast<uint32_t>(word));
+}
+
+uint32_t BlockDevice::ReadWord(const MemoryMap::AddrType offset)
+{
+    uint64_t sectors = m_imageSize / SECTOR_SIZE;
+    switch (offset)
+    {
+        case REG_MAGIC:           return MAGIC;
+        case REG_SECTOR_SIZE:     return SECTOR_SIZE;
+        case REG_CAPACITY:        return static_cast<uint32_t>(sectors);
+        case REG_CAPACITY + 4:    return static_cast<uint32_t>(sectors >> 32);
+        case REG_SECTOR:          return static_cast<uint32_t>(m_sector);
+        case REG_SECTOR + 4:      return static_cast<uint32_t>(m_sector >> 32);
+        case REG_ADDRESS:         return m_address;
+        case REG_COUNT:           return m_count;
+        case REG_COMMAND:         return m_command;
+        case REG_STATUS:          return m_status;
+        default:                  return 0;
+    }
+}
+
+void BlockDevice::WriteWord(const MemoryMap::AddrType offset, const uint32_t data)
+{
+    switch (offset)
+    {
+        case REG_SECTOR:
+            m_sector = (m_sector & 0xFFFFFFFF00000000ULL) | data;
+            break;
+        case REG_SECTOR + 4:
+            m_sector = (m_sector & 0xFFFFFFFFULL) | (static_cast<uint64_t>(data) << 32);
+            break;
+        case REG_ADDRESS:
+            m_address = data;
+            break;
+        case REG_COUNT:
+            m_count = data;
+            break;
+        case REG_COMMAND:
+            m_command = data;
+            m_status = Execute(data);
+            break;
+        default:
+            break;  // read only, or reserved
+    }
+}
+
+} // namespace riscvdb
@@ -0,0 +1,112 @@
+#include "clint.h"
+
+namespace riscvdb {
+
+thread_local unsigned int Clint::t_currentHart = 0;
+
+void Clint::SetHarts(const std::vector<RiscvProcessor*>& harts)
+{
+    m_harts = harts;
+}
+
+void Clint::SetCurrentHart(const unsigned int hart)
+{
+    t_currentHart = hart;
+}
+
+uint64_t Clint::Read(const MemoryMap::AddrType offset, const unsigned int size)
+{
+    // the words the access covers, then its bytes out of them
+    MemoryMap::AddrType first = offset & ~3ULL;
+    uint64_t words = ReadWord(first);
+    if (offset % 4 + size > 4)
+    {
+        words |= static_cast<uint64_t>(ReadWord(first + 4)) << 32;
+    }
+
+    uint64_t value = words >> (8 * (offset % 4));
+    return size >= 8 ? value : value & ((1ULL << (8 * size)) - 1);
+}
+
+void Clint::Write(const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+{
+    if (size == 8 && offset % 4 == 0)
+    {
+        WriteWord(offset, static_cast<uint32_t>(data));
+        WriteWord(offset + 4, static_cast<uint32_t>(data >> 32));
+        return;
+    }
+
+    // part of a word, merged into what's there
+    MemoryMap::AddrType first = offset & ~3ULL;
+    unsigned int shift = 8 * (offset % 4);
+    uint64_t mask = (size >= 4 ? 0xFFFFFFFFULL : (1ULL << (8 * size)) - 1) << shift;
+    uint64_t word = ReadWord(first);
+    word = (word & ~mask) | ((data << shift) & mask);
+    WriteWord(first, static_cast<uint32_t>(word));
+}
+
+RiscvProcessor* Clint::HartAt(const MemoryMap::AddrType offset, const MemoryMap::AddrType base,
+                              const unsigned int stride)
+{
+    MemoryMap::AddrType hart = (offset - base) / stride;
+    return hart < m_harts.size() ? m_harts[hart] : nullptr;
+}
+
+uint32_t Clint::ReadWord(const MemoryMap::AddrType offset)
+{
+    if (offset >= MTIME && offset < MTIME + 8)
+    {
+        RiscvProcessor* hart = t_currentHart < m_harts.size() ? m_harts[t_currentHart] : nullptr;
+        uint64_t time = hart != nullptr ? hart->GetTime() : 0;
+        return static_cast<uint32_t>(offset == MTIME ? time : time >> 32);
+    }
+    if (offset >= MTIMECMP && offset < MTIME)
+    {
+        RiscvProcessor* hart = HartAt(offset, MTIMECMP, 8);
+        uint64_t compare = hart != nullptr ? hart->GetTimerCompare() : 0;
+        return static_cast<uint32_t>(offset % 8 == 0 ? compare : compare >> 32);
+    }
+    if (offset < MTIMECMP)
+    {
+        RiscvProcessor* hart = HartAt(offset, MSIP, 4);
+        return hart != nullptr && hart->GetSoftwareInterrupt() ? 1 : 0;
+    }
+    return 0;  // reserved
+}
+
+void Clint::WriteWord(const MemoryMap::AddrType offset, const uint32_t data)
+{
+    if (offset >= MTIME && offset < MTIME + 8)
+    {
+        if (t_currentHart < m_harts.size())
+        {
+            RiscvProcessor* hart = m_harts[t_currentHart];
+            uint64_t time = hart->GetTime();
+            time = offset == MTIME ? (time & 0xFFFFFFFF00000000ULL) | data
+                                   : (time & 0xFFFFFFFFULL) | (static_cast<uint64_t>(data) << 32);
+            hart->SetTime(time);
+        }
+    }
+    else if (offset >= MTIMECMP && offset < MTIME)
+    {
+        RiscvProcessor* hart = HartAt(offset, MTIMECMP, 8);
+        if (hart != nullptr)
+        {
+            uint64_t compare = hart->GetTimerCompare();
+            compare = offset % 8 == 0 ? (compare & 0xFFFFFFFF00000000ULL) | data
+                                      : (compare & 0xFFFFFFFFULL) | (static_cast<uint64_t>(data) << 32);
+            hart->SetTimerCompare(compare);
+        }
+    }
+    else if (offset < MTIMECMP)
+    {
+        RiscvProcessor* hart = HartAt(offset, MSIP, 4);
+        if (hart != nullptr)
+        {
+            hart->SetSoftwareInterrupt((data & 0x1) != 0);
+        }
+    }
+}
+
+} // namespace riscvdb
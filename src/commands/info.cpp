@@ -6,8 +6,9 @@
 namespace riscvdb {
 
 const std::string CmdInfo::MSG_USAGE =
-"usage: info\n"
-"print current state of all machine registers";
+"usage: info [memory]\n"
+"print current state of all machine registers\n"
+"  memory    print the RAM backend and block cache hit/miss counts instead";
 
 CmdInfo::CmdInfo(SimHost& simHost)
 : m_simHost(simHost)
@@ -16,6 +17,12 @@ CmdInfo::CmdInfo(SimHost& simHost)
 }
 
 ConsoleCommand::CmdRetType CmdInfo::run(std::vector<std::string>& args) {
+  if (args.size() == 2 && args[1] == "memory")
+  {
+    printMemory();
+    return CmdRetType_OK;
+  }
+
   if (args.size() != 1)
   {
     std::cerr << MSG_USAGE << std::endl;
@@ -40,6 +47,22 @@ ConsoleCommand::CmdRetType CmdInfo::run(std::vector<std::string>& args) {
   return CmdRetType_OK;
 }
 
+void CmdInfo::printMemory()
+{
+  MemoryMap& mem = m_simHost.Memory();
+  std::cout << std::dec;
+  if (mem.GetBackend() == MemoryMap::BACKEND_FLAT)
+  {
+    std::cout << "backend: flat" << std::endl;
+    return;
+  }
+
+  MemoryMap::BlockCacheStats stats = mem.GetBlockCacheStats();
+  std::cout << "backend: blocks" << std::endl;
+  std::cout << "fetch cache: " << stats.fetchHits << " hits, " << stats.fetchMisses << " misses" << std::endl;
+  std::cout << "data cache: " << stats.dataHits << " hits, " << stats.dataMisses << " misses" << std::endl;
+}
+
 std::string CmdInfo::nameLong() { return "info"; }
 
 std::string CmdInfo::nameShort() { return "i"; }
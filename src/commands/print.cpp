@@ -309,10 +309,7 @@ void CmdPrint::runPrintMem(const CmdPrint::ArgParse& parser)
 void CmdPrint::runPrintMemSingle(const PrintFormat format, const MemoryMap::AddrType memAddr)
 {
   // print single word
-  uint32_t w_lower = m_simHost.Memory().ReadWord(memAddr);
-  uint32_t w_upper = m_simHost.Memory().ReadWord(memAddr + 4);
-  uint64_t memData = (static_cast<uint64_t>(w_upper) << 32) |
-                      static_cast<uint64_t>(w_lower);
+  uint64_t memData = m_simHost.Memory().ReadDoubleword(memAddr);
 
   std::cout << std::hex << std::right <<std::setfill('0') << std::setw(8);
   std::cout << memAddr << ": ";
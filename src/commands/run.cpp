@@ -1,8 +1,6 @@
 #include "commands/run.h"
 
 #include <iostream>
-#include <csignal>
-#include <cstring>
 
 namespace riscvdb {
 
@@ -16,22 +14,6 @@ CmdRun::CmdRun(SimHost& simHost)
   // Empty
 }
 
-void CmdRun::sigint_handler(int signum)
-{
-  if (signum == SIGINT)
-  {
-    if (m_simHost.GetState() == SimHost::RUNNING)
-    {
-      // user hit Ctrl-C before program finished
-      std::cout << std::endl;
-      std::cout << "user interrupted" << std::endl;
-
-      // this will eventually change the state
-      m_simHost.Pause();
-    }
-  }
-}
-
 ConsoleCommand::CmdRetType CmdRun::run(std::vector<std::string>& args)
 {
   unsigned long numInstructions = 0;
@@ -101,16 +83,10 @@ ConsoleCommand::CmdRetType CmdRun::run(std::vector<std::string>& args)
     return CmdRetType_ERROR;
   }
 
-  // Register a SIGINT handler for this class
-  SigIntHandler sigint(std::bind(&CmdRun::sigint_handler, this, std::placeholders::_1));
-
-  // and wait while running
-  while (m_simHost.GetState() == SimHost::RUNNING)
-  {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-  }
+  // and wait until it stops (Ctrl-C pauses it, see Console)
+  SimHost::SimState state = m_simHost.WaitForStop();
 
-  if (m_simHost.GetState() == SimHost::PAUSED)
+  if (state == SimHost::PAUSED)
   {
     std::cout << "target paused" << std::endl;
     std::cout << "PC = 0x";
@@ -118,7 +94,7 @@ ConsoleCommand::CmdRetType CmdRun::run(std::vector<std::string>& args)
     std::cout << std::dec << m_simHost.Processor().GetInstructionCount();
     std::cout << " instructions executed" << std::endl;
   }
-  else if (m_simHost.GetState() == SimHost::TERMINATED)
+  else if (state == SimHost::TERMINATED)
   {
     std::cout << "target terminated" << std::endl;
     std::cout << "PC = 0x";
@@ -1,8 +1,6 @@
 #include "commands/step.h"
 
 #include <iostream>
-#include <csignal>
-#include <cstring>
 
 namespace riscvdb {
 
@@ -16,22 +14,6 @@ CmdStep::CmdStep(SimHost& simHost)
   // Empty
 }
 
-void CmdStep::sigint_handler(int signum)
-{
-  if (signum == SIGINT)
-  {
-    if (m_simHost.GetState() == SimHost::RUNNING)
-    {
-      // user hit Ctrl-C before program finished
-      std::cout << std::endl;
-      std::cout << "user interrupted" << std::endl;
-
-      // this will eventually change the state
-      m_simHost.Pause();
-    }
-  }
-}
-
 ConsoleCommand::CmdRetType CmdStep::run(std::vector<std::string>& args)
 {
   unsigned long numInstructions = 1;
@@ -84,16 +66,10 @@ ConsoleCommand::CmdRetType CmdStep::run(std::vector<std::string>& args)
     return CmdRetType_ERROR;
   }
 
-  // Register a SIGINT handler for this class
-  SigIntHandler sigint(std::bind(&CmdStep::sigint_handler, this, std::placeholders::_1));
-
-  // and wait while running
-  while (m_simHost.GetState() == SimHost::RUNNING)
-  {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-  }
+  // and wait until it stops (Ctrl-C pauses it, see Console)
+  SimHost::SimState state = m_simHost.WaitForStop();
 
-  if (m_simHost.GetState() == SimHost::PAUSED)
+  if (state == SimHost::PAUSED)
   {
     std::cout << "target paused" << std::endl;
     std::cout << "PC = 0x";
@@ -101,7 +77,7 @@ ConsoleCommand::CmdRetType CmdStep::run(std::vector<std::string>& args)
     std::cout << std::dec << m_simHost.Processor().GetInstructionCount();
     std::cout << " instructions executed" << std::endl;
   }
-  else if (m_simHost.GetState() == SimHost::TERMINATED)
+  else if (state == SimHost::TERMINATED)
   {
     std::cout << "target terminated" << std::endl;
     std::cout << "PC = 0x";
@@ -48,66 +48,47 @@ std::string ConsoleCommand::extendedHelpStr() { return std::string(); }
  *
  * *****************************************************************************
  */
-std::deque<SigIntHandler*> SigIntHandler::s_instances;
-
-SigIntHandler::SigIntHandler(std::function<void(int)> handler)
-: m_handler(handler)
+SigIntHandler::SigIntHandler(std::function<bool(int)> handler)
+: m_handler(handler),
+  m_stop(false)
 {
-    // register static signal handler?
-    if (s_instances.empty())
-    {
-        struct sigaction sigIntHandler;
-        sigIntHandler.sa_handler = SigIntHandler::static_signalHandler;
-        sigemptyset(&sigIntHandler.sa_mask);
-        sigIntHandler.sa_flags = 0;
+    sigset_t sigint;
+    sigemptyset(&sigint);
+    sigaddset(&sigint, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint, &m_previousMask);
 
-        sigaction(SIGINT, &sigIntHandler, NULL);
-    }
-
-    // sign up this command for ctrl-C signal notification
-    s_instances.push_back(this);
+    m_thread = std::thread(&SigIntHandler::waitForSignals, this);
 }
 
 SigIntHandler::~SigIntHandler()
 {
-    // unregister when the SigInt context is destroyed
-
-    std::deque<SigIntHandler*>::iterator it;
-    for (it = s_instances.begin(); it != s_instances.end(); it++)
-    {
-        if (*it == this)
-        {
-            s_instances.erase(it);
-            break;
-        }
-    }
+    // wake the thread up to see that it's done
+    m_stop = true;
+    pthread_kill(m_thread.native_handle(), SIGINT);
+    m_thread.join();
 
-    // reset signal handler if no more left
-    if (s_instances.empty())
-    {
-        struct sigaction sigIntHandler;
-        sigIntHandler.sa_handler = nullptr;
-        sigemptyset(&sigIntHandler.sa_mask);
-        sigIntHandler.sa_flags = 0;
-
-        sigaction(SIGINT, &sigIntHandler, NULL);
-    }
+    pthread_sigmask(SIG_SETMASK, &m_previousMask, nullptr);
 }
 
-void SigIntHandler::signalHandler(int signum)
+void SigIntHandler::waitForSignals()
 {
-    m_handler(signum);
-}
+    sigset_t sigint;
+    sigemptyset(&sigint);
+    sigaddset(&sigint, SIGINT);
 
-void SigIntHandler::static_signalHandler(int signum)
-{
-    // invoke every class's individual handler
-    std::for_each(s_instances.begin(),
-                  s_instances.end(),
-                  std::bind(std::mem_fn(&SigIntHandler::signalHandler), std::placeholders::_1, signum));
+    int signum = 0;
+    while (sigwait(&sigint, &signum) == 0 && !m_stop)
+    {
+        if (!m_handler(signum))
+        {
+            // as if nobody was handling it
+            std::signal(SIGINT, SIG_DFL);
+            pthread_sigmask(SIG_UNBLOCK, &sigint, nullptr);
+            std::raise(SIGINT);
+        }
+    }
 }
 
-
 /*
  * *****************************************************************************
  *
@@ -118,6 +99,21 @@ void SigIntHandler::static_signalHandler(int signum)
 const std::string Console::CONSOLE_PROMPT = "(riscvdb) ";
 
 Console::Console(SimHost& simHost)
+: m_sigint([&simHost](int signum)
+  {
+      if (signum != SIGINT || simHost.GetState() != SimHost::RUNNING)
+      {
+          return false;
+      }
+
+      // user hit Ctrl-C before program finished
+      std::cout << std::endl;
+      std::cout << "user interrupted" << std::endl;
+
+      // the command waiting on the target returns once it has stopped
+      simHost.Pause();
+      return true;
+  })
 {
     // Console/app commands
     addCmd(std::make_shared<CmdHelp>(*this));
@@ -10,8 +10,9 @@
 
 namespace riscvdb {
 
-FileLoader::FileLoader(const std::string& pathStr)
-: m_pathStr(pathStr)
+FileLoader::FileLoader(const std::string& pathStr, std::ostream& log)
+: m_pathStr(pathStr),
+  m_log(log)
 {
     // empty
 }
@@ -50,8 +51,8 @@ const std::string& FileLoader::PathStr() const
 
 const std::string ElfFileLoader::EXT = ".elf";
 
-ElfFileLoader::ElfFileLoader(const std::string& path)
-: FileLoader(path)
+ElfFileLoader::ElfFileLoader(const std::string& path, std::ostream& log)
+: FileLoader(path, log)
 {
     LoadFile(path);
     LoadHeader();
@@ -117,21 +118,21 @@ void ElfFileLoader::LoadHeader()
 
 void ElfFileLoader::LoadProgramHeaders(MemoryMap& mem)
 {
-    std::cout << "Found program headers:" << std::endl;
-    std::cout << "  ";
-    std::cout << std::setw(4) << std::setfill(' ') << std::left << "Num";
-    std::cout << std::setw(8) << std::setfill(' ') << std::left << "Type";
-    std::cout << std::setw(11) << std::setfill(' ') << std::left << "VirtAddr";
-    std::cout << std::setw(11) << std::setfill(' ') << std::left << "MemSiz";
-    std::cout << std::endl;
+    m_log << "Found program headers:" << std::endl;
+    m_log << "  ";
+    m_log << std::setw(4) << std::setfill(' ') << std::left << "Num";
+    m_log << std::setw(8) << std::setfill(' ') << std::left << "Type";
+    m_log << std::setw(11) << std::setfill(' ') << std::left << "VirtAddr";
+    m_log << std::setw(11) << std::setfill(' ') << std::left << "MemSiz";
+    m_log << std::endl;
 
     MemoryMap::AddrType loadedSize = 0;
 
     Elf32_Off offset = m_header.e_phoff;
     for (Elf32_Half i = 0; i < m_header.e_phnum; ++i)
     {
-        std::cout << "  ";
-        std::cout << std::setw(4) << std::setfill(' ') << std::left << i;
+        m_log << "  ";
+        m_log << std::setw(4) << std::setfill(' ') << std::left << i;
 
         Elf32_Phdr progHdr;
         std::memcpy(&progHdr, m_filebytes.data() + offset,
@@ -141,18 +142,18 @@ void ElfFileLoader::LoadProgramHeaders(MemoryMap& mem)
 
         if (progHdr.p_type == PT_LOAD)
         {
-            std::cout << std::setw(8) << std::setfill(' ') << std::left;
-            std::cout << "LOAD";
+            m_log << std::setw(8) << std::setfill(' ') << std::left;
+            m_log << "LOAD";
 
-            std::cout << "0x";
-            std::cout << std::hex << std::setw(8) << std::right << std::setfill('0');
-            std::cout << progHdr.p_paddr;
-            std::cout << " ";
+            m_log << "0x";
+            m_log << std::hex << std::setw(8) << std::right << std::setfill('0');
+            m_log << progHdr.p_paddr;
+            m_log << " ";
 
-            std::cout << "0x";
-            std::cout << std::hex << std::setw(8) << std::right << std::setfill('0');
-            std::cout << progHdr.p_memsz;
-            std::cout << std::endl;
+            m_log << "0x";
+            m_log << std::hex << std::setw(8) << std::right << std::setfill('0');
+            m_log << progHdr.p_memsz;
+            m_log << std::endl;
 
             loadedSize += progHdr.p_memsz;
 
@@ -166,13 +167,13 @@ void ElfFileLoader::LoadProgramHeaders(MemoryMap& mem)
         }
         else
         {
-            std::cout << "(unused)" << std::endl;
+            m_log << "(unused)" << std::endl;
         }
     }
 
-    std::cout << std::dec;
-    std::cout << "Loaded " << loadedSize << " bytes into memory" << std::endl;
-    std::cout << std::endl;
+    m_log << std::dec;
+    m_log << "Loaded " << loadedSize << " bytes into memory" << std::endl;
+    m_log << std::endl;
 }
 
 void ElfFileLoader::LoadSymbols(SimHost& simHost)
@@ -192,19 +193,19 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
     std::memset(&symTableHdr, 0, sizeof(symTableHdr));
 
 
-    std::cout << "Found sections:" << std::endl;
-    std::cout << "  ";
-    std::cout << std::setw(4) << std::setfill(' ') << std::left << "Num";
-    std::cout << std::setw(18) << std::setfill(' ') << std::left << "Name";
-    std::cout << std::setw(18) << std::setfill(' ') << std::left << "Type";
-    std::cout << std::setw(11) << std::setfill(' ') << std::left << "Off";
-    std::cout << std::endl;
+    m_log << "Found sections:" << std::endl;
+    m_log << "  ";
+    m_log << std::setw(4) << std::setfill(' ') << std::left << "Num";
+    m_log << std::setw(18) << std::setfill(' ') << std::left << "Name";
+    m_log << std::setw(18) << std::setfill(' ') << std::left << "Type";
+    m_log << std::setw(11) << std::setfill(' ') << std::left << "Off";
+    m_log << std::endl;
 
     Elf32_Off offset = m_header.e_shoff;
     for (Elf32_Half i = 0; i < m_header.e_shnum; ++i)
     {
-        std::cout << "  ";
-        std::cout << std::setw(4) << std::setfill(' ') << std::left << i;
+        m_log << "  ";
+        m_log << std::setw(4) << std::setfill(' ') << std::left << i;
 
         Elf32_Shdr sectionHdr;
         std::memcpy(&sectionHdr, m_filebytes.data() + offset,
@@ -220,21 +221,21 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
         {
             name_ss << static_cast<char>(c);
         }
-        std::cout << std::setw(18) << std::setfill(' ') << std::left;
-        std::cout << name_ss.str();
+        m_log << std::setw(18) << std::setfill(' ') << std::left;
+        m_log << name_ss.str();
 
-        std::cout << std::setw(18) << std::setfill(' ') << std::left;
+        m_log << std::setw(18) << std::setfill(' ') << std::left;
         switch (sectionHdr.sh_type)
         {
             case SHT_STRTAB:
             {
                 if (i == m_header.e_shstrndx)
                 {
-                    std::cout << "STRTAB (shstrtab)";
+                    m_log << "STRTAB (shstrtab)";
                 }
                 else
                 {
-                    std::cout << "STRTAB";
+                    m_log << "STRTAB";
                     if (strTableFound)
                     {
                         throw std::runtime_error("multiple string tables in ELF");
@@ -248,7 +249,7 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
 
             case SHT_SYMTAB:
             {
-                std::cout << "SYMTAB";
+                m_log << "SYMTAB";
 
                 if (symTableFound)
                 {
@@ -261,38 +262,38 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
             }
 
             default:
-                std::cout << "(other)";
+                m_log << "(other)";
         }
 
-        std::cout << "0x";
-        std::cout << std::setw(8) << std::setfill('0') << std::right;
-        std::cout << sectionHdr.sh_offset;
-        std::cout << std::endl;
+        m_log << "0x";
+        m_log << std::setw(8) << std::setfill('0') << std::right;
+        m_log << sectionHdr.sh_offset;
+        m_log << std::endl;
     }
 
     // TODO dynamic sections
 
     if (symTableFound && strTableFound)
     {
-        std::cout << std::endl;
-        std::cout << "Found symbols: " << std::endl;
-        std::cout << "  ";
-        std::cout << std::setw(4) << std::setfill(' ') << std::left << "Num";
-        std::cout << std::setw(11) << std::setfill(' ') << std::left << "Value";
-        std::cout << std::setw(8) << std::setfill(' ') << std::left << "Type";
-        std::cout << std::setw(11) << std::setfill(' ') << std::left << "Bind";
-        std::cout << std::setw(11) << std::setfill(' ') << std::left << "Name";
-        std::cout << std::endl;
+        m_log << std::endl;
+        m_log << "Found symbols: " << std::endl;
+        m_log << "  ";
+        m_log << std::setw(4) << std::setfill(' ') << std::left << "Num";
+        m_log << std::setw(11) << std::setfill(' ') << std::left << "Value";
+        m_log << std::setw(8) << std::setfill(' ') << std::left << "Type";
+        m_log << std::setw(11) << std::setfill(' ') << std::left << "Bind";
+        m_log << std::setw(11) << std::setfill(' ') << std::left << "Name";
+        m_log << std::endl;
 
         // read symbol table
         Elf32_Word numSymbols = symTableHdr.sh_size / symTableHdr.sh_entsize;
         Elf32_Off symTableOffset = symTableHdr.sh_offset;
         for (Elf32_Word i = 0; i < numSymbols; ++i)
         {
-            std::cout << "  ";
-            std::cout << std::setw(4) << std::setfill(' ') << std::left;
-            std::cout << std::dec;
-            std::cout << i;
+            m_log << "  ";
+            m_log << std::setw(4) << std::setfill(' ') << std::left;
+            m_log << std::dec;
+            m_log << i;
 
             Elf32_Sym symbol;
             std::memcpy(&symbol, m_filebytes.data() + symTableOffset,
@@ -304,57 +305,57 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
             SimHost::Symbol symbolLoad;
 
             // symbol value:
-            std::cout << "0x";
-            std::cout << std::setw(8) << std::setfill('0') << std::right;
-            std::cout << std::hex << symbol.st_value;
-            std::cout << " ";
+            m_log << "0x";
+            m_log << std::setw(8) << std::setfill('0') << std::right;
+            m_log << std::hex << symbol.st_value;
+            m_log << " ";
             symbolLoad.addr = symbol.st_value;
 
-            std::cout << std::setw(8) << std::setfill(' ') << std::left;
+            m_log << std::setw(8) << std::setfill(' ') << std::left;
             switch (ELF32_ST_BIND(symbol.st_info))
             {
                 case STB_LOCAL:
-                    std::cout << "LOCAL";
+                    m_log << "LOCAL";
                     break;
                 case STB_GLOBAL:
-                    std::cout << "GLOBAL";
+                    m_log << "GLOBAL";
                     break;
                 case STB_WEAK:
-                    std::cout << "WEAK";
+                    m_log << "WEAK";
                     break;
                 default:
-                    std::cout << "unknown";
+                    m_log << "unknown";
             }
 
-            std::cout << std::setw(11) << std::setfill(' ') << std::left;
+            m_log << std::setw(11) << std::setfill(' ') << std::left;
             switch (ELF32_ST_TYPE(symbol.st_info))
             {
                 case STT_NOTYPE:
-                    std::cout << "NOTYPE";
+                    m_log << "NOTYPE";
                     symbolLoad.type = SimHost::SymbolType::NOTYPE;
                     break;
                 case STT_OBJECT:
-                    std::cout << "OBJECT";
+                    m_log << "OBJECT";
                     symbolLoad.type = SimHost::SymbolType::OBJECT;
                     break;
                 case STT_FUNC:
-                    std::cout << "FUNC";
+                    m_log << "FUNC";
                     symbolLoad.type = SimHost::SymbolType::FUNC;
                     break;
                 case STT_SECTION:
-                    std::cout << "SECTION";
+                    m_log << "SECTION";
                     symbolLoad.type = SimHost::SymbolType::SECTION;
                     break;
                 case STT_COMMON:
-                    std::cout << "COMMON";
+                    m_log << "COMMON";
                     symbolLoad.type = SimHost::SymbolType::COMMON;
                     break;
                 case STT_TLS:
-                    std::cout << "TLS";
+                    m_log << "TLS";
                     symbolLoad.type = SimHost::SymbolType::TLS;
                     break;
                 default:
-                    std::cout << "unknown";
+                    m_log << "unknown";
                     symbolLoad.type = SimHost::SymbolType::UNKNOWN;
             }
 
@@ -367,8 +368,8 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
                 name_ss << static_cast<char>(c);
             }
 
-            std::cout << std::setw(11) << std::setfill(' ') << std::left;
-            std::cout << name_ss.str();
+            m_log << std::setw(11) << std::setfill(' ') << std::left;
+            m_log << name_ss.str();
 
             // insert into sim's symbol table
             if (!name_ss.str().empty())
@@ -376,12 +377,12 @@ void ElfFileLoader::LoadSymbols(SimHost& simHost)
                 simHost.SymbolMap().insert(std::make_pair(name_ss.str(), symbolLoad));
             }
 
-            std::cout << std::endl;
+            m_log << std::endl;
         }
 
-        std::cout << std::dec;
-        std::cout << "Loaded " << simHost.SymbolMap().size();
-        std::cout << " symbols" << std::endl;
+        m_log << std::dec;
+        m_log << "Loaded " << simHost.SymbolMap().size();
+        m_log << " symbols" << std::endl;
     }
 }
 
@@ -1,18 +1,153 @@
 #include <iostream>
+#include <iomanip>
 #include <filesystem>
+#include <chrono>
+#include <glob.h>
 #include "cxxopts.hpp"
 #include "console.h"
 #include "simhost.h"
+#include "batchrunner.h"
+
+namespace
+{
+
+// Expands any wildcards left in the file names (e.g. if quoted), so that
+// batch runs can be given more files than fit on a command line
+bool expandGlobs(const std::vector<std::string>& patterns, std::vector<std::string>& paths)
+{
+    for (const std::string& pattern : patterns)
+    {
+        if (pattern.find_first_of("*?[") == std::string::npos)
+        {
+            paths.push_back(pattern);
+            continue;
+        }
+
+        glob_t matches;
+        if (glob(pattern.c_str(), 0, nullptr, &matches) != 0)
+        {
+            std::cerr << "error: no files match " << pattern << std::endl;
+            globfree(&matches);
+            return false;
+        }
+        paths.insert(paths.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+        globfree(&matches);
+    }
+    return true;
+}
+
+// The --harts, --quantum and --lockstep options
+void getHarts(const cxxopts::ParseResult& result, unsigned int& count,
+              riscvdb::SimHost::HartSync& sync, unsigned long& quantum)
+{
+    count = result["harts"].as<unsigned int>();
+    sync = result.count("lockstep") ? riscvdb::SimHost::HART_SYNC_LOCKSTEP : riscvdb::SimHost::HART_SYNC_QUANTUM;
+    quantum = result["quantum"].as<unsigned long>();
+}
+
+// Runs executables to completion without the console. A single run exits
+// with the program's exit code (the argument to _exit, in a0), several
+// exit with 0 only if they all did.
+int runBatch(const cxxopts::ParseResult& result, const riscvdb::MemoryMap::Backend memBackend)
+{
+    std::vector<std::string> paths;
+    if (!expandGlobs(result["executable"].as<std::vector<std::string>>(), paths))
+    {
+        return -1;
+    }
+
+    std::vector<riscvdb::BatchRunner::Job> jobs;
+    unsigned long seeds = result["seeds"].as<unsigned long>();
+    for (const std::string& path : paths)
+    {
+        riscvdb::BatchRunner::Job job;
+        job.path = path;
+        if (seeds == 0)
+        {
+            jobs.push_back(job);
+        }
+        for (unsigned long seed = 0; seed < seeds; ++seed)
+        {
+            job.seeded = true;
+            job.seed = static_cast<uint32_t>(seed);
+            jobs.push_back(job);
+        }
+    }
+
+    riscvdb::BatchRunner runner(memBackend, !result.count("single-step"),
+                                result["max-instructions"].as<unsigned long>());
+    unsigned int harts;
+    riscvdb::SimHost::HartSync sync;
+    unsigned long quantum;
+    getHarts(result, harts, sync, quantum);
+    runner.SetHarts(harts, sync, quantum);
+    if (result.count("uart-input"))
+    {
+        runner.SetUartInput(result["uart-input"].as<std::string>());
+    }
+    runner.SetSyscalls(result.count("syscalls") > 0);
+    if (result.count("disk"))
+    {
+        runner.SetBlockImage(result["disk"].as<std::string>());
+    }
+
+    if (jobs.size() == 1)
+    {
+        riscvdb::BatchRunner::Result run = runner.RunJob(jobs[0], std::cout, std::cerr);
+        if (run.exitCode == riscvdb::BatchRunner::EXIT_LOAD_FAILED)
+        {
+            return run.exitCode;
+        }
+
+        // on stderr, to keep it apart from anything the program prints
+        double mips = run.seconds > 0 ? run.instructions / run.seconds / 1e6 : 0;
+        std::cerr << std::dec << run.instructions << " instructions, ";
+        std::cerr << std::fixed << std::setprecision(3) << run.seconds << " s, ";
+        std::cerr << std::setprecision(1) << mips << " MIPS" << std::endl;
+        return run.exitCode;
+    }
+
+    unsigned int numThreads = riscvdb::BatchRunner::ThreadCount(result["jobs"].as<unsigned int>(), jobs.size());
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<riscvdb::BatchRunner::Result> results = runner.RunJobs(jobs, numThreads);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    unsigned int failed = riscvdb::BatchRunner::PrintReport(std::cout, jobs, results, seconds, numThreads);
+    return failed == 0 ? 0 : 1;
+}
+
+} // namespace
 
 int main(int argc, char* argv[])
 {
     cxxopts::Options options("riscvdb", "RISC V simulator and debugger");
     options.add_options()
-        ("executable", "The RISC V binary to execute", cxxopts::value<std::string>())
+        ("executable", "The RISC V binary to execute (or binaries, with --batch)",
+         cxxopts::value<std::vector<std::string>>())
         ("x,script", "Execute script from file", cxxopts::value<std::string>())
+        ("s,single-step", "Execute one instruction at a time instead of in basic blocks")
+        ("block-memory", "Store RAM in 4KiB blocks instead of one large reservation")
+        ("batch", "Run the executables to _exit without the console, and exit with their exit code")
+        ("n,max-instructions", "Stop a --batch run after this many instructions",
+         cxxopts::value<unsigned long>()->default_value("0"))
+        ("seeds", "Run each executable this many times, with seeds 0 to N-1 in riscvdb_seed",
+         cxxopts::value<unsigned long>()->default_value("0"))
+        ("j,jobs", "Number of --batch runs at once (defaults to the number of host cores)",
+         cxxopts::value<unsigned int>()->default_value("0"))
+        ("harts", "Number of harts (processors) sharing the memory",
+         cxxopts::value<unsigned int>()->default_value("1"))
+        ("quantum", "Instructions each hart runs before waiting for the others",
+         cxxopts::value<unsigned long>()->default_value(std::to_string(riscvdb::SimHost::DEFAULT_QUANTUM)))
+        ("lockstep", "Run the harts in turn on one thread, so that runs are repeatable")
+        ("uart-input", "Feed the contents of this file to the UART's receiver", cxxopts::value<std::string>())
+        ("uart-pty", "Connect the UART to a new pseudo terminal instead of stdout")
+        ("syscalls", "Do newlib's system calls (ecall) on the host, for printf and files")
+        ("disk", "Use this image file as the block device's disk", cxxopts::value<std::string>())
+        ("disk-snapshot", "Keep writes to the disk in memory instead of writing them to the image (always with --batch)")
         ("h,help", "Print usage");
     options.parse_positional({"executable"});
-    options.positional_help("riscv_binary_file");
+    options.positional_help("riscv_binary_file...");
 
     cxxopts::ParseResult result;
     try
@@ -31,12 +166,82 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    riscvdb::SimHost simHost;
+    if (result["harts"].as<unsigned int>() == 0)
+    {
+        std::cerr << "error: there must be at least one hart" << std::endl;
+        return -1;
+    }
+
+    riscvdb::MemoryMap::Backend memBackend = result.count("block-memory") ? riscvdb::MemoryMap::BACKEND_BLOCKS
+                                                                           : riscvdb::MemoryMap::BACKEND_FLAT;
+
+    if (result.count("batch"))
+    {
+        if (!result.count("executable") || result.count("script"))
+        {
+            std::cerr << "error: --batch needs an executable, and can't run a script" << std::endl;
+            return -1;
+        }
+        if (result.count("uart-pty"))
+        {
+            std::cerr << "error: --uart-pty can't be used with --batch" << std::endl;
+            return -1;
+        }
+        return runBatch(result, memBackend);
+    }
+
+    riscvdb::SimHost simHost(memBackend);
+    if (result.count("single-step"))
+    {
+        simHost.SetBlockExecution(false);
+    }
+    unsigned int harts;
+    riscvdb::SimHost::HartSync sync;
+    unsigned long quantum;
+    getHarts(result, harts, sync, quantum);
+    simHost.SetHarts(harts, sync, quantum);
+    simHost.SetSyscalls(result.count("syscalls") > 0);
+
+    if (result.count("uart-pty"))
+    {
+        std::string pty = simHost.SerialPort().OpenPty();
+        if (pty.empty())
+        {
+            std::cerr << "error: can't make a pseudo terminal for the UART" << std::endl;
+            return -1;
+        }
+        std::cout << "UART connected to " << pty << std::endl;
+    }
+    else if (result.count("uart-input"))
+    {
+        std::string path = result["uart-input"].as<std::string>();
+        if (simHost.SerialPort().OpenInput(path) != 0)
+        {
+            std::cerr << "error: can't open UART input " << path << std::endl;
+            return -1;
+        }
+    }
+
+    if (result.count("disk"))
+    {
+        std::string path = result["disk"].as<std::string>();
+        if (simHost.Disk().Open(path, result.count("disk-snapshot") > 0) != 0)
+        {
+            std::cerr << "error: can't open disk image " << path << std::endl;
+            return -1;
+        }
+    }
 
     if (result.count("executable"))
     {
-        std::string pathStr = result["executable"].as<std::string>();
-        int ret = simHost.LoadFile(pathStr);
+        std::vector<std::string> paths = result["executable"].as<std::vector<std::string>>();
+        if (paths.size() > 1)
+        {
+            std::cerr << "error: only one executable can be debugged at a time" << std::endl;
+            return -1;
+        }
+
+        int ret = simHost.LoadFile(paths[0]);
         if (ret != 0)
         {
             return ret;
@@ -1,19 +1,132 @@
 #include "memorymap.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <iterator>
 
 namespace riscvdb {
 
-MemoryMap::MemoryMap(const AddrType memAddrStart, const AddrType memSize)
+MemoryMap::MemoryMap(const AddrType memAddrStart, const AddrType memSize, const Backend backend)
 : m_addrLower(memAddrStart),
   m_addrUpper(memAddrStart + memSize),
-  m_memSize(memSize)
+  m_memSize(memSize),
+  m_ramUpper(memAddrStart + memSize),
+  m_devicesEnd(memAddrStart),
+  m_flat(nullptr),
+  m_flatSize(0),
+  m_codePages(memSize / CODE_PAGE_SIZE + 1),
+  m_writtenPages(memSize / CODE_PAGE_SIZE + 1),
+  m_codeWriteHandlerCount(0)
 {
+    if (backend == BACKEND_FLAT)
+    {
+        // [m_addrLower, m_addrUpper] is inclusive
+        AddrType pageSize = static_cast<AddrType>(sysconf(_SC_PAGESIZE));
+        AddrType size = (memSize + 1 + pageSize - 1) / pageSize * pageSize;
+
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem != MAP_FAILED)
+        {
+            m_flat = static_cast<std::byte*>(mem);
+            m_flatSize = size;
+        }
+    }
+
+    if (m_flat == nullptr)
+    {
+        AddrType numBlocks = m_addrUpper / DEFAULT_BLOCK_SIZE - m_addrLower / DEFAULT_BLOCK_SIZE + 1;
+        m_blockDirectory.resize((numBlocks + BLOCK_TABLE_SIZE - 1) / BLOCK_TABLE_SIZE);
+    }
+}
+
+MemoryMap::~MemoryMap()
+{
+    if (m_flat != nullptr)
+    {
+        munmap(m_flat, m_flatSize);
+    }
+}
+
+MemoryMap::Backend MemoryMap::GetBackend() const
+{
+    return m_flat != nullptr ? BACKEND_FLAT : BACKEND_BLOCKS;
+}
+
+MemoryMap::MemBlockType* MemoryMap::FindBlock(const AddrType baseAddress, const bool allocate, BlockCache& cache)
+{
+    BlockCache::Entry& entry = cache.entries[baseAddress % BLOCK_CACHE_SIZE];
+    if (entry.baseAddress == baseAddress)
+    {
+        cache.hits++;
+        return entry.block;
+    }
+    cache.misses++;
+
+    // blocks that were never written are not cached, as the entry would go
+    // stale once they are
+    AddrType index = baseAddress - m_addrLower / DEFAULT_BLOCK_SIZE;
+    std::unique_ptr<BlockTable>& table = m_blockDirectory[index / BLOCK_TABLE_SIZE];
+    if (!table)
+    {
+        if (!allocate)
+        {
+            return nullptr;
+        }
+        table = std::make_unique<BlockTable>();
+    }
+
+    std::unique_ptr<MemBlockType>& block = (*table)[index % BLOCK_TABLE_SIZE];
+    if (!block)
+    {
+        if (!allocate)
+        {
+            return nullptr;
+        }
+        block = std::make_unique<MemBlockType>();
+    }
+
+    entry.baseAddress = baseAddress;
+    entry.block = block.get();
+    return block.get();
+}
+
+MemoryMap::Device* MemoryMap::FindDevice(const AddrType address, const AddrType size, bool& touched)
+{
+    // the last device starting at or below the address, and the one after it
+    auto next = m_devices.upper_bound(address);
+    Device* holding = nullptr;
+    if (next != m_devices.begin())
+    {
+        Device& device = std::prev(next)->second;
+        if (address - device.base < device.size)
+        {
+            holding = &device;
+        }
+    }
 
+    bool straddles = holding != nullptr ? address + size > holding->base + holding->size
+                                        : next != m_devices.end() && address + size > next->first;
+    touched = holding != nullptr || straddles;
+    return straddles ? nullptr : holding;
 }
 
 void MemoryMap::Put(const AddrType address, const std::byte& data)
 {
+    if (address >= m_ramUpper)
+    {
+        bool touched;
+        Device* device = FindDevice(address, 1, touched);
+        if (device != nullptr)
+        {
+            device->write(address - device->base, 1, static_cast<uint64_t>(data));
+            return;
+        }
+    }
+
     if (address < m_addrLower || address > m_addrUpper)
     {
         std::stringstream ss;
@@ -22,18 +135,16 @@ void MemoryMap::Put(const AddrType address, const std::byte& data)
         throw std::out_of_range(ss.str());
     }
 
-    AddrType baseAddress = address / DEFAULT_BLOCK_SIZE;
-    AddrType offset = address % DEFAULT_BLOCK_SIZE;
-
-    std::unordered_map<AddrType, std::unique_ptr<MemBlockType>>::iterator it;
-    it = m_mem.find(baseAddress);
-    if (it == m_mem.end())
+    if (m_flat != nullptr)
+    {
+        m_flat[address - m_addrLower] = data;
+    }
+    else
     {
-        std::unique_ptr<MemBlockType> newBlock = std::make_unique<MemBlockType>();
-        m_mem[baseAddress] = std::move(newBlock);
+        (*FindBlock(address / DEFAULT_BLOCK_SIZE, true, m_dataCache))[address % DEFAULT_BLOCK_SIZE] = data;
     }
 
-    m_mem[baseAddress].get()->at(offset) = data;
+    NoteWrite(address, 1);
 }
 
 void MemoryMap::Put(const AddrType address, const std::vector<std::byte>& data)
@@ -48,6 +159,28 @@ void MemoryMap::Put(const AddrType address, const std::vector<std::byte>& data)
         throw std::out_of_range(ss.str());
     }
 
+    bool touched = false;
+    if (address + data.size() > m_ramUpper)
+    {
+        FindDevice(std::max(address, m_ramUpper), address + data.size() - std::max(address, m_ramUpper), touched);
+    }
+    if (touched)
+    {
+        // some of it is for devices, which take it a byte at a time
+        for (AddrType i = 0; i < data.size(); ++i)
+        {
+            Put(address + i, data[i]);
+        }
+        return;
+    }
+
+    if (m_flat != nullptr)
+    {
+        std::copy(data.begin(), data.end(), m_flat + (address - m_addrLower));
+        NoteWrite(address, data.size());
+        return;
+    }
+
     AddrType i = 0;  // indexes `address`
     AddrType currentAddr = address;  // raw physical address to be storing in
     AddrType bytesRemaining = data.size();
@@ -57,26 +190,31 @@ void MemoryMap::Put(const AddrType address, const std::vector<std::byte>& data)
         AddrType offset = currentAddr % DEFAULT_BLOCK_SIZE;
         AddrType bytesToCopy = std::min(DEFAULT_BLOCK_SIZE - offset, bytesRemaining);
 
-        std::unordered_map<AddrType, std::unique_ptr<MemBlockType>>::iterator it;
-        it = m_mem.find(baseAddress);
-        if (it == m_mem.end())
-        {
-            std::unique_ptr<MemBlockType> newBlock = std::make_unique<MemBlockType>();
-            m_mem[baseAddress] = std::move(newBlock);
-        }
-
         std::copy(data.begin() + i,
                   data.begin() + i + bytesToCopy,
-                  m_mem[baseAddress].get()->begin() + offset);
+                  FindBlock(baseAddress, true, m_dataCache)->begin() + offset);
 
         i += bytesToCopy;
         currentAddr += bytesToCopy;
         bytesRemaining -= bytesToCopy;
     }
+
+    NoteWrite(address, data.size());
 }
 
 void MemoryMap::Get(const AddrType address, std::byte& data_out)
 {
+    if (address >= m_ramUpper)
+    {
+        bool touched;
+        Device* device = FindDevice(address, 1, touched);
+        if (device != nullptr)
+        {
+            data_out = static_cast<std::byte>(device->read(address - device->base, 1));
+            return;
+        }
+    }
+
     if (address < m_addrLower || address > m_addrUpper)
     {
         std::stringstream ss;
@@ -86,56 +224,512 @@ void MemoryMap::Get(const AddrType address, std::byte& data_out)
         throw std::out_of_range(ss.str());
     }
 
-    AddrType baseAddress = address / DEFAULT_BLOCK_SIZE;
-    AddrType offset = address % DEFAULT_BLOCK_SIZE;
+    if (m_flat != nullptr)
+    {
+        data_out = m_flat[address - m_addrLower];
+        return;
+    }
+
+    // memory that was never written reads as zero, without allocating a block
+    MemBlockType* block = FindBlock(address / DEFAULT_BLOCK_SIZE, false, m_dataCache);
+    data_out = block != nullptr ? (*block)[address % DEFAULT_BLOCK_SIZE] : std::byte{0};
+}
 
-    std::unordered_map<AddrType, std::unique_ptr<MemBlockType>>::iterator it;
-    it = m_mem.find(baseAddress);
-    if (it == m_mem.end())
+template <typename T>
+T MemoryMap::Read(const AddrType address, BlockCache& cache)
+{
+    const std::byte* p = nullptr;
+    bool ram = address >= m_addrLower && address + sizeof(T) <= m_ramUpper;
+    if (!ram && address >= m_devicesEnd)
+    {
+        ram = address + sizeof(T) <= m_addrUpper;  // RAM above the devices
+    }
+    else if (!ram && address >= m_ramUpper)
     {
-        std::unique_ptr<MemBlockType> newBlock = std::make_unique<MemBlockType>();
-        m_mem[baseAddress] = std::move(newBlock);
+        bool touched;
+        Device* device = FindDevice(address, sizeof(T), touched);
+        if (device != nullptr)
+        {
+            return static_cast<T>(device->read(address - device->base, sizeof(T)));
+        }
+        ram = !touched && address + sizeof(T) <= m_addrUpper;  // RAM between devices
+    }
+
+    if (ram)
+    {
+        if (m_flat != nullptr)
+        {
+            p = m_flat + (address - m_addrLower);
+        }
+        else if (address % DEFAULT_BLOCK_SIZE + sizeof(T) <= DEFAULT_BLOCK_SIZE)
+        {
+            MemBlockType* block = FindBlock(address / DEFAULT_BLOCK_SIZE, false, cache);
+            if (block == nullptr)
+            {
+                return 0;
+            }
+            p = block->data() + address % DEFAULT_BLOCK_SIZE;
+        }
     }
 
-    data_out = m_mem[baseAddress].get()->at(offset);
+    T ret = 0;
+    for (unsigned int i = 0; i < sizeof(T); ++i)
+    {
+        std::byte b;
+        if (p != nullptr)
+        {
+            b = p[i];
+        }
+        else
+        {
+            // out of range, or straddling blocks
+            Get(address + i, b);
+        }
+        ret |= static_cast<T>(b) << (8 * i);
+    }
+    return ret;
+}
+
+template <typename T>
+void MemoryMap::Write(const AddrType address, const T data)
+{
+    std::byte* p = nullptr;
+    bool ram = address >= m_addrLower && address + sizeof(T) <= m_ramUpper;
+    if (!ram && address >= m_devicesEnd)
+    {
+        ram = address + sizeof(T) <= m_addrUpper;  // RAM above the devices
+    }
+    else if (!ram && address >= m_ramUpper)
+    {
+        bool touched;
+        Device* device = FindDevice(address, sizeof(T), touched);
+        if (device != nullptr)
+        {
+            device->write(address - device->base, sizeof(T), static_cast<uint64_t>(data));
+            return;
+        }
+        ram = !touched && address + sizeof(T) <= m_addrUpper;  // RAM between devices
+    }
+
+    if (ram)
+    {
+        if (m_flat != nullptr)
+        {
+            p = m_flat + (address - m_addrLower);
+        }
+        else if (address % DEFAULT_BLOCK_SIZE + sizeof(T) <= DEFAULT_BLOCK_SIZE)
+        {
+            p = FindBlock(address / DEFAULT_BLOCK_SIZE, true, m_dataCache)->data() + address % DEFAULT_BLOCK_SIZE;
+        }
+    }
+
+    if (p == nullptr)
+    {
+        // out of range, or straddling blocks
+        std::vector<std::byte> encoding(sizeof(T));
+        for (unsigned int i = 0; i < sizeof(T); ++i)
+        {
+            encoding[i] = static_cast<std::byte>((data >> (8 * i)) & 0xFF);
+        }
+        Put(address, encoding);
+        return;
+    }
+
+    for (unsigned int i = 0; i < sizeof(T); ++i)
+    {
+        p[i] = static_cast<std::byte>((data >> (8 * i)) & 0xFF);
+    }
+    NoteWrite(address, sizeof(T));
+}
+
+uint8_t MemoryMap::ReadByte(const AddrType address)
+{
+    return Read<uint8_t>(address, m_dataCache);
+}
+
+uint16_t MemoryMap::ReadHalfword(const AddrType address)
+{
+    return Read<uint16_t>(address, m_dataCache);
 }
 
 uint32_t MemoryMap::ReadWord(const AddrType address)
 {
-    // the MemoryMap is byte addressed
-    std::array<std::byte, 4> word;
+    return Read<uint32_t>(address, m_dataCache);
+}
+
+uint64_t MemoryMap::ReadDoubleword(const AddrType address)
+{
+    return Read<uint64_t>(address, m_dataCache);
+}
 
-    Get(address + 0, word.at(0));
-    Get(address + 1, word.at(1));
-    Get(address + 2, word.at(2));
-    Get(address + 3, word.at(3));
+uint32_t MemoryMap::FetchWord(const AddrType address)
+{
+    return Read<uint32_t>(address, m_fetchCache);
+}
 
-    uint32_t ret = 0;
-    ret |= static_cast<uint32_t>(word[0]) << 0;
-    ret |= static_cast<uint32_t>(word[1]) << 8;
-    ret |= static_cast<uint32_t>(word[2]) << 16;
-    ret |= static_cast<uint32_t>(word[3]) << 24;
+void MemoryMap::WriteByte(const AddrType address, const uint8_t data)
+{
+    Write<uint8_t>(address, data);
+}
 
-    return ret;
+void MemoryMap::WriteHalfword(const AddrType address, const uint16_t data)
+{
+    Write<uint16_t>(address, data);
 }
 
 void MemoryMap::WriteWord(const AddrType address, uint32_t data, uint32_t mask)
 {
-    uint32_t original = ReadWord(address);
-    uint32_t new_val = (original & ~mask) | (data & mask);
+    if (mask != 0xFFFFFFFF)
+    {
+        uint32_t original = ReadWord(address);
+        data = (original & ~mask) | (data & mask);
+    }
 
-    std::vector<std::byte> encoding(4);
-    encoding[0] = static_cast<std::byte>((new_val >> 0) & 0xFF);
-    encoding[1] = static_cast<std::byte>((new_val >> 8) & 0xFF);
-    encoding[2] = static_cast<std::byte>((new_val >> 16) & 0xFF);
-    encoding[3] = static_cast<std::byte>((new_val >> 24) & 0xFF);
+    Write<uint32_t>(address, data);
+}
 
-    Put(address, encoding);
+void MemoryMap::WriteDoubleword(const AddrType address, const uint64_t data)
+{
+    Write<uint64_t>(address, data);
+}
+
+uint32_t* MemoryMap::WordStorage(const AddrType address)
+{
+    if (address < m_addrLower || address + 4 > m_addrUpper || address % 4 != 0)
+    {
+        std::stringstream ss;
+        ss << "word at address " << address << " is unaligned or outside of range ";
+        ss << "[" << m_addrLower << ", " << m_addrUpper << "]";
+        throw std::out_of_range(ss.str());
+    }
+
+    // an aligned word never straddles blocks, and the host is little endian
+    // like the guest, so the storage can be used as it is
+    std::byte* p = m_flat != nullptr ? m_flat + (address - m_addrLower)
+                                     : FindBlock(address / DEFAULT_BLOCK_SIZE, true, m_dataCache)->data() +
+                                       address % DEFAULT_BLOCK_SIZE;
+    return reinterpret_cast<uint32_t*>(p);
+}
+
+namespace {
+
+uint32_t ApplyAtomicOp(const MemoryMap::AtomicOp op, const uint32_t old, const uint32_t operand)
+{
+    const bool isSigned = op == MemoryMap::ATOMIC_MIN || op == MemoryMap::ATOMIC_MAX;
+    const bool operandLess = isSigned ? static_cast<int32_t>(operand) < static_cast<int32_t>(old)
+                                      : operand < old;
+    switch (op)
+    {
+        case MemoryMap::ATOMIC_SWAP: return operand;
+        case MemoryMap::ATOMIC_ADD:  return old + operand;
+        case MemoryMap::ATOMIC_XOR:  return old ^ operand;
+        case MemoryMap::ATOMIC_AND:  return old & operand;
+        case MemoryMap::ATOMIC_OR:   return old | operand;
+        case MemoryMap::ATOMIC_MIN:
+        case MemoryMap::ATOMIC_MINU: return operandLess ? operand : old;
+        default:                     return operandLess ? old : operand;
+    }
+}
+
+} // namespace
+
+uint32_t MemoryMap::AtomicWord(const AddrType address, const AtomicOp op, const uint32_t operand)
+{
+    if (address >= m_ramUpper)
+    {
+        // a device sees a read then a write
+        bool touched;
+        Device* device = FindDevice(address, 4, touched);
+        if (device != nullptr)
+        {
+            uint32_t old = static_cast<uint32_t>(device->read(address - device->base, 4));
+            device->write(address - device->base, 4, ApplyAtomicOp(op, old, operand));
+            return old;
+        }
+    }
+
+    // std::atomic_ref is C++20, these builtins are what it does
+    uint32_t* word = WordStorage(address);
+    uint32_t old = 0;
+    switch (op)
+    {
+        case ATOMIC_SWAP: old = __atomic_exchange_n(word, operand, __ATOMIC_SEQ_CST); break;
+        case ATOMIC_ADD:  old = __atomic_fetch_add(word, operand, __ATOMIC_SEQ_CST); break;
+        case ATOMIC_XOR:  old = __atomic_fetch_xor(word, operand, __ATOMIC_SEQ_CST); break;
+        case ATOMIC_AND:  old = __atomic_fetch_and(word, operand, __ATOMIC_SEQ_CST); break;
+        case ATOMIC_OR:   old = __atomic_fetch_or(word, operand, __ATOMIC_SEQ_CST); break;
+        default:
+        {
+            // min/max have no host instruction, so compare and swap until
+            // nothing else got in between
+            old = __atomic_load_n(word, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(word, &old, ApplyAtomicOp(op, old, operand), true,
+                                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+            break;
+        }
+    }
+
+    NoteWrite(address, 4);
+    return old;
+}
+
+uint32_t MemoryMap::AtomicLoadWord(const AddrType address)
+{
+    if (address >= m_ramUpper)
+    {
+        bool touched;
+        Device* device = FindDevice(address, 4, touched);
+        if (device != nullptr)
+        {
+            return static_cast<uint32_t>(device->read(address - device->base, 4));
+        }
+    }
+    return __atomic_load_n(WordStorage(address), __ATOMIC_SEQ_CST);
+}
+
+bool MemoryMap::CompareExchangeWord(const AddrType address, const uint32_t expected, const uint32_t desired)
+{
+    if (address >= m_ramUpper)
+    {
+        bool touched;
+        Device* device = FindDevice(address, 4, touched);
+        if (device != nullptr)
+        {
+            if (static_cast<uint32_t>(device->read(address - device->base, 4)) != expected)
+            {
+                return false;
+            }
+            device->write(address - device->base, 4, desired);
+            return true;
+        }
+    }
+
+    uint32_t value = expected;
+    if (!__atomic_compare_exchange_n(WordStorage(address), &value, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        return false;
+    }
+
+    NoteWrite(address, 4);
+    return true;
 }
 
 void MemoryMap::Clear()
 {
-    m_mem.clear();
+    for (std::unique_ptr<BlockTable>& table : m_blockDirectory)
+    {
+        table.reset();
+    }
+    m_fetchCache.entries.fill(BlockCache::Entry());
+    m_dataCache.entries.fill(BlockCache::Entry());
+    if (m_flat != nullptr)
+    {
+        // hand the pages back, they read as zero again afterwards
+        madvise(m_flat, m_flatSize, MADV_DONTNEED);
+    }
+
+    // everything is gone, including any code
+    for (auto& handler : m_codeWriteHandlers)
+    {
+        handler.second(m_addrLower, m_memSize + 1);
+    }
+    for (std::atomic<bool>& codePage : m_codePages)
+    {
+        codePage.store(false, std::memory_order_relaxed);
+    }
+    for (std::atomic<bool>& writtenPage : m_writtenPages)
+    {
+        writtenPage.store(false, std::memory_order_relaxed);
+    }
+}
+
+void MemoryMap::AddDevice(const std::string& name, const AddrType base, const AddrType size,
+                          DeviceRead read, DeviceWrite write)
+{
+    if (size == 0 || base < m_addrLower || base + size - 1 > m_addrUpper || base % 4 != 0 || size % 4 != 0)
+    {
+        std::stringstream ss;
+        ss << std::hex;
+        ss << name << " range [" << base << ", " << base + size - 1 << "] is unaligned or outside of range ";
+        ss << "[" << m_addrLower << ", " << m_addrUpper << "]";
+        throw std::out_of_range(ss.str());
+    }
+
+    bool touched;
+    FindDevice(base, size, touched);
+    if (touched)
+    {
+        std::stringstream ss;
+        ss << std::hex;
+        ss << name << " range [" << base << ", " << base + size - 1 << "] overlaps another device";
+        throw std::invalid_argument(ss.str());
+    }
+
+    m_devices[base] = Device{name, base, size, read, write};
+    m_ramUpper = std::min(m_ramUpper, base);
+    m_devicesEnd = std::max(m_devicesEnd, base + size);
+}
+
+bool MemoryMap::MayTouchDevice(const AddrType address, const AddrType size) const
+{
+    return address + size > m_ramUpper && address < m_devicesEnd;
+}
+
+bool MemoryMap::ForEachSpan(const AddrType address, const AddrType size, const bool forWrite,
+                            const SpanVisitor& visit)
+{
+    if (address < m_addrLower || address + size > m_addrUpper)
+    {
+        return false;
+    }
+    bool touched = false;
+    if (MayTouchDevice(address, size))
+    {
+        AddrType first = std::max(address, m_ramUpper);
+        FindDevice(first, address + size - first, touched);
+    }
+    if (touched)
+    {
+        return false;
+    }
+
+    AddrType done = 0;
+    bool carryOn = true;
+    while (carryOn && done < size)
+    {
+        AddrType current = address + done;
+        std::byte* data;
+        AddrType length;
+        if (m_flat != nullptr)
+        {
+            data = m_flat + (current - m_addrLower);
+            length = size - done;
+        }
+        else
+        {
+            AddrType offset = current % DEFAULT_BLOCK_SIZE;
+            data = FindBlock(current / DEFAULT_BLOCK_SIZE, true, m_dataCache)->data() + offset;
+            length = std::min(DEFAULT_BLOCK_SIZE - offset, size - done);
+        }
+
+        carryOn = visit(data, length);
+        done += length;
+    }
+
+    if (forWrite)
+    {
+        NoteWrite(address, done);
+    }
+    return true;
+}
+
+MemoryMap::BlockCacheStats MemoryMap::GetBlockCacheStats() const
+{
+    BlockCacheStats stats;
+    stats.fetchHits = m_fetchCache.hits;
+    stats.fetchMisses = m_fetchCache.misses;
+    stats.dataHits = m_dataCache.hits;
+    stats.dataMisses = m_dataCache.misses;
+    return stats;
+}
+
+void MemoryMap::ForEachPage(const PageVisitor& visit) const
+{
+    if (m_flat != nullptr)
+    {
+        // the pages written to: the host can't tell those from pages that
+        // were only read (which it may back with its zero page), and doesn't
+        // report pages it has swapped out
+        for (AddrType page = 0; page < m_writtenPages.size(); ++page)
+        {
+            if (m_writtenPages[page].load(std::memory_order_relaxed))
+            {
+                AddrType offset = page * CODE_PAGE_SIZE;
+                visit(m_addrLower + offset, m_flat + offset, std::min(CODE_PAGE_SIZE, m_memSize + 1 - offset));
+            }
+        }
+        return;
+    }
+
+    AddrType firstBlock = m_addrLower / DEFAULT_BLOCK_SIZE;
+    for (AddrType tableNum = 0; tableNum < m_blockDirectory.size(); ++tableNum)
+    {
+        const std::unique_ptr<BlockTable>& table = m_blockDirectory[tableNum];
+        if (!table)
+        {
+            continue;
+        }
+
+        for (AddrType i = 0; i < BLOCK_TABLE_SIZE; ++i)
+        {
+            const std::unique_ptr<MemBlockType>& block = (*table)[i];
+            if (!block)
+            {
+                continue;
+            }
+
+            // the first and last blocks can extend past the range
+            AddrType blockAddress = (firstBlock + tableNum * BLOCK_TABLE_SIZE + i) * DEFAULT_BLOCK_SIZE;
+            AddrType start = std::max(blockAddress, m_addrLower);
+            AddrType end = std::min(blockAddress + DEFAULT_BLOCK_SIZE, m_addrUpper + 1);
+            visit(start, block->data() + (start - blockAddress), end - start);
+        }
+    }
+}
+
+unsigned int MemoryMap::AddCodeWriteHandler(CodeWriteHandler handler)
+{
+    unsigned int handlerId = m_codeWriteHandlerCount;
+    m_codeWriteHandlerCount++;
+
+    m_codeWriteHandlers[handlerId] = handler;
+    return handlerId;
+}
+
+void MemoryMap::RemoveCodeWriteHandler(const unsigned int handlerId)
+{
+    m_codeWriteHandlers.erase(handlerId);
+}
+
+void MemoryMap::MarkCodePage(const AddrType address)
+{
+    if (address < m_addrLower || address > m_addrUpper)
+    {
+        return;
+    }
+
+    m_codePages[(address - m_addrLower) / CODE_PAGE_SIZE].store(true, std::memory_order_relaxed);
+}
+
+void MemoryMap::NoteWrite(const AddrType address, const AddrType size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    AddrType firstPage = (address - m_addrLower) / CODE_PAGE_SIZE;
+    AddrType lastPage = (address - m_addrLower + size - 1) / CODE_PAGE_SIZE;
+    bool code = false;
+    for (AddrType page = firstPage; page <= lastPage; ++page)
+    {
+        // set only once, so that harts writing to the same page don't keep
+        // taking its cache line from each other
+        if (!m_writtenPages[page].load(std::memory_order_relaxed))
+        {
+            m_writtenPages[page].store(true, std::memory_order_relaxed);
+        }
+        code = code || m_codePages[page].load(std::memory_order_relaxed);
+    }
+
+    if (code)
+    {
+        // let the instruction caches know
+        for (auto& handler : m_codeWriteHandlers)
+        {
+            handler.second(address, size);
+        }
+    }
 }
 
 } // namespace riscvdb
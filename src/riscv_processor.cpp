@@ -1,27 +1,14 @@
 #include "riscv_processor.h"
 #include <sstream>
+#include <stdexcept>
 #include <iostream>
 #include <iomanip>
 #include <functional>
+#include <algorithm>
 
 namespace riscvdb
 {
 
-// CSR numbers
-const uint32_t RiscvProcessor::csr_mvendorid = 0xF11;
-const uint32_t RiscvProcessor::csr_marchid = 0xF12;
-const uint32_t RiscvProcessor::csr_mimpid = 0xF13;
-const uint32_t RiscvProcessor::csr_mhartid = 0xF14;
-const uint32_t RiscvProcessor::csr_mstatus = 0x300;
-const uint32_t RiscvProcessor::csr_misa = 0x301;
-const uint32_t RiscvProcessor::csr_mie = 0x304;
-const uint32_t RiscvProcessor::csr_mtvec = 0x305;
-const uint32_t RiscvProcessor::csr_mscratch = 0x340;
-const uint32_t RiscvProcessor::csr_mepc = 0x341;
-const uint32_t RiscvProcessor::csr_mcause = 0x342;
-const uint32_t RiscvProcessor::csr_mtval = 0x343;
-const uint32_t RiscvProcessor::csr_mip = 0x344;
-
 // Privilege levels
 const uint8_t RiscvProcessor::PRV_USER = 0;
 const uint8_t RiscvProcessor::PRV_MACHINE = 3;
@@ -42,71 +29,200 @@ const RiscvProcessor::Exception RiscvProcessor::ex_environment_call_from_Umode
 const RiscvProcessor::Exception RiscvProcessor::ex_environment_call_from_Mmode      = {0, 11};
 
 
-RiscvProcessor::RiscvProcessor(MemoryMap& mem)
+namespace {
+
+// Instructions are looked up by opcode[6:2], funct3 and bit 30 (which
+// separates add/sub, srl/sra etc.), giving the candidates to match against
+constexpr uint32_t DECODE_KEY_BITS = 0x4000707C;
+constexpr unsigned int NUM_DECODE_KEYS = 512;
+
+constexpr uint32_t DecodeKey(const uint32_t cmd)
+{
+    return (((cmd >> 2) & 0x1F) << 4) | (((cmd >> 12) & 0x7) << 1) | ((cmd >> 30) & 0x1);
+}
+
+constexpr uint32_t DecodeKeyBits(const uint32_t key)
+{
+    return (((key >> 4) & 0x1F) << 2) | (((key >> 1) & 0x7) << 12) | ((key & 0x1) << 30);
+}
+
+struct DecodeIndex
+{
+    std::array<uint16_t, NUM_DECODE_KEYS> first{};
+    std::array<uint8_t, NUM_DECODE_KEYS> count{};
+    std::array<uint8_t, 1024> candidates{};
+};
+
+template <typename Instruction, size_t N>
+constexpr DecodeIndex BuildDecodeIndex(const Instruction (&table)[N])
+{
+    DecodeIndex index{};
+    uint16_t next = 0;
+    for (uint32_t key = 0; key < NUM_DECODE_KEYS; ++key)
+    {
+        uint32_t bits = DecodeKeyBits(key);
+        index.first[key] = next;
+        for (size_t i = 0; i < N; ++i)
+        {
+            uint32_t common = table[i].mask & DECODE_KEY_BITS;
+            if ((bits & common) == (table[i].match & common))
+            {
+                index.candidates[next++] = static_cast<uint8_t>(i);
+                index.count[key]++;
+            }
+        }
+    }
+    return index;
+}
+
+// 32 bit instruction encodings, for expanding compressed instructions
+uint32_t EncodeR(const uint32_t funct7, const uint32_t rs2, const uint32_t rs1, const uint32_t funct3, const uint32_t rd)
+{
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | 0x33;
+}
+
+uint32_t EncodeI(const int32_t imm, const uint32_t rs1, const uint32_t funct3, const uint32_t rd, const uint32_t opcode)
+{
+    return ((static_cast<uint32_t>(imm) & 0xFFF) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t EncodeS(const int32_t imm, const uint32_t rs2, const uint32_t rs1, const uint32_t funct3,
+                 const uint32_t opcode = 0x23)
+{
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 5) & 0x7F) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1F) << 7) | opcode;
+}
+
+uint32_t EncodeB(const int32_t imm, const uint32_t rs2, const uint32_t rs1, const uint32_t funct3)
+{
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 12) & 0x1) << 31) | (((u >> 5) & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (funct3 << 12) | (((u >> 1) & 0xF) << 8) | (((u >> 11) & 0x1) << 7) | 0x63;
+}
+
+uint32_t EncodeJ(const int32_t imm, const uint32_t rd)
+{
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 20) & 0x1) << 31) | (((u >> 1) & 0x3FF) << 21) | (((u >> 11) & 0x1) << 20) |
+           (((u >> 12) & 0xFF) << 12) | (rd << 7) | 0x6F;
+}
+
+// Sign extends the low `bits` bits of value
+int32_t SignExtend(const uint32_t value, const unsigned int bits)
+{
+    uint32_t sign = 1u << (bits - 1);
+    return static_cast<int32_t>((value ^ sign) - sign);
+}
+
+template <typename Instruction, size_t N>
+constexpr bool InstructionTableInOrder(const Instruction (&table)[N])
+{
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (table[i].id != i)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+constexpr RiscvProcessor::CsrSlot RiscvProcessor::CsrSlotOf(const uint32_t csr_num)
+{
+    // cycle, time, instret and hpmcounter3-31, mcycle, minstret and
+    // mhpmcounter3-31, their high halves, and mhpmevent3-31
+    if ((csr_num & 0xF60) == 0xC00 ||
+        ((csr_num & 0xF60) == 0xB00 && (csr_num & 0x1F) != 1) ||
+        (csr_num >= csr_mhpmevent3 && csr_num <= csr_mhpmevent3 + 28))
+    {
+        return CSR_COUNTER;
+    }
+
+    switch (csr_num)
+    {
+        case csr_mvendorid: return CSR_MVENDORID;
+        case csr_marchid: return CSR_MARCHID;
+        case csr_mimpid: return CSR_MIMPID;
+        case csr_mhartid: return CSR_MHARTID;
+        case csr_mstatus: return CSR_MSTATUS;
+        case csr_misa: return CSR_MISA;
+        case csr_mie: return CSR_MIE;
+        case csr_mtvec: return CSR_MTVEC;
+        case csr_mscratch: return CSR_MSCRATCH;
+        case csr_mepc: return CSR_MEPC;
+        case csr_mcause: return CSR_MCAUSE;
+        case csr_mtval: return CSR_MTVAL;
+        case csr_mip: return CSR_MIP;
+        case csr_fflags: return CSR_FFLAGS;
+        case csr_frm: return CSR_FRM;
+        case csr_fcsr: return CSR_FCSR;
+        case csr_mcounteren: return CSR_MCOUNTEREN;
+        case csr_mcountinhibit: return CSR_MCOUNTINHIBIT;
+        default: return CSR_UNIMPLEMENTED;
+    }
+}
+
+const std::array<uint8_t, RiscvProcessor::NUM_CSR_NUMBERS> RiscvProcessor::s_csr_slots = []() constexpr
+{
+    std::array<uint8_t, NUM_CSR_NUMBERS> slots{};
+    for (uint32_t csr_num = 0; csr_num < NUM_CSR_NUMBERS; ++csr_num)
+    {
+        slots[csr_num] = CsrSlotOf(csr_num);
+    }
+    return slots;
+}();
+
+RiscvProcessor::RiscvProcessor(MemoryMap& mem, const uint32_t hartId)
 : m_mem(mem),
   m_pc(0),
+  m_hart_id(hartId),
   m_instruction_count(0),
   m_verbose(false),
-  m_prv(PRV_MACHINE)
+  m_interrupt_pending(false),
+  m_event_deadline(NO_EVENT),
+  m_timer_compare(NO_EVENT),
+  m_software_interrupt(false),
+  m_time_offset(0),
+  m_reservation_valid(false),
+  m_reservation_address(0),
+  m_reservation_value(0),
+  m_prv(PRV_MACHINE),
+  m_decode_last_page_num(0),
+  m_decode_last_page(nullptr),
+  m_host_thread(std::thread::id()),
+  m_invalidation_pending(false),
+  m_breakpoint_hit(false),
+  m_breakpoint_skip(false),
+  m_block_epoch(0),
+  m_last_block(nullptr),
+  m_jit_enabled(true),
+  m_compiled_blocks(0),
+  m_decoded_length(4)
 {
     // initialize all values to default:
     Reset();
 
-    // Setup lookup tables
-    // R types
-    cmd_mapping_R[mask_add] =   Instruction("add", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_add);
-    cmd_mapping_R[mask_sub] =   Instruction("sub", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_sub);
-    cmd_mapping_R[mask_sll] =   Instruction("sll", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_sll);
-    cmd_mapping_R[mask_slt] =   Instruction("slt", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_slt);
-    cmd_mapping_R[mask_sltu] =  Instruction("sltu", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_sltu);
-    cmd_mapping_R[mask_xor] =   Instruction("xor", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_xor);
-    cmd_mapping_R[mask_srl] =   Instruction("srl", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_srl);
-    cmd_mapping_R[mask_sra] =   Instruction("sra", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_sra);
-    cmd_mapping_R[mask_or] =    Instruction("or", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_or);
-    cmd_mapping_R[mask_and] =   Instruction("and", &RiscvProcessor::decode_R,  &RiscvProcessor::execute_and);
-
-    // I/S/B types
-    cmd_mapping_ISB[mask_jalr] =  Instruction("jalr", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_jalr);
-    cmd_mapping_ISB[mask_beq] =   Instruction("beq", &RiscvProcessor::decode_B,  &RiscvProcessor::execute_beq);
-    cmd_mapping_ISB[mask_bne] =   Instruction("bne", &RiscvProcessor::decode_B,  &RiscvProcessor::execute_bne);
-    cmd_mapping_ISB[mask_blt] =   Instruction("blt", &RiscvProcessor::decode_B,  &RiscvProcessor::execute_blt);
-    cmd_mapping_ISB[mask_bge] =   Instruction("bge", &RiscvProcessor::decode_B,  &RiscvProcessor::execute_bge);
-    cmd_mapping_ISB[mask_bltu] =  Instruction("bltu", &RiscvProcessor::decode_B,  &RiscvProcessor::execute_bltu);
-    cmd_mapping_ISB[mask_bgeu] =  Instruction("bgeu", &RiscvProcessor::decode_B,  &RiscvProcessor::execute_bgeu);
-    cmd_mapping_ISB[mask_lb] =    Instruction("lb", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_lb);
-    cmd_mapping_ISB[mask_lh] =    Instruction("lh", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_lh);
-    cmd_mapping_ISB[mask_lw] =    Instruction("lw", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_lw);
-    cmd_mapping_ISB[mask_lbu] =   Instruction("lbu", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_lbu);
-    cmd_mapping_ISB[mask_lhu] =   Instruction("lhu", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_lhu);
-    cmd_mapping_ISB[mask_sb] =    Instruction("sb", &RiscvProcessor::decode_S,  &RiscvProcessor::execute_sb);
-    cmd_mapping_ISB[mask_sh] =    Instruction("sh", &RiscvProcessor::decode_S,  &RiscvProcessor::execute_sh);
-    cmd_mapping_ISB[mask_sw] =    Instruction("sw", &RiscvProcessor::decode_S,  &RiscvProcessor::execute_sw);
-    cmd_mapping_ISB[mask_addi] =  Instruction("addi", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_addi);
-    cmd_mapping_ISB[mask_slti] =  Instruction("slti", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_slti);
-    cmd_mapping_ISB[mask_sltiu] = Instruction("sltiu", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_sltiu);
-    cmd_mapping_ISB[mask_xori] =  Instruction("xori", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_xori);
-    cmd_mapping_ISB[mask_ori] =   Instruction("ori", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_ori);
-    cmd_mapping_ISB[mask_andi] =  Instruction("andi", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_andi);
-    cmd_mapping_ISB[mask_slli] =  Instruction("slli", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_slli);
-    cmd_mapping_ISB[mask_srli] =  Instruction("srli", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_srli);
-    cmd_mapping_ISB[mask_srai] =  Instruction("srai", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_srai);
-    cmd_mapping_ISB[mask_csrrw] = Instruction("csrrw", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_csrrw);
-    cmd_mapping_ISB[mask_csrrs] = Instruction("csrrs", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_csrrs);
-    cmd_mapping_ISB[mask_csrrc] = Instruction("csrrc", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_csrrc);
-    cmd_mapping_ISB[mask_csrrwi] = Instruction("csrrwi", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_csrrwi);
-    cmd_mapping_ISB[mask_csrrsi] = Instruction("csrrsi", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_csrrsi);
-    cmd_mapping_ISB[mask_csrrci] = Instruction("csrrci", &RiscvProcessor::decode_I,  &RiscvProcessor::execute_csrrci);
-
-    // U/J types
-    cmd_mapping_UJ[mask_lui] =   Instruction("lui", &RiscvProcessor::decode_U,  &RiscvProcessor::execute_lui);
-    cmd_mapping_UJ[mask_auipc] = Instruction("auipc", &RiscvProcessor::decode_U,  &RiscvProcessor::execute_auipc);
-    cmd_mapping_UJ[mask_jal] =   Instruction("jal", &RiscvProcessor::decode_J,  &RiscvProcessor::execute_jal);
-
-    // SYSTEM types
-    cmd_mapping_SYSTEM[mask_fence] =  Instruction("fence", nullptr,  nullptr);
-    cmd_mapping_SYSTEM[mask_mret] =   Instruction("mret", nullptr,  &RiscvProcessor::execute_mret);
-    cmd_mapping_SYSTEM[mask_ebreak] = Instruction("ebreak", nullptr,  &RiscvProcessor::execute_ebreak);
-    cmd_mapping_SYSTEM[mask_ecall] =  Instruction("ecall", nullptr,  &RiscvProcessor::execute_ecall);
+    // Cached instructions need to be dropped when their memory is modified
+    m_code_write_handler = m_mem.AddCodeWriteHandler(
+        [this](const MemoryMap::AddrType address, const MemoryMap::AddrType size)
+        {
+            std::thread::id hostThread = m_host_thread;
+            if (hostThread != std::thread::id() && hostThread != std::this_thread::get_id())
+            {
+                std::lock_guard<std::mutex> lock(m_invalidation_mutex);
+                m_pending_invalidations.emplace_back(address, size);
+                m_invalidation_pending = true;
+                return;
+            }
+            InvalidateDecoded(address, size);
+        });
+}
+
+RiscvProcessor::~RiscvProcessor()
+{
+    m_mem.RemoveCodeWriteHandler(m_code_write_handler);
 }
 
 void RiscvProcessor::SetVerbose(const bool verbose)
@@ -127,20 +243,26 @@ void RiscvProcessor::Reset()
     // Reset privilege level
     m_prv = PRV_MACHINE;
 
+    m_freg.fill(0);
+
     // Reset csr registers
-    m_csr_table[csr_mvendorid] = 0;
-    m_csr_table[csr_marchid] = 0;
-    m_csr_table[csr_mimpid] = 0x20190200;
-    m_csr_table[csr_mhartid] = 0;
-    m_csr_table[csr_mstatus] = 0;
-    m_csr_table[csr_misa] = 0x40100100;
-    m_csr_table[csr_mie] = 0;
-    m_csr_table[csr_mtvec] = 0;
-    m_csr_table[csr_mscratch] = 0;
-    m_csr_table[csr_mepc] = 0;
-    m_csr_table[csr_mcause] = 0;
-    m_csr_table[csr_mtval] = 0;
-    m_csr_table[csr_mip] = 0;
+    m_csr.fill(0);
+    m_csr[CSR_MIMPID] = 0x20190200;
+    m_csr[CSR_MHARTID] = m_hart_id;
+    m_csr[CSR_MISA] = 0x4010112D;  // RV32IMAFDC, with user mode
+    m_csr[CSR_MSTATUS] = 0x2000;  // FS Initial, so FP code runs without turning it on first
+    m_csr[CSR_MCOUNTEREN] = 0x7;  // cycle, time and instret, so user mode code can time itself
+    UpdateInterruptPending();
+
+    m_counters.fill(Counter{0, 0, false});
+
+    // mtime starts at 0, and mtimecmp where it can never be reached
+    m_time_offset = 0;
+    m_timer_compare = NO_EVENT;
+    m_software_interrupt = false;
+    m_event_deadline = NO_EVENT;
+
+    m_reservation_valid = false;
 }
 
 RiscvProcessor::Register RiscvProcessor::GetPC() const
@@ -191,37 +313,25 @@ unsigned long long RiscvProcessor::GetInstructionCount() const
 void RiscvProcessor::SetPrivilegeLevel(const uint8_t prv)
 {
     m_prv = prv;
+    UpdateInterruptPending();
 }
 
 uint32_t RiscvProcessor::GetCSRValue(const uint32_t csr_num) const
 {
     uint32_t val = 0;
 
-    switch (csr_num) {
-        // Only allow valid CSR values
-        case csr_mvendorid:
-        case csr_marchid:
-        case csr_mimpid:
-        case csr_mhartid:
-        case csr_mstatus:
-        case csr_misa:
-        case csr_mie:
-        case csr_mtvec:
-        case csr_mscratch:
-        case csr_mepc:
-        case csr_mcause:
-        case csr_mtval:
-        case csr_mip:
-            val = m_csr_table.at(csr_num);
-            break;
-
-        default:
-            {
-                std::stringstream ss;
-                ss << "csr number " << csr_num << " is invalid";
-                throw std::invalid_argument(ss.str());
-            }
+    // Only allow valid CSR values
+    if (csr_num >= NUM_CSR_NUMBERS || s_csr_slots[csr_num] == CSR_UNIMPLEMENTED)
+    {
+        std::stringstream ss;
+        ss << "csr number " << csr_num << " is invalid";
+        throw std::invalid_argument(ss.str());
+    }
+    if (s_csr_slots[csr_num] == CSR_COUNTER)
+    {
+        return ReadCounterCSR(csr_num);
     }
+    val = m_csr[s_csr_slots[csr_num]];
 
     return val;
 }
@@ -229,7 +339,12 @@ uint32_t RiscvProcessor::GetCSRValue(const uint32_t csr_num) const
 RiscvProcessor::set_csr_result RiscvProcessor::SetCSRValue(const uint32_t csr_num, const uint32_t new_value)
 {
     set_csr_result ret;
-    ret.set_csr_user_mode = m_prv == PRV_USER;
+    ret.set_csr_user_mode = m_prv == PRV_USER && (csr_num & 0x300) != 0;  // bits 9:8 are the lowest privilege
+
+    if (csr_num < NUM_CSR_NUMBERS && s_csr_slots[csr_num] == CSR_COUNTER)
+    {
+        return ret.set_csr_user_mode ? ret : WriteCounterCSR(csr_num, new_value);
+    }
 
     // Differnet csr numbers have different methods of update:
     switch (csr_num) {
@@ -248,10 +363,57 @@ RiscvProcessor::set_csr_result RiscvProcessor::SetCSRValue(const uint32_t csr_nu
 
         case csr_mstatus:
             // mask to only allow:
+            //  fs   14:13
             //  mpp  12:11
             //  mpie  7
             //  mie   3
-            m_csr_table[csr_num] = new_value & 0x1888;
+            // with sd (31) read only, set when fs is Dirty
+            m_csr[CSR_MSTATUS] = new_value & 0x7888;
+            if ((new_value & 0x6000) == 0x6000)
+            {
+                m_csr[CSR_MSTATUS] |= 0x80000000;
+            }
+            UpdateInterruptPending();
+            break;
+
+        case csr_fflags:
+        case csr_frm:
+        case csr_fcsr:
+            // Not there while mstatus.fs is Off. fcsr is frm (7:5) and
+            // fflags (4:0) together.
+            if ((m_csr[CSR_MSTATUS] & 0x6000) == 0)
+            {
+                ret.set_csr_undefined_num = true;
+                break;
+            }
+            if (csr_num == csr_fflags)
+            {
+                m_csr[CSR_FCSR] = (m_csr[CSR_FCSR] & ~0x1F) | (new_value & 0x1F);
+            }
+            else if (csr_num == csr_frm)
+            {
+                m_csr[CSR_FCSR] = (m_csr[CSR_FCSR] & 0x1F) | ((new_value & 0x7) << 5);
+            }
+            else
+            {
+                m_csr[CSR_FCSR] = new_value & 0xFF;
+            }
+            m_csr[CSR_FFLAGS] = m_csr[CSR_FCSR] & 0x1F;
+            m_csr[CSR_FRM] = m_csr[CSR_FCSR] >> 5;
+            SetFpDirty();
+            break;
+
+        case csr_mcounteren:
+            // which counters user mode can read, bit n for cycle + n
+            m_csr[CSR_MCOUNTEREN] = new_value;
+            break;
+
+        case csr_mcountinhibit:
+            // only cycle (0) and instret (2) count anything, and time (1)
+            // can't be stopped
+            m_csr[CSR_MCOUNTINHIBIT] = new_value & ~0x2;
+            SetCounterInhibited(COUNTER_CYCLE, (new_value & 0x1) != 0);
+            SetCounterInhibited(COUNTER_INSTRET, (new_value & 0x4) != 0);
             break;
 
         case csr_mie:
@@ -262,32 +424,33 @@ RiscvProcessor::set_csr_result RiscvProcessor::SetCSRValue(const uint32_t csr_nu
             //  utie  4
             //  msie  3
             //  usie  0
-            m_csr_table[csr_num] = new_value & 0x999;
+            m_csr[CSR_MIE] = new_value & 0x999;
+            UpdateInterruptPending();
             break;
 
         case csr_mtvec:
             if ((new_value & 0x1) == 1)
             {
                 // fix bits 1 to 6 to 0
-                m_csr_table[csr_num] = new_value & 0xFFFFFF81;
+                m_csr[CSR_MTVEC] = new_value & 0xFFFFFF81;
             }
             else
             {
                 // fix bit 1 to 0
-                m_csr_table[csr_num] = new_value & 0xFFFFFFFD;
+                m_csr[CSR_MTVEC] = new_value & 0xFFFFFFFD;
             }
             break;
 
         case csr_mepc:
-            // Bits 0 and 1 fixed to 0
-            m_csr_table[csr_num] = new_value & 0xFFFFFFFC;
+            // Bit 0 fixed to 0 (only bit 1 too without compressed instructions)
+            m_csr[CSR_MEPC] = new_value & 0xFFFFFFFE;
             break;
 
         case csr_mcause:
             // Only interrupt bit and 4-bit exception code field implemented
             //   interrupt bit    31
             //   4-bit exception  0:3
-            m_csr_table[csr_num] = new_value & 0x8000000F;
+            m_csr[CSR_MCAUSE] = new_value & 0x8000000F;
             break;
 
         case csr_mip:
@@ -299,14 +462,15 @@ RiscvProcessor::set_csr_result RiscvProcessor::SetCSRValue(const uint32_t csr_nu
             //  msip  3   R
             //  usip  0   RW
             // Can only write to R/W fields
-            m_csr_table[csr_num] = (m_csr_table[csr_num] & ~0x111) | (new_value & 0x111);
+            m_csr[CSR_MIP] = (m_csr[CSR_MIP] & ~0x111) | (new_value & 0x111);
+            UpdateInterruptPending();
             break;
 
         // All other CSR values
         case csr_mscratch:
         case csr_mtval:
             // No specific rule applies
-            m_csr_table[csr_num] = new_value;
+            m_csr[s_csr_slots[csr_num]] = new_value;
             break;
 
         default:
@@ -317,36 +481,682 @@ RiscvProcessor::set_csr_result RiscvProcessor::SetCSRValue(const uint32_t csr_nu
     return ret;
 }
 
+bool RiscvProcessor::ReadCSR(const uint32_t csr_num, uint32_t& value) const
+{
+    const uint8_t slot = s_csr_slots[csr_num];
+    if (slot != CSR_COUNTER)
+    {
+        value = m_csr[slot];
+        return true;
+    }
+
+    // User mode can only read cycle, time, instret and hpmcounter3-31, and
+    // only those mcounteren allows
+    if (m_prv == PRV_USER &&
+        ((csr_num & 0x300) != 0 || ((m_csr[CSR_MCOUNTEREN] >> (csr_num & 0x1F)) & 1) == 0))
+    {
+        return false;
+    }
+    value = ReadCounterCSR(csr_num);
+    return true;
+}
+
+// The counter values seen by the instruction running now. Writes (and
+// changes to mcountinhibit) are seen from the next instruction on, after
+// this one has been counted.
+uint64_t RiscvProcessor::CounterValue(const CounterId id) const
+{
+    const Counter& counter = m_counters[id];
+    return counter.inhibited ? counter.held : m_instruction_count + counter.offset;
+}
+
+void RiscvProcessor::SetCounterValue(const CounterId id, const uint64_t value)
+{
+    Counter& counter = m_counters[id];
+    if (counter.inhibited)
+    {
+        counter.held = value;
+    }
+    else
+    {
+        counter.offset = value - (m_instruction_count + 1);
+    }
+}
+
+void RiscvProcessor::SetCounterInhibited(const CounterId id, const bool inhibited)
+{
+    Counter& counter = m_counters[id];
+    if (inhibited != counter.inhibited)
+    {
+        uint64_t next = counter.inhibited ? counter.held : m_instruction_count + 1 + counter.offset;
+        counter.inhibited = inhibited;
+        SetCounterValue(id, next);
+    }
+}
+
+uint32_t RiscvProcessor::ReadCounterCSR(const uint32_t csr_num) const
+{
+    uint64_t value = 0;
+    if ((csr_num & 0xF00) != 0x300)  // mhpmevent3-31 always read 0
+    {
+        switch (csr_num & 0x1F)
+        {
+            case 0: value = CounterValue(COUNTER_CYCLE); break;
+            case 1: value = GetTime(); break;
+            case 2: value = CounterValue(COUNTER_INSTRET); break;
+            default: break;  // hpmcounter3-31 count nothing
+        }
+    }
+    return (csr_num & 0x80) != 0 ? static_cast<uint32_t>(value >> 32) : static_cast<uint32_t>(value);
+}
+
+RiscvProcessor::set_csr_result RiscvProcessor::WriteCounterCSR(const uint32_t csr_num, const uint32_t new_value)
+{
+    set_csr_result ret;
+    if ((csr_num & 0xF00) == 0xC00)
+    {
+        // The unprivileged counters are read only copies
+        ret.set_csr_read_only = true;
+        return ret;
+    }
+
+    CounterId id;
+    switch (csr_num & 0x1F)
+    {
+        case 0: id = COUNTER_CYCLE; break;
+        case 2: id = COUNTER_INSTRET; break;
+        default: return ret;  // mhpmcounter3-31 and mhpmevent3-31 ignore writes
+    }
+
+    // the half that isn't written keeps the value it would have had next
+    const Counter& counter = m_counters[id];
+    uint64_t next = counter.inhibited ? counter.held : CounterValue(id) + 1;
+    if ((csr_num & 0x80) != 0)
+    {
+        next = (next & 0xFFFFFFFF) | (static_cast<uint64_t>(new_value) << 32);
+    }
+    else
+    {
+        next = (next & 0xFFFFFFFF00000000) | new_value;
+    }
+    SetCounterValue(id, next);
+    return ret;
+}
+
+void RiscvProcessor::SetInterruptPending(const Exception& interrupt, const bool pending)
+{
+    uint32_t bit = 1u << interrupt.exceptionCode;
+    if (pending)
+    {
+        m_csr[CSR_MIP] |= bit & 0x999;
+    }
+    else
+    {
+        m_csr[CSR_MIP] &= ~bit;
+    }
+    UpdateInterruptPending();
+}
+
+uint64_t RiscvProcessor::GetTime() const
+{
+    return m_instruction_count + m_time_offset;
+}
+
+void RiscvProcessor::SetTime(const uint64_t time)
+{
+    m_time_offset = time - m_instruction_count;
+    m_event_deadline = 0;
+}
+
+uint64_t RiscvProcessor::GetTimerCompare() const
+{
+    return m_timer_compare;
+}
+
+void RiscvProcessor::SetTimerCompare(const uint64_t compare)
+{
+    m_timer_compare = compare;
+    m_event_deadline = 0;
+}
+
+bool RiscvProcessor::GetSoftwareInterrupt() const
+{
+    return m_software_interrupt;
+}
+
+void RiscvProcessor::SetSoftwareInterrupt(const bool pending)
+{
+    m_software_interrupt = pending;
+    m_event_deadline = 0;
+}
+
+void RiscvProcessor::HandleEvents()
+{
+    // Anything set from here on brings the deadline forward again, and the
+    // exchange at the end leaves it there for next time
+    m_event_deadline = NO_EVENT;
+
+    const uint64_t time = GetTime();
+    const uint64_t compare = m_timer_compare;
+    SetInterruptPending(ex_machine_timer_interrupt, time >= compare);
+    SetInterruptPending(ex_machine_software_interrupt, m_software_interrupt);
+
+    // mtip stays set until mtimecmp is written, so there's nothing more to
+    // wait for once it is
+    uint64_t next = time >= compare ? NO_EVENT : compare - m_time_offset;
+    uint64_t expected = NO_EVENT;
+    m_event_deadline.compare_exchange_strong(expected, next);
+}
+
 void RiscvProcessor::Step()
 {
-    // Fetch command at PC
-    uint32_t instruction = m_mem.ReadWord(m_pc);
+    m_breakpoint_hit = false;
+    if (m_invalidation_pending)
+    {
+        ApplyPendingInvalidations();
+    }
+    if (m_instruction_count >= m_event_deadline.load(std::memory_order_relaxed))
+    {
+        HandleEvents();
+    }
 
-    // Execute command
-    ExecuteCmd(instruction);
+    // Execute command at PC
+    ExecuteCmd();
 
     // Increase PC
-    m_pc += 4;  // increase by a word
+    m_pc += m_decoded_length;  // past the instruction (or back where it was)
     m_instruction_count++;
 }
 
-void RiscvProcessor::ExecuteCmd(const uint32_t cmd)
-{
+unsigned long RiscvProcessor::StepBlock(unsigned long maxInstructions)
+{
+    m_breakpoint_hit = false;
+    if (m_invalidation_pending)
+    {
+        ApplyPendingInvalidations();
+    }
+    if (m_instruction_count >= m_event_deadline.load(std::memory_order_relaxed))
+    {
+        HandleEvents();
+    }
+
+    // Stop at the next event, so that a timer interrupt is taken on the
+    // instruction it's due (a deadline brought forward while the block runs
+    // waits for the next one)
+    const uint64_t untilEvent = m_event_deadline.load(std::memory_order_relaxed) - m_instruction_count;
+    if (maxInstructions == 0 || untilEvent < maxInstructions)
+    {
+        maxInstructions = untilEvent;
+    }
+
+    // Nothing can be running a retired block by now
+    if (!m_retired_blocks.empty())
+    {
+        m_retired_blocks.clear();
+        m_last_block = nullptr;
+    }
+
+    // Anything out of the ordinary goes through the single step path
+    if (m_verbose || maxInstructions == 1 || m_pc % 2 != 0 || m_interrupt_pending)
+    {
+        Step();
+        return m_breakpoint_hit ? 0 : 1;
+    }
+
+    // Interrupts become pending through CSR instructions, which end a block,
+    // or through stores to the CLINT, which bring the event deadline forward
+    // (to 0). Stores check for that and end the block there, so that the
+    // interrupt is taken on the next instruction, as when single stepping.
+    Block* block = FetchBlock(m_pc);
+    unsigned long steps = 0;
+
+#ifdef RISCVDB_ENABLE_JIT
+    if (m_jit_enabled && (maxInstructions == 0 || maxInstructions >= block->ops.size()))
+    {
+        if (block->jitFunction == nullptr && !block->jitFailed && ++block->runCount >= JIT_THRESHOLD)
+        {
+            block->jitFailed = !CompileBlock(*block);
+        }
+
+        if (block->jitFunction != nullptr)
+        {
+            Register nextPC = m_pc;
+            steps = block->jitFunction(m_reg.data(), this, &nextPC, &block->valid);
+            m_pc = nextPC;
+            m_instruction_count += steps;
+
+            // the rest (if anything) is left to the interpreter
+            if (steps == block->ops.size() || !block->valid)
+            {
+                m_last_block = block;
+                return steps;
+            }
+        }
+    }
+#endif
+
+#ifdef RISCVDB_ENABLE_THREADED
+    steps = RunBlockThreaded(*block, steps, maxInstructions);
+#else
+    for (size_t i = steps; i < block->ops.size(); ++i)
+    {
+        const DecodedInstruction& decoded = block->ops[i];
+        Register expectedPC = m_pc + decoded.length;
+        ExecuteDecoded(decoded);
+        m_pc += m_decoded_length;
+        m_instruction_count++;
+        steps++;
+
+        // Stop early on an exception, if the block overwrote itself, or if
+        // a store brought an event forward
+        if (m_pc != expectedPC || !block->valid || steps == maxInstructions ||
+            m_instruction_count >= m_event_deadline.load(std::memory_order_relaxed))
+        {
+            if (m_breakpoint_hit)
+            {
+                steps--;  // the trap op didn't run anything
+            }
+            break;
+        }
+    }
+#endif
+
+    m_last_block = block;
+    return steps;
+}
+
+#ifdef RISCVDB_ENABLE_THREADED
+// Same as the loop at the end of StepBlock, but with direct threaded
+// dispatch: each op holds the address of the code handling it, and each
+// handler jumps straight to the next op's handler. This uses labels as
+// values, which is a GCC/Clang extension.
+unsigned long RiscvProcessor::RunBlockThreaded(Block& block, unsigned long steps, const unsigned long maxInstructions)
+{
+    // in InstructionId order
+    static const void* const handlers[NUM_INSTRUCTIONS + 2] = {
+        &&do_lui, &&do_auipc, &&do_jal, &&do_jalr,
+        &&do_beq, &&do_bne, &&do_blt, &&do_bge, &&do_bltu, &&do_bgeu,
+        &&do_lb, &&do_lh, &&do_lw, &&do_lbu, &&do_lhu,
+        &&do_sb, &&do_sh, &&do_sw,
+        &&do_addi, &&do_slti, &&do_sltiu, &&do_xori, &&do_ori, &&do_andi,
+        &&do_slli, &&do_srli, &&do_srai,
+        &&do_add, &&do_sub, &&do_sll, &&do_slt, &&do_sltu,
+        &&do_xor, &&do_srl, &&do_sra, &&do_or, &&do_and,
+        &&do_fence, &&do_ecall, &&do_ebreak, &&do_mret,
+        &&do_csrrw, &&do_csrrs, &&do_csrrc, &&do_csrrwi, &&do_csrrsi, &&do_csrrci,
+        &&do_mul, &&do_mulh, &&do_mulhsu, &&do_mulhu, &&do_div, &&do_divu, &&do_rem, &&do_remu,
+        &&do_lr_w, &&do_sc_w, &&do_amoswap_w, &&do_amoadd_w, &&do_amoxor_w, &&do_amoand_w,
+        &&do_amoor_w, &&do_amomin_w, &&do_amomax_w, &&do_amominu_w, &&do_amomaxu_w,
+        &&do_flw, &&do_fsw, &&do_fmadd_s, &&do_fmsub_s, &&do_fnmsub_s, &&do_fnmadd_s, &&do_fadd_s,
+        &&do_fsub_s, &&do_fmul_s, &&do_fdiv_s, &&do_fsqrt_s, &&do_fsgnj_s, &&do_fsgnjn_s, &&do_fsgnjx_s,
+        &&do_fmin_s, &&do_fmax_s, &&do_fcvt_w_s, &&do_fcvt_wu_s, &&do_fmv_x_w, &&do_feq_s, &&do_flt_s,
+        &&do_fle_s, &&do_fclass_s, &&do_fcvt_s_w, &&do_fcvt_s_wu, &&do_fmv_w_x,
+        &&do_fld, &&do_fsd, &&do_fmadd_d, &&do_fmsub_d, &&do_fnmsub_d, &&do_fnmadd_d, &&do_fadd_d,
+        &&do_fsub_d, &&do_fmul_d, &&do_fdiv_d, &&do_fsqrt_d, &&do_fsgnj_d, &&do_fsgnjn_d, &&do_fsgnjx_d,
+        &&do_fmin_d, &&do_fmax_d, &&do_fcvt_s_d, &&do_fcvt_d_s, &&do_feq_d, &&do_flt_d, &&do_fle_d,
+        &&do_fclass_d, &&do_fcvt_w_d, &&do_fcvt_wu_d, &&do_fcvt_d_w, &&do_fcvt_d_wu,
+        &&do_illegal, &&do_breakpoint,
+    };
+
+    if (!block.threaded)
+    {
+        for (DecodedInstruction& op : block.ops)
+        {
+            op.handler = handlers[op.id];
+        }
+        block.threaded = true;
+    }
+
+    if (steps >= block.ops.size())
+    {
+        return steps;
+    }
+
+    const DecodedInstruction* op = &block.ops[steps];
+    const DecodedInstruction* end = block.ops.data() + block.ops.size();
+    Register expectedPC;
+
+#define THREADED_DISPATCH()             \
+    expectedPC = m_pc + op->length;     \
+    m_decoded_length = op->length;      \
+    m_decoded_rd = op->rd;              \
+    m_decoded_rs1 = op->rs1;            \
+    m_decoded_rs2 = op->rs2;            \
+    m_decoded_imm = op->imm;            \
+    goto *op->handler
+
+// Stop early on an exception, or if the block overwrote itself
+#define THREADED_NEXT()                 \
+    m_pc += m_decoded_length;           \
+    m_instruction_count++;              \
+    steps++;                            \
+    if (m_pc != expectedPC || !block.valid || steps == maxInstructions || ++op == end) \
+    {                                   \
+        return steps;                   \
+    }                                   \
+    THREADED_DISPATCH()
+
+#define THREADED_HANDLER(name)          \
+    do_##name:                          \
+    execute_##name();                   \
+    THREADED_NEXT();
+
+// Stores can reach the CLINT, and also stop if they brought an event forward
+#define THREADED_STORE_HANDLER(name)    \
+    do_##name:                          \
+    execute_##name();                   \
+    if (m_instruction_count + 1 >= m_event_deadline.load(std::memory_order_relaxed)) \
+    {                                   \
+        m_pc += m_decoded_length;       \
+        m_instruction_count++;          \
+        return steps + 1;               \
+    }                                   \
+    THREADED_NEXT();
+
+    THREADED_DISPATCH();
+
+    THREADED_HANDLER(lui)
+    THREADED_HANDLER(auipc)
+    THREADED_HANDLER(jal)
+    THREADED_HANDLER(jalr)
+    THREADED_HANDLER(beq)
+    THREADED_HANDLER(bne)
+    THREADED_HANDLER(blt)
+    THREADED_HANDLER(bge)
+    THREADED_HANDLER(bltu)
+    THREADED_HANDLER(bgeu)
+    THREADED_HANDLER(lb)
+    THREADED_HANDLER(lh)
+    THREADED_HANDLER(lw)
+    THREADED_HANDLER(lbu)
+    THREADED_HANDLER(lhu)
+    THREADED_STORE_HANDLER(sb)
+    THREADED_STORE_HANDLER(sh)
+    THREADED_STORE_HANDLER(sw)
+    THREADED_HANDLER(addi)
+    THREADED_HANDLER(slti)
+    THREADED_HANDLER(sltiu)
+    THREADED_HANDLER(xori)
+    THREADED_HANDLER(ori)
+    THREADED_HANDLER(andi)
+    THREADED_HANDLER(slli)
+    THREADED_HANDLER(srli)
+    THREADED_HANDLER(srai)
+    THREADED_HANDLER(add)
+    THREADED_HANDLER(sub)
+    THREADED_HANDLER(sll)
+    THREADED_HANDLER(slt)
+    THREADED_HANDLER(sltu)
+    THREADED_HANDLER(xor)
+    THREADED_HANDLER(srl)
+    THREADED_HANDLER(sra)
+    THREADED_HANDLER(or)
+    THREADED_HANDLER(and)
+    THREADED_HANDLER(ecall)
+    THREADED_HANDLER(ebreak)
+    THREADED_HANDLER(mret)
+    THREADED_HANDLER(csrrw)
+    THREADED_HANDLER(csrrs)
+    THREADED_HANDLER(csrrc)
+    THREADED_HANDLER(csrrwi)
+    THREADED_HANDLER(csrrsi)
+    THREADED_HANDLER(csrrci)
+    THREADED_HANDLER(mul)
+    THREADED_HANDLER(mulh)
+    THREADED_HANDLER(mulhsu)
+    THREADED_HANDLER(mulhu)
+    THREADED_HANDLER(div)
+    THREADED_HANDLER(divu)
+    THREADED_HANDLER(rem)
+    THREADED_HANDLER(remu)
+    THREADED_HANDLER(lr_w)
+    THREADED_STORE_HANDLER(sc_w)
+    THREADED_STORE_HANDLER(amoswap_w)
+    THREADED_STORE_HANDLER(amoadd_w)
+    THREADED_STORE_HANDLER(amoxor_w)
+    THREADED_STORE_HANDLER(amoand_w)
+    THREADED_STORE_HANDLER(amoor_w)
+    THREADED_STORE_HANDLER(amomin_w)
+    THREADED_STORE_HANDLER(amomax_w)
+    THREADED_STORE_HANDLER(amominu_w)
+    THREADED_STORE_HANDLER(amomaxu_w)
+    THREADED_HANDLER(flw)
+    THREADED_STORE_HANDLER(fsw)
+    THREADED_HANDLER(fmadd_s)
+    THREADED_HANDLER(fmsub_s)
+    THREADED_HANDLER(fnmsub_s)
+    THREADED_HANDLER(fnmadd_s)
+    THREADED_HANDLER(fadd_s)
+    THREADED_HANDLER(fsub_s)
+    THREADED_HANDLER(fmul_s)
+    THREADED_HANDLER(fdiv_s)
+    THREADED_HANDLER(fsqrt_s)
+    THREADED_HANDLER(fsgnj_s)
+    THREADED_HANDLER(fsgnjn_s)
+    THREADED_HANDLER(fsgnjx_s)
+    THREADED_HANDLER(fmin_s)
+    THREADED_HANDLER(fmax_s)
+    THREADED_HANDLER(fcvt_w_s)
+    THREADED_HANDLER(fcvt_wu_s)
+    THREADED_HANDLER(fmv_x_w)
+    THREADED_HANDLER(feq_s)
+    THREADED_HANDLER(flt_s)
+    THREADED_HANDLER(fle_s)
+    THREADED_HANDLER(fclass_s)
+    THREADED_HANDLER(fcvt_s_w)
+    THREADED_HANDLER(fcvt_s_wu)
+    THREADED_HANDLER(fmv_w_x)
+    THREADED_HANDLER(fld)
+    THREADED_STORE_HANDLER(fsd)
+    THREADED_HANDLER(fmadd_d)
+    THREADED_HANDLER(fmsub_d)
+    THREADED_HANDLER(fnmsub_d)
+    THREADED_HANDLER(fnmadd_d)
+    THREADED_HANDLER(fadd_d)
+    THREADED_HANDLER(fsub_d)
+    THREADED_HANDLER(fmul_d)
+    THREADED_HANDLER(fdiv_d)
+    THREADED_HANDLER(fsqrt_d)
+    THREADED_HANDLER(fsgnj_d)
+    THREADED_HANDLER(fsgnjn_d)
+    THREADED_HANDLER(fsgnjx_d)
+    THREADED_HANDLER(fmin_d)
+    THREADED_HANDLER(fmax_d)
+    THREADED_HANDLER(fcvt_s_d)
+    THREADED_HANDLER(fcvt_d_s)
+    THREADED_HANDLER(feq_d)
+    THREADED_HANDLER(flt_d)
+    THREADED_HANDLER(fle_d)
+    THREADED_HANDLER(fclass_d)
+    THREADED_HANDLER(fcvt_w_d)
+    THREADED_HANDLER(fcvt_wu_d)
+    THREADED_HANDLER(fcvt_d_w)
+    THREADED_HANDLER(fcvt_d_wu)
+
+do_fence:
+    // for harts on other threads
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    THREADED_NEXT();
+
+do_illegal:
+    RaiseException(ex_illegal_instruction);
+    THREADED_NEXT();
+
+do_breakpoint:
+    // stop before the instruction, without counting it
+    m_breakpoint_hit = true;
+    return steps;
+
+#undef THREADED_STORE_HANDLER
+#undef THREADED_HANDLER
+#undef THREADED_NEXT
+#undef THREADED_DISPATCH
+}
+#endif
+
+void RiscvProcessor::AddBreakpoint(const uint32_t address)
+{
+    // the PC can't be anywhere else
+    if (address % 2 != 0 || HasBreakpoint(address))
+    {
+        return;
+    }
+
+    m_breakpoint_pages[address / CODE_PAGE_SIZE].set((address % CODE_PAGE_SIZE) / 2);
+
+    // Only the instruction itself needs decoding again (as the trap op),
+    // along with any block holding it
+    InvalidateDecoded(address, 2);
+}
+
+void RiscvProcessor::RemoveBreakpoint(const uint32_t address)
+{
+    if (!HasBreakpoint(address))
+    {
+        return;
+    }
+
+    auto it = m_breakpoint_pages.find(address / CODE_PAGE_SIZE);
+    it->second.reset((address % CODE_PAGE_SIZE) / 2);
+    if (it->second.none())
+    {
+        m_breakpoint_pages.erase(it);
+    }
+
+    InvalidateDecoded(address, 2);
+}
+
+void RiscvProcessor::ClearBreakpoints()
+{
+    while (!m_breakpoint_pages.empty())
+    {
+        auto it = m_breakpoint_pages.begin();
+        uint32_t pageStart = it->first * CODE_PAGE_SIZE;
+        for (uint32_t i = 0; i < it->second.size(); ++i)
+        {
+            if (it->second.test(i))
+            {
+                RemoveBreakpoint(pageStart + i * 2);  // may erase the page
+            }
+        }
+    }
+}
+
+bool RiscvProcessor::HasBreakpoint(const uint32_t address) const
+{
+    if (m_breakpoint_pages.empty() || address % 2 != 0)
+    {
+        return false;
+    }
+
+    auto it = m_breakpoint_pages.find(address / CODE_PAGE_SIZE);
+    return it != m_breakpoint_pages.end() && it->second.test((address % CODE_PAGE_SIZE) / 2);
+}
+
+bool RiscvProcessor::BreakpointHit() const
+{
+    return m_breakpoint_hit;
+}
+
+void RiscvProcessor::StepOverBreakpoint()
+{
+    m_breakpoint_skip = true;
+    Step();
+    m_breakpoint_skip = false;
+}
+
+void RiscvProcessor::BreakpointTrap()
+{
+    // Undo the step that's about to happen, as if nothing was fetched
+    m_breakpoint_hit = true;
+    m_pc -= m_decoded_length;
+    m_instruction_count--;
+}
+
+void RiscvProcessor::SetHostThread(const std::thread::id thread)
+{
+    m_host_thread = thread;
+}
+
+void RiscvProcessor::SetEcallHandler(EcallHandler handler)
+{
+    m_ecall_handler = handler;
+}
+
+void RiscvProcessor::ApplyPendingInvalidations()
+{
+    std::lock_guard<std::mutex> lock(m_invalidation_mutex);
+    for (const auto& write : m_pending_invalidations)
+    {
+        InvalidateDecoded(write.first, write.second);
+    }
+    m_pending_invalidations.clear();
+    m_invalidation_pending = false;
+}
+
+void RiscvProcessor::SetJitEnabled(const bool enabled)
+{
+    m_jit_enabled = enabled;
+}
+
+unsigned long RiscvProcessor::GetCompiledBlockCount() const
+{
+    return m_compiled_blocks;
+}
+
+void RiscvProcessor::ExecuteCmd()
+{
+  // until something is decoded, traps step the PC as for a full instruction
+  m_decoded_length = 4;
+
+  // Breakpoints come before anything else at this PC
+  if (!m_breakpoint_skip && HasBreakpoint(m_pc)) {
+    BreakpointTrap();
+    return;
+  }
+
   if (m_verbose)
   {
     std::cout << "instruction 0x";
-    std::cout << std::setw(8) << std::setfill('0') << std::hex << cmd;
+    std::cout << std::setw(8) << std::setfill('0') << std::hex << m_mem.FetchWord(m_pc);
     std::cout << " ...    ";
   }
 
   // Exception and interrupt checking
-  if (m_pc % 4 != 0) {
+  if (m_pc % 2 != 0) {
       RaiseException(ex_instruction_address_misaligned);
       return;
   }
 
+  // Trigger interrupts
+  const Exception* interrupt = PendingInterrupt();
+  if (interrupt != nullptr) {
+    RaiseException(*interrupt);
+    m_pc += m_decoded_length;
+    m_decoded_length = FetchDecoded(m_pc).length;  // the handler's first instruction is stepped over
+    m_instruction_count++;
+    return;
+  }
+
+  ExecuteDecoded(FetchDecoded(m_pc));
+}
+
+void RiscvProcessor::UpdateInterruptPending()
+{
+  // Same enable condition as PendingInterrupt applies to each interrupt
+  uint32_t mstatus_mie = (m_csr[CSR_MSTATUS] >> 3) & 0x1;
+  bool enabled = (mstatus_mie && m_prv == PRV_MACHINE) || m_prv == PRV_USER;
+  m_interrupt_pending = enabled && (m_csr[CSR_MIP] & m_csr[CSR_MIE] & 0x999) != 0;
+}
+
+const RiscvProcessor::Exception* RiscvProcessor::PendingInterrupt()
+{
+  if (!m_interrupt_pending) {
+    return nullptr;
+  }
+
   // Load bits for interrupts
-  uint32_t mip = m_csr_table[csr_mip];
+  uint32_t mip = m_csr[CSR_MIP];
   uint32_t mip_usip = (mip >> 0) & 0x1;
   uint32_t mip_msip = (mip >> 3) & 0x1;
   uint32_t mip_utip = (mip >> 4) & 0x1;
@@ -354,7 +1164,7 @@ void RiscvProcessor::ExecuteCmd(const uint32_t cmd)
   uint32_t mip_ueip = (mip >> 8) & 0x1;
   uint32_t mip_meip = (mip >> 11) & 0x1;
 
-  uint32_t mie = m_csr_table[csr_mie];
+  uint32_t mie = m_csr[CSR_MIE];
   uint32_t mie_usie = (mie >> 0) & 0x1;
   uint32_t mie_msie = (mie >> 3) & 0x1;
   uint32_t mie_utie = (mie >> 4) & 0x1;
@@ -362,115 +1172,665 @@ void RiscvProcessor::ExecuteCmd(const uint32_t cmd)
   uint32_t mie_ueie = (mie >> 8) & 0x1;
   uint32_t mie_meie = (mie >> 11) & 0x1;
 
-  uint32_t mstatus_mie = (m_csr_table[csr_mstatus] >> 3) & 0x1;
+  uint32_t mstatus_mie = (m_csr[CSR_MSTATUS] >> 3) & 0x1;
 
   // Trigger interrupts
   // Machine external interrupt:
   if (mip_meip && mie_meie && ((mstatus_mie && m_prv == PRV_MACHINE) || (~mstatus_mie && m_prv == PRV_USER))) {
-    RaiseException(ex_machine_external_interrupt);
-    m_pc += 4;
-    m_instruction_count++;
-    return;
+    return &ex_machine_external_interrupt;
   }
   // Machine software interrupt:
   if (mip_msip && mie_msie && ((mstatus_mie && m_prv == PRV_MACHINE) || (~mstatus_mie && m_prv == PRV_USER))) {
-    RaiseException(ex_machine_software_interrupt);
-    m_pc += 4;
-    m_instruction_count++;
-    return;
+    return &ex_machine_software_interrupt;
   }
   // Machine timer interrupt
   if (mip_mtip && mie_mtie && ((mstatus_mie && m_prv == PRV_MACHINE) || (~mstatus_mie && m_prv == PRV_USER))) {
-    RaiseException(ex_machine_timer_interrupt);
-    m_pc += 4;
-    m_instruction_count++;
-    return;
+    return &ex_machine_timer_interrupt;
   }
   // User external interrupt
   if (mip_ueip && mie_ueie && ((mstatus_mie && m_prv == PRV_MACHINE) || (~mstatus_mie && m_prv == PRV_USER))) {
-    RaiseException(ex_user_external_interrupt);
-    m_pc += 4;
-    m_instruction_count++;
-    return;
+    return &ex_user_external_interrupt;
   }
   // User software interrupt:
   if (mip_usip && mie_usie && ((mstatus_mie && m_prv == PRV_MACHINE) || (~mstatus_mie && m_prv == PRV_USER))) {
-    RaiseException(ex_user_software_interrupt);
-    m_pc += 4;
-    m_instruction_count++;
-    return;
+    return &ex_user_software_interrupt;
   }
   // User timer interrupt:
   if (mip_utip && mie_utie && ((mstatus_mie && m_prv == PRV_MACHINE) || (~mstatus_mie && m_prv == PRV_USER))) {
-    RaiseException(ex_user_timer_interrupt);
-    m_pc += 4;
-    m_instruction_count++;
-    return;
+    return &ex_user_timer_interrupt;
   }
 
-    // Get and run the instruction decoder and executor
-    bool instructionFound = false;
-    Instruction instruction;
-    // InstructionDecoder decoder;
-    // InstructionExector executor;
+  return nullptr;
+}
+
+void RiscvProcessor::ExecuteDecoded(const DecodedInstruction& decoded)
+{
+    m_decoded_length = decoded.length;
+
+    if (decoded.id == INST_ILLEGAL)
+    {
+        // No instruction matched
+        if (m_verbose)
+        {
+          std::cout << "unknown instruction" << std::endl;
+        }
+        RaiseException(ex_illegal_instruction);
+        return;
+    }
 
-    // Try R types
-    if (cmd_mapping_R.find(cmd & mask_R) != cmd_mapping_R.end()) {
-        instruction = cmd_mapping_R[cmd & mask_R];
-        instructionFound = true;
+    if (decoded.id == INST_BREAKPOINT)
+    {
+        if (m_breakpoint_skip)
+        {
+            // resuming from the breakpoint, so run what's really there
+            ExecuteDecoded(Decode(FetchInstruction(m_pc)));
+        }
+        else
+        {
+            BreakpointTrap();
+        }
+        return;
     }
-    // Try I/S/B types
-    else if (cmd_mapping_ISB.find(cmd & mask_ISB) != cmd_mapping_ISB.end()) {
-        instruction = cmd_mapping_ISB[cmd & mask_ISB];
-        instructionFound = true;
+
+    m_decoded_rd = decoded.rd;
+    m_decoded_rs1 = decoded.rs1;
+    m_decoded_rs2 = decoded.rs2;
+    m_decoded_imm = decoded.imm;
+
+    if (m_verbose)
+    {
+      VerbosePrintInstruction(decoded);
     }
-    // Try U/J types
-    else if (cmd_mapping_UJ.find(cmd & mask_UJ) != cmd_mapping_UJ.end()) {
-        instruction = cmd_mapping_UJ[cmd & mask_UJ];
-        instructionFound = true;
+
+    switch (decoded.id)
+    {
+        case INST_LUI:     execute_lui(); break;
+        case INST_AUIPC:   execute_auipc(); break;
+        case INST_JAL:     execute_jal(); break;
+        case INST_JALR:    execute_jalr(); break;
+        case INST_BEQ:     execute_beq(); break;
+        case INST_BNE:     execute_bne(); break;
+        case INST_BLT:     execute_blt(); break;
+        case INST_BGE:     execute_bge(); break;
+        case INST_BLTU:    execute_bltu(); break;
+        case INST_BGEU:    execute_bgeu(); break;
+        case INST_LB:      execute_lb(); break;
+        case INST_LH:      execute_lh(); break;
+        case INST_LW:      execute_lw(); break;
+        case INST_LBU:     execute_lbu(); break;
+        case INST_LHU:     execute_lhu(); break;
+        case INST_SB:      execute_sb(); break;
+        case INST_SH:      execute_sh(); break;
+        case INST_SW:      execute_sw(); break;
+        case INST_ADDI:    execute_addi(); break;
+        case INST_SLTI:    execute_slti(); break;
+        case INST_SLTIU:   execute_sltiu(); break;
+        case INST_XORI:    execute_xori(); break;
+        case INST_ORI:     execute_ori(); break;
+        case INST_ANDI:    execute_andi(); break;
+        case INST_SLLI:    execute_slli(); break;
+        case INST_SRLI:    execute_srli(); break;
+        case INST_SRAI:    execute_srai(); break;
+        case INST_ADD:     execute_add(); break;
+        case INST_SUB:     execute_sub(); break;
+        case INST_SLL:     execute_sll(); break;
+        case INST_SLT:     execute_slt(); break;
+        case INST_SLTU:    execute_sltu(); break;
+        case INST_XOR:     execute_xor(); break;
+        case INST_SRL:     execute_srl(); break;
+        case INST_SRA:     execute_sra(); break;
+        case INST_OR:      execute_or(); break;
+        case INST_AND:     execute_and(); break;
+        case INST_FENCE:   std::atomic_thread_fence(std::memory_order_seq_cst); break;
+        case INST_ECALL:   execute_ecall(); break;
+        case INST_EBREAK:  execute_ebreak(); break;
+        case INST_MRET:    execute_mret(); break;
+        case INST_CSRRW:   execute_csrrw(); break;
+        case INST_CSRRS:   execute_csrrs(); break;
+        case INST_CSRRC:   execute_csrrc(); break;
+        case INST_CSRRWI:  execute_csrrwi(); break;
+        case INST_CSRRSI:  execute_csrrsi(); break;
+        case INST_CSRRCI:  execute_csrrci(); break;
+        case INST_MUL:     execute_mul(); break;
+        case INST_MULH:    execute_mulh(); break;
+        case INST_MULHSU:  execute_mulhsu(); break;
+        case INST_MULHU:   execute_mulhu(); break;
+        case INST_DIV:     execute_div(); break;
+        case INST_DIVU:    execute_divu(); break;
+        case INST_REM:     execute_rem(); break;
+        case INST_REMU:    execute_remu(); break;
+        case INST_LR_W:      execute_lr_w(); break;
+        case INST_SC_W:      execute_sc_w(); break;
+        case INST_AMOSWAP_W: execute_amoswap_w(); break;
+        case INST_AMOADD_W:  execute_amoadd_w(); break;
+        case INST_AMOXOR_W:  execute_amoxor_w(); break;
+        case INST_AMOAND_W:  execute_amoand_w(); break;
+        case INST_AMOOR_W:   execute_amoor_w(); break;
+        case INST_AMOMIN_W:  execute_amomin_w(); break;
+        case INST_AMOMAX_W:  execute_amomax_w(); break;
+        case INST_AMOMINU_W: execute_amominu_w(); break;
+        case INST_AMOMAXU_W: execute_amomaxu_w(); break;
+        case INST_FLW:        execute_flw(); break;
+        case INST_FSW:        execute_fsw(); break;
+        case INST_FMADD_S:    execute_fmadd_s(); break;
+        case INST_FMSUB_S:    execute_fmsub_s(); break;
+        case INST_FNMSUB_S:   execute_fnmsub_s(); break;
+        case INST_FNMADD_S:   execute_fnmadd_s(); break;
+        case INST_FADD_S:     execute_fadd_s(); break;
+        case INST_FSUB_S:     execute_fsub_s(); break;
+        case INST_FMUL_S:     execute_fmul_s(); break;
+        case INST_FDIV_S:     execute_fdiv_s(); break;
+        case INST_FSQRT_S:    execute_fsqrt_s(); break;
+        case INST_FSGNJ_S:    execute_fsgnj_s(); break;
+        case INST_FSGNJN_S:   execute_fsgnjn_s(); break;
+        case INST_FSGNJX_S:   execute_fsgnjx_s(); break;
+        case INST_FMIN_S:     execute_fmin_s(); break;
+        case INST_FMAX_S:     execute_fmax_s(); break;
+        case INST_FCVT_W_S:   execute_fcvt_w_s(); break;
+        case INST_FCVT_WU_S:  execute_fcvt_wu_s(); break;
+        case INST_FMV_X_W:    execute_fmv_x_w(); break;
+        case INST_FEQ_S:      execute_feq_s(); break;
+        case INST_FLT_S:      execute_flt_s(); break;
+        case INST_FLE_S:      execute_fle_s(); break;
+        case INST_FCLASS_S:   execute_fclass_s(); break;
+        case INST_FCVT_S_W:   execute_fcvt_s_w(); break;
+        case INST_FCVT_S_WU:  execute_fcvt_s_wu(); break;
+        case INST_FMV_W_X:    execute_fmv_w_x(); break;
+        case INST_FLD:        execute_fld(); break;
+        case INST_FSD:        execute_fsd(); break;
+        case INST_FMADD_D:    execute_fmadd_d(); break;
+        case INST_FMSUB_D:    execute_fmsub_d(); break;
+        case INST_FNMSUB_D:   execute_fnmsub_d(); break;
+        case INST_FNMADD_D:   execute_fnmadd_d(); break;
+        case INST_FADD_D:     execute_fadd_d(); break;
+        case INST_FSUB_D:     execute_fsub_d(); break;
+        case INST_FMUL_D:     execute_fmul_d(); break;
+        case INST_FDIV_D:     execute_fdiv_d(); break;
+        case INST_FSQRT_D:    execute_fsqrt_d(); break;
+        case INST_FSGNJ_D:    execute_fsgnj_d(); break;
+        case INST_FSGNJN_D:   execute_fsgnjn_d(); break;
+        case INST_FSGNJX_D:   execute_fsgnjx_d(); break;
+        case INST_FMIN_D:     execute_fmin_d(); break;
+        case INST_FMAX_D:     execute_fmax_d(); break;
+        case INST_FCVT_S_D:   execute_fcvt_s_d(); break;
+        case INST_FCVT_D_S:   execute_fcvt_d_s(); break;
+        case INST_FEQ_D:      execute_feq_d(); break;
+        case INST_FLT_D:      execute_flt_d(); break;
+        case INST_FLE_D:      execute_fle_d(); break;
+        case INST_FCLASS_D:   execute_fclass_d(); break;
+        case INST_FCVT_W_D:   execute_fcvt_w_d(); break;
+        case INST_FCVT_WU_D:  execute_fcvt_wu_d(); break;
+        case INST_FCVT_D_W:   execute_fcvt_d_w(); break;
+        case INST_FCVT_D_WU:  execute_fcvt_d_wu(); break;
+        default:
+            break;
     }
-    // Try "System" instructions
-    else if (cmd_mapping_SYSTEM.find(cmd & mask_SYSTEM) != cmd_mapping_SYSTEM.end()) {
-        instruction = cmd_mapping_SYSTEM[cmd & mask_SYSTEM];
-        instructionFound = true;
+
+    if (m_verbose)
+    {
+      std::cout << std::endl;
     }
+}
 
-    // Finally... decode the instruction and execute
-    if (instructionFound)
+const RiscvProcessor::DecodedInstruction& RiscvProcessor::FetchDecoded(const uint32_t address)
+{
+    // Find the page of decoded instructions (usually the same as last time)
+    uint32_t pageNum = address / CODE_PAGE_SIZE;
+    if (m_decode_last_page == nullptr || pageNum != m_decode_last_page_num)
     {
-      if (m_verbose)
-      {
-        VerbosePrintInstruction(instruction);
-      }
+        auto it = m_decode_cache.find(pageNum);
+        if (it == m_decode_cache.end())
+        {
+            it = m_decode_cache.emplace(pageNum, std::make_unique<DecodedPage>()).first;
+            m_mem.MarkCodePage(address);
+        }
+
+        m_decode_last_page = it->second.get();
+        m_decode_last_page_num = pageNum;
+    }
 
-      if (instruction.decoder != nullptr)
-      {
-          (this->*instruction.decoder)(cmd);
-      }
+    DecodedInstruction& decoded = (*m_decode_last_page)[(address % CODE_PAGE_SIZE) / 2];
+    if (!decoded.valid)
+    {
+        decoded = Decode(FetchInstruction(address));
+        if (decoded.length == 4 && address % CODE_PAGE_SIZE == CODE_PAGE_SIZE - 2)
+        {
+            // the second half is on the next page, and writes there matter too
+            m_mem.MarkCodePage(address + 2);
+        }
+        if (HasBreakpoint(address))
+        {
+            // still decoded above, so a bad fetch throws just the same
+            uint8_t length = decoded.length;
+            decoded = DecodedInstruction();
+            decoded.valid = true;
+            decoded.id = INST_BREAKPOINT;
+            decoded.length = length;
+        }
+    }
 
-      if (instruction.executor != nullptr)
-      {
-          (this->*instruction.executor)();
-      }
+    return decoded;
+}
 
-      if (m_verbose)
-      {
-        std::cout << std::endl;
-      }
-      return;
+uint32_t RiscvProcessor::FetchInstruction(const uint32_t address)
+{
+    // Only fetch the second half if there is one, as a compressed
+    // instruction can be the last thing in memory
+    uint32_t low = m_mem.ReadHalfword(address);
+    if ((low & 0x3) != 0x3)
+    {
+        return low;
     }
+    return m_mem.FetchWord(address);
+}
 
-    // No instruction matched
-    if (m_verbose)
+RiscvProcessor::DecodedInstruction RiscvProcessor::Decode(const uint32_t rawCmd)
+{
+    static_assert(InstructionTableInOrder(s_instructions), "s_instructions must be in InstructionId order");
+    static constexpr DecodeIndex index = BuildDecodeIndex(s_instructions);
+
+    DecodedInstruction decoded;
+    decoded.valid = true;
+
+    // Compressed instructions have anything but 11 in the lowest two bits
+    uint32_t cmd = rawCmd;
+    if ((rawCmd & 0x3) != 0x3)
     {
-      std::cout << "unknown instruction" << std::endl;
+        cmd = ExpandCompressed(static_cast<uint16_t>(rawCmd));
+        decoded.length = 2;
     }
-    RaiseException(ex_illegal_instruction);
+
+    // Only the candidates sharing this opcode/funct3/funct7 bit need checking
+    uint32_t key = DecodeKey(cmd);
+    for (unsigned int i = 0; i < index.count[key]; ++i)
+    {
+        const Instruction& instruction = s_instructions[index.candidates[index.first[key] + i]];
+        if ((cmd & instruction.mask) == instruction.match)
+        {
+            decoded.id = instruction.id;
+            break;
+        }
+    }
+
+    if (decoded.id == INST_ILLEGAL)
+    {
+        // illegal instruction, raised when executed
+        return decoded;
+    }
+
+    // Decode the operands now so they don't need extracting again
+    switch (s_instructions[decoded.id].format)
+    {
+        case FORMAT_R: decode_R(cmd, decoded); break;
+        case FORMAT_I: decode_I(cmd, decoded); break;
+        case FORMAT_S: decode_S(cmd, decoded); break;
+        case FORMAT_B: decode_B(cmd, decoded); break;
+        case FORMAT_U: decode_U(cmd, decoded); break;
+        case FORMAT_J: decode_J(cmd, decoded); break;
+        case FORMAT_RM: decode_RM(cmd, decoded); break;
+        case FORMAT_R4: decode_R4(cmd, decoded); break;
+        case FORMAT_NONE: break;
+    }
+
+    // Control transfers and system instructions finish a basic block
+    uint32_t opcode = cmd & mask_UJ;
+    decoded.ends_block = opcode == mask_jal || opcode == mask_jalr ||
+                         opcode == mask_beq || opcode == mask_ecall ||
+                         opcode == mask_fence;
+
+    return decoded;
+}
+
+uint32_t RiscvProcessor::ExpandCompressed(const uint16_t cmd)
+{
+    // Register fields: full size, and the 3 bit ones for x8-x15
+    const uint32_t rd = (cmd >> 7) & 0x1F;
+    const uint32_t rs2 = (cmd >> 2) & 0x1F;
+    const uint32_t rdShort = ((cmd >> 2) & 0x7) + 8;
+    const uint32_t rs1Short = ((cmd >> 7) & 0x7) + 8;
+    const uint32_t funct3 = (cmd >> 13) & 0x7;
+
+    // Immediates, scattered as the spec has them
+    const int32_t imm6 = SignExtend(((cmd >> 7) & 0x20) | ((cmd >> 2) & 0x1F), 6);
+    const uint32_t uimmWord = ((cmd >> 7) & 0x38) | ((cmd >> 4) & 0x4) | ((cmd << 1) & 0x40);
+    const uint32_t uimmDouble = ((cmd >> 7) & 0x38) | ((cmd << 1) & 0xC0);
+
+    switch (cmd & 0x3)
+    {
+        case 0x0:
+            switch (funct3)
+            {
+                case 0x0:
+                {
+                    // c.addi4spn -> addi rd', x2, nzuimm
+                    uint32_t nzuimm = ((cmd >> 7) & 0x30) | ((cmd >> 1) & 0x3C0) | ((cmd >> 4) & 0x4) | ((cmd >> 2) & 0x8);
+                    if (nzuimm == 0)
+                    {
+                        return 0;  // includes the all zero instruction
+                    }
+                    return EncodeI(static_cast<int32_t>(nzuimm), 2, 0x0, rdShort, 0x13);
+                }
+                case 0x1:
+                    // c.fld -> fld rd', uimm(rs1')
+                    return EncodeI(static_cast<int32_t>(uimmDouble), rs1Short, 0x3, rdShort, 0x07);
+                case 0x2:
+                    // c.lw -> lw rd', uimm(rs1')
+                    return EncodeI(static_cast<int32_t>(uimmWord), rs1Short, 0x2, rdShort, 0x03);
+                case 0x3:
+                    // c.flw -> flw rd', uimm(rs1')
+                    return EncodeI(static_cast<int32_t>(uimmWord), rs1Short, 0x2, rdShort, 0x07);
+                case 0x5:
+                    // c.fsd -> fsd rs2', uimm(rs1')
+                    return EncodeS(static_cast<int32_t>(uimmDouble), rdShort, rs1Short, 0x3, 0x27);
+                case 0x6:
+                    // c.sw -> sw rs2', uimm(rs1')
+                    return EncodeS(static_cast<int32_t>(uimmWord), rdShort, rs1Short, 0x2);
+                case 0x7:
+                    // c.fsw -> fsw rs2', uimm(rs1')
+                    return EncodeS(static_cast<int32_t>(uimmWord), rdShort, rs1Short, 0x2, 0x27);
+                default:
+                    // reserved
+                    return 0;
+            }
+
+        case 0x1:
+            switch (funct3)
+            {
+                case 0x0:
+                    // c.addi (c.nop) -> addi rd, rd, imm
+                    return EncodeI(imm6, rd, 0x0, rd, 0x13);
+                case 0x1:
+                case 0x5:
+                {
+                    // c.jal -> jal x1, offset, c.j -> jal x0, offset
+                    uint32_t offset = ((cmd >> 1) & 0x800) | ((cmd >> 7) & 0x10) | ((cmd >> 1) & 0x300) |
+                                      ((cmd << 2) & 0x400) | ((cmd >> 1) & 0x40) | ((cmd << 1) & 0x80) |
+                                      ((cmd >> 2) & 0xE) | ((cmd << 3) & 0x20);
+                    return EncodeJ(SignExtend(offset, 12), funct3 == 0x1 ? 1 : 0);
+                }
+                case 0x2:
+                    // c.li -> addi rd, x0, imm
+                    return EncodeI(imm6, 0, 0x0, rd, 0x13);
+                case 0x3:
+                    if (rd == 2)
+                    {
+                        // c.addi16sp -> addi x2, x2, nzimm
+                        uint32_t nzimm = ((cmd >> 3) & 0x200) | ((cmd >> 2) & 0x10) | ((cmd << 1) & 0x40) |
+                                         ((cmd << 4) & 0x180) | ((cmd << 3) & 0x20);
+                        if (nzimm == 0)
+                        {
+                            return 0;
+                        }
+                        return EncodeI(SignExtend(nzimm, 10), 2, 0x0, 2, 0x13);
+                    }
+                    // c.lui -> lui rd, nzimm
+                    if (imm6 == 0)
+                    {
+                        return 0;
+                    }
+                    return (static_cast<uint32_t>(imm6) << 12) | (rd << 7) | 0x37;
+                case 0x4:
+                {
+                    uint32_t rs1 = rs1Short;
+                    switch ((cmd >> 10) & 0x3)
+                    {
+                        case 0x0:
+                        case 0x1:
+                            // c.srli, c.srai -> srli/srai rd', rd', shamt (shamt[5] must be 0)
+                            if (cmd & 0x1000)
+                            {
+                                return 0;
+                            }
+                            return EncodeI(static_cast<int32_t>(rs2 | ((cmd & 0x400) ? 0x400 : 0)), rs1, 0x5, rs1, 0x13);
+                        case 0x2:
+                            // c.andi -> andi rd', rd', imm
+                            return EncodeI(imm6, rs1, 0x7, rs1, 0x13);
+                        default:
+                        {
+                            // c.sub, c.xor, c.or, c.and (the rest are RV64 only)
+                            if (cmd & 0x1000)
+                            {
+                                return 0;
+                            }
+                            static const uint32_t ops[][2] = {{0x20, 0x0}, {0x00, 0x4}, {0x00, 0x6}, {0x00, 0x7}};
+                            const uint32_t* op = ops[(cmd >> 5) & 0x3];
+                            return EncodeR(op[0], rdShort, rs1, op[1], rs1);
+                        }
+                    }
+                }
+                case 0x6:
+                case 0x7:
+                {
+                    // c.beqz, c.bnez -> beq/bne rs1', x0, offset
+                    uint32_t offset = ((cmd >> 4) & 0x100) | ((cmd >> 7) & 0x18) | ((cmd << 1) & 0xC0) |
+                                      ((cmd >> 2) & 0x6) | ((cmd << 3) & 0x20);
+                    return EncodeB(SignExtend(offset, 9), 0, rs1Short, funct3 == 0x6 ? 0x0 : 0x1);
+                }
+            }
+            return 0;
+
+        case 0x2:
+            switch (funct3)
+            {
+                case 0x0:
+                    // c.slli -> slli rd, rd, shamt (shamt[5] must be 0)
+                    if (cmd & 0x1000)
+                    {
+                        return 0;
+                    }
+                    return EncodeI(static_cast<int32_t>(rs2), rd, 0x1, rd, 0x13);
+                case 0x1:
+                {
+                    // c.fldsp -> fld rd, uimm(x2)
+                    uint32_t uimm = ((cmd >> 7) & 0x20) | ((cmd >> 2) & 0x18) | ((cmd << 4) & 0x1C0);
+                    return EncodeI(static_cast<int32_t>(uimm), 2, 0x3, rd, 0x07);
+                }
+                case 0x2:
+                case 0x3:
+                {
+                    // c.lwsp -> lw rd, uimm(x2), c.flwsp -> flw rd, uimm(x2)
+                    if (rd == 0 && funct3 == 0x2)
+                    {
+                        return 0;
+                    }
+                    uint32_t uimm = ((cmd >> 7) & 0x20) | ((cmd >> 2) & 0x1C) | ((cmd << 4) & 0xC0);
+                    return EncodeI(static_cast<int32_t>(uimm), 2, 0x2, rd, funct3 == 0x2 ? 0x03 : 0x07);
+                }
+                case 0x4:
+                    if ((cmd & 0x1000) == 0)
+                    {
+                        if (rs2 == 0)
+                        {
+                            // c.jr -> jalr x0, 0(rs1)
+                            return rd == 0 ? 0 : EncodeI(0, rd, 0x0, 0, 0x67);
+                        }
+                        // c.mv -> add rd, x0, rs2
+                        return EncodeR(0x00, rs2, 0, 0x0, rd);
+                    }
+                    if (rs2 == 0)
+                    {
+                        // c.ebreak, c.jalr -> jalr x1, 0(rs1)
+                        return rd == 0 ? 0x00100073 : EncodeI(0, rd, 0x0, 1, 0x67);
+                    }
+                    // c.add -> add rd, rd, rs2
+                    return EncodeR(0x00, rs2, rd, 0x0, rd);
+                case 0x5:
+                {
+                    // c.fsdsp -> fsd rs2, uimm(x2)
+                    uint32_t uimm = ((cmd >> 7) & 0x38) | ((cmd >> 1) & 0x1C0);
+                    return EncodeS(static_cast<int32_t>(uimm), rs2, 2, 0x3, 0x27);
+                }
+                case 0x6:
+                case 0x7:
+                {
+                    // c.swsp -> sw rs2, uimm(x2), c.fswsp -> fsw rs2, uimm(x2)
+                    uint32_t uimm = ((cmd >> 7) & 0x3C) | ((cmd >> 1) & 0xC0);
+                    return EncodeS(static_cast<int32_t>(uimm), rs2, 2, 0x2, funct3 == 0x6 ? 0x23 : 0x27);
+                }
+                default:
+                    return 0;
+            }
+
+        default:
+            // not compressed
+            return 0;
+    }
+}
+
+const char* RiscvProcessor::InstructionName(const InstructionId id)
+{
+    if (id >= NUM_INSTRUCTIONS)
+    {
+        return "unknown";
+    }
+    return s_instructions[id].displayName;
+}
+
+void RiscvProcessor::InvalidateDecoded(const MemoryMap::AddrType writeAddress, const MemoryMap::AddrType writeSize)
+{
+    // A full size instruction starting in the halfword before can overlap
+    // the write too (even from the previous page)
+    MemoryMap::AddrType address = writeAddress >= 2 ? writeAddress - 2 : writeAddress;
+    MemoryMap::AddrType size = writeSize + (writeAddress - address);
+
+    for (auto& page : m_decode_cache)
+    {
+        MemoryMap::AddrType pageStart = static_cast<MemoryMap::AddrType>(page.first) * CODE_PAGE_SIZE;
+        MemoryMap::AddrType pageEnd = pageStart + CODE_PAGE_SIZE;
+        if (address >= pageEnd || address + size <= pageStart)
+        {
+            continue;
+        }
+
+        // drop every instruction overlapping the written bytes
+        MemoryMap::AddrType first = (std::max(address, pageStart) - pageStart) / 2;
+        MemoryMap::AddrType last = (std::min(address + size, pageEnd) - pageStart - 1) / 2;
+        for (MemoryMap::AddrType i = first; i <= last; ++i)
+        {
+            (*page.second)[i].valid = false;
+        }
+    }
+
+    for (auto& page : m_page_blocks)
+    {
+        MemoryMap::AddrType pageStart = static_cast<MemoryMap::AddrType>(page.first) * CODE_PAGE_SIZE;
+        if (address >= pageStart + CODE_PAGE_SIZE || address + size <= pageStart)
+        {
+            continue;
+        }
+
+        std::vector<Block*> pageBlocks = page.second;
+        for (Block* block : pageBlocks)
+        {
+            if (address < block->end && address + size > block->start)
+            {
+                RetireBlock(block);
+            }
+        }
+    }
+}
+
+RiscvProcessor::Block* RiscvProcessor::FetchBlock(const uint32_t address)
+{
+    // Usually one of the blocks that followed the last one last time
+    bool linkable = m_last_block != nullptr && m_last_block->valid;
+    if (linkable)
+    {
+        for (const BlockLink& link : m_last_block->next)
+        {
+            if (link.block != nullptr && link.pc == address && link.epoch == m_block_epoch)
+            {
+                return link.block;
+            }
+        }
+    }
+
+    Block* block = nullptr;
+    auto it = m_blocks.find(address);
+    if (it != m_blocks.end())
+    {
+        block = it->second.get();
+    }
+    else
+    {
+        block = BuildBlock(address);
+    }
+
+    // Chain it on to the last block, replacing the older of its links
+    if (linkable)
+    {
+        BlockLink& link = m_last_block->next[m_last_block->nextReplace];
+        link.pc = address;
+        link.block = block;
+        link.epoch = m_block_epoch;
+        m_last_block->nextReplace = (m_last_block->nextReplace + 1) % m_last_block->next.size();
+    }
+
+    return block;
+}
+
+RiscvProcessor::Block* RiscvProcessor::BuildBlock(const uint32_t address)
+{
+    std::unique_ptr<Block> block = std::make_unique<Block>();
+    block->start = address;
+
+    uint32_t pc = address;
+    while (true)
+    {
+        const DecodedInstruction* decoded = nullptr;
+        if (pc == address)
+        {
+            decoded = &FetchDecoded(pc);
+        }
+        else
+        {
+            // Don't fail on reading past the end of memory before the
+            // program has actually got there
+            try
+            {
+                decoded = &FetchDecoded(pc);
+            }
+            catch (std::out_of_range&)
+            {
+                break;
+            }
+        }
+
+        block->ops.push_back(*decoded);
+        pc += decoded->length;
+
+        if (decoded->ends_block ||
+            pc / CODE_PAGE_SIZE != address / CODE_PAGE_SIZE ||
+            block->ops.size() == MAX_BLOCK_LENGTH)
+        {
+            break;
+        }
+    }
+    block->end = pc;
+
+    Block* ret = block.get();
+    m_page_blocks[address / CODE_PAGE_SIZE].push_back(ret);
+    m_blocks[address] = std::move(block);
+    return ret;
 }
 
-void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction& inst)
+void RiscvProcessor::RetireBlock(Block* block)
 {
-  if (inst.decoder == &RiscvProcessor::decode_R)
+    block->valid = false;
+    m_block_epoch++;  // drops every link to it
+
+    std::vector<Block*>& pageBlocks = m_page_blocks[block->start / CODE_PAGE_SIZE];
+    pageBlocks.erase(std::remove(pageBlocks.begin(), pageBlocks.end(), block), pageBlocks.end());
+
+    auto it = m_blocks.find(block->start);
+    m_retired_blocks.push_back(std::move(it->second));
+    m_blocks.erase(it);
+}
+
+void RiscvProcessor::VerbosePrintInstruction(const DecodedInstruction& decoded)
+{
+  const Instruction& inst = s_instructions[decoded.id];
+  if (inst.format == FORMAT_R)
   {
     // R type
     std::cout << std::setw(6);
@@ -489,7 +1849,7 @@ void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction&
     std::cout << std::setw(0);
     std::cout << "x" << std::dec << m_decoded_rs2;
   }
-  else if (inst.decoder == &RiscvProcessor::decode_I)
+  else if (inst.format == FORMAT_I)
   {
     // I type
     std::cout << std::setw(6);
@@ -509,7 +1869,7 @@ void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction&
     std::cout << std::setfill(' ');
     std::cout << std::hex << m_decoded_imm;
   }
-  else if (inst.decoder == &RiscvProcessor::decode_S)
+  else if (inst.format == FORMAT_S)
   {
     // S type
     std::cout << std::setw(6);
@@ -529,7 +1889,7 @@ void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction&
     std::cout << std::setfill(' ');
     std::cout << std::hex << m_decoded_imm;
   }
-  else if (inst.decoder == &RiscvProcessor::decode_B)
+  else if (inst.format == FORMAT_B)
   {
     // B type
     std::cout << std::setw(6);
@@ -549,7 +1909,7 @@ void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction&
     std::cout << std::setfill(' ');
     std::cout << std::hex << m_decoded_imm;
   }
-  else if (inst.decoder == &RiscvProcessor::decode_U)
+  else if (inst.format == FORMAT_U)
   {
     // U type
     std::cout << std::setw(6);
@@ -564,7 +1924,7 @@ void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction&
     std::cout << std::setfill(' ');
     std::cout << "," << std::hex << m_decoded_imm;
   }
-  else if (inst.decoder == &RiscvProcessor::decode_J)
+  else if (inst.format == FORMAT_J)
   {
     // J type
     std::cout << std::setw(6);
@@ -579,7 +1939,37 @@ void RiscvProcessor::VerbosePrintInstruction(const RiscvProcessor::Instruction&
     std::cout << std::setfill(' ');
     std::cout << "," << std::hex << m_decoded_imm;
   }
-  else if (inst.decoder == nullptr)
+  else if (inst.format == FORMAT_RM || inst.format == FORMAT_R4)
+  {
+    // FP, with the rounding mode last
+    std::cout << std::setw(6);
+    std::cout << std::setfill(' ');
+    std::cout << std::left;
+    std::cout << inst.displayName;
+
+    std::cout << std::setw(0);
+    std::cout << "f" << std::dec << m_decoded_rd;
+    std::cout << ",";
+
+    std::cout << std::setw(0);
+    std::cout << "f" << std::dec << m_decoded_rs1;
+    std::cout << ",";
+
+    std::cout << std::setw(0);
+    std::cout << "f" << std::dec << m_decoded_rs2;
+    std::cout << ",";
+
+    if (inst.format == FORMAT_R4)
+    {
+      std::cout << std::setw(0);
+      std::cout << "f" << std::dec << (m_decoded_imm & 0x1F);
+      std::cout << ",";
+    }
+
+    std::cout << std::setw(0);
+    std::cout << "rm" << std::dec << ((m_decoded_imm >> (inst.format == FORMAT_R4 ? 5 : 0)) & 0x7);
+  }
+  else if (inst.format == FORMAT_NONE)
   {
     // SYSTEM type
     std::cout << std::setw(6);
@@ -609,11 +1999,14 @@ void RiscvProcessor::RaiseException(const RiscvProcessor::Exception& exception_d
     // Set mepc
     SetCSRValue(csr_mepc, m_pc);
 
+    // Traps lose any reservation
+    m_reservation_valid = false;
+
     // Set mtval
     if (exception_data == ex_illegal_instruction)
     {
         // Store the instruction
-        SetCSRValue(csr_mtval, m_mem.ReadWord(m_pc));
+        SetCSRValue(csr_mtval, FetchInstruction(m_pc));
     }
     else if (exception_data == ex_instruction_address_misaligned)
     {
@@ -635,101 +2028,112 @@ void RiscvProcessor::RaiseException(const RiscvProcessor::Exception& exception_d
     // Push interrupt enable stack (ie)
     uint32_t mstatus;
 
-    mstatus = m_csr_table[csr_mstatus];
+    mstatus = m_csr[CSR_MSTATUS];
     uint32_t mie = (mstatus >> 3) & 0x1;
     mstatus = (mstatus & ~(0x1 << 3)) | 0 << 3; 
     mstatus = (mstatus & ~(0x1 << 7)) | mie << 7; 
     SetCSRValue(csr_mstatus, mstatus);
 
     // Push privilege level stack (mpp) (copy prv to mstatus and to go machine prv)
-    mstatus = m_csr_table[csr_mstatus];
+    mstatus = m_csr[CSR_MSTATUS];
     mstatus = (mstatus & ~(0x3 << 11)) | m_prv << 11; // replace bits 12:11 with privilege level
     SetCSRValue(csr_mstatus, mstatus);
     SetPrivilegeLevel(PRV_MACHINE);
 
     // transfer to mtvec base
-    uint32_t base = m_csr_table[csr_mtvec] & 0xFFFFFFFC;
-    uint32_t mode = m_csr_table[csr_mtvec] & 0x1;
+    uint32_t base = m_csr[CSR_MTVEC] & 0xFFFFFFFC;
+    uint32_t mode = m_csr[CSR_MTVEC] & 0x1;
     // in vectored mode, need to add 4*cause
     if (mode == 1 && exception_data.interrupt == 1) {
-        base += 4 * m_csr_table[csr_mcause];
+        base += 4 * m_csr[CSR_MCAUSE];
     }
-    m_pc = base - 4;
+    m_pc = base - m_decoded_length;
 }
 
 
 // Core instruction decoding ---------------------------------------------------
-void RiscvProcessor::decode_R(uint32_t cmd) {
+void RiscvProcessor::decode_R(const uint32_t cmd, DecodedInstruction& decoded) {
   // decode subfields
-  m_decoded_rd = (cmd >> 7) & 0x1F;
-  m_decoded_rs1 = (cmd >> 15) & 0x1F;
-  m_decoded_rs2 = (cmd >> 20) & 0x1F;
+  decoded.rd = (cmd >> 7) & 0x1F;
+  decoded.rs1 = (cmd >> 15) & 0x1F;
+  decoded.rs2 = (cmd >> 20) & 0x1F;
+}
+
+void RiscvProcessor::decode_RM(const uint32_t cmd, DecodedInstruction& decoded) {
+  decode_R(cmd, decoded);
+  decoded.imm = (cmd >> 12) & 0x7;  // rounding mode
 }
 
-void RiscvProcessor::decode_I(uint32_t cmd) {
-  m_decoded_rd = (cmd >> 7) & 0x1F;
-  m_decoded_rs1 = (cmd >> 15) & 0x1F;
-  m_decoded_imm = (cmd >> 20) & 0xFFF;
+void RiscvProcessor::decode_R4(const uint32_t cmd, DecodedInstruction& decoded) {
+  decode_R(cmd, decoded);
+  decoded.imm = (cmd >> 27) & 0x1F;         // rs3
+  decoded.imm |= ((cmd >> 12) & 0x7) << 5;  // rounding mode
+}
+
+void RiscvProcessor::decode_I(const uint32_t cmd, DecodedInstruction& decoded) {
+  decoded.rd = (cmd >> 7) & 0x1F;
+  decoded.rs1 = (cmd >> 15) & 0x1F;
+  decoded.imm = (cmd >> 20) & 0xFFF;
 
   // Perform sign extension
   uint32_t imm_sign = (cmd >> 31) & 0x1;
   if (imm_sign == 0x1) {
     // sign extend
-    m_decoded_imm |= 0xFFFFF000;
+    decoded.imm |= 0xFFFFF000;
   }
 }
 
-void RiscvProcessor::decode_S(uint32_t cmd) {
-  m_decoded_rs1 = (cmd >> 15) & 0x1F;
-  m_decoded_rs2 = (cmd >> 20) & 0x1F;
-  m_decoded_imm = 0x0;
-  m_decoded_imm |= (cmd >> 7) & 0x1F;   // imm[4:0] in cmd[11:7]
-  m_decoded_imm |= (cmd >> 20) & 0xFE0; // imm[11:5] in cmd[31:25]
+void RiscvProcessor::decode_S(const uint32_t cmd, DecodedInstruction& decoded) {
+  decoded.rs1 = (cmd >> 15) & 0x1F;
+  decoded.rs2 = (cmd >> 20) & 0x1F;
+  decoded.imm = 0x0;
+  decoded.imm |= (cmd >> 7) & 0x1F;   // imm[4:0] in cmd[11:7]
+  decoded.imm |= (cmd >> 20) & 0xFE0; // imm[11:5] in cmd[31:25]
 
   // Perform sign extension
   uint32_t imm_sign = (cmd >> 31) & 0x1;
   if (imm_sign == 0x1) {
     // sign extend
-    m_decoded_imm |= 0xFFFFF000;
+    decoded.imm |= 0xFFFFF000;
   }  
 }
 
-void RiscvProcessor::decode_B(uint32_t cmd) {
+void RiscvProcessor::decode_B(const uint32_t cmd, DecodedInstruction& decoded) {
   // decode subfields
-  m_decoded_rs1 = (cmd >> 15) & 0x1F;
-  m_decoded_rs2 = (cmd >> 20) & 0x1F;
-  m_decoded_imm = 0x0;
-  m_decoded_imm |= (cmd << 4) & 0x800;   // imm[11] in cmd[7]
-  m_decoded_imm |= (cmd >> 7) & 0x1E;    // imm[4:1] in cmd[11:8]
-  m_decoded_imm |= (cmd >> 20) & 0x7E0;  // imm[10:5] in cmd[30:25]
-  m_decoded_imm |= (cmd >> 19) & 0x1000; // imm[12] in cmd[31]
+  decoded.rs1 = (cmd >> 15) & 0x1F;
+  decoded.rs2 = (cmd >> 20) & 0x1F;
+  decoded.imm = 0x0;
+  decoded.imm |= (cmd << 4) & 0x800;   // imm[11] in cmd[7]
+  decoded.imm |= (cmd >> 7) & 0x1E;    // imm[4:1] in cmd[11:8]
+  decoded.imm |= (cmd >> 20) & 0x7E0;  // imm[10:5] in cmd[30:25]
+  decoded.imm |= (cmd >> 19) & 0x1000; // imm[12] in cmd[31]
 
   // Perform sign extension
   uint32_t imm_sign = (cmd >> 31) & 0x1;
   if (imm_sign == 0x1) {
     // sign extend
-    m_decoded_imm |= 0xFFFFE000;
+    decoded.imm |= 0xFFFFE000;
   }
 }
 
-void RiscvProcessor::decode_U(uint32_t cmd) {
-  m_decoded_rd = (cmd >> 7) & 0x1F;  // cut out rd value
-  m_decoded_imm = cmd & 0xFFFFF000;  // imm = cmd[31:12] (the remainder=0)
+void RiscvProcessor::decode_U(const uint32_t cmd, DecodedInstruction& decoded) {
+  decoded.rd = (cmd >> 7) & 0x1F;  // cut out rd value
+  decoded.imm = cmd & 0xFFFFF000;  // imm = cmd[31:12] (the remainder=0)
 }
 
-void RiscvProcessor::decode_J(uint32_t cmd) {
-  m_decoded_rd = (cmd >> 7) & 0x1F;
-  m_decoded_imm = 0x0;
-  m_decoded_imm |= (cmd >> 20) & 0x7FE;    // imm[10:1] in cmd[30:21]
-  m_decoded_imm |= (cmd >> 9) & 0x800;     // imm[11] in cmd[20]
-  m_decoded_imm |= cmd & 0xFF000;          // imm[19:12] in cmd[19:12]
-  m_decoded_imm |= (cmd >> 11) & 0x100000; // imm[20] in cmd[31]
+void RiscvProcessor::decode_J(const uint32_t cmd, DecodedInstruction& decoded) {
+  decoded.rd = (cmd >> 7) & 0x1F;
+  decoded.imm = 0x0;
+  decoded.imm |= (cmd >> 20) & 0x7FE;    // imm[10:1] in cmd[30:21]
+  decoded.imm |= (cmd >> 9) & 0x800;     // imm[11] in cmd[20]
+  decoded.imm |= cmd & 0xFF000;          // imm[19:12] in cmd[19:12]
+  decoded.imm |= (cmd >> 11) & 0x100000; // imm[20] in cmd[31]
 
   // Perform sign extension
   uint32_t imm_sign = (cmd >> 31) & 0x1;
   if (imm_sign == 0x1) {
     // sign extend
-    m_decoded_imm |= 0xFFE00000;
+    decoded.imm |= 0xFFE00000;
   }
 }
 
@@ -744,30 +2148,28 @@ void RiscvProcessor::execute_auipc() {
 }
 
 void RiscvProcessor::execute_jal() {
-  // store PC+4 in rd
-  SetReg(m_decoded_rd, m_pc+4);
+  // store the next PC in rd
+  SetReg(m_decoded_rd, m_pc + m_decoded_length);
   // jump
-  m_pc += m_decoded_imm - 4;
+  m_pc += m_decoded_imm - m_decoded_length;
 }
 
 void RiscvProcessor::execute_jalr() {
   // save the pc register value before overwriting
-  uint32_t m_pc_saved = m_pc+4;
+  uint32_t m_pc_saved = m_pc + m_decoded_length;
 
-  // Jump  
-  m_pc = m_reg[m_decoded_rs1]+m_decoded_imm-4;  // -4 (execute function will increment by 4)
-  m_pc -= m_pc % 2; // ensure alignment
-  
-  // write PC+4 to rd (do this last since rd and rs1 can be the same)
+  // Jump (the execute function will step on by the instruction length)
+  m_pc = (m_reg[m_decoded_rs1] + m_decoded_imm) & ~1u;  // ensure alignment
+  m_pc -= m_decoded_length;
+
+  // write the next PC to rd (do this last since rd and rs1 can be the same)
   SetReg(m_decoded_rd, m_pc_saved);
 }
 
 void RiscvProcessor::execute_lb() {
   uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
 
-  std::byte b;
-  m_mem.Get(address, b);
-  uint32_t data = static_cast<uint32_t>(b) & 0xff;
+  uint32_t data = m_mem.ReadByte(address);
 
   // sign extend
   uint32_t data_sign = (data >> 7) & 0x1;
@@ -781,13 +2183,7 @@ void RiscvProcessor::execute_lb() {
 void RiscvProcessor::execute_lh() {
   uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
 
-  std::byte b0, b1;
-  m_mem.Get(address + 0, b0);
-  m_mem.Get(address + 1, b1);
-
-  uint32_t data = 0;
-  data |= (static_cast<uint32_t>(b0) & 0xff) << 0;
-  data |= (static_cast<uint32_t>(b1) & 0xff) << 8;
+  uint32_t data = m_mem.ReadHalfword(address);
 
   // Check address alignment
   if (address % 2 != 0) {
@@ -822,9 +2218,7 @@ void RiscvProcessor::execute_lw() {
 void RiscvProcessor::execute_lbu() {
   uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
 
-  std::byte b;
-  m_mem.Get(address, b);
-  uint32_t data = static_cast<uint32_t>(b) & 0xff;
+  uint32_t data = m_mem.ReadByte(address);
 
   SetReg(m_decoded_rd, data);
 }
@@ -832,13 +2226,7 @@ void RiscvProcessor::execute_lbu() {
 void RiscvProcessor::execute_lhu() {
   uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
 
-  std::byte b0, b1;
-  m_mem.Get(address + 0, b0);
-  m_mem.Get(address + 1, b1);
-
-  uint32_t data = 0;
-  data |= (static_cast<uint32_t>(b0) & 0xff) << 0;
-  data |= (static_cast<uint32_t>(b1) & 0xff) << 8;
+  uint32_t data = m_mem.ReadHalfword(address);
 
   // Check address alignment
   if (address % 2 != 0) {
@@ -854,8 +2242,7 @@ void RiscvProcessor::execute_sb() {
   uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
   uint32_t data = m_reg[m_decoded_rs2];
 
-  const std::byte b{static_cast<uint8_t>(data & 0xff)};
-  m_mem.Put(address, b);
+  m_mem.WriteByte(address, data & 0xff);
 }
 
 void RiscvProcessor::execute_sh() {
@@ -869,11 +2256,7 @@ void RiscvProcessor::execute_sh() {
     return;
   }
 
-  const std::vector<std::byte> bytes = {
-    std::byte{static_cast<uint8_t>((data >> 0) & 0xff)},
-    std::byte{static_cast<uint8_t>((data >> 8) & 0xff)}
-  };
-  m_mem.Put(address, bytes);
+  m_mem.WriteHalfword(address, data & 0xffff);
 }
 
 void RiscvProcessor::execute_sw() {
@@ -887,48 +2270,48 @@ void RiscvProcessor::execute_sw() {
     return;
   }
 
-  m_mem.WriteWord(address, data, 0xFFFFFFFF);
+  m_mem.WriteWord(address, data);
 }
 
 void RiscvProcessor::execute_beq() {
   if (m_reg[m_decoded_rs1] == m_reg[m_decoded_rs2]) {
     // Perform jump
-    m_pc += m_decoded_imm-4;  // -4 (execute function will increment by 4)
+    m_pc += m_decoded_imm - m_decoded_length;  // the execute function steps on by the length
   }
 }
 
 void RiscvProcessor::execute_bne() {
   if (m_reg[m_decoded_rs1] != m_reg[m_decoded_rs2]) {
     // Perform jump
-    m_pc += m_decoded_imm-4;  // -4 (execute function will increment by 4)
+    m_pc += m_decoded_imm - m_decoded_length;  // the execute function steps on by the length
   }
 }
 
 void RiscvProcessor::execute_blt() {
   if (static_cast<int32_t>(m_reg[m_decoded_rs1]) < static_cast<int32_t>(m_reg[m_decoded_rs2])) {
     // Perform jump
-    m_pc += m_decoded_imm-4;  // -4 (execute function will increment by 4)
+    m_pc += m_decoded_imm - m_decoded_length;  // the execute function steps on by the length
   }
 }
 
 void RiscvProcessor::execute_bge() {
   if (static_cast<int32_t>(m_reg[m_decoded_rs1]) >= static_cast<int32_t>(m_reg[m_decoded_rs2])) {
     // Perform jump
-    m_pc += m_decoded_imm-4;  // -4 (execute function will increment by 4)
+    m_pc += m_decoded_imm - m_decoded_length;  // the execute function steps on by the length
   }
 }
 
 void RiscvProcessor::execute_bltu() {
   if (static_cast<uint32_t>(m_reg[m_decoded_rs1]) < static_cast<uint32_t>(m_reg[m_decoded_rs2])) {
     // Perform jump
-    m_pc += m_decoded_imm-4;  // -4 (execute function will increment by 4)
+    m_pc += m_decoded_imm - m_decoded_length;  // the execute function steps on by the length
   }
 }
 
 void RiscvProcessor::execute_bgeu() {
   if (static_cast<uint32_t>(m_reg[m_decoded_rs1]) >= static_cast<uint32_t>(m_reg[m_decoded_rs2])) {
     // Perform jump
-    m_pc += m_decoded_imm-4;  // -4 (execute function will increment by 4)
+    m_pc += m_decoded_imm - m_decoded_length;  // the execute function steps on by the length
   }
 }
 
@@ -1101,10 +2484,10 @@ void RiscvProcessor::execute_mret() {
 
 
   // Recover exception
-  m_pc = m_csr_table[csr_mepc] - 4;
+  m_pc = m_csr[CSR_MEPC] - m_decoded_length;
 
   // Read mstatus
-  uint32_t mstatus = m_csr_table[csr_mstatus];
+  uint32_t mstatus = m_csr[CSR_MSTATUS];
   uint32_t mpp = (mstatus >> 11) & 0x3;
   uint32_t mpie = (mstatus >> 7) & 0x1;
   uint32_t mie = (mstatus >> 3) & 0x1;
@@ -1116,7 +2499,7 @@ void RiscvProcessor::execute_mret() {
   mie = mpie;
   mpie = 1;
   mpp = PRV_USER;
-  mstatus = 0;
+  mstatus &= ~0x1888;  // keeping fs
   mstatus |= (mpp & 0x3) << 11;
   mstatus |= (mpie & 0x1) << 7;
   mstatus |= (mie & 0x1) << 3;
@@ -1124,6 +2507,10 @@ void RiscvProcessor::execute_mret() {
 }
 
 void RiscvProcessor::execute_ecall() {
+  if (m_ecall_handler && m_ecall_handler(*this)) {
+    return;
+  }
+
   // Exception checking
   if (m_prv == PRV_USER) {
     RaiseException(ex_environment_call_from_Umode);
@@ -1138,7 +2525,11 @@ void RiscvProcessor::execute_csrrw() {
   uint32_t csr_num = m_decoded_imm & 0xFFF;  // remove sign extension
 
   // Read values
-  uint32_t csr_val = m_csr_table[csr_num];
+  uint32_t csr_val;
+  if (!ReadCSR(csr_num, csr_val)) {
+    RaiseException(ex_illegal_instruction);
+    return;
+  }
   uint32_t reg_rs1 = m_reg[m_decoded_rs1];
   uint32_t reg_rd = m_reg[m_decoded_rd];
 
@@ -1166,7 +2557,11 @@ void RiscvProcessor::execute_csrrs() {
   uint32_t csr_num = m_decoded_imm & 0xFFF;  // remove sign extension
 
   // Read values
-  uint32_t csr_val = m_csr_table[csr_num];
+  uint32_t csr_val;
+  if (!ReadCSR(csr_num, csr_val)) {
+    RaiseException(ex_illegal_instruction);
+    return;
+  }
   uint32_t reg_rs1 = m_reg[m_decoded_rs1];
   uint32_t reg_rd = m_reg[m_decoded_rd];
 
@@ -1198,7 +2593,11 @@ void RiscvProcessor::execute_csrrc() {
   uint32_t csr_num = m_decoded_imm & 0xFFF;  // remove sign extension
 
   // Read values
-  uint32_t csr_val = m_csr_table[csr_num];
+  uint32_t csr_val;
+  if (!ReadCSR(csr_num, csr_val)) {
+    RaiseException(ex_illegal_instruction);
+    return;
+  }
   uint32_t reg_rs1 = m_reg[m_decoded_rs1];
   uint32_t reg_rd = m_reg[m_decoded_rd];
 
@@ -1230,7 +2629,11 @@ void RiscvProcessor::execute_csrrwi() {
   uint32_t csr_num = m_decoded_imm & 0xFFF;  // remove sign extension
 
   // Read values
-  uint32_t csr_val = m_csr_table[csr_num];
+  uint32_t csr_val;
+  if (!ReadCSR(csr_num, csr_val)) {
+    RaiseException(ex_illegal_instruction);
+    return;
+  }
   uint32_t reg_rd = m_reg[m_decoded_rd];
 
   // Write values
@@ -1255,7 +2658,11 @@ void RiscvProcessor::execute_csrrsi() {
   uint32_t csr_num = m_decoded_imm & 0xFFF;  // remove sign extension
 
   // Read values
-  uint32_t csr_val = m_csr_table[csr_num];
+  uint32_t csr_val;
+  if (!ReadCSR(csr_num, csr_val)) {
+    RaiseException(ex_illegal_instruction);
+    return;
+  }
   uint32_t reg_rd = m_reg[m_decoded_rd];
 
   // Write reg
@@ -1289,7 +2696,11 @@ void RiscvProcessor::execute_csrrci() {
   uint32_t csr_num = m_decoded_imm & 0xFFF;  // remove sign extension
 
   // Read values
-  uint32_t csr_val = m_csr_table[csr_num];
+  uint32_t csr_val;
+  if (!ReadCSR(csr_num, csr_val)) {
+    RaiseException(ex_illegal_instruction);
+    return;
+  }
   uint32_t reg_rd = m_reg[m_decoded_rd];
 
   // Write reg
@@ -1321,4 +2732,149 @@ void RiscvProcessor::execute_csrrci() {
   }
 }
 
+// M extension -----------------------------------------------------------------
+// Products are taken in 64 bits, with each operand sign or zero extended, so
+// that the high word comes for free. Division never traps: dividing by zero
+// gives all ones (or the dividend, for the remainder), and the one signed
+// overflow (-2^31 / -1) gives -2^31 with remainder 0.
+void RiscvProcessor::execute_mul() {
+  uint32_t product = m_reg[m_decoded_rs1] * m_reg[m_decoded_rs2];
+  SetReg(m_decoded_rd, product);
+}
+
+void RiscvProcessor::execute_mulh() {
+  int64_t product = static_cast<int64_t>(static_cast<int32_t>(m_reg[m_decoded_rs1])) *
+                    static_cast<int64_t>(static_cast<int32_t>(m_reg[m_decoded_rs2]));
+  SetReg(m_decoded_rd, static_cast<uint32_t>(static_cast<uint64_t>(product) >> 32));
+}
+
+void RiscvProcessor::execute_mulhsu() {
+  // can't overflow: |rs1| <= 2^31 and rs2 < 2^32
+  int64_t product = static_cast<int64_t>(static_cast<int32_t>(m_reg[m_decoded_rs1])) *
+                    static_cast<int64_t>(m_reg[m_decoded_rs2]);
+  SetReg(m_decoded_rd, static_cast<uint32_t>(static_cast<uint64_t>(product) >> 32));
+}
+
+void RiscvProcessor::execute_mulhu() {
+  uint64_t product = static_cast<uint64_t>(m_reg[m_decoded_rs1]) * static_cast<uint64_t>(m_reg[m_decoded_rs2]);
+  SetReg(m_decoded_rd, static_cast<uint32_t>(product >> 32));
+}
+
+void RiscvProcessor::execute_div() {
+  int32_t dividend = static_cast<int32_t>(m_reg[m_decoded_rs1]);
+  int32_t divisor = static_cast<int32_t>(m_reg[m_decoded_rs2]);
+  if (divisor == 0) {
+    SetReg(m_decoded_rd, 0xFFFFFFFF);
+  } else {
+    // in 64 bits, -2^31 / -1 doesn't overflow and truncates back to -2^31
+    int64_t quotient = static_cast<int64_t>(dividend) / divisor;
+    SetReg(m_decoded_rd, static_cast<uint32_t>(quotient));
+  }
+}
+
+void RiscvProcessor::execute_divu() {
+  uint32_t divisor = m_reg[m_decoded_rs2];
+  if (divisor == 0) {
+    SetReg(m_decoded_rd, 0xFFFFFFFF);
+  } else {
+    SetReg(m_decoded_rd, m_reg[m_decoded_rs1] / divisor);
+  }
+}
+
+void RiscvProcessor::execute_rem() {
+  int32_t dividend = static_cast<int32_t>(m_reg[m_decoded_rs1]);
+  int32_t divisor = static_cast<int32_t>(m_reg[m_decoded_rs2]);
+  if (divisor == 0) {
+    SetReg(m_decoded_rd, m_reg[m_decoded_rs1]);
+  } else {
+    int64_t remainder = static_cast<int64_t>(dividend) % divisor;
+    SetReg(m_decoded_rd, static_cast<uint32_t>(remainder));
+  }
+}
+
+void RiscvProcessor::execute_remu() {
+  uint32_t divisor = m_reg[m_decoded_rs2];
+  if (divisor == 0) {
+    SetReg(m_decoded_rd, m_reg[m_decoded_rs1]);
+  } else {
+    SetReg(m_decoded_rd, m_reg[m_decoded_rs1] % divisor);
+  }
+}
+
+// A extension ---
+
+void RiscvProcessor::execute_lr_w() {
+  uint32_t address = m_reg[m_decoded_rs1];
+  if (address % 4 != 0) {
+    RaiseException(ex_load_address_misaligned);
+    return;
+  }
+
+  uint32_t data = m_mem.AtomicLoadWord(address);
+  m_reservation_valid = true;
+  m_reservation_address = address;
+  m_reservation_value = data;
+  SetReg(m_decoded_rd, data);
+}
+
+void RiscvProcessor::execute_sc_w() {
+  uint32_t address = m_reg[m_decoded_rs1];
+  if (address % 4 != 0) {
+    RaiseException(ex_store_address_misaligned);
+    return;
+  }
+
+  // fails (writing 1 to rd) unless the word is as it was at the LR
+  bool stored = m_reservation_valid && m_reservation_address == address &&
+                m_mem.CompareExchangeWord(address, m_reservation_value, m_reg[m_decoded_rs2]);
+  m_reservation_valid = false;
+  SetReg(m_decoded_rd, stored ? 0 : 1);
+}
+
+void RiscvProcessor::ExecuteAmo(const MemoryMap::AtomicOp op) {
+  uint32_t address = m_reg[m_decoded_rs1];
+  if (address % 4 != 0) {
+    RaiseException(ex_store_address_misaligned);
+    return;
+  }
+
+  SetReg(m_decoded_rd, m_mem.AtomicWord(address, op, m_reg[m_decoded_rs2]));
+}
+
+void RiscvProcessor::execute_amoswap_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_SWAP);
+}
+
+void RiscvProcessor::execute_amoadd_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_ADD);
+}
+
+void RiscvProcessor::execute_amoxor_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_XOR);
+}
+
+void RiscvProcessor::execute_amoand_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_AND);
+}
+
+void RiscvProcessor::execute_amoor_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_OR);
+}
+
+void RiscvProcessor::execute_amomin_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_MIN);
+}
+
+void RiscvProcessor::execute_amomax_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_MAX);
+}
+
+void RiscvProcessor::execute_amominu_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_MINU);
+}
+
+void RiscvProcessor::execute_amomaxu_w() {
+  ExecuteAmo(MemoryMap::ATOMIC_MAXU);
+}
+
 } // namespace riscvdb
@@ -0,0 +1,1052 @@
+#include "riscv_processor.h"
+#include <cfenv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#ifdef __SSE2_MATH__
+#include <xmmintrin.h>
+#endif
+
+// F and D extensions.
+//
+// Arithmetic runs on the host FPU in the guest's rounding mode, and the
+// host's exception flags become fflags. The host and RISC-V agree on IEEE
+// 754 rounding, flags and tininess (detected after rounding on both), so
+// only these need fixing up afterwards or doing in software:
+//  - NaN results are always the canonical NaN, where x86 passes a NaN
+//    operand through or gives a negative default NaN
+//  - singles are NaN-boxed in the 64 bit registers
+//  - round to nearest, ties to max magnitude (RMM), which x86 doesn't have
+//  - min/max, comparisons, classify and sign injection
+//  - conversions to integers, which saturate instead of giving 0x80000000
+
+namespace riscvdb {
+
+namespace {
+
+// fflags bits
+const uint32_t FFLAG_NX = 0x01;  // inexact
+const uint32_t FFLAG_UF = 0x02;  // underflow
+const uint32_t FFLAG_OF = 0x04;  // overflow
+const uint32_t FFLAG_DZ = 0x08;  // divide by zero
+const uint32_t FFLAG_NV = 0x10;  // invalid
+
+// Rounding modes (rm and frm)
+const uint32_t RM_RNE = 0;
+const uint32_t RM_RTZ = 1;
+const uint32_t RM_RDN = 2;
+const uint32_t RM_RUP = 3;
+const uint32_t RM_RMM = 4;
+const uint32_t RM_DYN = 7;
+
+const uint32_t MSTATUS_FS = 0x6000;
+const uint32_t MSTATUS_SD = 0x80000000;
+
+const uint32_t CANONICAL_NAN_S = 0x7FC00000;
+const uint64_t CANONICAL_NAN_D = 0x7FF8000000000000;
+const uint64_t NAN_BOX = 0xFFFFFFFF00000000;
+
+template <typename To, typename From>
+To BitCast(const From value)
+{
+    static_assert(sizeof(To) == sizeof(From), "sizes must match");
+    To result;
+    std::memcpy(&result, &value, sizeof(To));
+    return result;
+}
+
+template <typename T> struct FpTraits;
+
+template <> struct FpTraits<float>
+{
+    typedef uint32_t Bits;
+    typedef double Wide;  // with room for round to odd (at least 2 more bits)
+    static constexpr Bits SIGN = 0x80000000;
+    static constexpr Bits QUIET = 0x00400000;
+    static constexpr Bits CANONICAL_NAN = CANONICAL_NAN_S;
+};
+
+template <> struct FpTraits<double>
+{
+    typedef uint64_t Bits;
+    typedef long double Wide;
+    static constexpr Bits SIGN = 0x8000000000000000;
+    static constexpr Bits QUIET = 0x0008000000000000;
+    static constexpr Bits CANONICAL_NAN = CANONICAL_NAN_D;
+};
+
+static_assert(std::numeric_limits<long double>::digits >= std::numeric_limits<double>::digits + 2,
+              "RMM doubles need a wider long double");
+
+template <typename T>
+T CanonicalNaN()
+{
+    return BitCast<T>(FpTraits<T>::CANONICAL_NAN);
+}
+
+template <typename T>
+bool IsSignalingNaN(const T value)
+{
+    typedef FpTraits<T> Traits;
+    typename Traits::Bits bits = BitCast<typename Traits::Bits>(value);
+    return std::isnan(value) && (bits & Traits::QUIET) == 0;
+}
+
+// Keeps the compiler from moving FP operations across the changes to the
+// host's rounding mode and flags, or from working them out at compile time
+template <typename T>
+T Launder(const T value)
+{
+    volatile T result = value;
+    return result;
+}
+
+uint32_t FlagsFromFenv(const int excepts)
+{
+    uint32_t flags = 0;
+    flags |= (excepts & FE_INVALID) ? FFLAG_NV : 0;
+    flags |= (excepts & FE_DIVBYZERO) ? FFLAG_DZ : 0;
+    flags |= (excepts & FE_OVERFLOW) ? FFLAG_OF : 0;
+    flags |= (excepts & FE_UNDERFLOW) ? FFLAG_UF : 0;
+    flags |= (excepts & FE_INEXACT) ? FFLAG_NX : 0;
+    return flags;
+}
+
+// Host rounding mode and flags through <cfenv>: slower, but covers x87 long
+// doubles too (and any host)
+class HostFenv
+{
+public:
+    explicit HostFenv(const int rounding)
+    {
+        std::fegetenv(&m_saved);
+        std::fesetround(rounding);
+        std::feclearexcept(FE_ALL_EXCEPT);
+    }
+
+    ~HostFenv()
+    {
+        std::fesetenv(&m_saved);
+    }
+
+    uint32_t Flags() const
+    {
+        return FlagsFromFenv(std::fetestexcept(FE_ALL_EXCEPT));
+    }
+
+private:
+    std::fenv_t m_saved;
+};
+
+#ifdef __SSE2_MATH__
+// Straight to MXCSR, which is all that float and double arithmetic uses.
+//
+// The flags the guest has already raised are set on the way in: raising a
+// host flag that was clear costs a microcode assist, some tens of ns, where
+// one that's already set is free, and fflags is sticky, so most programs
+// only pay for the first inexact result. The host's own rounding mode only
+// needs putting back if the guest's was different, as leftover host flags
+// are harmless.
+class HostRounding
+{
+public:
+    HostRounding(const uint32_t mode, const uint32_t flags)
+    : m_saved(_mm_getcsr())
+    , m_csr(0x1F80 | ROUNDING[mode])
+    {
+        // rounding control is bits 14:13, and everything else is the default
+        // (exceptions masked, no flush to zero)
+        m_csr |= (flags & FFLAG_NV) ? 0x01 : 0;
+        m_csr |= (flags & FFLAG_DZ) ? 0x04 : 0;
+        m_csr |= (flags & FFLAG_OF) ? 0x08 : 0;
+        m_csr |= (flags & FFLAG_UF) ? 0x10 : 0;
+        m_csr |= (flags & FFLAG_NX) ? 0x20 : 0;
+        _mm_setcsr(m_csr);
+    }
+
+    ~HostRounding()
+    {
+        if ((m_saved & ~0x3Fu) != (m_csr & ~0x3Fu))
+        {
+            _mm_setcsr(m_saved);
+        }
+    }
+
+    uint32_t Flags() const
+    {
+        unsigned int csr = _mm_getcsr();
+        uint32_t flags = 0;
+        flags |= (csr & 0x01) ? FFLAG_NV : 0;
+        flags |= (csr & 0x04) ? FFLAG_DZ : 0;
+        flags |= (csr & 0x08) ? FFLAG_OF : 0;
+        flags |= (csr & 0x10) ? FFLAG_UF : 0;
+        flags |= (csr & 0x20) ? FFLAG_NX : 0;
+        return flags;  // not the denormal operand flag, which RISC-V has no use for
+    }
+
+private:
+    static constexpr unsigned int ROUNDING[] = {0x0000, 0x6000, 0x2000, 0x4000};
+
+    unsigned int m_saved;
+    unsigned int m_csr;
+};
+#else
+class HostRounding : public HostFenv
+{
+public:
+    HostRounding(const uint32_t mode, const uint32_t flags)
+    : HostFenv(ROUNDING[mode])
+    {
+        (void)flags;  // only a shortcut, so starting clear is fine
+    }
+
+private:
+    static constexpr int ROUNDING[] = {FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD};
+};
+#endif
+
+// Rounds an inexact result truncated toward zero to odd: the last bit stands
+// in for everything that was cut off, so that rounding it again to 2 or more
+// bits fewer is the same as rounding the exact result once
+template <typename Wide>
+Wide RoundToOdd(const Wide value, const bool inexact)
+{
+    if (!inexact || value == 0 || std::isinf(value))
+    {
+        return value;
+    }
+    int exponent;
+    Wide mantissa = std::ldexp(std::frexp(value, &exponent), std::numeric_limits<Wide>::digits);
+    if (std::fmod(mantissa, Wide(2)) == 0)
+    {
+        return std::nextafter(value, std::copysign(std::numeric_limits<Wide>::infinity(), value));
+    }
+    return value;
+}
+
+// Rounds to T with ties away from zero (RMM), in software
+template <typename T, typename Wide>
+T RoundTiesAway(const Wide value, uint32_t& flags)
+{
+    if (value == 0 || std::isinf(value))
+    {
+        return static_cast<T>(value);
+    }
+
+    const int digits = std::numeric_limits<T>::digits;
+    int exponent;
+    Wide mantissa = std::frexp(value, &exponent);
+
+    // subnormals have fewer bits, maybe none
+    int bits = digits;
+    if (exponent < std::numeric_limits<T>::min_exponent)
+    {
+        bits -= std::numeric_limits<T>::min_exponent - exponent;
+    }
+
+    Wide scaled = std::ldexp(mantissa, bits);
+    Wide rounded = std::round(scaled);
+    Wide result = std::ldexp(rounded, exponent - bits);
+
+    if (std::fabs(result) > std::numeric_limits<T>::max())
+    {
+        flags |= FFLAG_OF | FFLAG_NX;
+        return value < 0 ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+    }
+    if (rounded != scaled)
+    {
+        flags |= FFLAG_NX;
+
+        // tiny if still below the smallest normal when rounded to full precision
+        Wide unbounded = std::ldexp(std::round(std::ldexp(mantissa, digits)), exponent - digits);
+        if (std::fabs(unbounded) < std::numeric_limits<T>::min())
+        {
+            flags |= FFLAG_UF;
+        }
+    }
+    return static_cast<T>(result);
+}
+
+// Runs op on the host in the given rounding mode, adding to flags. Pass the
+// guest's fflags in flags where that's what they'll be added to, to save the
+// host raising them again.
+template <typename T, typename Op, typename... Args>
+T Arith(const uint32_t mode, uint32_t& flags, Op op, const Args... args)
+{
+    T result;
+    if (mode != RM_RMM)
+    {
+        HostRounding rounding(mode, flags);
+        result = Launder<T>(op(Launder(args)...));
+        flags |= rounding.Flags();
+    }
+    else
+    {
+        // Truncated and rounded to odd in a wider type, then rounded with
+        // ties away. Only the invalid and divide by zero flags come from the
+        // host then, as the rest depend on the final rounding.
+        typedef typename FpTraits<T>::Wide Wide;
+        Wide wide;
+        uint32_t wideFlags;
+        {
+            HostFenv rounding(FE_TOWARDZERO);
+            wide = Launder<Wide>(op(Launder<Wide>(args)...));
+            wideFlags = rounding.Flags();
+        }
+        flags |= wideFlags & (FFLAG_NV | FFLAG_DZ);
+        result = std::isnan(wide) ? CanonicalNaN<T>()
+                                  : RoundTiesAway<T>(RoundToOdd(wide, (wideFlags & FFLAG_NX) != 0), flags);
+    }
+
+    return std::isnan(result) ? CanonicalNaN<T>() : result;
+}
+
+// Narrows a double (or converts an integer held exactly in a double)
+template <typename T>
+T Convert(const uint32_t mode, uint32_t& flags, const double value)
+{
+    if (mode == RM_RMM)
+    {
+        if (std::isnan(value))
+        {
+            flags |= IsSignalingNaN(value) ? FFLAG_NV : 0;
+            return CanonicalNaN<T>();
+        }
+        return RoundTiesAway<T>(value, flags);
+    }
+    return Arith<T>(mode, flags, [](const auto a) { return static_cast<T>(a); }, value);
+}
+
+template <typename T>
+T FusedMultiplyAdd(const uint32_t mode, uint32_t& flags, const T a, const T b, const T c)
+{
+    // invalid even if the addend is a quiet NaN
+    if ((std::isinf(a) && b == 0) || (a == 0 && std::isinf(b)))
+    {
+        flags |= FFLAG_NV;
+    }
+    return Arith<T>(mode, flags, [](const auto x, const auto y, const auto z) { return std::fma(x, y, z); }, a, b, c);
+}
+
+// minimumNumber/maximumNumber: a NaN only if both are, and -0 < +0
+template <typename T>
+T MinMax(uint32_t& flags, const T a, const T b, const bool isMax)
+{
+    if (IsSignalingNaN(a) || IsSignalingNaN(b))
+    {
+        flags |= FFLAG_NV;
+    }
+    if (std::isnan(a) && std::isnan(b))
+    {
+        return CanonicalNaN<T>();
+    }
+    if (std::isnan(a))
+    {
+        return b;
+    }
+    if (std::isnan(b))
+    {
+        return a;
+    }
+    if (a == b)
+    {
+        // only differ if they're zeros of opposite sign
+        return (std::signbit(a) != isMax) ? a : b;
+    }
+    return ((a < b) != isMax) ? a : b;
+}
+
+enum Comparison { COMPARE_EQ, COMPARE_LT, COMPARE_LE };
+
+template <typename T>
+uint32_t Compare(uint32_t& flags, const T a, const T b, const Comparison comparison)
+{
+    if (std::isnan(a) || std::isnan(b))
+    {
+        // only signaling NaNs for feq, any NaN for the ordered ones
+        if (comparison != COMPARE_EQ || IsSignalingNaN(a) || IsSignalingNaN(b))
+        {
+            flags |= FFLAG_NV;
+        }
+        return 0;
+    }
+    switch (comparison)
+    {
+        case COMPARE_EQ: return a == b;
+        case COMPARE_LT: return a < b;
+        default: return a <= b;
+    }
+}
+
+template <typename T>
+uint32_t Classify(const T value)
+{
+    bool negative = std::signbit(value);
+    switch (std::fpclassify(value))
+    {
+        case FP_INFINITE: return negative ? 1 << 0 : 1 << 7;
+        case FP_NORMAL: return negative ? 1 << 1 : 1 << 6;
+        case FP_SUBNORMAL: return negative ? 1 << 2 : 1 << 5;
+        case FP_ZERO: return negative ? 1 << 3 : 1 << 4;
+        default: return IsSignalingNaN(value) ? 1 << 8 : 1 << 9;
+    }
+}
+
+// fsgnj, fsgnjn and fsgnjx: the magnitude of a with a sign from b
+template <typename T>
+T InjectSign(const T a, const T b, const uint32_t funct3)
+{
+    typedef typename FpTraits<T>::Bits Bits;
+    const Bits SIGN = FpTraits<T>::SIGN;
+    Bits bitsA = BitCast<Bits>(a);
+    Bits bitsB = BitCast<Bits>(b);
+    Bits sign = funct3 == 0 ? (bitsB & SIGN) : funct3 == 1 ? (~bitsB & SIGN) : ((bitsA ^ bitsB) & SIGN);
+    return BitCast<T>((bitsA & ~SIGN) | sign);
+}
+
+// Rounds to an integer in the given mode, saturating out of range values
+// (and NaNs, to the largest) with the invalid flag
+template <typename T>
+uint32_t ToInteger(const uint32_t mode, uint32_t& flags, const T value, const bool isSigned)
+{
+    const double minimum = isSigned ? -2147483648.0 : 0.0;
+    const double maximum = isSigned ? 2147483647.0 : 4294967295.0;
+    const uint32_t minimumBits = isSigned ? 0x80000000 : 0;
+    const uint32_t maximumBits = isSigned ? 0x7FFFFFFF : 0xFFFFFFFF;
+
+    if (std::isnan(value))
+    {
+        flags |= FFLAG_NV;
+        return maximumBits;
+    }
+
+    double exact = value;
+    double rounded;
+    switch (mode)
+    {
+        case RM_RTZ: rounded = std::trunc(exact); break;
+        case RM_RDN: rounded = std::floor(exact); break;
+        case RM_RUP: rounded = std::ceil(exact); break;
+        case RM_RMM: rounded = std::round(exact); break;
+        default:
+            rounded = std::round(exact);
+            if (std::fabs(rounded - exact) == 0.5)
+            {
+                rounded = 2 * std::round(exact / 2);  // ties to even
+            }
+            break;
+    }
+
+    if (rounded < minimum)
+    {
+        flags |= FFLAG_NV;
+        return minimumBits;
+    }
+    if (rounded > maximum)
+    {
+        flags |= FFLAG_NV;
+        return maximumBits;
+    }
+    if (rounded != exact)
+    {
+        flags |= FFLAG_NX;
+    }
+    return isSigned ? static_cast<uint32_t>(static_cast<int32_t>(rounded)) : static_cast<uint32_t>(rounded);
+}
+
+const auto ADD = [](const auto a, const auto b) { return a + b; };
+const auto SUB = [](const auto a, const auto b) { return a - b; };
+const auto MUL = [](const auto a, const auto b) { return a * b; };
+const auto DIV = [](const auto a, const auto b) { return a / b; };
+const auto SQRT = [](const auto a) { return std::sqrt(a); };
+
+} // namespace
+
+uint64_t RiscvProcessor::GetFReg(const unsigned regNum) const
+{
+    if (regNum > 31)
+    {
+        std::stringstream ss;
+        ss << "register " << regNum << " exceeds registers f0..f31";
+        throw std::out_of_range(ss.str());
+    }
+
+    return m_freg[regNum];
+}
+
+void RiscvProcessor::SetFReg(const unsigned regNum, const uint64_t newValue)
+{
+    if (regNum > 31)
+    {
+        std::stringstream ss;
+        ss << "register " << regNum << " exceeds registers f0..f31";
+        throw std::out_of_range(ss.str());
+    }
+
+    m_freg[regNum] = newValue;
+}
+
+float RiscvProcessor::ReadFloat(const unsigned regNum) const
+{
+    uint64_t value = m_freg[regNum];
+    if ((value & NAN_BOX) != NAN_BOX)
+    {
+        return CanonicalNaN<float>();
+    }
+    return BitCast<float>(static_cast<uint32_t>(value));
+}
+
+double RiscvProcessor::ReadDouble(const unsigned regNum) const
+{
+    return BitCast<double>(m_freg[regNum]);
+}
+
+void RiscvProcessor::WriteFloat(const unsigned regNum, const float value)
+{
+    m_freg[regNum] = NAN_BOX | BitCast<uint32_t>(value);
+    SetFpDirty();
+}
+
+void RiscvProcessor::WriteDouble(const unsigned regNum, const double value)
+{
+    m_freg[regNum] = BitCast<uint64_t>(value);
+    SetFpDirty();
+}
+
+bool RiscvProcessor::FpEnabled()
+{
+    if ((m_csr[CSR_MSTATUS] & MSTATUS_FS) == 0)
+    {
+        RaiseException(ex_illegal_instruction);
+        return false;
+    }
+    return true;
+}
+
+bool RiscvProcessor::FpRoundingMode(const uint32_t rm, uint32_t& mode)
+{
+    if (!FpEnabled())
+    {
+        return false;
+    }
+
+    mode = rm == RM_DYN ? m_csr[CSR_FRM] : rm;
+    if (mode > RM_RMM)
+    {
+        // reserved, in the instruction or in frm
+        RaiseException(ex_illegal_instruction);
+        return false;
+    }
+    return true;
+}
+
+void RiscvProcessor::AccrueFpFlags(const uint32_t flags)
+{
+    if (flags != 0)
+    {
+        m_csr[CSR_FFLAGS] |= flags;
+        m_csr[CSR_FCSR] |= flags;
+        SetFpDirty();
+    }
+}
+
+void RiscvProcessor::SetFpDirty()
+{
+    m_csr[CSR_MSTATUS] |= MSTATUS_FS | MSTATUS_SD;
+}
+
+// Loads and stores ------------------------------------------------------------
+// Moving a value doesn't look at it, so NaN payloads survive these (and the
+// fmv instructions) untouched.
+
+void RiscvProcessor::execute_flw()
+{
+    if (!FpEnabled())
+    {
+        return;
+    }
+
+    uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
+    uint32_t data = m_mem.ReadWord(address);
+    if (address % 4 != 0)
+    {
+        RaiseException(ex_load_address_misaligned);
+        return;
+    }
+    m_freg[m_decoded_rd] = NAN_BOX | data;
+    SetFpDirty();
+}
+
+void RiscvProcessor::execute_fsw()
+{
+    if (!FpEnabled())
+    {
+        return;
+    }
+
+    uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
+    if (address % 4 != 0)
+    {
+        RaiseException(ex_store_address_misaligned);
+        return;
+    }
+    m_mem.WriteWord(address, static_cast<uint32_t>(m_freg[m_decoded_rs2]));
+}
+
+void RiscvProcessor::execute_fld()
+{
+    if (!FpEnabled())
+    {
+        return;
+    }
+
+    uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
+    uint64_t low = m_mem.ReadWord(address);
+    uint64_t high = m_mem.ReadWord(address + 4);
+    if (address % 8 != 0)
+    {
+        RaiseException(ex_load_address_misaligned);
+        return;
+    }
+    m_freg[m_decoded_rd] = (high << 32) | low;
+    SetFpDirty();
+}
+
+void RiscvProcessor::execute_fsd()
+{
+    if (!FpEnabled())
+    {
+        return;
+    }
+
+    uint32_t address = m_reg[m_decoded_rs1] + m_decoded_imm;
+    if (address % 8 != 0)
+    {
+        RaiseException(ex_store_address_misaligned);
+        return;
+    }
+    uint64_t data = m_freg[m_decoded_rs2];
+    m_mem.WriteWord(address, static_cast<uint32_t>(data));
+    m_mem.WriteWord(address + 4, static_cast<uint32_t>(data >> 32));
+}
+
+// Single precision ------------------------------------------------------------
+
+#define FP_ARITH_S(name, op)                                                   \
+void RiscvProcessor::execute_##name()                                          \
+{                                                                              \
+    uint32_t mode;                                                             \
+    if (!FpRoundingMode(m_decoded_imm, mode))                                  \
+    {                                                                          \
+        return;                                                                \
+    }                                                                          \
+    uint32_t flags = m_csr[CSR_FFLAGS];                                        \
+    WriteFloat(m_decoded_rd, Arith<float>(mode, flags, op,                     \
+                                          ReadFloat(m_decoded_rs1),            \
+                                          ReadFloat(m_decoded_rs2)));          \
+    AccrueFpFlags(flags);                                                      \
+}
+
+FP_ARITH_S(fadd_s, ADD)
+FP_ARITH_S(fsub_s, SUB)
+FP_ARITH_S(fmul_s, MUL)
+FP_ARITH_S(fdiv_s, DIV)
+
+#undef FP_ARITH_S
+
+// rs3 in the low bits of imm, and the rounding mode above
+#define FP_FMA_S(name, negateProduct, negateAddend)                            \
+void RiscvProcessor::execute_##name()                                          \
+{                                                                              \
+    uint32_t mode;                                                             \
+    if (!FpRoundingMode(m_decoded_imm >> 5, mode))                             \
+    {                                                                          \
+        return;                                                                \
+    }                                                                          \
+    float a = ReadFloat(m_decoded_rs1);                                        \
+    float c = ReadFloat(m_decoded_imm & 0x1F);                                 \
+    uint32_t flags = m_csr[CSR_FFLAGS];                                        \
+    WriteFloat(m_decoded_rd, FusedMultiplyAdd(mode, flags,                     \
+                                              negateProduct ? -a : a,          \
+                                              ReadFloat(m_decoded_rs2),        \
+                                              negateAddend ? -c : c));         \
+    AccrueFpFlags(flags);                                                      \
+}
+
+FP_FMA_S(fmadd_s, false, false)
+FP_FMA_S(fmsub_s, false, true)
+FP_FMA_S(fnmsub_s, true, false)
+FP_FMA_S(fnmadd_s, true, true)
+
+#undef FP_FMA_S
+
+void RiscvProcessor::execute_fsqrt_s()
+{
+    uint32_t mode;
+    if (!FpRoundingMode(m_decoded_imm, mode))
+    {
+        return;
+    }
+    uint32_t flags = m_csr[CSR_FFLAGS];
+    WriteFloat(m_decoded_rd, Arith<float>(mode, flags, SQRT, ReadFloat(m_decoded_rs1)));
+    AccrueFpFlags(flags);
+}
+
+void RiscvProcessor::execute_fsgnj_s()
+{
+    if (FpEnabled())
+    {
+        WriteFloat(m_decoded_rd, InjectSign(ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), 0));
+    }
+}
+
+void RiscvProcessor::execute_fsgnjn_s()
+{
+    if (FpEnabled())
+    {
+        WriteFloat(m_decoded_rd, InjectSign(ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), 1));
+    }
+}
+
+void RiscvProcessor::execute_fsgnjx_s()
+{
+    if (FpEnabled())
+    {
+        WriteFloat(m_decoded_rd, InjectSign(ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), 2));
+    }
+}
+
+void RiscvProcessor::execute_fmin_s()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        WriteFloat(m_decoded_rd, MinMax(flags, ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), false));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fmax_s()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        WriteFloat(m_decoded_rd, MinMax(flags, ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), true));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_w_s()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, ToInteger(mode, flags, ReadFloat(m_decoded_rs1), true));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_wu_s()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, ToInteger(mode, flags, ReadFloat(m_decoded_rs1), false));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fmv_x_w()
+{
+    if (FpEnabled())
+    {
+        SetReg(m_decoded_rd, static_cast<uint32_t>(m_freg[m_decoded_rs1]));
+    }
+}
+
+void RiscvProcessor::execute_feq_s()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, Compare(flags, ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), COMPARE_EQ));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_flt_s()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, Compare(flags, ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), COMPARE_LT));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fle_s()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, Compare(flags, ReadFloat(m_decoded_rs1), ReadFloat(m_decoded_rs2), COMPARE_LE));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fclass_s()
+{
+    if (FpEnabled())
+    {
+        SetReg(m_decoded_rd, Classify(ReadFloat(m_decoded_rs1)));
+    }
+}
+
+void RiscvProcessor::execute_fcvt_s_w()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = m_csr[CSR_FFLAGS];
+        WriteFloat(m_decoded_rd, Convert<float>(mode, flags, static_cast<int32_t>(m_reg[m_decoded_rs1])));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_s_wu()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = m_csr[CSR_FFLAGS];
+        WriteFloat(m_decoded_rd, Convert<float>(mode, flags, m_reg[m_decoded_rs1]));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fmv_w_x()
+{
+    if (FpEnabled())
+    {
+        m_freg[m_decoded_rd] = NAN_BOX | m_reg[m_decoded_rs1];
+        SetFpDirty();
+    }
+}
+
+// Double precision ------------------------------------------------------------
+
+#define FP_ARITH_D(name, op)                                                   \
+void RiscvProcessor::execute_##name()                                          \
+{                                                                              \
+    uint32_t mode;                                                             \
+    if (!FpRoundingMode(m_decoded_imm, mode))                                  \
+    {                                                                          \
+        return;                                                                \
+    }                                                                          \
+    uint32_t flags = m_csr[CSR_FFLAGS];                                        \
+    WriteDouble(m_decoded_rd, Arith<double>(mode, flags, op,                   \
+                                            ReadDouble(m_decoded_rs1),         \
+                                            ReadDouble(m_decoded_rs2)));       \
+    AccrueFpFlags(flags);                                                      \
+}
+
+FP_ARITH_D(fadd_d, ADD)
+FP_ARITH_D(fsub_d, SUB)
+FP_ARITH_D(fmul_d, MUL)
+FP_ARITH_D(fdiv_d, DIV)
+
+#undef FP_ARITH_D
+
+#define FP_FMA_D(name, negateProduct, negateAddend)                            \
+void RiscvProcessor::execute_##name()                                          \
+{                                                                              \
+    uint32_t mode;                                                             \
+    if (!FpRoundingMode(m_decoded_imm >> 5, mode))                             \
+    {                                                                          \
+        return;                                                                \
+    }                                                                          \
+    double a = ReadDouble(m_decoded_rs1);                                      \
+    double c = ReadDouble(m_decoded_imm & 0x1F);                               \
+    uint32_t flags = m_csr[CSR_FFLAGS];                                        \
+    WriteDouble(m_decoded_rd, FusedMultiplyAdd(mode, flags,                    \
+                                               negateProduct ? -a : a,         \
+                                               ReadDouble(m_decoded_rs2),      \
+                                               negateAddend ? -c : c));        \
+    AccrueFpFlags(flags);                                                      \
+}
+
+FP_FMA_D(fmadd_d, false, false)
+FP_FMA_D(fmsub_d, false, true)
+FP_FMA_D(fnmsub_d, true, false)
+FP_FMA_D(fnmadd_d, true, true)
+
+#undef FP_FMA_D
+
+void RiscvProcessor::execute_fsqrt_d()
+{
+    uint32_t mode;
+    if (!FpRoundingMode(m_decoded_imm, mode))
+    {
+        return;
+    }
+    uint32_t flags = m_csr[CSR_FFLAGS];
+    WriteDouble(m_decoded_rd, Arith<double>(mode, flags, SQRT, ReadDouble(m_decoded_rs1)));
+    AccrueFpFlags(flags);
+}
+
+void RiscvProcessor::execute_fsgnj_d()
+{
+    if (FpEnabled())
+    {
+        WriteDouble(m_decoded_rd, InjectSign(ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), 0));
+    }
+}
+
+void RiscvProcessor::execute_fsgnjn_d()
+{
+    if (FpEnabled())
+    {
+        WriteDouble(m_decoded_rd, InjectSign(ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), 1));
+    }
+}
+
+void RiscvProcessor::execute_fsgnjx_d()
+{
+    if (FpEnabled())
+    {
+        WriteDouble(m_decoded_rd, InjectSign(ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), 2));
+    }
+}
+
+void RiscvProcessor::execute_fmin_d()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        WriteDouble(m_decoded_rd, MinMax(flags, ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), false));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fmax_d()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        WriteDouble(m_decoded_rd, MinMax(flags, ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), true));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_s_d()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = m_csr[CSR_FFLAGS];
+        WriteFloat(m_decoded_rd, Convert<float>(mode, flags, ReadDouble(m_decoded_rs1)));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_d_s()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        // always exact
+        float value = ReadFloat(m_decoded_rs1);
+        if (std::isnan(value))
+        {
+            AccrueFpFlags(IsSignalingNaN(value) ? FFLAG_NV : 0);
+            WriteDouble(m_decoded_rd, CanonicalNaN<double>());
+            return;
+        }
+        WriteDouble(m_decoded_rd, value);
+    }
+}
+
+void RiscvProcessor::execute_feq_d()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, Compare(flags, ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), COMPARE_EQ));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_flt_d()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, Compare(flags, ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), COMPARE_LT));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fle_d()
+{
+    if (FpEnabled())
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, Compare(flags, ReadDouble(m_decoded_rs1), ReadDouble(m_decoded_rs2), COMPARE_LE));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fclass_d()
+{
+    if (FpEnabled())
+    {
+        SetReg(m_decoded_rd, Classify(ReadDouble(m_decoded_rs1)));
+    }
+}
+
+void RiscvProcessor::execute_fcvt_w_d()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, ToInteger(mode, flags, ReadDouble(m_decoded_rs1), true));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_wu_d()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        uint32_t flags = 0;
+        SetReg(m_decoded_rd, ToInteger(mode, flags, ReadDouble(m_decoded_rs1), false));
+        AccrueFpFlags(flags);
+    }
+}
+
+void RiscvProcessor::execute_fcvt_d_w()
+{
+    // always exact, but the rounding mode still has to be a valid one
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        WriteDouble(m_decoded_rd, static_cast<int32_t>(m_reg[m_decoded_rs1]));
+    }
+}
+
+void RiscvProcessor::execute_fcvt_d_wu()
+{
+    uint32_t mode;
+    if (FpRoundingMode(m_decoded_imm, mode))
+    {
+        WriteDouble(m_decoded_rd, m_reg[m_decoded_rs1]);
+    }
+}
+
+} // namespace riscvdb
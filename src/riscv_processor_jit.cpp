@@ -0,0 +1,535 @@
+#include "riscv_processor.h"
+#include <stdexcept>
+#include <vector>
+
+// Compiles basic blocks to x86-64. Only built with RISCVDB_JIT enabled.
+//
+// Generated functions keep the guest registers in m_reg, addressed through
+// rbx. Memory accesses call back into JitLoad/JitStore. Generated code never
+// raises exceptions itself: it returns early instead, and the interpreter
+// runs that instruction so that the exception is raised exactly as it would
+// have been. Device accesses are left to the interpreter the same way, as
+// devices can see the instruction count (the CLINT's mtime), which generated
+// code only brings up to date when it returns, and stores to them can make
+// an interrupt pending.
+
+namespace riscvdb {
+
+namespace {
+
+typedef X86Emitter X;
+
+// Held for the whole function (all callee saved)
+const X::Reg REGS = X::RBX;       // Register* regs
+const X::Reg PROCESSOR = X::R12;  // RiscvProcessor* processor
+const X::Reg NEXT_PC = X::R13;    // Register* pc
+const X::Reg VALID = X::R14;      // const bool* valid
+
+int32_t RegOffset(const uint32_t reg)
+{
+    return static_cast<int32_t>(reg * sizeof(RiscvProcessor::Register));
+}
+
+void LoadGuestReg(X86Emitter& x, const X::Reg dst, const uint32_t reg)
+{
+    // x0 is always stored as 0, so it can be read like any other
+    x.Load(dst, REGS, RegOffset(reg));
+}
+
+void StoreGuestReg(X86Emitter& x, const uint32_t reg, const X::Reg src)
+{
+    if (reg != 0)
+    {
+        x.Store(REGS, RegOffset(reg), src);
+    }
+}
+
+} // namespace
+
+bool RiscvProcessor::CompileBlock(Block& block)
+{
+    // Host equivalents of the instructions that get compiled
+    struct AluMapping { InstructionId id; X::AluOp op; };
+    static const AluMapping aluR[] = {
+        {INST_ADD, X::ADD},
+        {INST_SUB, X::SUB},
+        {INST_XOR, X::XOR},
+        {INST_OR, X::OR},
+        {INST_AND, X::AND},
+    };
+    static const AluMapping aluI[] = {
+        {INST_ADDI, X::ADD},
+        {INST_XORI, X::XOR},
+        {INST_ORI, X::OR},
+        {INST_ANDI, X::AND},
+    };
+
+    struct ShiftMapping { InstructionId id; X::ShiftOp op; };
+    static const ShiftMapping shiftR[] = {
+        {INST_SLL, X::SHL},
+        {INST_SRL, X::SHR},
+        {INST_SRA, X::SAR},
+    };
+    static const ShiftMapping shiftI[] = {
+        {INST_SLLI, X::SHL},
+        {INST_SRLI, X::SHR},
+        {INST_SRAI, X::SAR},
+    };
+
+    struct CompareMapping { InstructionId id; X::Condition cc; };
+    static const CompareMapping setR[] = {
+        {INST_SLT, X::CC_L},
+        {INST_SLTU, X::CC_B},
+    };
+    static const CompareMapping setI[] = {
+        {INST_SLTI, X::CC_L},
+        {INST_SLTIU, X::CC_B},
+    };
+    static const CompareMapping branches[] = {
+        {INST_BEQ, X::CC_E},
+        {INST_BNE, X::CC_NE},
+        {INST_BLT, X::CC_L},
+        {INST_BGE, X::CC_GE},
+        {INST_BLTU, X::CC_B},
+        {INST_BGEU, X::CC_AE},
+    };
+
+    // Multiplies are done in 64 bits, with the operands sign or zero
+    // extended, keeping the low or high word of the product
+    struct MulMapping { InstructionId id; bool signed1; bool signed2; bool high; };
+    static const MulMapping muls[] = {
+        {INST_MUL, false, false, false},
+        {INST_MULH, true, true, true},
+        {INST_MULHSU, true, false, true},
+        {INST_MULHU, false, false, true},
+    };
+
+    // Divides too, where -2^31 / -1 can't overflow
+    struct DivMapping { InstructionId id; bool isSigned; bool remainder; };
+    static const DivMapping divs[] = {
+        {INST_DIV, true, false},
+        {INST_DIVU, false, false},
+        {INST_REM, true, true},
+        {INST_REMU, false, true},
+    };
+
+    struct MemMapping { InstructionId id; uint32_t funct3; };
+    static const MemMapping loads[] = {
+        {INST_LB, 0},
+        {INST_LH, 1},
+        {INST_LW, 2},
+        {INST_LBU, 4},
+        {INST_LHU, 5},
+    };
+    static const MemMapping stores[] = {
+        {INST_SB, 0},
+        {INST_SH, 1},
+        {INST_SW, 2},
+    };
+
+    X86Emitter x;
+    std::vector<X86Emitter::Label> exits;  // jumps to the epilogue
+
+    // Return having run `count` instructions, with the next PC `pc`
+    auto exitAt = [&](const uint32_t count, const uint32_t pc)
+    {
+        x.StoreImm(NEXT_PC, 0, pc);
+        x.MovImm(X::RAX, count);
+        exits.push_back(x.Jump());
+    };
+
+    // Prologue. Four pushes and 8 bytes of padding leave the stack 16 byte
+    // aligned for calls out.
+    x.Push(X::RBX);
+    x.Push(X::R12);
+    x.Push(X::R13);
+    x.Push(X::R14);
+    x.AddImm64(X::RSP, -8);
+    x.Mov64(REGS, X::RDI);
+    x.Mov64(PROCESSOR, X::RSI);
+    x.Mov64(NEXT_PC, X::RDX);
+    x.Mov64(VALID, X::RCX);
+
+    bool jumped = false;  // last instruction wrote the next PC
+    uint32_t pc = block.start;
+    for (size_t i = 0; i < block.ops.size(); ++i)
+    {
+        const DecodedInstruction& op = block.ops[i];
+        const uint32_t count = static_cast<uint32_t>(i);
+        const uint32_t next = pc + op.length;  // compressed instructions are shorter
+
+        bool compiled = false;
+        if (op.id == INST_LUI)
+        {
+            x.MovImm(X::RAX, static_cast<uint32_t>(op.imm));
+            StoreGuestReg(x, op.rd, X::RAX);
+            compiled = true;
+        }
+        else if (op.id == INST_AUIPC)
+        {
+            x.MovImm(X::RAX, pc + static_cast<uint32_t>(op.imm));
+            StoreGuestReg(x, op.rd, X::RAX);
+            compiled = true;
+        }
+        else if (op.id == INST_JAL)
+        {
+            x.MovImm(X::RAX, next);
+            StoreGuestReg(x, op.rd, X::RAX);
+            x.StoreImm(NEXT_PC, 0, pc + static_cast<uint32_t>(op.imm));
+            jumped = true;
+            compiled = true;
+        }
+        else if (op.id == INST_JALR)
+        {
+            // target is written before rd, since rd and rs1 can be the same
+            LoadGuestReg(x, X::RAX, op.rs1);
+            x.AluImm(X::ADD, X::RAX, op.imm);
+            x.AluImm(X::AND, X::RAX, ~1);
+            x.Store(NEXT_PC, 0, X::RAX);
+            x.MovImm(X::RAX, next);
+            StoreGuestReg(x, op.rd, X::RAX);
+            jumped = true;
+            compiled = true;
+        }
+
+        for (const AluMapping& m : aluR)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                LoadGuestReg(x, X::RCX, op.rs2);
+                x.Alu(m.op, X::RAX, X::RCX);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const AluMapping& m : aluI)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                x.AluImm(m.op, X::RAX, op.imm);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const ShiftMapping& m : shiftR)
+        {
+            if (op.id == m.id)
+            {
+                // the host masks the shift amount to 5 bits too
+                LoadGuestReg(x, X::RAX, op.rs1);
+                LoadGuestReg(x, X::RCX, op.rs2);
+                x.Shift(m.op, X::RAX);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const ShiftMapping& m : shiftI)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                x.ShiftImm(m.op, X::RAX, static_cast<uint8_t>(op.imm & 0x1F));
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const CompareMapping& m : setR)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                LoadGuestReg(x, X::RCX, op.rs2);
+                x.Alu(X::CMP, X::RAX, X::RCX);
+                x.SetCC(m.cc, X::RAX);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const CompareMapping& m : setI)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                x.AluImm(X::CMP, X::RAX, op.imm);
+                x.SetCC(m.cc, X::RAX);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const CompareMapping& m : branches)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                LoadGuestReg(x, X::RCX, op.rs2);
+                x.Alu(X::CMP, X::RAX, X::RCX);
+                X86Emitter::Label taken = x.JumpIf(m.cc);
+                x.StoreImm(NEXT_PC, 0, next);
+                X86Emitter::Label done = x.Jump();
+                x.Bind(taken);
+                x.StoreImm(NEXT_PC, 0, pc + static_cast<uint32_t>(op.imm));
+                x.Bind(done);
+                jumped = true;
+                compiled = true;
+            }
+        }
+        for (const MulMapping& m : muls)
+        {
+            if (op.id == m.id)
+            {
+                // 32 bit loads zero extend
+                LoadGuestReg(x, X::RAX, op.rs1);
+                LoadGuestReg(x, X::RCX, op.rs2);
+                if (m.signed1)
+                {
+                    x.MovSx64(X::RAX, X::RAX);
+                }
+                if (m.signed2)
+                {
+                    x.MovSx64(X::RCX, X::RCX);
+                }
+                x.IMul64(X::RAX, X::RCX);
+                if (m.high)
+                {
+                    x.ShiftImm64(X::SHR, X::RAX, 32);
+                }
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const DivMapping& m : divs)
+        {
+            if (op.id == m.id)
+            {
+                LoadGuestReg(x, X::RAX, op.rs1);
+                LoadGuestReg(x, X::RCX, op.rs2);
+
+                // dividing by zero gives all ones, or leaves the dividend as
+                // the remainder
+                x.Test(X::RCX, X::RCX);
+                X86Emitter::Label nonZero = x.JumpIf(X::CC_NE);
+                if (!m.remainder)
+                {
+                    x.MovImm(X::RAX, 0xFFFFFFFF);
+                }
+                X86Emitter::Label done = x.Jump();
+
+                x.Bind(nonZero);
+                if (m.isSigned)
+                {
+                    x.MovSx64(X::RAX, X::RAX);
+                    x.MovSx64(X::RCX, X::RCX);
+                    x.Cqo();
+                    x.IDiv64(X::RCX);
+                }
+                else
+                {
+                    x.Alu(X::XOR, X::RDX, X::RDX);
+                    x.Div64(X::RCX);
+                }
+                if (m.remainder)
+                {
+                    x.Mov(X::RAX, X::RDX);
+                }
+
+                x.Bind(done);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const MemMapping& m : loads)
+        {
+            if (op.id == m.id)
+            {
+                // JitLoad(processor, address, funct3)
+                LoadGuestReg(x, X::RSI, op.rs1);
+                x.AluImm(X::ADD, X::RSI, op.imm);
+                x.Mov64(X::RDI, PROCESSOR);
+                x.MovImm(X::RDX, m.funct3);
+                x.MovImm64(X::RAX, reinterpret_cast<uint64_t>(&RiscvProcessor::JitLoad));
+                x.Call(X::RAX);
+
+                // leave faults and devices to the interpreter
+                x.BitTest64(X::RAX, 32);
+                X86Emitter::Label ok = x.JumpIf(X::CC_AE);
+                exitAt(count, pc);
+                x.Bind(ok);
+                StoreGuestReg(x, op.rd, X::RAX);
+                compiled = true;
+            }
+        }
+        for (const MemMapping& m : stores)
+        {
+            if (op.id == m.id)
+            {
+                // JitStore(processor, address, data, funct3)
+                LoadGuestReg(x, X::RSI, op.rs1);
+                x.AluImm(X::ADD, X::RSI, op.imm);
+                LoadGuestReg(x, X::RDX, op.rs2);
+                x.Mov64(X::RDI, PROCESSOR);
+                x.MovImm(X::RCX, m.funct3);
+                x.MovImm64(X::RAX, reinterpret_cast<uint64_t>(&RiscvProcessor::JitStore));
+                x.Call(X::RAX);
+
+                // leave faults and devices to the interpreter
+                x.Test(X::RAX, X::RAX);
+                X86Emitter::Label ok = x.JumpIf(X::CC_NE);
+                exitAt(count, pc);
+                x.Bind(ok);
+
+                // the store may have overwritten this block
+                x.CmpByteImm(VALID, 0, 0);
+                X86Emitter::Label valid = x.JumpIf(X::CC_NE);
+                exitAt(count + 1, next);
+                x.Bind(valid);
+                compiled = true;
+            }
+        }
+
+        if (!compiled)
+        {
+            if (i == 0)
+            {
+                // nothing worth compiling
+                return false;
+            }
+
+            // leave this one (and anything after it) to the interpreter
+            exitAt(count, pc);
+            break;
+        }
+        else if (i == block.ops.size() - 1)
+        {
+            // ran the whole block
+            if (!jumped)
+            {
+                x.StoreImm(NEXT_PC, 0, next);
+            }
+            x.MovImm(X::RAX, count + 1);
+        }
+
+        pc = next;
+    }
+
+    // Epilogue
+    for (X86Emitter::Label exit : exits)
+    {
+        x.Bind(exit);
+    }
+    x.AddImm64(X::RSP, 8);
+    x.Pop(X::R14);
+    x.Pop(X::R13);
+    x.Pop(X::R12);
+    x.Pop(X::RBX);
+    x.Ret();
+
+    try
+    {
+        block.jitCode = std::make_unique<ExecutableMemory>(x.Code());
+    }
+    catch (std::runtime_error& err)
+    {
+        // just keep interpreting it
+        return false;
+    }
+
+    block.jitFunction = reinterpret_cast<decltype(block.jitFunction)>(
+        const_cast<void*>(block.jitCode->Entry()));
+    m_compiled_blocks++;
+    return true;
+}
+
+uint64_t RiscvProcessor::JitLoad(RiscvProcessor* processor, const uint32_t address, const uint32_t funct3)
+{
+    // Same accesses as the interpreter, but returns JIT_FAULT instead of
+    // raising an exception or letting one escape into generated code
+    MemoryMap& mem = processor->m_mem;
+    if (mem.MayTouchDevice(address, 1U << (funct3 & 0x3)))
+    {
+        return JIT_FAULT;
+    }
+    try
+    {
+        switch (funct3)
+        {
+            case 0:  // lb
+                return static_cast<uint32_t>(static_cast<int8_t>(mem.ReadByte(address)));
+            case 4:  // lbu
+                return mem.ReadByte(address);
+            case 1:  // lh
+            case 5:  // lhu
+            {
+                uint16_t data = mem.ReadHalfword(address);
+                if (address % 2 != 0)
+                {
+                    return JIT_FAULT;
+                }
+                if (funct3 == 1)
+                {
+                    return static_cast<uint32_t>(static_cast<int16_t>(data));
+                }
+                return data;
+            }
+            case 2:  // lw
+            {
+                uint32_t data = mem.ReadWord(address);
+                if (address % 4 != 0)
+                {
+                    return JIT_FAULT;
+                }
+                return data;
+            }
+            default:
+                return JIT_FAULT;
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        return JIT_FAULT;
+    }
+}
+
+uint32_t RiscvProcessor::JitStore(RiscvProcessor* processor, const uint32_t address, const uint32_t data, const uint32_t funct3)
+{
+    // Returns 0 on a fault, with nothing written
+    MemoryMap& mem = processor->m_mem;
+    if (mem.MayTouchDevice(address, 1U << (funct3 & 0x3)))
+    {
+        return 0;
+    }
+    try
+    {
+        switch (funct3)
+        {
+            case 0:  // sb
+                mem.WriteByte(address, data & 0xff);
+                return 1;
+            case 1:  // sh
+            {
+                if (address % 2 != 0)
+                {
+                    return 0;
+                }
+                mem.WriteHalfword(address, data & 0xffff);
+                return 1;
+            }
+            case 2:  // sw
+                if (address % 4 != 0)
+                {
+                    return 0;
+                }
+                mem.WriteWord(address, data);
+                return 1;
+            default:
+                return 0;
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        return 0;
+    }
+}
+
+} // namespace riscvdb
@@ -5,16 +5,62 @@
 #include <filesystem>
 #include <algorithm>
 #include <utility>
+#include <memory>
+#include <stdexcept>
 
 namespace riscvdb {
 
-SimHost::SimHost()
+SimHost::SimHost(const MemoryMap::Backend memBackend)
 : m_state(IDLE),
-  m_mem(DEFAULT_MEM_ORIGIN, DEFAULT_MEM_SIZE),
-  m_processor(m_mem),
-  m_breakpointCount(0)
+  m_mem(DEFAULT_MEM_ORIGIN, DEFAULT_MEM_SIZE, memBackend),
+  m_disk(m_mem),
+  m_syscalls(m_mem),
+  m_syscallsEnabled(false),
+  m_hartSync(HART_SYNC_QUANTUM),
+  m_quantum(DEFAULT_QUANTUM),
+  m_breakpointCount(0),
+  m_blockExecution(true),
+  m_quiet(false),
+  m_out(&std::cout),
+  m_err(&std::cerr),
+  m_workerRunning(false),
+  m_hasExit(false),
+  m_exitAddr(0)
 {
-    // empty
+    m_harts.push_back(std::make_unique<RiscvProcessor>(m_mem, 0));
+
+    m_mem.AddDevice("clint", Clint::DEFAULT_BASE, Clint::SIZE,
+        [this](const MemoryMap::AddrType offset, const unsigned int size)
+        {
+            return m_clint.Read(offset, size);
+        },
+        [this](const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+        {
+            m_clint.Write(offset, size, data);
+        });
+    connectHarts();
+
+    m_mem.AddDevice("uart", Uart::DEFAULT_BASE, Uart::SIZE,
+        [this](const MemoryMap::AddrType offset, const unsigned int size)
+        {
+            return m_uart.Read(offset, size);
+        },
+        [this](const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+        {
+            m_uart.Write(offset, size, data);
+        });
+    m_uart.SetOutput(*m_out);
+    m_syscalls.SetOutput(*m_out, *m_err);
+
+    m_mem.AddDevice("disk", BlockDevice::DEFAULT_BASE, BlockDevice::SIZE,
+        [this](const MemoryMap::AddrType offset, const unsigned int size)
+        {
+            return m_disk.Read(offset, size);
+        },
+        [this](const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+        {
+            m_disk.Write(offset, size, data);
+        });
 }
 
 SimHost::~SimHost()
@@ -31,30 +77,34 @@ int SimHost::LoadFile(const std::string& pathStr)
 
     if (!std::filesystem::exists(path))
     {
-        std::cerr << "File " << pathStr << " does not exist" << std::endl;
+        *m_err << "File " << pathStr << " does not exist" << std::endl;
         return -1;
     }
 
-    std::cout << "Loading executable " << pathStr << std::endl;
+    // an ostream without a buffer discards everything
+    std::ostream nullLog(nullptr);
+    std::ostream& log = m_quiet ? nullLog : *m_out;
+
+    log << "Loading executable " << pathStr << std::endl;
 
     std::string ext = path.extension();
     try
     {
         if (ext == riscvdb::ElfFileLoader::EXT) {
-            riscvdb::ElfFileLoader elfFileLoader(pathStr);
+            riscvdb::ElfFileLoader elfFileLoader(pathStr, log);
             LoadFile(elfFileLoader);
         } else if (ext == std::string(".bin")) {
-            std::cerr << "raw binaries not yet supported" << std::endl;
+            *m_err << "raw binaries not yet supported" << std::endl;
             return -1;
         } else {
-            std::cerr << "unexpected filetype " << ext << std::endl;
+            *m_err << "unexpected filetype " << ext << std::endl;
             return -1;
         }
     }
     catch (std::runtime_error& err)
     {
-        std::cerr << "failed to load file" << std::endl;
-        std::cerr << err.what() << std::endl;
+        *m_err << "failed to load file" << std::endl;
+        *m_err << err.what() << std::endl;
         return -1;
     }
 
@@ -71,12 +121,20 @@ int SimHost::LoadFile(FileLoader& loader)
     m_loadedBin = loader.PathStr();  // make a copy for if we need to reload
     loader.LoadMemory(*this);
 
+    // the heap starts after the program, and can grow up to the devices
+    auto end_it = m_symbolMap.find("_end");
+    m_syscalls.Reset(end_it != m_symbolMap.end() ? end_it->second.addr : 0, Uart::DEFAULT_BASE);
+
     // if a _start symbol is defined, we should set the PC to that location
     auto it = m_symbolMap.find("_start");
     if (it != m_symbolMap.end())
     {
         MemoryMap::AddrType startAddr = it->second.addr;
-        m_processor.SetPC(startAddr);
+        for (auto& hart : m_harts)
+        {
+            // every hart starts here, it's up to the program to use mhartid
+            hart->SetPC(startAddr);
+        }
     }
     return 0;
 }
@@ -93,7 +151,72 @@ MemoryMap& SimHost::Memory()
 
 RiscvProcessor& SimHost::Processor()
 {
-    return m_processor;
+    return *m_harts[0];
+}
+
+RiscvProcessor& SimHost::Hart(const unsigned int hart)
+{
+    return *m_harts.at(hart);
+}
+
+Uart& SimHost::SerialPort()
+{
+    return m_uart;
+}
+
+BlockDevice& SimHost::Disk()
+{
+    return m_disk;
+}
+
+void SimHost::SetSyscalls(bool enabled)
+{
+    m_syscallsEnabled = enabled;
+}
+
+SyscallProxy& SimHost::Syscalls()
+{
+    return m_syscalls;
+}
+
+unsigned int SimHost::GetHartCount() const
+{
+    return static_cast<unsigned int>(m_harts.size());
+}
+
+void SimHost::SetHarts(const unsigned int count, const HartSync sync, const unsigned long quantum)
+{
+    if (m_state == RUNNING)
+    {
+        throw std::runtime_error("can't change harts while running");
+    }
+    if (count == 0)
+    {
+        throw std::invalid_argument("there must be at least one hart");
+    }
+
+    m_hartSync = sync;
+    m_quantum = quantum > 0 ? quantum : DEFAULT_QUANTUM;
+
+    m_harts.clear();
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        m_harts.push_back(std::make_unique<RiscvProcessor>(m_mem, i));
+        for (auto& bkpt : m_breakpoints)
+        {
+            m_harts.back()->AddBreakpoint(bkpt.first);
+        }
+    }
+    connectHarts();
+
+    auto it = m_symbolMap.find("_start");
+    if (it != m_symbolMap.end())
+    {
+        for (auto& hart : m_harts)
+        {
+            hart->SetPC(it->second.addr);
+        }
+    }
 }
 
 void SimHost::ResetSim()
@@ -105,11 +228,14 @@ void SimHost::ResetSim()
     }
 
     m_mem.Clear();
-    m_processor.Reset();
+    for (auto& hart : m_harts)
+    {
+        hart->Reset();
+    }
     m_symbolMap.clear();
 
     // now that memory is cleared, reload original ELF back in
-    std::cout << "reloading binary" << std::endl;
+    *m_out << "reloading binary" << std::endl;
     LoadFile(m_loadedBin);
 }
 
@@ -128,13 +254,27 @@ void SimHost::Run(unsigned long numInstructions)
     }
 
     m_state = RUNNING;
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_workerRunning = true;
+    }
     m_simRunner = std::thread(&SimHost::runSimWorker, this, numInstructions);
 }
 
 void SimHost::Pause()
 {
-    m_state = PAUSED;
-    m_simRunner.join();
+    // the worker notices on its next block, and signals when it is done.
+    // Only a running target is paused, so one that has just terminated stays
+    // terminated.
+    SimState running = RUNNING;
+    m_state.compare_exchange_strong(running, PAUSED);
+}
+
+SimHost::SimState SimHost::WaitForStop()
+{
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    m_stopped.wait(lock, [this] { return !m_workerRunning; });
+    return m_state;
 }
 
 int SimHost::AddBreakpoint(MemoryMap::AddrType addr)
@@ -152,6 +292,10 @@ int SimHost::AddBreakpoint(MemoryMap::AddrType addr)
     m_breakpointCount++;
 
     m_breakpoints.insert(std::make_pair(addr, bkptNum));
+    for (auto& hart : m_harts)
+    {
+        hart->AddBreakpoint(addr);
+    }
 
     return bkptNum;
 }
@@ -166,11 +310,22 @@ void SimHost::RemoveBreakpoint(const unsigned int breakpointNumber)
         throw std::invalid_argument("breakpoint number not found");
     }
 
+    for (auto& hart : m_harts)
+    {
+        hart->RemoveBreakpoint(it->first);
+    }
     m_breakpoints.erase(it);
 }
 
 void SimHost::ClearBreakpoints()
 {
+    for (auto& bkpt : m_breakpoints)
+    {
+        for (auto& hart : m_harts)
+        {
+            hart->RemoveBreakpoint(bkpt.first);
+        }
+    }
     m_breakpoints.clear();
     // Note: we don't reset the breakpoint counter
 }
@@ -182,79 +337,316 @@ SimHost::SymbolMapType& SimHost::SymbolMap()
 
 void SimHost::SetVerbose(bool verbose)
 {
-    m_processor.SetVerbose(verbose);
+    for (auto& hart : m_harts)
+    {
+        hart->SetVerbose(verbose);
+    }
 }
 
-void SimHost::runSimWorker(unsigned long numInstructions)
+void SimHost::SetBlockExecution(bool enabled)
 {
-    unsigned long instCounter = 0;
+    m_blockExecution = enabled;
+}
+
+void SimHost::SetQuiet(bool quiet)
+{
+    m_quiet = quiet;
+}
 
+void SimHost::SetOutput(std::ostream& out, std::ostream& err)
+{
+    m_out = &out;
+    m_err = &err;
+    m_uart.SetOutput(out);
+    m_syscalls.SetOutput(out, err);
+}
+
+void SimHost::runSimWorker(unsigned long numInstructions)
+{
     // see if we have an _exit symbol to automatically terminate on
     auto symbol_it = m_symbolMap.find("_exit");
-    bool hasExit = false;
-    MemoryMap::AddrType exitAddr = 0;
-    if (symbol_it != m_symbolMap.end())
+    m_hasExit = symbol_it != m_symbolMap.end();
+    m_exitAddr = m_hasExit ? symbol_it->second.addr : 0;
+
+    std::vector<HartRun> runs(m_harts.size());
+    for (size_t i = 0; i < m_harts.size(); ++i)
+    {
+        RiscvProcessor& processor = *m_harts[i];
+        runs[i].processor = &processor;
+        runs[i].hart = static_cast<unsigned int>(i);
+
+        // trap here as for a breakpoint, so that it gets noticed
+        if (m_hasExit)
+        {
+            processor.AddBreakpoint(m_exitAddr);
+        }
+
+        // resuming from a breakpoint, the instruction under it runs this time
+        runs[i].resuming = processor.HasBreakpoint(processor.GetPC());
+    }
+
+    if (runs.size() == 1)
+    {
+        // nothing to keep in step with
+        runs[0].processor->SetHostThread(std::this_thread::get_id());
+        runHart(runs[0], numInstructions, 0);
+    }
+    else if (m_hartSync == HART_SYNC_LOCKSTEP || m_mem.GetBackend() != MemoryMap::BACKEND_FLAT)
+    {
+        // (the block backend's caches can't be shared between threads)
+        runLockstep(runs, numInstructions);
+    }
+    else
+    {
+        runParallel(runs, numInstructions);
+    }
+
+    // only stopped by running out of instructions
+    stopTarget(PAUSED);
+
+    // whatever the target printed without a newline at the end
+    m_uart.Flush();
+
+    // wake anyone waiting for the target to stop
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_workerRunning = false;
+    }
+    m_stopped.notify_all();
+}
+
+void SimHost::runLockstep(std::vector<HartRun>& runs, const unsigned long numInstructions)
+{
+    for (HartRun& run : runs)
+    {
+        run.processor->SetHostThread(std::this_thread::get_id());
+    }
+
+    // a quantum each in turn, stopping as soon as any of them stops the target
+    bool running = true;
+    while (running && m_state == RUNNING)
     {
-        hasExit = true;
-        exitAddr = symbol_it->second.addr;
+        running = false;
+        for (HartRun& run : runs)
+        {
+            if (m_state != RUNNING)
+            {
+                break;
+            }
+            runHart(run, numInstructions, m_quantum);
+            running = running || !run.done;
+        }
     }
+}
 
-    while(m_state == RUNNING)
+void SimHost::runParallel(std::vector<HartRun>& runs, const unsigned long numInstructions)
+{
+    // Harts run a quantum at a time on threads of their own, and then wait
+    // for each other. Whether to carry on is decided by the last to arrive,
+    // so that they all agree.
+    std::mutex syncMutex;
+    std::condition_variable syncDone;
+    size_t arrived = 0;
+    unsigned long generation = 0;
+    bool carryOn = true;
+
+    auto sync = [&]()
     {
-        instCounter++;
-        m_processor.Step();
+        std::unique_lock<std::mutex> lock(syncMutex);
+        unsigned long myGeneration = generation;
+        if (++arrived == runs.size())
+        {
+            arrived = 0;
+            generation++;
+            carryOn = m_state == RUNNING &&
+                      std::any_of(runs.begin(), runs.end(), [](const HartRun& run) { return !run.done; });
+            syncDone.notify_all();
+        }
+        else
+        {
+            syncDone.wait(lock, [&] { return generation != myGeneration; });
+        }
+        return carryOn;
+    };
 
-        if (numInstructions > 0 && instCounter == numInstructions)
+    auto hartThread = [&](HartRun& run)
+    {
+        run.processor->SetHostThread(std::this_thread::get_id());
+        do
         {
-            m_state = PAUSED;
+            if (!run.done)
+            {
+                runHart(run, numInstructions, m_quantum);
+            }
+        } while (sync());
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < runs.size(); ++i)
+    {
+        threads.emplace_back(hartThread, std::ref(runs[i]));
+    }
+    hartThread(runs[0]);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void SimHost::connectHarts()
+{
+    std::vector<RiscvProcessor*> harts;
+    for (auto& hart : m_harts)
+    {
+        harts.push_back(hart.get());
+    }
+    m_clint.SetHarts(harts);
+
+    for (RiscvProcessor* hart : harts)
+    {
+        hart->SetEcallHandler([this](RiscvProcessor& caller)
+        {
+            if (!m_syscallsEnabled || !m_syscalls.Handle(caller))
+            {
+                return false;
+            }
+            if (m_syscalls.Exited())
+            {
+                stopTarget(TERMINATED);
+            }
+            return true;
+        });
+    }
+}
+
+void SimHost::runHart(HartRun& run, const unsigned long numInstructions, const unsigned long quantum)
+{
+    RiscvProcessor& processor = *run.processor;
+    Clint::SetCurrentHart(run.hart);
+    const unsigned long quantumEnd = run.instCounter + quantum;
+
+    while (m_state == RUNNING && !run.done && (quantum == 0 || run.instCounter != quantumEnd))
+    {
+        // stop at whichever comes first, the end of the run or of the quantum
+        unsigned long end = numInstructions;
+        if (quantum > 0 && (end == 0 || quantumEnd < end))
+        {
+            end = quantumEnd;
+        }
+
+        // everything below is checked once per block, so the block needs to
+        // stop where a single step would have
+        uint32_t csr_mcause = processor.GetCSRValue(RiscvProcessor::csr_mcause);
+        if (run.resuming)
+        {
+            run.resuming = false;
+            run.instCounter++;
+            processor.StepOverBreakpoint();
+        }
+        else if (!m_blockExecution ||
+            (csr_mcause & 0x8000000F) == RiscvProcessor::ex_illegal_instruction.exceptionCode ||
+            (csr_mcause & 0x8000000F) == RiscvProcessor::ex_breakpoint.exceptionCode)
+        {
+            run.instCounter++;
+            processor.Step();
+            if (processor.BreakpointHit())
+            {
+                run.instCounter--;
+            }
+        }
+        else
+        {
+            unsigned long remaining = end > 0 ? end - run.instCounter : 0;
+            run.instCounter += processor.StepBlock(remaining);
+        }
+
+        if (numInstructions > 0 && run.instCounter == numInstructions)
+        {
+            run.done = true;
             continue;
         }
 
-        // check for illegal instruction interrupt
-        uint32_t csr_mcause = m_processor.GetCSRValue(RiscvProcessor::csr_mcause);
-        if ((csr_mcause & 0xF) == RiscvProcessor::ex_illegal_instruction.exceptionCode)
+        // check for illegal instruction interrupt (interrupts from the CLINT
+        // share exception codes, but have the top bit set)
+        csr_mcause = processor.GetCSRValue(RiscvProcessor::csr_mcause);
+        if ((csr_mcause & 0x8000000F) == RiscvProcessor::ex_illegal_instruction.exceptionCode)
         {
             // illegal instruction :(
-            std::cout << "illegal instruction at PC = 0x";
-            std::cout << std::hex << std::right << std::setfill('0') << std::setw(8);
-            std::cout << m_processor.GetPC();
-            std::cout << std::endl;
-
-            m_state = TERMINATED;
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            printHart(run);
+            *m_out << "illegal instruction at PC = 0x";
+            *m_out << std::hex << std::right << std::setfill('0') << std::setw(8);
+            *m_out << processor.GetPC();
+            *m_out << std::endl;
+
+            stopTarget(TERMINATED);
             continue;
         }
 
         // check for machine breakpoint
-        if ((csr_mcause & 0xF) == RiscvProcessor::ex_breakpoint.exceptionCode)
+        if ((csr_mcause & 0x8000000F) == RiscvProcessor::ex_breakpoint.exceptionCode)
         {
             // illegal instruction :(
-            std::cout << "machine breakpoint at PC = 0x";
-            std::cout << std::hex << std::setfill('0') << std::setw(8);
-            std::cout << m_processor.GetPC();
-            std::cout << std::endl;
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            printHart(run);
+            *m_out << "machine breakpoint at PC = 0x";
+            *m_out << std::hex << std::setfill('0') << std::setw(8);
+            *m_out << processor.GetPC();
+            *m_out << std::endl;
+
+            stopTarget(PAUSED);
+            continue;
+        }
 
-            m_state = PAUSED;
+        // Host breakpoints and the exit symbol stop the processor with the
+        // PC on them, so there's nothing to check unless it did
+        if (!processor.BreakpointHit())
+        {
             continue;
         }
 
         // check for host breakpoint
-        auto currentPC = m_processor.GetPC();
+        auto currentPC = processor.GetPC();
         auto bkpt_it = m_breakpoints.find(currentPC);
         if (bkpt_it != m_breakpoints.end())
         {
             // host breakpoint found
-            std::cout << "breakpoint " << bkpt_it->second << " hit" << std::endl;
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            printHart(run);
+            *m_out << "breakpoint " << bkpt_it->second << " hit" << std::endl;
 
-            m_state = PAUSED;
+            stopTarget(PAUSED);
             continue;
         }
 
         // check for exit symbol
-        if (hasExit && currentPC == exitAddr)
+        if (m_hasExit && currentPC == m_exitAddr)
         {
-            m_state = TERMINATED;
+            stopTarget(TERMINATED);
             continue;
         }
+
+        // left behind by an earlier program's exit symbol
+        processor.RemoveBreakpoint(currentPC);
+    }
+}
+
+void SimHost::printHart(const HartRun& run)
+{
+    if (m_harts.size() > 1)
+    {
+        *m_out << std::dec << "hart " << run.hart << ": ";
+    }
+}
+
+void SimHost::stopTarget(const SimState state)
+{
+    // Once terminated, other harts stopping as well doesn't change that
+    SimState current = RUNNING;
+    while (current != TERMINATED && current != state &&
+           !m_state.compare_exchange_weak(current, state))
+    {
+        // current has been updated, try again
     }
 }
 
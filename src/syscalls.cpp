@@ -0,0 +1,435 @@
+#include "syscalls.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <cerrno>
+#include <ctime>
+#include <array>
+#include <cstring>
+
+namespace riscvdb {
+
+namespace {
+
+// newlib's open flags (sys/_default_fcntl.h), which libgloss passes on as
+// they are
+const uint32_t NEWLIB_O_ACCMODE = 0x0003;
+const uint32_t NEWLIB_O_APPEND = 0x0008;
+const uint32_t NEWLIB_O_CREAT = 0x0200;
+const uint32_t NEWLIB_O_TRUNC = 0x0400;
+const uint32_t NEWLIB_O_EXCL = 0x0800;
+
+const int32_t GUEST_AT_FDCWD = -100;
+const uint32_t FIRST_FILE = 3;  // after stdin, stdout and stderr
+const uint32_t MAX_PATH = 4096;
+
+// struct kernel_stat in libgloss for riscv (the Linux layout), which it
+// converts to newlib's struct stat
+const size_t KSTAT_SIZE = 128;
+const size_t KSTAT_DEV = 0;
+const size_t KSTAT_INO = 8;
+const size_t KSTAT_MODE = 16;
+const size_t KSTAT_NLINK = 20;
+const size_t KSTAT_UID = 24;
+const size_t KSTAT_GID = 28;
+const size_t KSTAT_RDEV = 32;
+const size_t KSTAT_SIZE_FIELD = 48;
+const size_t KSTAT_BLKSIZE = 56;
+const size_t KSTAT_BLOCKS = 64;
+const size_t KSTAT_ATIME = 72;  // struct timespec, 16 bytes each
+const size_t KSTAT_MTIME = 88;
+const size_t KSTAT_CTIME = 104;
+
+// struct timeval and struct __kernel_timespec: 64 bit seconds, then
+// microseconds or nanoseconds (64 bit too)
+const size_t TIME_SIZE = 16;
+
+template <typename T, size_t N>
+void Pack(std::array<uint8_t, N>& buf, const size_t offset, const T value)
+{
+    // the host is little endian like the guest
+    std::memcpy(buf.data() + offset, &value, sizeof(T));
+}
+
+} // namespace
+
+SyscallProxy::SyscallProxy(MemoryMap& mem)
+: m_mem(mem),
+  m_out(nullptr),
+  m_err(nullptr),
+  m_heapStart(0),
+  m_heapLimit(0),
+  m_brk(0),
+  m_exited(false),
+  m_exitCode(0)
+{
+    // empty
+}
+
+SyscallProxy::~SyscallProxy()
+{
+    CloseFiles();
+}
+
+void SyscallProxy::SetOutput(std::ostream& out, std::ostream& err)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_out = &out;
+    m_err = &err;
+}
+
+void SyscallProxy::Reset(const MemoryMap::AddrType heapStart, const MemoryMap::AddrType heapLimit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CloseFiles();
+    m_heapStart = heapStart;
+    m_heapLimit = heapLimit;
+    m_brk = heapStart;
+    m_exited = false;
+    m_exitCode = 0;
+}
+
+void SyscallProxy::CloseFiles()
+{
+    for (auto& file : m_files)
+    {
+        close(file.second);
+    }
+    m_files.clear();
+}
+
+bool SyscallProxy::Exited() const
+{
+    return m_exited;
+}
+
+uint32_t SyscallProxy::ExitCode() const
+{
+    return m_exitCode;
+}
+
+bool SyscallProxy::Handle(RiscvProcessor& hart)
+{
+    const uint32_t a0 = hart.GetReg(10);
+    const uint32_t a1 = hart.GetReg(11);
+    const uint32_t a2 = hart.GetReg(12);
+    const uint32_t a3 = hart.GetReg(13);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int32_t ret;
+    switch (hart.GetReg(17))
+    {
+        case SYS_OPEN:
+            ret = Open(a0, a1, a2);
+            break;
+        case SYS_OPENAT:
+            // relative to a directory isn't supported, only to the working one
+            ret = static_cast<int32_t>(a0) == GUEST_AT_FDCWD ? Open(a1, a2, a3) : -EBADF;
+            break;
+        case SYS_CLOSE:
+            ret = Close(a0);
+            break;
+        case SYS_READ:
+            ret = Read(a0, a1, a2);
+            break;
+        case SYS_WRITE:
+            ret = Write(a0, a1, a2);
+            break;
+        case SYS_LSEEK:
+            ret = Lseek(a0, static_cast<int32_t>(a1), a2);
+            break;
+        case SYS_FSTAT:
+            ret = Fstat(a0, a1);
+            break;
+        case SYS_BRK:
+            ret = Brk(a0);
+            break;
+        case SYS_GETTIMEOFDAY:
+            ret = GetTimeOfDay(a0);
+            break;
+        case SYS_CLOCK_GETTIME64:
+            // whichever clock a0 asks for, it gets the real time one
+            ret = ClockGetTime(a1);
+            break;
+        case SYS_EXIT:
+            m_exited = true;
+            m_exitCode = a0;
+            ret = static_cast<int32_t>(a0);
+            break;
+        default:
+            return false;
+    }
+
+    hart.SetReg(10, static_cast<uint32_t>(ret));
+    return true;
+}
+
+bool SyscallProxy::CopyOut(const uint32_t address, const uint8_t* data, const uint32_t size)
+{
+    return m_mem.ForEachSpan(address, size, true,
+        [&](std::byte* span, const MemoryMap::AddrType spanSize)
+        {
+            std::memcpy(span, data, spanSize);
+            data += spanSize;
+            return true;
+        });
+}
+
+bool SyscallProxy::ReadString(const uint32_t address, std::string& str)
+{
+    str.clear();
+    for (uint32_t i = 0; i < MAX_PATH; ++i)
+    {
+        char c = static_cast<char>(m_mem.ReadByte(address + i));
+        if (c == '\0')
+        {
+            return true;
+        }
+        str.push_back(c);
+    }
+    return false;
+}
+
+int32_t SyscallProxy::Open(const uint32_t pathAddr, const uint32_t flags, const uint32_t mode)
+{
+    std::string path;
+    if (!ReadString(pathAddr, path))
+    {
+        return -ENAMETOOLONG;
+    }
+
+    int hostFlags = O_CLOEXEC;
+    switch (flags & NEWLIB_O_ACCMODE)
+    {
+        case 0:  hostFlags |= O_RDONLY; break;
+        case 1:  hostFlags |= O_WRONLY; break;
+        default: hostFlags |= O_RDWR; break;
+    }
+    hostFlags |= (flags & NEWLIB_O_APPEND) ? O_APPEND : 0;
+    hostFlags |= (flags & NEWLIB_O_CREAT) ? O_CREAT : 0;
+    hostFlags |= (flags & NEWLIB_O_TRUNC) ? O_TRUNC : 0;
+    hostFlags |= (flags & NEWLIB_O_EXCL) ? O_EXCL : 0;
+
+    int hostFd = open(path.c_str(), hostFlags, static_cast<mode_t>(mode));
+    if (hostFd < 0)
+    {
+        return -errno;
+    }
+
+    // the lowest free descriptor, as on the host
+    uint32_t fd = FIRST_FILE;
+    while (m_files.count(fd) != 0)
+    {
+        fd++;
+    }
+    m_files[fd] = hostFd;
+    return static_cast<int32_t>(fd);
+}
+
+int32_t SyscallProxy::Close(const uint32_t fd)
+{
+    if (fd < FIRST_FILE)
+    {
+        return 0;  // the host's stay open
+    }
+
+    auto it = m_files.find(fd);
+    if (it == m_files.end())
+    {
+        return -EBADF;
+    }
+    int ret = close(it->second);
+    m_files.erase(it);
+    return ret == 0 ? 0 : -errno;
+}
+
+int32_t SyscallProxy::Read(const uint32_t fd, const uint32_t bufAddr, const uint32_t count)
+{
+    int hostFd;
+    if (fd == STDIN_FILENO)
+    {
+        hostFd = STDIN_FILENO;
+    }
+    else
+    {
+        auto it = m_files.find(fd);
+        if (it == m_files.end())
+        {
+            return -EBADF;
+        }
+        hostFd = it->second;
+    }
+
+    // straight into guest memory, until the host comes up short
+    int32_t total = 0;
+    int error = 0;
+    bool inRange = m_mem.ForEachSpan(bufAddr, count, true,
+        [&](std::byte* data, const MemoryMap::AddrType size)
+        {
+            ssize_t ret = read(hostFd, data, size);
+            if (ret < 0)
+            {
+                error = errno;
+                return false;
+            }
+            total += static_cast<int32_t>(ret);
+            return static_cast<MemoryMap::AddrType>(ret) == size;
+        });
+
+    if (!inRange)
+    {
+        return -EFAULT;
+    }
+    return total > 0 || error == 0 ? total : -error;
+}
+
+int32_t SyscallProxy::Write(const uint32_t fd, const uint32_t bufAddr, const uint32_t count)
+{
+    if (fd == STDOUT_FILENO || fd == STDERR_FILENO)
+    {
+        std::ostream* stream = fd == STDOUT_FILENO ? m_out : m_err;
+        bool inRange = m_mem.ForEachSpan(bufAddr, count, false,
+            [&](std::byte* data, const MemoryMap::AddrType size)
+            {
+                if (stream != nullptr)
+                {
+                    stream->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+                }
+                return true;
+            });
+        if (stream != nullptr)
+        {
+            stream->flush();
+        }
+        return inRange ? static_cast<int32_t>(count) : -EFAULT;
+    }
+
+    auto it = m_files.find(fd);
+    if (it == m_files.end())
+    {
+        return -EBADF;
+    }
+    int hostFd = it->second;
+
+    int32_t total = 0;
+    int error = 0;
+    bool inRange = m_mem.ForEachSpan(bufAddr, count, false,
+        [&](std::byte* data, const MemoryMap::AddrType size)
+        {
+            ssize_t ret = write(hostFd, data, size);
+            if (ret < 0)
+            {
+                error = errno;
+                return false;
+            }
+            total += static_cast<int32_t>(ret);
+            return static_cast<MemoryMap::AddrType>(ret) == size;
+        });
+
+    if (!inRange)
+    {
+        return -EFAULT;
+    }
+    return total > 0 || error == 0 ? total : -error;
+}
+
+int32_t SyscallProxy::Lseek(const uint32_t fd, const int32_t offset, const uint32_t whence)
+{
+    if (fd < FIRST_FILE)
+    {
+        return -ESPIPE;
+    }
+    auto it = m_files.find(fd);
+    if (it == m_files.end())
+    {
+        return -EBADF;
+    }
+
+    // SEEK_SET/CUR/END are 0/1/2 on both sides
+    off_t ret = lseek(it->second, offset, static_cast<int>(whence));
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    return ret > INT32_MAX ? -EOVERFLOW : static_cast<int32_t>(ret);
+}
+
+int32_t SyscallProxy::Fstat(const uint32_t fd, const uint32_t statAddr)
+{
+    struct stat st;
+    if (fd < FIRST_FILE)
+    {
+        // a terminal, so that newlib buffers stdout a line at a time
+        std::memset(&st, 0, sizeof(st));
+        st.st_mode = S_IFCHR | 0620;
+        st.st_nlink = 1;
+    }
+    else
+    {
+        auto it = m_files.find(fd);
+        if (it == m_files.end())
+        {
+            return -EBADF;
+        }
+        if (fstat(it->second, &st) != 0)
+        {
+            return -errno;
+        }
+    }
+
+    std::array<uint8_t, KSTAT_SIZE> buf = {};
+    Pack<uint64_t>(buf, KSTAT_DEV, st.st_dev);
+    Pack<uint64_t>(buf, KSTAT_INO, st.st_ino);
+    Pack<uint32_t>(buf, KSTAT_MODE, st.st_mode);
+    Pack<uint32_t>(buf, KSTAT_NLINK, static_cast<uint32_t>(st.st_nlink));
+    Pack<uint32_t>(buf, KSTAT_UID, st.st_uid);
+    Pack<uint32_t>(buf, KSTAT_GID, st.st_gid);
+    Pack<uint64_t>(buf, KSTAT_RDEV, st.st_rdev);
+    Pack<int64_t>(buf, KSTAT_SIZE_FIELD, st.st_size);
+    Pack<int32_t>(buf, KSTAT_BLKSIZE, static_cast<int32_t>(st.st_blksize));
+    Pack<int64_t>(buf, KSTAT_BLOCKS, st.st_blocks);
+    Pack<int64_t>(buf, KSTAT_ATIME, st.st_atim.tv_sec);
+    Pack<int32_t>(buf, KSTAT_ATIME + 8, static_cast<int32_t>(st.st_atim.tv_nsec));
+    Pack<int64_t>(buf, KSTAT_MTIME, st.st_mtim.tv_sec);
+    Pack<int32_t>(buf, KSTAT_MTIME + 8, static_cast<int32_t>(st.st_mtim.tv_nsec));
+    Pack<int64_t>(buf, KSTAT_CTIME, st.st_ctim.tv_sec);
+    Pack<int32_t>(buf, KSTAT_CTIME + 8, static_cast<int32_t>(st.st_ctim.tv_nsec));
+
+    return CopyOut(statAddr, buf.data(), KSTAT_SIZE) ? 0 : -EFAULT;
+}
+
+int32_t SyscallProxy::Brk(const uint32_t address)
+{
+    // as Linux, a break that can't be set leaves it where it was (and 0
+    // asks where that is)
+    if (address >= m_heapStart && address <= m_heapLimit)
+    {
+        m_brk = address;
+    }
+    return static_cast<int32_t>(m_brk);
+}
+
+int32_t SyscallProxy::GetTimeOfDay(const uint32_t timevalAddr)
+{
+    // struct timeval, with newlib's 64 bit time_t
+    timeval tv;
+    gettimeofday(&tv, nullptr);
+    std::array<uint8_t, TIME_SIZE> buf = {};
+    Pack<uint64_t>(buf, 0, static_cast<uint64_t>(tv.tv_sec));
+    Pack<uint64_t>(buf, 8, static_cast<uint64_t>(tv.tv_usec));
+    return CopyOut(timevalAddr, buf.data(), TIME_SIZE) ? 0 : -EFAULT;
+}
+
+int32_t SyscallProxy::ClockGetTime(const uint32_t timespecAddr)
+{
+    // struct __kernel_timespec, 64 bit seconds and nanoseconds
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    std::array<uint8_t, TIME_SIZE> buf = {};
+    Pack<uint64_t>(buf, 0, static_cast<uint64_t>(ts.tv_sec));
+    Pack<uint64_t>(buf, 8, static_cast<uint64_t>(ts.tv_nsec));
+    return CopyOut(timespecAddr, buf.data(), TIME_SIZE) ? 0 : -EFAULT;
+}
+
+} // namespace riscvdb
@@ -0,0 +1,270 @@
+#include "uart.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <cerrno>
+#include <cstdlib>
+
+namespace riscvdb {
+
+Uart::Uart()
+: m_ier(0),
+  m_lcr(0),
+  m_mcr(0),
+  m_scr(0),
+  m_dll(0),
+  m_dlm(0),
+  m_out(nullptr),
+  m_rxPos(0),
+  m_rxFd(-1),
+  m_ptyFd(-1),
+  m_ptySlaveFd(-1)
+{
+    m_tx.reserve(BUFFER_SIZE);
+}
+
+Uart::~Uart()
+{
+    Flush();
+    CloseFds();
+}
+
+void Uart::CloseFds()
+{
+    if (m_rxFd >= 0 && m_rxFd != m_ptyFd)
+    {
+        close(m_rxFd);
+    }
+    if (m_ptyFd >= 0)
+    {
+        close(m_ptyFd);
+    }
+    if (m_ptySlaveFd >= 0)
+    {
+        close(m_ptySlaveFd);
+    }
+    m_rxFd = -1;
+    m_ptyFd = -1;
+    m_ptySlaveFd = -1;
+}
+
+void Uart::SetOutput(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FlushLocked();
+    m_out = &out;
+}
+
+int Uart::OpenInput(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CloseFds();
+    m_rxFd = fd;
+    m_rx.clear();
+    m_rxPos = 0;
+    return 0;
+}
+
+std::string Uart::OpenPty()
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        if (master >= 0)
+        {
+            close(master);
+        }
+        return "";
+    }
+    std::string name = ptsname(master);
+
+    // raw, so that the terminal doesn't echo what it receives back to us, or
+    // hold it back until a newline
+    int slave = open(name.c_str(), O_RDWR | O_NOCTTY);
+    termios tio;
+    if (slave < 0 || tcgetattr(slave, &tio) != 0)
+    {
+        close(master);
+        if (slave >= 0)
+        {
+            close(slave);
+        }
+        return "";
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FlushLocked();
+    CloseFds();
+    m_ptyFd = master;
+    m_ptySlaveFd = slave;
+    m_rxFd = master;
+    m_rx.clear();
+    m_rxPos = 0;
+    return name;
+}
+
+void Uart::Flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FlushLocked();
+}
+
+void Uart::FlushLocked()
+{
+    if (m_tx.empty())
+    {
+        return;
+    }
+
+    if (m_ptyFd >= 0)
+    {
+        // with nothing connected to read them, bytes are lost, as on a real
+        // serial line
+        size_t written = 0;
+        while (written < m_tx.size())
+        {
+            ssize_t ret = write(m_ptyFd, m_tx.data() + written, m_tx.size() - written);
+            if (ret <= 0)
+            {
+                break;
+            }
+            written += static_cast<size_t>(ret);
+        }
+    }
+    else if (m_out != nullptr)
+    {
+        m_out->write(m_tx.data(), static_cast<std::streamsize>(m_tx.size()));
+        m_out->flush();
+    }
+    m_tx.clear();
+}
+
+bool Uart::RxReady()
+{
+    if (m_rxPos < m_rx.size())
+    {
+        return true;
+    }
+    if (m_rxFd < 0)
+    {
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point now;
+    if (m_rxFd == m_ptyFd)
+    {
+        now = std::chrono::steady_clock::now();
+        if (now < m_nextPoll)
+        {
+            return false;
+        }
+    }
+
+    m_rx.resize(BUFFER_SIZE);
+    ssize_t ret = read(m_rxFd, m_rx.data(), m_rx.size());
+    m_rx.resize(ret > 0 ? static_cast<size_t>(ret) : 0);
+    m_rxPos = 0;
+
+    if (ret == 0 && m_rxFd != m_ptyFd)
+    {
+        // the end of the file
+        close(m_rxFd);
+        m_rxFd = -1;
+    }
+    else if (ret <= 0 && m_rxFd == m_ptyFd)
+    {
+        m_nextPoll = now + std::chrono::milliseconds(1);
+    }
+    return !m_rx.empty();
+}
+
+uint64_t Uart::Read(const MemoryMap::AddrType offset, const unsigned int size)
+{
+    (void)size;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool dlab = (m_lcr & LCR_DLAB) != 0;
+    switch (offset)
+    {
+        case RBR:
+            if (dlab)
+            {
+                return m_dll;
+            }
+            return RxReady() ? m_rx[m_rxPos++] : 0;
+        case IER:
+            return dlab ? m_dlm : m_ier;
+        case IIR:
+            return 0xC1;  // FIFOs enabled, nothing pending
+        case LCR:
+            return m_lcr;
+        case MCR:
+            return m_mcr;
+        case LSR:
+            return LSR_THRE | LSR_TEMT | (RxReady() ? LSR_DR : 0);
+        case MSR:
+            return 0xB0;  // DCD, DSR and CTS
+        case SCR:
+            return m_scr;
+        default:
+            return 0;
+    }
+}
+
+void Uart::Write(const MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+{
+    (void)size;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool dlab = (m_lcr & LCR_DLAB) != 0;
+    uint8_t value = static_cast<uint8_t>(data);
+    switch (offset)
+    {
+        case RBR:
+            if (dlab)
+            {
+                m_dll = value;
+                break;
+            }
+            m_tx.push_back(static_cast<char>(value));
+            if (value == '\n' || m_tx.size() >= BUFFER_SIZE)
+            {
+                FlushLocked();
+            }
+            break;
+        case IER:
+            if (dlab)
+            {
+                m_dlm = value;
+            }
+            else
+            {
+                m_ier = value & 0x0F;
+            }
+            break;
+        case IIR:
+            // FCR. What's been read ahead of the guest isn't really in a
+            // FIFO, so clearing it doesn't drop anything.
+            break;
+        case LCR:
+            m_lcr = value;
+            break;
+        case MCR:
+            m_mcr = value & 0x1F;
+            break;
+        case SCR:
+            m_scr = value;
+            break;
+        default:
+            break;
+    }
+}
+
+} // namespace riscvdb
@@ -0,0 +1,352 @@
+#include "x86_emitter.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace riscvdb {
+
+void X86Emitter::Mov(const Reg dst, const Reg src)
+{
+    // mov r/m32, r32
+    Rex(false, src, dst);
+    Byte(0x89);
+    ModRMReg(src, dst);
+}
+
+void X86Emitter::MovImm(const Reg dst, const uint32_t imm)
+{
+    // mov r32, imm32
+    Rex(false, 0, dst);
+    Byte(0xB8 + (dst & 7));
+    Imm32(imm);
+}
+
+void X86Emitter::Load(const Reg dst, const Reg base, const int32_t disp)
+{
+    // mov r32, r/m32
+    Rex(false, dst, base);
+    Byte(0x8B);
+    ModRMMem(dst, base, disp);
+}
+
+void X86Emitter::Store(const Reg base, const int32_t disp, const Reg src)
+{
+    // mov r/m32, r32
+    Rex(false, src, base);
+    Byte(0x89);
+    ModRMMem(src, base, disp);
+}
+
+void X86Emitter::StoreImm(const Reg base, const int32_t disp, const uint32_t imm)
+{
+    // mov r/m32, imm32
+    Rex(false, 0, base);
+    Byte(0xC7);
+    ModRMMem(0, base, disp);
+    Imm32(imm);
+}
+
+void X86Emitter::Alu(const AluOp op, const Reg dst, const Reg src)
+{
+    // op r/m32, r32
+    Rex(false, src, dst);
+    Byte(static_cast<uint8_t>(op * 8 + 1));
+    ModRMReg(src, dst);
+}
+
+void X86Emitter::AluImm(const AluOp op, const Reg dst, const int32_t imm)
+{
+    // op r/m32, imm32
+    Rex(false, 0, dst);
+    Byte(0x81);
+    ModRMReg(op, dst);
+    Imm32(static_cast<uint32_t>(imm));
+}
+
+void X86Emitter::Shift(const ShiftOp op, const Reg dst)
+{
+    // op r/m32, cl
+    Rex(false, 0, dst);
+    Byte(0xD3);
+    ModRMReg(op, dst);
+}
+
+void X86Emitter::ShiftImm(const ShiftOp op, const Reg dst, const uint8_t amount)
+{
+    // op r/m32, imm8
+    Rex(false, 0, dst);
+    Byte(0xC1);
+    ModRMReg(op, dst);
+    Byte(amount);
+}
+
+void X86Emitter::Test(const Reg a, const Reg b)
+{
+    // test r/m32, r32
+    Rex(false, b, a);
+    Byte(0x85);
+    ModRMReg(b, a);
+}
+
+void X86Emitter::SetCC(const Condition cc, const Reg dst)
+{
+    // setcc r/m8, then movzx r32, r/m8
+    Rex(false, 0, dst, dst >= RSP);
+    Byte(0x0F);
+    Byte(0x90 + cc);
+    ModRMReg(0, dst);
+
+    Rex(false, dst, dst, dst >= RSP);
+    Byte(0x0F);
+    Byte(0xB6);
+    ModRMReg(dst, dst);
+}
+
+void X86Emitter::CmpByteImm(const Reg base, const int32_t disp, const int8_t imm)
+{
+    // cmp r/m8, imm8
+    Rex(false, 0, base);
+    Byte(0x80);
+    ModRMMem(CMP, base, disp);
+    Byte(static_cast<uint8_t>(imm));
+}
+
+void X86Emitter::Mov64(const Reg dst, const Reg src)
+{
+    Rex(true, src, dst);
+    Byte(0x89);
+    ModRMReg(src, dst);
+}
+
+void X86Emitter::MovImm64(const Reg dst, const uint64_t imm)
+{
+    // movabs r64, imm64
+    Rex(true, 0, dst);
+    Byte(0xB8 + (dst & 7));
+    Imm32(static_cast<uint32_t>(imm));
+    Imm32(static_cast<uint32_t>(imm >> 32));
+}
+
+void X86Emitter::AddImm64(const Reg dst, const int32_t imm)
+{
+    Rex(true, 0, dst);
+    Byte(0x81);
+    ModRMReg(ADD, dst);
+    Imm32(static_cast<uint32_t>(imm));
+}
+
+void X86Emitter::MovSx64(const Reg dst, const Reg src)
+{
+    // movsxd r64, r/m32
+    Rex(true, dst, src);
+    Byte(0x63);
+    ModRMReg(dst, src);
+}
+
+void X86Emitter::IMul64(const Reg dst, const Reg src)
+{
+    // imul r64, r/m64
+    Rex(true, dst, src);
+    Byte(0x0F);
+    Byte(0xAF);
+    ModRMReg(dst, src);
+}
+
+void X86Emitter::ShiftImm64(const ShiftOp op, const Reg dst, const uint8_t amount)
+{
+    // op r/m64, imm8
+    Rex(true, 0, dst);
+    Byte(0xC1);
+    ModRMReg(op, dst);
+    Byte(amount);
+}
+
+void X86Emitter::Cqo()
+{
+    Rex(true, 0, 0);
+    Byte(0x99);
+}
+
+void X86Emitter::Div64(const Reg divisor)
+{
+    // div r/m64
+    Rex(true, 0, divisor);
+    Byte(0xF7);
+    ModRMReg(6, divisor);
+}
+
+void X86Emitter::IDiv64(const Reg divisor)
+{
+    // idiv r/m64
+    Rex(true, 0, divisor);
+    Byte(0xF7);
+    ModRMReg(7, divisor);
+}
+
+void X86Emitter::BitTest64(const Reg src, const uint8_t bit)
+{
+    // bt r/m64, imm8
+    Rex(true, 0, src);
+    Byte(0x0F);
+    Byte(0xBA);
+    ModRMReg(4, src);
+    Byte(bit);
+}
+
+void X86Emitter::Push(const Reg reg)
+{
+    Rex(false, 0, reg);
+    Byte(0x50 + (reg & 7));
+}
+
+void X86Emitter::Pop(const Reg reg)
+{
+    Rex(false, 0, reg);
+    Byte(0x58 + (reg & 7));
+}
+
+void X86Emitter::Call(const Reg target)
+{
+    // call r/m64
+    Rex(false, 0, target);
+    Byte(0xFF);
+    ModRMReg(2, target);
+}
+
+void X86Emitter::Ret()
+{
+    Byte(0xC3);
+}
+
+X86Emitter::Label X86Emitter::Jump()
+{
+    // jmp rel32
+    Byte(0xE9);
+    Label label = m_code.size();
+    Imm32(0);
+    return label;
+}
+
+X86Emitter::Label X86Emitter::JumpIf(const Condition cc)
+{
+    // jcc rel32
+    Byte(0x0F);
+    Byte(0x80 + cc);
+    Label label = m_code.size();
+    Imm32(0);
+    return label;
+}
+
+void X86Emitter::Bind(const Label label)
+{
+    // relative to the end of the jump instruction
+    uint32_t rel = static_cast<uint32_t>(m_code.size() - (label + 4));
+    std::memcpy(&m_code[label], &rel, sizeof(rel));
+}
+
+const std::vector<uint8_t>& X86Emitter::Code() const
+{
+    return m_code;
+}
+
+void X86Emitter::Byte(const uint8_t b)
+{
+    m_code.push_back(b);
+}
+
+void X86Emitter::Imm32(const uint32_t imm)
+{
+    Byte((imm >> 0) & 0xFF);
+    Byte((imm >> 8) & 0xFF);
+    Byte((imm >> 16) & 0xFF);
+    Byte((imm >> 24) & 0xFF);
+}
+
+void X86Emitter::Rex(const bool wide, const unsigned reg, const unsigned base, const bool force)
+{
+    uint8_t rex = 0x40;
+    rex |= wide ? 0x08 : 0;
+    rex |= (reg & 8) ? 0x04 : 0;
+    rex |= (base & 8) ? 0x01 : 0;
+    if (rex != 0x40 || force)
+    {
+        Byte(rex);
+    }
+}
+
+void X86Emitter::ModRMReg(const unsigned reg, const unsigned rm)
+{
+    Byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+void X86Emitter::ModRMMem(const unsigned reg, const Reg base, const int32_t disp)
+{
+    // [rbp] and [r13] have no encoding without a displacement
+    uint8_t mod = 0x80;  // disp32
+    if (disp == 0 && (base & 7) != RBP)
+    {
+        mod = 0x00;
+    }
+    else if (disp >= -128 && disp <= 127)
+    {
+        mod = 0x40;  // disp8
+    }
+
+    Byte(static_cast<uint8_t>(mod | ((reg & 7) << 3) | (base & 7)));
+
+    // [rsp] and [r12] need a SIB byte
+    if ((base & 7) == RSP)
+    {
+        Byte(0x24);
+    }
+
+    if (mod == 0x40)
+    {
+        Byte(static_cast<uint8_t>(disp));
+    }
+    else if (mod == 0x80)
+    {
+        Imm32(static_cast<uint32_t>(disp));
+    }
+}
+
+ExecutableMemory::ExecutableMemory(const std::vector<uint8_t>& code)
+: m_mem(nullptr),
+  m_size(0)
+{
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    m_size = ((code.size() + pageSize - 1) / pageSize) * pageSize;
+
+    m_mem = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m_mem == MAP_FAILED)
+    {
+        m_mem = nullptr;
+        throw std::runtime_error("failed to map memory for generated code");
+    }
+
+    std::memcpy(m_mem, code.data(), code.size());
+
+    // never writable and executable at the same time
+    if (mprotect(m_mem, m_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(m_mem, m_size);
+        m_mem = nullptr;
+        throw std::runtime_error("failed to make generated code executable");
+    }
+}
+
+ExecutableMemory::~ExecutableMemory()
+{
+    if (m_mem != nullptr)
+    {
+        munmap(m_mem, m_size);
+    }
+}
+
+const void* ExecutableMemory::Entry() const
+{
+    return m_mem;
+}
+
+} // namespace riscvdb
@@ -0,0 +1,60 @@
+#ifndef RISCVDB_TEST_BACKENDS_H
+#define RISCVDB_TEST_BACKENDS_H
+
+#include <iostream>
+
+#include "memorymap.h"
+
+// For the tests that run the same checks on each memory backend: runs them
+// on each in turn, and reports failures as "!! <backend>: <message>".
+
+namespace backends
+{
+
+class Reporter
+{
+public:
+    explicit Reporter(const char* name) : m_name(name), m_errors(0) {}
+
+    // Counts an error, and starts its line for the caller to finish
+    std::ostream& Error()
+    {
+        m_errors++;
+        return std::cout << "!! " << m_name << ": ";
+    }
+
+    const char* Name() const { return m_name; }
+    unsigned long Errors() const { return m_errors; }
+
+private:
+    const char* m_name;
+    unsigned long m_errors;
+};
+
+// Runs check(backend, reporter) on the flat and block backends, returning
+// the number of errors between them
+template <typename Check>
+unsigned long RunEach(Check check)
+{
+    const struct
+    {
+        riscvdb::MemoryMap::Backend backend;
+        const char* name;
+    } backends[] = {
+        {riscvdb::MemoryMap::BACKEND_FLAT, "flat"},
+        {riscvdb::MemoryMap::BACKEND_BLOCKS, "blocks"},
+    };
+
+    unsigned long errors = 0;
+    for (const auto& backend : backends)
+    {
+        Reporter reporter(backend.name);
+        check(backend.backend, reporter);
+        errors += reporter.Errors();
+    }
+    return errors;
+}
+
+} // namespace backends
+
+#endif  // RISCVDB_TEST_BACKENDS_H
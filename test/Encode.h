@@ -0,0 +1,67 @@
+#ifndef RISCVDB_TEST_ENCODE_H
+#define RISCVDB_TEST_ENCODE_H
+
+#include <cstdint>
+
+// Instruction encoders for the tests that build their programs by hand.
+// Immediates are byte offsets and are cut down to the bits the format holds.
+
+namespace encode
+{
+
+inline uint32_t EncodeR(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd,
+                        uint32_t opcode = 0x33)
+{
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+inline uint32_t EncodeR4(uint32_t rs3, uint32_t fmt, uint32_t rs2, uint32_t rs1, uint32_t rm, uint32_t rd,
+                         uint32_t opcode)
+{
+    return (rs3 << 27) | (fmt << 25) | (rs2 << 20) | (rs1 << 15) | (rm << 12) | (rd << 7) | opcode;
+}
+
+inline uint32_t EncodeI(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode)
+{
+    return ((static_cast<uint32_t>(imm) & 0xFFF) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+inline uint32_t EncodeS(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3)
+{
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 5) & 0x7F) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1F) << 7) | 0x23;
+}
+
+inline uint32_t EncodeB(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3)
+{
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 12) & 0x1) << 31) | (((u >> 5) & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (funct3 << 12) | (((u >> 1) & 0xF) << 8) | (((u >> 11) & 0x1) << 7) | 0x63;
+}
+
+inline uint32_t EncodeU(uint32_t imm, uint32_t rd, uint32_t opcode)
+{
+    return (imm & 0xFFFFF000) | (rd << 7) | opcode;
+}
+
+inline uint32_t EncodeJ(int32_t imm, uint32_t rd)
+{
+    uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 20) & 0x1) << 31) | (((u >> 1) & 0x3FF) << 21) | (((u >> 11) & 0x1) << 20) |
+           (((u >> 12) & 0xFF) << 12) | (rd << 7) | 0x6F;
+}
+
+// AMO word operations (funct5), without aq or rl
+inline uint32_t EncodeAmo(uint32_t funct5, uint32_t rs2, uint32_t rs1, uint32_t rd)
+{
+    return (funct5 << 27) | (rs2 << 20) | (rs1 << 15) | (0x2 << 12) | (rd << 7) | 0x2F;
+}
+
+const uint32_t NOP = 0x00000013;    // addi x0, x0, 0
+const uint32_t HALT = 0x0000006F;   // jal x0, 0
+const uint32_t ECALL = 0x00000073;
+const uint32_t MRET = 0x30200073;
+
+} // namespace encode
+
+#endif  // RISCVDB_TEST_ENCODE_H
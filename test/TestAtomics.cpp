@@ -0,0 +1,149 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+using namespace encode;
+
+// Benchmarks contended atomics: every hart, each on its own host thread,
+// hammers the same word with amoadd.w, then takes turns at an LR/SC spinlock
+// around a plain read-modify-write. Both totals have to come out exact.
+
+namespace
+{
+
+const uint32_t AMO_CODE_ADDR = 0x1000;
+const uint32_t LOCK_CODE_ADDR = 0x2000;
+const uint32_t COUNTER_ADDR = 0x8000;
+const uint32_t LOCK_ADDR = 0x8040;  // cache lines apart
+const uint32_t SHARED_ADDR = 0x8080;
+const uint32_t MEM_SIZE = 0x10000;
+
+const uint32_t AMO_ITERATIONS = 200000;
+const uint32_t LOCK_ITERATIONS = 20000;
+
+// x5 counts down the iterations, x6 is 1, and x10/x11/x12 hold the
+// counter, lock and shared word addresses
+const std::vector<uint32_t> AMO_PROGRAM = {
+    EncodeAmo(0x00, 6, 10, 0),           // amoadd.w x0, x6, (x10)
+    EncodeI(-1, 5, 0x0, 5, 0x13),        // addi x5, x5, -1
+    EncodeB(-8, 0, 5, 0x1),              // bnez x5, 0b
+    HALT,
+};
+
+const std::vector<uint32_t> LOCK_PROGRAM = {
+    EncodeAmo(0x02, 0, 11, 7),           // lr.w x7, (x11)
+    EncodeB(-4, 0, 7, 0x1),              // bnez x7, 0b (held)
+    EncodeAmo(0x03, 6, 11, 7),           // sc.w x7, x6, (x11)
+    EncodeB(-12, 0, 7, 0x1),             // bnez x7, 0b (lost it)
+    EncodeI(0, 12, 0x2, 29, 0x03),       // lw x29, 0(x12)
+    EncodeI(1, 29, 0x0, 29, 0x13),       // addi x29, x29, 1
+    EncodeS(0, 29, 12, 0x2),             // sw x29, 0(x12)
+    EncodeAmo(0x01, 0, 11, 0),           // amoswap.w x0, x0, (x11) (release)
+    EncodeI(-1, 5, 0x0, 5, 0x13),        // addi x5, x5, -1
+    EncodeB(-36, 0, 5, 0x1),             // bnez x5, 0b
+    HALT,
+};
+
+// Runs the program at codeAddr on every hart at once, returning the time taken
+double Run(std::vector<std::unique_ptr<rv::RiscvProcessor>>& harts,
+           const uint32_t codeAddr, const uint32_t haltAddr, const uint32_t iterations)
+{
+    for (std::unique_ptr<rv::RiscvProcessor>& hart : harts)
+    {
+        hart->Reset();
+        hart->SetPC(codeAddr);
+        hart->SetReg(5, iterations);
+        hart->SetReg(6, 1);
+        hart->SetReg(10, COUNTER_ADDR);
+        hart->SetReg(11, LOCK_ADDR);
+        hart->SetReg(12, SHARED_ADDR);
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::unique_ptr<rv::RiscvProcessor>& hart : harts)
+    {
+        rv::RiscvProcessor* processor = hart.get();
+        threads.emplace_back([processor, haltAddr]()
+        {
+            processor->SetHostThread(std::this_thread::get_id());
+            while (processor->GetPC() != haltAddr)
+            {
+                processor->StepBlock();
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rv::MemoryMap memoryMap(0, MEM_SIZE);
+    for (size_t i = 0; i < AMO_PROGRAM.size(); ++i)
+    {
+        memoryMap.WriteWord(AMO_CODE_ADDR + i * 4, AMO_PROGRAM[i]);
+    }
+    for (size_t i = 0; i < LOCK_PROGRAM.size(); ++i)
+    {
+        memoryMap.WriteWord(LOCK_CODE_ADDR + i * 4, LOCK_PROGRAM[i]);
+    }
+    const uint32_t amoHalt = AMO_CODE_ADDR + (AMO_PROGRAM.size() - 1) * 4;
+    const uint32_t lockHalt = LOCK_CODE_ADDR + (LOCK_PROGRAM.size() - 1) * 4;
+
+    unsigned long errors = 0;
+    for (unsigned int numHarts = 1; numHarts <= 8; numHarts *= 2)
+    {
+        std::vector<std::unique_ptr<rv::RiscvProcessor>> harts;
+        for (unsigned int i = 0; i < numHarts; ++i)
+        {
+            harts.push_back(std::make_unique<rv::RiscvProcessor>(memoryMap, i));
+        }
+
+        memoryMap.WriteWord(COUNTER_ADDR, 0);
+        memoryMap.WriteWord(LOCK_ADDR, 0);
+        memoryMap.WriteWord(SHARED_ADDR, 0);
+
+        double amoTime = Run(harts, AMO_CODE_ADDR, amoHalt, AMO_ITERATIONS);
+        double lockTime = Run(harts, LOCK_CODE_ADDR, lockHalt, LOCK_ITERATIONS);
+
+        uint32_t counter = memoryMap.ReadWord(COUNTER_ADDR);
+        uint32_t shared = memoryMap.ReadWord(SHARED_ADDR);
+
+        std::cout << numHarts << (numHarts == 1 ? " hart:  " : " harts: ");
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << numHarts * AMO_ITERATIONS / amoTime / 1e6 << " M amoadd/s, ";
+        std::cout << numHarts * LOCK_ITERATIONS / lockTime / 1e6 << " M lock acquisitions/s" << std::endl;
+
+        if (counter != numHarts * AMO_ITERATIONS)
+        {
+            std::cout << "!! counter is " << counter << " expecting " << numHarts * AMO_ITERATIONS << std::endl;
+            errors++;
+        }
+        if (shared != numHarts * LOCK_ITERATIONS)
+        {
+            std::cout << "!! locked counter is " << shared << " expecting " << numHarts * LOCK_ITERATIONS << std::endl;
+            errors++;
+        }
+    }
+
+    std::cout << "host has " << std::thread::hardware_concurrency() << " threads" << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+
+#include "memorymap.h"
+#include "blockdevice.h"
+#include "Backends.h"
+
+namespace rv = riscvdb;
+
+// Checks the block device's registers and transfers, with the image shared
+// and as a snapshot, for each memory backend, and benchmarks loading a large
+// image into RAM through it against putting it there a byte at a time.
+
+namespace
+{
+
+const uint32_t BUF_ADDR = 0x100000;
+const uint32_t COPY_ADDR = 0x1000000;
+const uint32_t MEM_SIZE = 0x2000000;
+const uint32_t DISK_ADDR = MEM_SIZE - 0x1000;
+
+// with a partial sector at the end, which is left out
+const uint32_t IMAGE_SECTORS = 16384;  // 8 MiB
+const uint32_t IMAGE_SIZE = IMAGE_SECTORS * rv::BlockDevice::SECTOR_SIZE + 100;
+
+const std::string IMAGE_PATH = "blockdevice_test.img";
+
+uint8_t ImageByte(const uint32_t offset)
+{
+    return static_cast<uint8_t>((offset * 2654435761u) >> 24);
+}
+
+// Does command on count sectors from sector, with the buffer at address,
+// returning the status
+uint32_t Transfer(rv::MemoryMap& memoryMap, const uint32_t command, const uint64_t sector,
+                  const uint32_t count, const uint32_t address)
+{
+    memoryMap.WriteDoubleword(DISK_ADDR + rv::BlockDevice::REG_SECTOR, sector);
+    memoryMap.WriteWord(DISK_ADDR + rv::BlockDevice::REG_COUNT, count);
+    memoryMap.WriteWord(DISK_ADDR + rv::BlockDevice::REG_ADDRESS, address);
+    memoryMap.WriteWord(DISK_ADDR + rv::BlockDevice::REG_COMMAND, command);
+    return memoryMap.ReadWord(DISK_ADDR + rv::BlockDevice::REG_STATUS);
+}
+
+std::vector<char> ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void Run(const rv::MemoryMap::Backend backend, backends::Reporter& report)
+{
+    std::vector<char> image(IMAGE_SIZE);
+    for (uint32_t i = 0; i < IMAGE_SIZE; ++i)
+    {
+        image[i] = static_cast<char>(ImageByte(i));
+    }
+    std::ofstream(IMAGE_PATH, std::ios::binary).write(image.data(), image.size());
+
+    rv::MemoryMap memoryMap(0, MEM_SIZE, backend);
+    rv::BlockDevice disk(memoryMap);
+    memoryMap.AddDevice("disk", DISK_ADDR, rv::BlockDevice::SIZE,
+        [&disk](const rv::MemoryMap::AddrType offset, const unsigned int size)
+        {
+            return disk.Read(offset, size);
+        },
+        [&disk](const rv::MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+        {
+            disk.Write(offset, size, data);
+        });
+
+    // Nothing to transfer to or from without an image
+    if (memoryMap.ReadWord(DISK_ADDR + rv::BlockDevice::REG_MAGIC) != rv::BlockDevice::MAGIC ||
+        memoryMap.ReadWord(DISK_ADDR + rv::BlockDevice::REG_SECTOR_SIZE) != rv::BlockDevice::SECTOR_SIZE ||
+        memoryMap.ReadDoubleword(DISK_ADDR + rv::BlockDevice::REG_CAPACITY) != 0 ||
+        Transfer(memoryMap, rv::BlockDevice::CMD_READ, 0, 1, BUF_ADDR) != rv::BlockDevice::STATUS_ERROR)
+    {
+        report.Error() << "registers without a disk" << std::endl;
+    }
+
+    if (disk.Open(IMAGE_PATH, false) != 0)
+    {
+        report.Error() << "can't open " << IMAGE_PATH << std::endl;
+        return;
+    }
+    uint64_t capacity = memoryMap.ReadDoubleword(DISK_ADDR + rv::BlockDevice::REG_CAPACITY);
+    if (capacity != IMAGE_SECTORS)
+    {
+        report.Error() << "capacity " << capacity << " sectors" << std::endl;
+    }
+
+    // The whole image into RAM
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    uint32_t status = Transfer(memoryMap, rv::BlockDevice::CMD_READ, 0, IMAGE_SECTORS, BUF_ADDR);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double diskSeconds = std::chrono::duration<double>(end - begin).count();
+
+    if (status != rv::BlockDevice::STATUS_OK)
+    {
+        report.Error() << "reading the image gave status " << status << std::endl;
+    }
+    for (uint32_t i = 0; i < IMAGE_SECTORS * rv::BlockDevice::SECTOR_SIZE; ++i)
+    {
+        if (memoryMap.ReadByte(BUF_ADDR + i) != ImageByte(i))
+        {
+            report.Error() << "image read differs at " << i << std::endl;
+            break;
+        }
+    }
+
+    // The same bytes put there one at a time, having read the file
+    begin = std::chrono::steady_clock::now();
+    std::vector<char> bytes = ReadFile(IMAGE_PATH);
+    for (uint32_t i = 0; i < IMAGE_SECTORS * rv::BlockDevice::SECTOR_SIZE; ++i)
+    {
+        memoryMap.Put(COPY_ADDR + i, static_cast<std::byte>(bytes[i]));
+    }
+    end = std::chrono::steady_clock::now();
+    double putSeconds = std::chrono::duration<double>(end - begin).count();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << report.Name() << ": " << IMAGE_SECTORS * rv::BlockDevice::SECTOR_SIZE / diskSeconds / 1e6 << " MB/s from the disk, ";
+    std::cout << IMAGE_SECTORS * rv::BlockDevice::SECTOR_SIZE / putSeconds / 1e6 << " MB/s a byte at a time" << std::endl;
+
+    // Writes reach the file
+    for (uint32_t i = 0; i < 2 * rv::BlockDevice::SECTOR_SIZE; ++i)
+    {
+        memoryMap.WriteByte(BUF_ADDR + i, static_cast<uint8_t>(i));
+    }
+    status = Transfer(memoryMap, rv::BlockDevice::CMD_WRITE, 10, 2, BUF_ADDR);
+    uint32_t flushed = Transfer(memoryMap, rv::BlockDevice::CMD_FLUSH, 0, 0, 0);
+    bytes = ReadFile(IMAGE_PATH);
+    bool written = bytes.size() == IMAGE_SIZE;
+    for (uint32_t i = 0; written && i < IMAGE_SIZE; ++i)
+    {
+        uint32_t sectorOffset = i - 10 * rv::BlockDevice::SECTOR_SIZE;
+        uint8_t expected = sectorOffset < 2 * rv::BlockDevice::SECTOR_SIZE ? static_cast<uint8_t>(sectorOffset)
+                                                                             : ImageByte(i);
+        written = static_cast<uint8_t>(bytes[i]) == expected;
+    }
+    if (status != rv::BlockDevice::STATUS_OK || flushed != rv::BlockDevice::STATUS_OK || !written)
+    {
+        report.Error() << "write to the image" << std::endl;
+    }
+
+    // Past the end of the disk or of RAM, and unknown commands
+    if (Transfer(memoryMap, rv::BlockDevice::CMD_READ, IMAGE_SECTORS - 1, 2, BUF_ADDR) != rv::BlockDevice::STATUS_ERROR ||
+        Transfer(memoryMap, rv::BlockDevice::CMD_READ, 1ULL << 40, 1, BUF_ADDR) != rv::BlockDevice::STATUS_ERROR ||
+        Transfer(memoryMap, rv::BlockDevice::CMD_READ, 0, 2, DISK_ADDR - rv::BlockDevice::SECTOR_SIZE) != rv::BlockDevice::STATUS_ERROR ||
+        Transfer(memoryMap, 99, 0, 1, BUF_ADDR) != rv::BlockDevice::STATUS_UNSUPPORTED)
+    {
+        report.Error() << "transfers out of range" << std::endl;
+    }
+
+    // A snapshot's writes are read back, but never reach the file
+    bytes = ReadFile(IMAGE_PATH);
+    if (disk.Open(IMAGE_PATH, true) != 0)
+    {
+        report.Error() << "can't open " << IMAGE_PATH << " as a snapshot" << std::endl;
+        return;
+    }
+    for (uint32_t i = 0; i < rv::BlockDevice::SECTOR_SIZE; ++i)
+    {
+        memoryMap.WriteByte(BUF_ADDR + i, 0xFF);
+    }
+    status = Transfer(memoryMap, rv::BlockDevice::CMD_WRITE, 0, 1, BUF_ADDR);
+    flushed = Transfer(memoryMap, rv::BlockDevice::CMD_FLUSH, 0, 0, 0);
+    uint32_t readBack = Transfer(memoryMap, rv::BlockDevice::CMD_READ, 0, 1, COPY_ADDR);
+    disk.Close();
+    if (status != rv::BlockDevice::STATUS_OK || flushed != rv::BlockDevice::STATUS_OK ||
+        readBack != rv::BlockDevice::STATUS_OK || memoryMap.ReadWord(COPY_ADDR) != 0xFFFFFFFF ||
+        ReadFile(IMAGE_PATH) != bytes)
+    {
+        report.Error() << "snapshot" << std::endl;
+    }
+
+    std::remove(IMAGE_PATH.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    return backends::RunEach(Run) == 0 ? 0 : 1;
+}
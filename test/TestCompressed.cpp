@@ -0,0 +1,177 @@
+#include <iostream>
+#include <vector>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+
+// Checks the expansion of compressed instructions against the assembler's
+// encodings, at the ends and in the middle of each immediate's range, that
+// reserved encodings expand to 0, and that c.jal and c.jalr link to the
+// instruction 2 bytes on rather than 4.
+
+namespace
+{
+
+const uint32_t MEM_SIZE = 0x10000;
+const uint32_t CODE_ADDR = 0x100;
+const uint32_t TARGET_ADDR = 0x200;
+const unsigned int BLOCK_RUNS = 20;  // more than the JIT's threshold
+
+struct Case
+{
+    uint16_t compressed;
+    uint32_t expected;
+    const char* name;
+};
+
+const std::vector<Case> CASES = {
+    {0x0040, 0x00410413, "c.addi4spn x8, sp, 4"},
+    {0x1FFC, 0x3FC10793, "c.addi4spn x15, sp, 1020"},
+    {0x1524, 0x2A810493, "c.addi4spn x9, sp, 680"},
+    {0x4380, 0x0007A403, "c.lw x8, 0(x15)"},
+    {0x5C7C, 0x07C42783, "c.lw x15, 124(x8)"},
+    {0x41E8, 0x0445A503, "c.lw x10, 68(x11)"},
+    {0xDF64, 0x06972E23, "c.sw x9, 124(x14)"},
+    {0xD2D0, 0x02C6A223, "c.sw x12, 36(x13)"},
+    {0x0001, 0x00000013, "c.nop"},
+    {0x1281, 0xFE028293, "c.addi x5, -32"},
+    {0x0FFD, 0x01FF8F93, "c.addi x31, 31"},
+    {0x3001, 0x801FF0EF, "c.jal -2048"},
+    {0x2FFD, 0x7FE000EF, "c.jal 2046"},
+    {0x2B89, 0x552000EF, "c.jal 1362"},
+    {0xBFFD, 0xFFFFF06F, "c.j -2"},
+    {0xA46D, 0x2AA0006F, "c.j 682"},
+    {0x5081, 0xFE000093, "c.li x1, -32"},
+    {0x4F55, 0x01500F13, "c.li x30, 21"},
+    {0x7101, 0xE0010113, "c.addi16sp sp, -512"},
+    {0x617D, 0x1F010113, "c.addi16sp sp, 496"},
+    {0x6171, 0x15010113, "c.addi16sp sp, 336"},
+    {0x6085, 0x000010B7, "c.lui x1, 1"},
+    {0x7F81, 0xFFFE0FB7, "c.lui x31, 0xfffe0"},
+    {0x61FD, 0x0001F1B7, "c.lui x3, 0x1f"},
+    {0x807D, 0x01F45413, "c.srli x8, 31"},
+    {0x8785, 0x4017D793, "c.srai x15, 1"},
+    {0x8555, 0x41555513, "c.srai x10, 21"},
+    {0x9881, 0xFE04F493, "c.andi x9, -32"},
+    {0x8B55, 0x01577713, "c.andi x14, 21"},
+    {0x8C1D, 0x40F40433, "c.sub x8, x15"},
+    {0x8CB9, 0x00E4C4B3, "c.xor x9, x14"},
+    {0x8D55, 0x00D56533, "c.or x10, x13"},
+    {0x8DF1, 0x00C5F5B3, "c.and x11, x12"},
+    {0xD001, 0xF00400E3, "c.beqz x8, -256"},
+    {0xCFFD, 0x0E078F63, "c.beqz x15, 254"},
+    {0xE54D, 0x0A051563, "c.bnez x10, 170"},
+    {0xF6CD, 0xFA0695E3, "c.bnez x13, -86"},
+    {0x00FE, 0x01F09093, "c.slli x1, 31"},
+    {0x0FD6, 0x015F9F93, "c.slli x31, 21"},
+    {0x50FE, 0x0FC12083, "c.lwsp x1, 252(sp)"},
+    {0x4F82, 0x00012F83, "c.lwsp x31, 0(sp)"},
+    {0x552A, 0x0A812503, "c.lwsp x10, 168(sp)"},
+    {0x8082, 0x00008067, "c.jr x1"},
+    {0x8F82, 0x000F8067, "c.jr x31"},
+    {0x80FE, 0x01F000B3, "c.mv x1, x31"},
+    {0x9002, 0x00100073, "c.ebreak"},
+    {0x9282, 0x000280E7, "c.jalr x5"},
+    {0x9F86, 0x001F8FB3, "c.add x31, x1"},
+    {0xDF86, 0x0E112E23, "c.swsp x1, 252(sp)"},
+    {0xC07E, 0x01F12023, "c.swsp x31, 0(sp)"},
+    {0xD52A, 0x0AA12423, "c.swsp x10, 168(sp)"},
+
+    // floating point
+    {0x7FE0, 0x07C7A407, "c.flw f8, 124(x15)"},
+    {0x705C, 0x02442787, "c.flw f15, 36(x8)"},
+    {0x3F64, 0x0F873487, "c.fld f9, 248(x14)"},
+    {0x2930, 0x05053607, "c.fld f12, 80(x10)"},
+    {0xFDE8, 0x06A5AE27, "c.fsw f10, 124(x11)"},
+    {0xBCF4, 0x0ED4BC27, "c.fsd f13, 248(x9)"},
+    {0xB7C0, 0x0A87B427, "c.fsd f8, 168(x15)"},
+    {0x70FE, 0x0FC12087, "c.flwsp f1, 252(sp)"},
+    {0x7FAA, 0x0A812F87, "c.flwsp f31, 168(sp)"},
+    {0x307E, 0x1F813007, "c.fldsp f0, 504(sp)"},
+    {0x2A56, 0x15013A07, "c.fldsp f20, 336(sp)"},
+    {0xFF86, 0x0E112E27, "c.fswsp f1, 252(sp)"},
+    {0xBFFE, 0x1FF13C27, "c.fsdsp f31, 504(sp)"},
+    {0xAAAA, 0x14A13827, "c.fsdsp f10, 336(sp)"},
+
+    // reserved
+    {0x0000, 0x00000000, "all zeros"},
+    {0x0004, 0x00000000, "c.addi4spn x9, sp, 0"},
+    {0x6081, 0x00000000, "c.lui x1, 0"},
+    {0x6101, 0x00000000, "c.addi16sp sp, 0"},
+    {0x8002, 0x00000000, "c.jr x0"},
+    {0x4002, 0x00000000, "c.lwsp x0, 0(sp)"},
+    {0x907D, 0x00000000, "c.srli x8, 63"},
+    {0x10FE, 0x00000000, "c.slli x1, 63"},
+    {0x9C1D, 0x00000000, "c.subw x8, x15"},
+    {0xFFFF, 0x00000000, "not compressed"},
+};
+
+// Runs the compressed jump at CODE_ADDR, to a halt at TARGET_ADDR, and
+// counts an error if it didn't get there with the return address in ra
+unsigned long CheckLink(rv::RiscvProcessor& processor, const char* name, const bool block)
+{
+    processor.SetPC(CODE_ADDR);
+    processor.SetReg(1, 0);
+    processor.SetReg(5, TARGET_ADDR);
+    if (block)
+    {
+        processor.StepBlock();
+    }
+    else
+    {
+        processor.Step();
+    }
+
+    if (processor.GetPC() != TARGET_ADDR || processor.GetReg(1) != CODE_ADDR + 2)
+    {
+        std::cout << "!! " << name << std::hex << ": at " << processor.GetPC();
+        std::cout << " with ra " << processor.GetReg(1) << std::dec << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    unsigned long errors = 0;
+    for (const Case& c : CASES)
+    {
+        uint32_t expanded = rv::RiscvProcessor::ExpandCompressed(c.compressed);
+        if (expanded != c.expected)
+        {
+            std::cout << "!! " << c.name << std::hex << ": got " << expanded;
+            std::cout << " expecting " << c.expected << std::dec << std::endl;
+            errors++;
+        }
+    }
+
+    rv::MemoryMap mem(0, MEM_SIZE);
+    rv::RiscvProcessor processor(mem);
+    mem.WriteWord(TARGET_ADDR, encode::HALT);
+
+    // c.jal to TARGET_ADDR, then c.jalr x5
+    const std::vector<std::pair<uint16_t, const char*>> links = {
+        {0x2201, "c.jal"},
+        {0x9282, "c.jalr x5"},
+    };
+    for (const auto& link : links)
+    {
+        mem.WriteHalfword(CODE_ADDR, link.first);
+        errors += CheckLink(processor, link.second, false);
+        for (unsigned int run = 0; run < BLOCK_RUNS; ++run)
+        {
+            errors += CheckLink(processor, link.second, true);
+        }
+    }
+
+    std::cout << CASES.size() << " cases, " << errors << " errors" << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include "riscv_processor.h"
+
+namespace rv = riscvdb;
+
+// Benchmarks decode + dispatch with the compile time decode table, against
+// the hash map lookup it replaced. Both decode the same instruction words,
+// and dispatch to handlers doing the same (trivial) work.
+
+namespace
+{
+
+// The previous scheme: one hash map per instruction type mask, returning an
+// Instruction by value with decoder and executor member function pointers
+class HashMapDispatch
+{
+public:
+    HashMapDispatch()
+    {
+        const uint32_t R[] = {0x33, 0x40000033, 0x1033, 0x2033, 0x3033, 0x4033, 0x5033, 0x40005033, 0x6033, 0x7033};
+        for (uint32_t m : R)
+        {
+            cmd_mapping_R[m] = Instruction("r", &HashMapDispatch::decode_R, &HashMapDispatch::execute);
+        }
+
+        const uint32_t I[] = {0x67, 0x3, 0x1003, 0x2003, 0x4003, 0x5003, 0x13, 0x2013, 0x3013, 0x4013, 0x6013,
+                              0x7013, 0x1013, 0x5013, 0x1073, 0x2073, 0x3073, 0x5073, 0x6073, 0x7073};
+        for (uint32_t m : I)
+        {
+            cmd_mapping_ISB[m] = Instruction("i", &HashMapDispatch::decode_I, &HashMapDispatch::execute);
+        }
+        const uint32_t S[] = {0x23, 0x1023, 0x2023};
+        for (uint32_t m : S)
+        {
+            cmd_mapping_ISB[m] = Instruction("s", &HashMapDispatch::decode_S, &HashMapDispatch::execute);
+        }
+        const uint32_t B[] = {0x63, 0x1063, 0x4063, 0x5063, 0x6063, 0x7063};
+        for (uint32_t m : B)
+        {
+            cmd_mapping_ISB[m] = Instruction("b", &HashMapDispatch::decode_B, &HashMapDispatch::execute);
+        }
+
+        cmd_mapping_UJ[0x37] = Instruction("lui", &HashMapDispatch::decode_U, &HashMapDispatch::execute);
+        cmd_mapping_UJ[0x17] = Instruction("auipc", &HashMapDispatch::decode_U, &HashMapDispatch::execute);
+        cmd_mapping_UJ[0x6F] = Instruction("jal", &HashMapDispatch::decode_J, &HashMapDispatch::execute);
+
+        cmd_mapping_SYSTEM[0xF] = Instruction("fence", nullptr, nullptr);
+        cmd_mapping_SYSTEM[0x30200073] = Instruction("mret", nullptr, &HashMapDispatch::execute);
+        cmd_mapping_SYSTEM[0x100073] = Instruction("ebreak", nullptr, &HashMapDispatch::execute);
+        cmd_mapping_SYSTEM[0x73] = Instruction("ecall", nullptr, &HashMapDispatch::execute);
+    }
+
+    void Run(const uint32_t cmd)
+    {
+        Instruction instruction;
+        auto it = cmd_mapping_R.find(cmd & 0xFE00707F);
+        if (it != cmd_mapping_R.end()) {
+            instruction = it->second;
+        }
+        else if ((it = cmd_mapping_ISB.find(cmd & 0x707F)) != cmd_mapping_ISB.end()) {
+            instruction = it->second;
+        }
+        else if ((it = cmd_mapping_UJ.find(cmd & 0x7F)) != cmd_mapping_UJ.end()) {
+            instruction = it->second;
+        }
+        else if ((it = cmd_mapping_SYSTEM.find(cmd & 0xFFF0707F)) != cmd_mapping_SYSTEM.end()) {
+            instruction = it->second;
+        }
+        else {
+            m_illegal++;
+            return;
+        }
+
+        m_rd = 0;
+        m_rs1 = 0;
+        m_rs2 = 0;
+        m_imm = 0;
+        if (instruction.decoder != nullptr)
+        {
+            (this->*instruction.decoder)(cmd);
+        }
+        if (instruction.executor != nullptr)
+        {
+            (this->*instruction.executor)();
+        }
+    }
+
+    uint64_t Result() const { return m_sum + m_illegal; }
+
+private:
+    using InstructionDecoder = void (HashMapDispatch::*)(uint32_t);
+    using InstructionExector = void (HashMapDispatch::*)(void);
+    struct Instruction {
+        std::string displayName;
+        InstructionDecoder decoder;
+        InstructionExector executor;
+
+        Instruction() = default;
+
+        Instruction(std::string n, InstructionDecoder d, InstructionExector e)
+        : displayName(n),
+          decoder(d),
+          executor(e)
+        {}
+    };
+
+    std::unordered_map<uint32_t, Instruction> cmd_mapping_R;
+    std::unordered_map<uint32_t, Instruction> cmd_mapping_ISB;
+    std::unordered_map<uint32_t, Instruction> cmd_mapping_UJ;
+    std::unordered_map<uint32_t, Instruction> cmd_mapping_SYSTEM;
+
+    uint32_t m_rd = 0;
+    uint32_t m_rs1 = 0;
+    uint32_t m_rs2 = 0;
+    int32_t m_imm = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_illegal = 0;
+
+    // as in RiscvProcessor before
+    void decode_R(uint32_t cmd) {
+        m_rd = (cmd >> 7) & 0x1F;
+        m_rs1 = (cmd >> 15) & 0x1F;
+        m_rs2 = (cmd >> 20) & 0x1F;
+    }
+    void decode_I(uint32_t cmd) {
+        m_rd = (cmd >> 7) & 0x1F;
+        m_rs1 = (cmd >> 15) & 0x1F;
+        m_imm = (cmd >> 20) & 0xFFF;
+        if ((cmd >> 31) & 0x1) { m_imm |= 0xFFFFF000; }
+    }
+    void decode_S(uint32_t cmd) {
+        m_rs1 = (cmd >> 15) & 0x1F;
+        m_rs2 = (cmd >> 20) & 0x1F;
+        m_imm = ((cmd >> 7) & 0x1F) | ((cmd >> 20) & 0xFE0);
+        if ((cmd >> 31) & 0x1) { m_imm |= 0xFFFFF000; }
+    }
+    void decode_B(uint32_t cmd) {
+        m_rs1 = (cmd >> 15) & 0x1F;
+        m_rs2 = (cmd >> 20) & 0x1F;
+        m_imm = ((cmd << 4) & 0x800) | ((cmd >> 7) & 0x1E) | ((cmd >> 20) & 0x7E0) | ((cmd >> 19) & 0x1000);
+        if ((cmd >> 31) & 0x1) { m_imm |= 0xFFFFE000; }
+    }
+    void decode_U(uint32_t cmd) {
+        m_rd = (cmd >> 7) & 0x1F;
+        m_imm = cmd & 0xFFFFF000;
+    }
+    void decode_J(uint32_t cmd) {
+        m_rd = (cmd >> 7) & 0x1F;
+        m_imm = ((cmd >> 20) & 0x7FE) | ((cmd >> 9) & 0x800) | (cmd & 0xFF000) | ((cmd >> 11) & 0x100000);
+        if ((cmd >> 31) & 0x1) { m_imm |= 0xFFE00000; }
+    }
+    void execute() { m_sum += m_rd + m_rs1 + m_rs2 + m_imm; }
+};
+
+// The same work through RiscvProcessor::Decode and a switch on the id
+class TableDispatch
+{
+public:
+    void Run(const uint32_t cmd)
+    {
+        rv::RiscvProcessor::DecodedInstruction decoded = rv::RiscvProcessor::Decode(cmd);
+        switch (decoded.id)
+        {
+            case rv::RiscvProcessor::INST_ILLEGAL:
+                m_illegal++;
+                break;
+            case rv::RiscvProcessor::INST_FENCE:
+                break;
+            default:
+                m_sum += decoded.rd + decoded.rs1 + decoded.rs2 + decoded.imm;
+                break;
+        }
+    }
+
+    uint64_t Result() const { return m_sum + m_illegal; }
+
+private:
+    uint64_t m_sum = 0;
+    uint64_t m_illegal = 0;
+};
+
+template <typename Dispatch>
+long long Time(Dispatch& dispatch, const std::vector<uint32_t>& words, const unsigned int rounds)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < rounds; ++round)
+    {
+        for (uint32_t word : words)
+        {
+            dispatch.Run(word);
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    // Instruction words: every opcode/funct3/funct7 combination in use, with
+    // random register and immediate fields
+    const uint32_t matches[] = {
+        0x37, 0x17, 0x6F, 0x67, 0x63, 0x1063, 0x4063, 0x5063, 0x6063, 0x7063,
+        0x3, 0x1003, 0x2003, 0x4003, 0x5003, 0x23, 0x1023, 0x2023,
+        0x13, 0x2013, 0x3013, 0x4013, 0x6013, 0x7013, 0x1013, 0x5013, 0x40005013,
+        0x33, 0x40000033, 0x1033, 0x2033, 0x3033, 0x4033, 0x5033, 0x40005033, 0x6033, 0x7033,
+        0x1073, 0x2073, 0x3073, 0x5073, 0x6073, 0x7073,
+    };
+    std::default_random_engine generator;
+    std::uniform_int_distribution<uint32_t> any32;
+    std::vector<uint32_t> words(1024 * 1024);
+    for (uint32_t& word : words)
+    {
+        uint32_t match = matches[any32(generator) % (sizeof(matches) / sizeof(matches[0]))];
+        uint32_t fields = any32(generator) & 0x01FF8F80;  // rd, rs1, rs2
+        if ((match & 0x7F) != 0x33 && match != 0x1013 && match != 0x5013 && match != 0x40005013)
+        {
+            fields |= any32(generator) & 0xFE000000;  // immediate bits
+        }
+        word = match | fields;
+    }
+    std::cout << "generated " << words.size() << " instructions" << std::endl;
+
+    const unsigned int rounds = 20;
+    HashMapDispatch hashMap;
+    TableDispatch table;
+    long long hashMapTime = Time(hashMap, words, rounds);
+    long long tableTime = Time(table, words, rounds);
+
+    std::cout << "hash map dispatch: " << hashMapTime << " [ms]" << std::endl;
+    std::cout << "decode table dispatch: " << tableTime << " [ms]" << std::endl;
+
+    // Both should have decoded the same thing
+    if (hashMap.Result() != table.Result())
+    {
+        std::cout << "!! decoded operands differ" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+
+// Checks F/D results and fflags on the cases where the host FPU and RISC-V
+// differ (NaNs, RMM rounding, saturating conversions, min/max...) or where
+// flags are easy to get wrong, then benchmarks a fused multiply-add loop.
+
+namespace
+{
+
+const uint32_t MEM_SIZE = 0x10000;
+const uint32_t TRAP_ADDR = 0x100;
+const uint32_t LOOP_ADDR = 0x1000;
+const uint32_t LOOP_ITERATIONS = 1000000;
+
+// fflags
+const uint32_t NX = 0x01;
+const uint32_t UF = 0x02;
+const uint32_t OF = 0x04;
+const uint32_t DZ = 0x08;
+const uint32_t NV = 0x10;
+
+// Rounding modes
+const uint32_t RNE = 0;
+const uint32_t RTZ = 1;
+const uint32_t RDN = 2;
+const uint32_t RUP = 3;
+const uint32_t RMM = 4;
+const uint32_t DYN = 7;
+
+// Operands are in f1, f2 and f3 (or x1), and results go to f10 (or x10)
+uint32_t EncodeFp(uint32_t funct7, uint32_t rs2, uint32_t rm)
+{
+    return encode::EncodeR(funct7, rs2, 1, rm, 10, 0x53);
+}
+
+uint32_t EncodeFma(uint32_t opcode, uint32_t fmt, uint32_t rm)
+{
+    return encode::EncodeR4(3, fmt, 2, 1, rm, 10, opcode);
+}
+
+// funct7 values
+const uint32_t FADD = 0x00, FSUB = 0x04, FMUL = 0x08, FDIV = 0x0C, FSQRT = 0x2C;
+const uint32_t FSGNJ = 0x10, FMINMAX = 0x14, FCVT_S_D = 0x20, FCVT_D_S = 0x21;
+const uint32_t FCMP = 0x50, FCVT_W = 0x60, FCVT_FROM_W = 0x68, FMV_X = 0x70;
+const uint32_t DOUBLE = 0x01;  // added to the funct7 for the D version
+const uint32_t FMADD = 0x43, FNMSUB = 0x4B;
+
+uint64_t S(uint32_t bits)
+{
+    return 0xFFFFFFFF00000000 | bits;  // NaN-boxed
+}
+
+struct Case
+{
+    const char* name;
+    uint32_t cmd;
+    uint64_t a, b, c;     // f1, f2, f3, or x1 for a conversion from an integer
+    uint64_t expected;    // f10, or x10 for anything with an integer result
+    uint32_t flags;
+    bool intOperand;
+    bool intResult;
+};
+
+const std::vector<Case> CASES = {
+    // Rounding: 1 + 2^-24 is halfway between 1 and the next single
+    {"fadd.s rne tie",     EncodeFp(FADD, 2, RNE), S(0x3F800000), S(0x33800000), 0, S(0x3F800000), NX, false, false},
+    {"fadd.s rmm tie",     EncodeFp(FADD, 2, RMM), S(0x3F800000), S(0x33800000), 0, S(0x3F800001), NX, false, false},
+    {"fadd.s rup",         EncodeFp(FADD, 2, RUP), S(0x3F800000), S(0x33800000), 0, S(0x3F800001), NX, false, false},
+    {"fsub.s rdn zero",    EncodeFp(FSUB, 2, RDN), S(0x3F800000), S(0x3F800000), 0, S(0x80000000), 0, false, false},
+    {"fadd.d rmm tie",     EncodeFp(FADD + DOUBLE, 2, RMM), 0x3FF0000000000000, 0x3CA0000000000000, 0,
+                           0x3FF0000000000001, NX, false, false},
+    {"fadd.d rne tie",     EncodeFp(FADD + DOUBLE, 2, RNE), 0x3FF0000000000000, 0x3CA0000000000000, 0,
+                           0x3FF0000000000000, NX, false, false},
+
+    // NaNs come out canonical, and only signaling ones are invalid
+    {"fadd.s qnan",        EncodeFp(FADD, 2, RNE), S(0x7FC12345), S(0x3F800000), 0, S(0x7FC00000), 0, false, false},
+    {"fadd.s snan",        EncodeFp(FADD, 2, RNE), S(0x7F800001), S(0x3F800000), 0, S(0x7FC00000), NV, false, false},
+    {"fadd.s not boxed",   EncodeFp(FADD, 2, RNE), 0x3F800000, S(0x3F800000), 0, S(0x7FC00000), 0, false, false},
+    {"fmul.d inf * 0",     EncodeFp(FMUL + DOUBLE, 2, RNE), 0xFFF0000000000000, 0, 0,
+                           0x7FF8000000000000, NV, false, false},
+    {"fdiv.s 1 / 0",       EncodeFp(FDIV, 2, RNE), S(0x3F800000), S(0x00000000), 0, S(0x7F800000), DZ, false, false},
+    {"fdiv.s 0 / 0",       EncodeFp(FDIV, 2, RNE), S(0x00000000), S(0x00000000), 0, S(0x7FC00000), NV, false, false},
+    {"fsqrt.s -1",         EncodeFp(FSQRT, 0, RNE), S(0xBF800000), 0, 0, S(0x7FC00000), NV, false, false},
+    {"fsqrt.d 2",          EncodeFp(FSQRT + DOUBLE, 0, RNE), 0x4000000000000000, 0, 0,
+                           0x3FF6A09E667F3BCD, NX, false, false},
+    {"fmadd.s inf*0+qnan", EncodeFma(FMADD, 0, RNE), S(0x7F800000), S(0x00000000), S(0x7FC00000),
+                           S(0x7FC00000), NV, false, false},
+    {"fnmsub.d",           EncodeFma(FNMSUB, 1, RNE), 0x4000000000000000, 0x4008000000000000, 0x3FF0000000000000,
+                           0xC014000000000000, 0, false, false},
+
+    // Overflow, and underflow with tininess detected after rounding
+    {"fmul.s overflow",    EncodeFp(FMUL, 2, RNE), S(0x7F7FFFFF), S(0x40000000), 0, S(0x7F800000), OF | NX, false, false},
+    {"fmul.s overflow rtz", EncodeFp(FMUL, 2, RTZ), S(0x7F7FFFFF), S(0x40000000), 0, S(0x7F7FFFFF), OF | NX, false, false},
+    {"fcvt.s.d not tiny",  EncodeFp(FCVT_S_D, 1, RNE), 0x380FFFFFF0000000, 0, 0, S(0x00800000), NX, false, false},
+    {"fcvt.s.d tiny",      EncodeFp(FCVT_S_D, 1, RTZ), 0x380FFFFFF0000000, 0, 0, S(0x007FFFFF), UF | NX, false, false},
+    {"fmul.d subnormal",   EncodeFp(FMUL + DOUBLE, 2, RNE), 0x0010000000000000, 0x3FE0000000000001, 0,
+                           0x0008000000000000, UF | NX, false, false},
+    {"fmul.d subnormal rmm", EncodeFp(FMUL + DOUBLE, 2, RMM), 0x0010000000000000, 0x3FE0000000000001, 0,
+                           0x0008000000000001, UF | NX, false, false},
+
+    // Sign injection, min/max
+    {"fsgnjn.s",           EncodeFp(FSGNJ, 2, 1), S(0x3F800000), S(0x3F800000), 0, S(0xBF800000), 0, false, false},
+    {"fsgnjx.d",           EncodeFp(FSGNJ + DOUBLE, 2, 2), 0xC000000000000000, 0xC008000000000000, 0,
+                           0x4000000000000000, 0, false, false},
+    {"fmin.s -0 +0",       EncodeFp(FMINMAX, 2, 0), S(0x00000000), S(0x80000000), 0, S(0x80000000), 0, false, false},
+    {"fmax.s -0 +0",       EncodeFp(FMINMAX, 2, 1), S(0x80000000), S(0x00000000), 0, S(0x00000000), 0, false, false},
+    {"fmin.s qnan",        EncodeFp(FMINMAX, 2, 0), S(0x7FC00000), S(0x3F800000), 0, S(0x3F800000), 0, false, false},
+    {"fmin.s snan",        EncodeFp(FMINMAX, 2, 0), S(0x7F800001), S(0x3F800000), 0, S(0x3F800000), NV, false, false},
+    {"fmax.d both nan",    EncodeFp(FMINMAX + DOUBLE, 2, 1), 0x7FF8000000000123, 0xFFF8000000000000, 0,
+                           0x7FF8000000000000, 0, false, false},
+
+    // Comparisons and classify
+    {"feq.s snan",         EncodeFp(FCMP, 2, 2), S(0x7F800001), S(0x3F800000), 0, 0, NV, false, true},
+    {"feq.s qnan",         EncodeFp(FCMP, 2, 2), S(0x7FC00000), S(0x3F800000), 0, 0, 0, false, true},
+    {"flt.s qnan",         EncodeFp(FCMP, 2, 1), S(0x7FC00000), S(0x3F800000), 0, 0, NV, false, true},
+    {"fle.d equal",        EncodeFp(FCMP + DOUBLE, 2, 0), 0x3FF0000000000000, 0x3FF0000000000000, 0, 1, 0, false, true},
+    {"fclass.s -inf",      EncodeFp(FMV_X, 0, 1), S(0xFF800000), 0, 0, 0x001, 0, false, true},
+    {"fclass.s -0",        EncodeFp(FMV_X, 0, 1), S(0x80000000), 0, 0, 0x008, 0, false, true},
+    {"fclass.s subnormal", EncodeFp(FMV_X, 0, 1), S(0x00000001), 0, 0, 0x020, 0, false, true},
+    {"fclass.s snan",      EncodeFp(FMV_X, 0, 1), S(0x7F800001), 0, 0, 0x100, 0, false, true},
+    {"fclass.d qnan",      EncodeFp(FMV_X + DOUBLE, 0, 1), 0x7FF8000000000000, 0, 0, 0x200, 0, false, true},
+    {"fmv.x.w not boxed",  EncodeFp(FMV_X, 0, 0), 0x12345678, 0, 0, 0x12345678, 0, false, true},
+
+    // Conversions to integers saturate
+    {"fcvt.w.s nan",       EncodeFp(FCVT_W, 0, RNE), S(0x7FC00000), 0, 0, 0x7FFFFFFF, NV, false, true},
+    {"fcvt.w.s -inf",      EncodeFp(FCVT_W, 0, RNE), S(0xFF800000), 0, 0, 0x80000000, NV, false, true},
+    {"fcvt.w.s 2.5 rne",   EncodeFp(FCVT_W, 0, RNE), S(0x40200000), 0, 0, 2, NX, false, true},
+    {"fcvt.w.s 2.5 rmm",   EncodeFp(FCVT_W, 0, RMM), S(0x40200000), 0, 0, 3, NX, false, true},
+    {"fcvt.wu.s -1",       EncodeFp(FCVT_W, 1, RNE), S(0xBF800000), 0, 0, 0, NV, false, true},
+    {"fcvt.wu.s -0.5 rtz", EncodeFp(FCVT_W, 1, RTZ), S(0xBF000000), 0, 0, 0, NX, false, true},
+    {"fcvt.w.d 3e9",       EncodeFp(FCVT_W + DOUBLE, 0, RNE), 0x41E65A0BC0000000, 0, 0, 0x7FFFFFFF, NV, false, true},
+    {"fcvt.wu.d 3e9",      EncodeFp(FCVT_W + DOUBLE, 1, RNE), 0x41E65A0BC0000000, 0, 0, 0xB2D05E00, 0, false, true},
+
+    // and from them
+    {"fcvt.s.w rne",       EncodeFp(FCVT_FROM_W, 0, RNE), 0x7FFFFFFF, 0, 0, S(0x4F000000), NX, true, false},
+    {"fcvt.s.w rtz",       EncodeFp(FCVT_FROM_W, 0, RTZ), 0x7FFFFFFF, 0, 0, S(0x4EFFFFFF), NX, true, false},
+    {"fcvt.s.wu rmm",      EncodeFp(FCVT_FROM_W, 1, RMM), 0xFFFFFFFF, 0, 0, S(0x4F800000), NX, true, false},
+    {"fcvt.d.wu",          EncodeFp(FCVT_FROM_W + DOUBLE, 1, RNE), 0xFFFFFFFF, 0, 0, 0x41EFFFFFFFE00000, 0, true, false},
+    {"fcvt.d.s snan",      EncodeFp(FCVT_D_S, 0, RNE), S(0x7F800001), 0, 0, 0x7FF8000000000000, NV, false, false},
+};
+
+// Compressed FP loads and stores, and what they expand to
+const uint32_t COMPRESSED[][2] = {
+    {0x2480, 0x0084B407},  // c.fld fs0, 8(s1)
+    {0xA480, 0x0084B427},  // c.fsd fs0, 8(s1)
+    {0x60C0, 0x0044A407},  // c.flw fs0, 4(s1)
+    {0xE0C0, 0x0084A227},  // c.fsw fs0, 4(s1)
+    {0x20B2, 0x10813087},  // c.fldsp ft1, 264(sp)
+    {0xA606, 0x10113427},  // c.fsdsp ft1, 264(sp)
+    {0x609A, 0x08412087},  // c.flwsp ft1, 132(sp)
+    {0xE306, 0x08112227},  // c.fswsp ft1, 132(sp)
+};
+
+// Runs the instruction at 0, returning false if it trapped
+bool RunOne(rv::MemoryMap& mem, rv::RiscvProcessor& processor, const uint32_t cmd)
+{
+    mem.WriteWord(0, cmd);
+    processor.SetPC(0);
+    processor.Step();
+    return processor.GetPC() == 4;
+}
+
+unsigned long CheckCases(rv::MemoryMap& mem, rv::RiscvProcessor& processor)
+{
+    unsigned long errors = 0;
+    for (const Case& c : CASES)
+    {
+        processor.Reset();
+        processor.SetFReg(1, c.a);
+        processor.SetFReg(2, c.b);
+        processor.SetFReg(3, c.c);
+        if (c.intOperand)
+        {
+            processor.SetReg(1, static_cast<uint32_t>(c.a));
+        }
+
+        if (!RunOne(mem, processor, c.cmd))
+        {
+            std::cout << "!! " << c.name << " trapped" << std::endl;
+            errors++;
+            continue;
+        }
+
+        uint64_t result = c.intResult ? processor.GetReg(10) : processor.GetFReg(10);
+        uint32_t flags = processor.GetCSRValue(rv::RiscvProcessor::csr_fflags);
+        if (result != c.expected || flags != c.flags)
+        {
+            std::cout << "!! " << c.name << std::hex << ": got " << result << " flags " << flags;
+            std::cout << " expecting " << c.expected << " flags " << c.flags << std::dec << std::endl;
+            errors++;
+        }
+    }
+    return errors;
+}
+
+unsigned long CheckMachineState(rv::MemoryMap& mem, rv::RiscvProcessor& processor)
+{
+    unsigned long errors = 0;
+    auto check = [&errors](const bool ok, const char* what)
+    {
+        if (!ok)
+        {
+            std::cout << "!! " << what << std::endl;
+            errors++;
+        }
+    };
+
+    // Flags accrue, and fcsr is frm and fflags together
+    processor.Reset();
+    processor.SetCSRValue(rv::RiscvProcessor::csr_frm, RUP);
+    processor.SetFReg(1, S(0x3F800000));
+    processor.SetFReg(2, S(0x00000000));
+    check(RunOne(mem, processor, EncodeFp(FDIV, 2, DYN)), "fdiv.s trapped");
+    processor.SetFReg(2, S(0x33800000));
+    check(RunOne(mem, processor, EncodeFp(FADD, 2, DYN)), "fadd.s trapped");
+    check(processor.GetFReg(10) == S(0x3F800001), "dynamic rounding didn't use frm");
+    check(processor.GetCSRValue(rv::RiscvProcessor::csr_fcsr) == ((RUP << 5) | DZ | NX), "fcsr is wrong");
+    check((processor.GetCSRValue(rv::RiscvProcessor::csr_mstatus) & 0x80006000) == 0x80006000,
+          "writing FP state didn't make mstatus.fs dirty");
+
+    // Reserved rounding modes, in the instruction or frm, are illegal
+    processor.Reset();
+    processor.SetCSRValue(rv::RiscvProcessor::csr_mtvec, TRAP_ADDR);
+    check(!RunOne(mem, processor, EncodeFp(FADD, 2, 5)), "rm 5 didn't trap");
+    processor.SetCSRValue(rv::RiscvProcessor::csr_frm, 6);
+    check(!RunOne(mem, processor, EncodeFp(FADD, 2, DYN)), "frm 6 didn't trap");
+    check(RunOne(mem, processor, EncodeFp(FSGNJ, 2, 0)), "sign injection doesn't round, but trapped");
+
+    // Everything FP is illegal with mstatus.fs off
+    processor.Reset();
+    processor.SetCSRValue(rv::RiscvProcessor::csr_mtvec, TRAP_ADDR);
+    processor.SetCSRValue(rv::RiscvProcessor::csr_mstatus, 0);
+    check(!RunOne(mem, processor, EncodeFp(FSGNJ, 2, 0)), "FP instruction ran with fs off");
+    check(processor.GetCSRValue(rv::RiscvProcessor::csr_mcause) == 2, "fs off wasn't an illegal instruction");
+    check(processor.SetCSRValue(rv::RiscvProcessor::csr_fflags, 0).set_csr_undefined_num,
+          "fflags writable with fs off");
+
+    // Singles are NaN-boxed when loaded, and doubles take both words
+    processor.Reset();
+    mem.WriteWord(0x800, 0x3F800000);
+    mem.WriteWord(0x804, 0x40000000);
+    processor.SetReg(1, 0x800);
+    check(RunOne(mem, processor, (1 << 15) | (0x2 << 12) | (10 << 7) | 0x07), "flw trapped");
+    check(processor.GetFReg(10) == S(0x3F800000), "flw didn't NaN-box");
+    check(RunOne(mem, processor, (1 << 15) | (0x3 << 12) | (10 << 7) | 0x07), "fld trapped");
+    check(processor.GetFReg(10) == 0x400000003F800000, "fld is wrong");
+    processor.SetReg(1, 0x804);
+    check(!RunOne(mem, processor, (1 << 15) | (0x3 << 12) | (10 << 7) | 0x07), "misaligned fld didn't trap");
+
+    for (const uint32_t* c : COMPRESSED)
+    {
+        if (rv::RiscvProcessor::ExpandCompressed(static_cast<uint16_t>(c[0])) != c[1])
+        {
+            std::cout << "!! " << std::hex << c[0] << " doesn't expand to " << c[1] << std::dec << std::endl;
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+// fmadd.d in a loop, to see what the rounding mode and flag handling costs
+double Benchmark(rv::MemoryMap& mem, rv::RiscvProcessor& processor, const uint32_t rm)
+{
+    const std::vector<uint32_t> program = {
+        encode::EncodeR4(10, 1, 2, 1, rm, 10, FMADD),  // fmadd.d f10, f1, f2, f10
+        encode::EncodeI(-1, 5, 0x0, 5, 0x13),          // addi x5, x5, -1
+        encode::EncodeB(-8, 0, 5, 0x1),                // bnez x5, 0b
+        encode::HALT,
+    };
+    for (size_t i = 0; i < program.size(); ++i)
+    {
+        mem.WriteWord(LOOP_ADDR + i * 4, program[i]);
+    }
+    const uint32_t haltAddr = LOOP_ADDR + (program.size() - 1) * 4;
+
+    processor.Reset();
+    processor.SetPC(LOOP_ADDR);
+    processor.SetReg(5, LOOP_ITERATIONS);
+    processor.SetFReg(1, 0x3FF0000000000001);
+    processor.SetFReg(2, 0x3FEFFFFFFFFFFFFF);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    while (processor.GetPC() != haltAddr)
+    {
+        processor.StepBlock();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return LOOP_ITERATIONS / std::chrono::duration<double>(end - begin).count() / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rv::MemoryMap mem(0, MEM_SIZE);
+    rv::RiscvProcessor processor(mem);
+
+    unsigned long errors = CheckCases(mem, processor);
+    errors += CheckMachineState(mem, processor);
+    std::cout << CASES.size() << " cases, " << errors << " errors" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << Benchmark(mem, processor, RNE) << " M fmadd.d/s, ";
+    std::cout << Benchmark(mem, processor, RMM) << " M fmadd.d/s rounding to max magnitude" << std::endl;
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "simhost.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+using namespace encode;
+
+// Checks that each hart reads its own mhartid, that lockstep runs of harts
+// racing on a shared counter end the same way every time, and that a run
+// stops as soon as any one hart reaches _exit.
+
+namespace
+{
+
+const uint32_t START_ADDR = 0x1000;
+const uint32_t EXIT_ADDR = 0x1800;
+const uint32_t DATA_ADDR = 0x2000;
+const unsigned int NUM_HARTS = 4;
+const uint32_t EXIT_HART = 1;
+const int32_t ITERATIONS = 1000;
+const unsigned long QUANTUM = 7;
+const unsigned long MAX_INSTRUCTIONS = 1000000;  // per hart, in case _exit is missed
+
+// Each hart notes its mhartid in x10 and in its own word after the counter at
+// DATA_ADDR, then adds to the counter ITERATIONS << mhartid times with a plain
+// load and store, so that the harts lose some of each other's updates. Hart
+// EXIT_HART then calls _exit, while the others halt.
+const std::vector<uint32_t> PROGRAM = {
+    EncodeI(0xF14, 0, 0x2, 10, 0x73),       // csrr x10, mhartid
+    EncodeU(DATA_ADDR, 12, 0x37),           // lui x12, DATA_ADDR
+    EncodeI(2, 10, 0x1, 11, 0x13),          // slli x11, x10, 2
+    EncodeR(0x00, 12, 11, 0x0, 11),         // add x11, x11, x12
+    EncodeS(4, 10, 11, 0x2),                // sw x10, 4(x11)
+    EncodeI(ITERATIONS, 0, 0x0, 5, 0x13),   // addi x5, x0, ITERATIONS
+    EncodeR(0x00, 10, 5, 0x1, 5),           // sll x5, x5, x10
+    EncodeI(0, 12, 0x2, 6, 0x03),           // 1: lw x6, 0(x12)
+    EncodeI(1, 6, 0x0, 6, 0x13),            // addi x6, x6, 1
+    EncodeS(0, 6, 12, 0x2),                 // sw x6, 0(x12)
+    EncodeI(-1, 5, 0x0, 5, 0x13),           // addi x5, x5, -1
+    EncodeB(-16, 0, 5, 0x1),                // bnez x5, 1b
+    EncodeI(EXIT_HART, 0, 0x0, 7, 0x13),    // addi x7, x0, EXIT_HART
+    EncodeB(8, 7, 10, 0x1),                 // bne x10, x7, 2f
+    EncodeJ(EXIT_ADDR - (START_ADDR + 14 * 4), 0),  // j _exit
+    HALT,                                   // 2: j 2b
+};
+
+// How a run ended
+struct Outcome
+{
+    rv::SimHost::SimState state = rv::SimHost::IDLE;
+    std::vector<uint32_t> pcs;
+    std::vector<uint32_t> regs;  // x0-x31 of each hart in turn
+    std::vector<unsigned long long> counts;
+    std::vector<uint32_t> data;  // the counter, then each hart's word
+
+    bool operator==(const Outcome& other) const
+    {
+        return state == other.state && pcs == other.pcs && regs == other.regs &&
+               counts == other.counts && data == other.data;
+    }
+};
+
+Outcome Run(const rv::SimHost::HartSync sync)
+{
+    rv::SimHost simHost;
+    std::ostringstream out;
+    simHost.SetOutput(out, out);
+
+    for (size_t i = 0; i < PROGRAM.size(); ++i)
+    {
+        simHost.Memory().WriteWord(START_ADDR + static_cast<uint32_t>(i) * 4, PROGRAM[i]);
+    }
+    simHost.Memory().WriteWord(EXIT_ADDR, HALT);
+    simHost.SymbolMap()["_start"] = {rv::SimHost::FUNC, START_ADDR};
+    simHost.SymbolMap()["_exit"] = {rv::SimHost::FUNC, EXIT_ADDR};
+
+    simHost.SetHarts(NUM_HARTS, sync, QUANTUM);
+    simHost.Run(MAX_INSTRUCTIONS);
+
+    Outcome outcome;
+    outcome.state = simHost.WaitForStop();
+    for (unsigned int hart = 0; hart < simHost.GetHartCount(); ++hart)
+    {
+        rv::RiscvProcessor& processor = simHost.Hart(hart);
+        outcome.pcs.push_back(processor.GetPC());
+        for (unsigned int reg = 0; reg < 32; ++reg)
+        {
+            outcome.regs.push_back(processor.GetReg(reg));
+        }
+        outcome.counts.push_back(processor.GetInstructionCount());
+    }
+    for (unsigned int i = 0; i <= NUM_HARTS; ++i)
+    {
+        outcome.data.push_back(simHost.Memory().ReadWord(DATA_ADDR + i * 4));
+    }
+    return outcome;
+}
+
+unsigned long Check(const Outcome& outcome, const char* name)
+{
+    unsigned long errors = 0;
+    auto check = [&errors, name](const bool ok, const char* what)
+    {
+        if (!ok)
+        {
+            std::cout << "!! " << name << ": " << what << std::endl;
+            errors++;
+        }
+    };
+
+    check(outcome.state == rv::SimHost::TERMINATED, "didn't stop at _exit");
+    check(outcome.pcs[EXIT_HART] == EXIT_ADDR, "the exiting hart isn't at _exit");
+    for (unsigned int hart = 0; hart < NUM_HARTS; ++hart)
+    {
+        check(outcome.regs[hart * 32 + 10] == hart && outcome.data[hart + 1] == hart, "mhartid is wrong");
+    }
+
+    // the harts with more to do were stopped part way through
+    for (unsigned int hart = EXIT_HART + 1; hart < NUM_HARTS; ++hart)
+    {
+        check(outcome.regs[hart * 32 + 5] != 0, "a hart finished after another reached _exit");
+    }
+    return errors;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    unsigned long errors = 0;
+    Outcome lockstep = Run(rv::SimHost::HART_SYNC_LOCKSTEP);
+    errors += Check(lockstep, "lockstep");
+    errors += Check(Run(rv::SimHost::HART_SYNC_QUANTUM), "threads");
+
+    for (unsigned int run = 0; run < 3; ++run)
+    {
+        if (!(Run(rv::SimHost::HART_SYNC_LOCKSTEP) == lockstep))
+        {
+            std::cout << "!! lockstep runs differ" << std::endl;
+            errors++;
+            break;
+        }
+    }
+
+    std::cout << "counter " << lockstep.data[0] << " after lockstep runs of ";
+    for (unsigned long long count : lockstep.counts)
+    {
+        std::cout << count << " ";
+    }
+    std::cout << "instructions" << std::endl;
+
+    return errors == 0 ? 0 : 1;
+}
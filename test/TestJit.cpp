@@ -0,0 +1,358 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+using namespace encode;
+
+// Runs randomly generated RV32IMAC programs on the JIT and on the interpreter,
+// and checks that they agree after every block.
+
+namespace
+{
+
+const uint32_t TRAP_ADDR = 0x0;
+const uint32_t CODE_ADDR = 0x1000;
+const uint32_t DATA_ADDR = 0x8000;
+const uint32_t MEM_SIZE = 0x10000;
+
+// Registers the generated code doesn't write to
+const uint32_t REG_CODE = 28;  // code base, for self modifying stores
+const uint32_t REG_TRAP = 29;  // used by the trap handler
+const uint32_t REG_DATA = 30;  // data base
+const uint32_t REG_LOOP = 31;  // loop counter
+
+// A random compressed ALU instruction, writing to one of x1-x27
+uint16_t CompressedAlu(std::default_random_engine& generator)
+{
+    std::uniform_int_distribution<uint32_t> any32;
+    uint32_t rd = 1 + any32(generator) % 27;
+    uint32_t rs2 = 1 + any32(generator) % 31;
+    uint32_t rdShort = any32(generator) % 8;   // x8-x15
+    uint32_t rs2Short = any32(generator) % 8;
+    uint32_t imm = any32(generator) % 64;
+    switch (any32(generator) % 7)
+    {
+        case 0:  // c.addi
+            return static_cast<uint16_t>(((imm & 0x20) << 7) | (rd << 7) | ((imm & 0x1F) << 2) | 0x1);
+        case 1:  // c.li
+            return static_cast<uint16_t>(0x4000 | ((imm & 0x20) << 7) | (rd << 7) | ((imm & 0x1F) << 2) | 0x1);
+        case 2:  // c.slli
+            return static_cast<uint16_t>((rd << 7) | ((imm & 0x1F) << 2) | 0x2);
+        case 3:  // c.mv
+            return static_cast<uint16_t>(0x8000 | (rd << 7) | (rs2 << 2) | 0x2);
+        case 4:  // c.add
+            return static_cast<uint16_t>(0x9000 | (rd << 7) | (rs2 << 2) | 0x2);
+        case 5:  // c.srli c.srai c.andi
+        {
+            uint32_t funct2 = any32(generator) % 3;
+            uint32_t high = funct2 == 2 ? (imm & 0x20) << 7 : 0;
+            return static_cast<uint16_t>(0x8000 | high | (funct2 << 10) | (rdShort << 7) | ((imm & 0x1F) << 2) | 0x1);
+        }
+        default:  // c.sub c.xor c.or c.and
+            return static_cast<uint16_t>(0x8C00 | (rdShort << 7) | ((any32(generator) % 4) << 5) | (rs2Short << 2) | 0x1);
+    }
+}
+
+std::vector<uint32_t> GenerateProgram(std::default_random_engine& generator)
+{
+    std::uniform_int_distribution<uint32_t> anyReg(0, 31);
+    std::uniform_int_distribution<uint32_t> destReg(1, 27);
+    std::uniform_int_distribution<int32_t> imm12(-2048, 2047);
+    std::uniform_int_distribution<uint32_t> any32;
+    std::uniform_int_distribution<int32_t> dataOffset(0, 255);
+    std::uniform_int_distribution<uint32_t> kind(0, 99);
+
+    std::vector<uint32_t> program;
+
+    // loop counter
+    program.push_back(EncodeI(100, 0, 0x0, REG_LOOP, 0x13));  // addi
+
+    std::uniform_int_distribution<size_t> bodyLength(8, 80);
+    size_t length = bodyLength(generator);
+    size_t loopStart = program.size();
+    for (size_t i = 0; i < length; ++i)
+    {
+        size_t remaining = length - i;
+        uint32_t k = kind(generator);
+        uint32_t rd = destReg(generator);
+        uint32_t rs1 = anyReg(generator);
+        uint32_t rs2 = anyReg(generator);
+
+        if (k < 5)
+        {
+            // two compressed instructions in a word, so that branch targets
+            // stay word aligned
+            uint32_t first = CompressedAlu(generator);
+            uint32_t second = CompressedAlu(generator);
+            program.push_back(first | (second << 16));
+        }
+        else if (k < 27)
+        {
+            // add sub sll slt sltu xor srl sra or and, and the M extension
+            static const uint32_t ops[][2] = {
+                {0x00, 0}, {0x20, 0}, {0x00, 1}, {0x00, 2}, {0x00, 3},
+                {0x00, 4}, {0x00, 5}, {0x20, 5}, {0x00, 6}, {0x00, 7},
+                {0x01, 0}, {0x01, 1}, {0x01, 2}, {0x01, 3},
+                {0x01, 4}, {0x01, 5}, {0x01, 6}, {0x01, 7},
+            };
+            const uint32_t* op = ops[any32(generator) % 18];
+            program.push_back(EncodeR(op[0], rs2, rs1, op[1], rd));
+        }
+        else if (k < 30)
+        {
+            // lr sc amoswap amoadd amoxor amoand amoor amomin amomax amominu amomaxu,
+            // all on the first data word
+            static const uint32_t funct5s[] = {0x02, 0x03, 0x01, 0x00, 0x04, 0x0C, 0x08, 0x10, 0x14, 0x18, 0x1C};
+            uint32_t funct5 = funct5s[any32(generator) % 11];
+            uint32_t amo = (funct5 << 27) | ((funct5 == 0x02 ? 0 : rs2) << 20) | (REG_DATA << 15) | (0x2 << 12) |
+                           (rd << 7) | 0x2F;
+            program.push_back(amo);
+        }
+        else if (k < 55)
+        {
+            // addi slti sltiu xori ori andi, and the shifts
+            uint32_t funct3 = any32(generator) % 8;
+            int32_t imm = imm12(generator);
+            if (funct3 == 1)
+            {
+                imm &= 0x1F;
+            }
+            else if (funct3 == 5)
+            {
+                imm = (imm & 0x1F) | ((any32(generator) % 2) ? 0x400 : 0);
+            }
+            program.push_back(EncodeI(imm, rs1, funct3, rd, 0x13));
+        }
+        else if (k < 60)
+        {
+            // lui / auipc
+            program.push_back(EncodeU(any32(generator), rd, (k % 2) ? 0x37 : 0x17));
+        }
+        else if (k < 72)
+        {
+            // lb lh lw lbu lhu, some misaligned
+            static const uint32_t funct3s[] = {0, 1, 2, 4, 5};
+            program.push_back(EncodeI(dataOffset(generator), REG_DATA, funct3s[any32(generator) % 5], rd, 0x03));
+        }
+        else if (k < 84)
+        {
+            // sb sh sw, some misaligned
+            program.push_back(EncodeS(dataOffset(generator), rs2, REG_DATA, any32(generator) % 3));
+        }
+        else if (k < 92 && remaining > 2)
+        {
+            // forward branch, staying inside the loop
+            static const uint32_t funct3s[] = {0, 1, 4, 5, 6, 7};
+            int32_t skip = 1 + static_cast<int32_t>(any32(generator) % std::min<size_t>(remaining - 1, 4));
+            program.push_back(EncodeB(skip * 4, rs2, rs1, funct3s[any32(generator) % 6]));
+        }
+        else if (k < 95 && remaining > 2)
+        {
+            // forward jal
+            int32_t skip = 1 + static_cast<int32_t>(any32(generator) % std::min<size_t>(remaining - 1, 4));
+            program.push_back(EncodeJ(skip * 4, rd));
+        }
+        else if (k < 97)
+        {
+            // overwrite an instruction in the loop with an illegal one
+            int32_t target = static_cast<int32_t>((loopStart + any32(generator) % length) * 4);
+            program.push_back(EncodeS(target, 0, REG_CODE, 2));
+        }
+        else if (k < 98)
+        {
+            // csrrw x?, mscratch
+            program.push_back(EncodeI(0x340, rs1 == REG_TRAP ? 0 : rs1, 0x1, rd, 0x73));
+        }
+        else if (k < 99)
+        {
+            // read cycle, time, instret or a high half, or write minstret or
+            // mcycle (or, illegally, cycle)
+            static const uint32_t counters[] = {0xC00, 0xC01, 0xC02, 0xC80, 0xC82, 0xB00, 0xB02, 0xB82};
+            uint32_t csr = counters[any32(generator) % 8];
+            uint32_t source = (csr & 0xF00) == 0xC00 && any32(generator) % 4 != 0 ? 0 : rs1;
+            program.push_back(EncodeI(csr, source == REG_TRAP ? 0 : source, source == 0 ? 0x2 : 0x1, rd, 0x73));
+        }
+        else
+        {
+            // illegal
+            program.push_back(0xFFFFFFFF);
+        }
+    }
+
+    // loop tail: addi x31, x31, -1; bne x31, x0, loopStart
+    program.push_back(EncodeI(-1, REG_LOOP, 0x0, REG_LOOP, 0x13));
+    int32_t back = -static_cast<int32_t>((program.size() - loopStart) * 4);
+    program.push_back(EncodeB(back, 0, REG_LOOP, 0x1));
+
+    // halt: jal x0, 0
+    program.push_back(EncodeJ(0, 0));
+    return program;
+}
+
+void LoadProgram(rv::MemoryMap& mem, const std::vector<uint32_t>& program, std::default_random_engine generator)
+{
+    mem.Clear();
+
+    // trap handler skips the faulting instruction
+    const std::vector<uint32_t> handler = {
+        EncodeI(0x341, 0, 0x2, REG_TRAP, 0x73),         // csrrs x29, mepc, x0
+        EncodeI(4, REG_TRAP, 0x0, REG_TRAP, 0x13),      // addi x29, x29, 4
+        EncodeI(0x341, REG_TRAP, 0x1, 0, 0x73),         // csrrw x0, mepc, x29
+        0x30200073,                                     // mret
+    };
+    for (size_t i = 0; i < handler.size(); ++i)
+    {
+        mem.WriteWord(TRAP_ADDR + i * 4, handler[i], 0xFFFFFFFF);
+    }
+
+    for (size_t i = 0; i < program.size(); ++i)
+    {
+        mem.WriteWord(CODE_ADDR + i * 4, program[i], 0xFFFFFFFF);
+    }
+
+    std::uniform_int_distribution<uint32_t> any32;
+    for (uint32_t addr = DATA_ADDR; addr < DATA_ADDR + 0x200; addr += 4)
+    {
+        mem.WriteWord(addr, any32(generator), 0xFFFFFFFF);
+    }
+}
+
+void SetupProcessor(rv::RiscvProcessor& processor, std::default_random_engine generator)
+{
+    processor.Reset();
+    processor.SetPC(CODE_ADDR);
+
+    std::uniform_int_distribution<uint32_t> any32;
+    for (unsigned reg = 1; reg < 32; ++reg)
+    {
+        processor.SetReg(reg, any32(generator));
+    }
+    processor.SetReg(REG_CODE, CODE_ADDR);
+    processor.SetReg(REG_DATA, DATA_ADDR);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const unsigned int numPrograms = 200;
+    const unsigned long maxSteps = 200000;
+
+    rv::MemoryMap jitMem(0, MEM_SIZE);
+    rv::MemoryMap interpMem(0, MEM_SIZE);
+    rv::RiscvProcessor jit(jitMem);
+    rv::RiscvProcessor interp(interpMem);
+    interp.SetJitEnabled(false);
+
+    std::default_random_engine generator;
+    unsigned long long totalInstructions = 0;
+    unsigned long breakpointsHit = 0;
+    int failures = 0;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (unsigned int n = 0; n < numPrograms && failures == 0; ++n)
+    {
+        std::vector<uint32_t> program = GenerateProgram(generator);
+        uint32_t haltAddr = CODE_ADDR + (program.size() - 1) * 4;
+
+        std::default_random_engine dataGenerator(n);
+        LoadProgram(jitMem, program, dataGenerator);
+        LoadProgram(interpMem, program, dataGenerator);
+        SetupProcessor(jit, dataGenerator);
+        SetupProcessor(interp, dataGenerator);
+
+        // Both should stop at the same breakpoint, somewhere in the program
+        uint32_t bkptAddr = CODE_ADDR + (n % (program.size() - 1)) * 4;
+        jit.ClearBreakpoints();
+        interp.ClearBreakpoints();
+        jit.AddBreakpoint(bkptAddr);
+        interp.AddBreakpoint(bkptAddr);
+
+        unsigned long steps = 0;
+        while (steps < maxSteps && jit.GetPC() != haltAddr)
+        {
+            unsigned long jitSteps = 0;
+            unsigned long interpSteps = 0;
+            if (jit.BreakpointHit() && jit.GetPC() == bkptAddr)
+            {
+                breakpointsHit++;
+                jit.StepOverBreakpoint();
+                interp.StepOverBreakpoint();
+                jitSteps = interpSteps = 1;
+            }
+            else
+            {
+                jitSteps = jit.StepBlock();
+                interpSteps = interp.StepBlock();
+            }
+            steps += jitSteps;
+
+            bool same = jitSteps == interpSteps &&
+                        jit.BreakpointHit() == interp.BreakpointHit() &&
+                        jit.GetPC() == interp.GetPC() &&
+                        jit.GetInstructionCount() == interp.GetInstructionCount();
+            for (unsigned reg = 0; reg < 32; ++reg)
+            {
+                same = same && jit.GetReg(reg) == interp.GetReg(reg);
+            }
+            same = same && jit.GetCSRValue(rv::RiscvProcessor::csr_mcause) == interp.GetCSRValue(rv::RiscvProcessor::csr_mcause);
+            same = same && jit.GetCSRValue(rv::RiscvProcessor::csr_mepc) == interp.GetCSRValue(rv::RiscvProcessor::csr_mepc);
+
+            if (!same)
+            {
+                std::cout << "!! program " << n << " differs after " << steps << " steps";
+                std::cout << std::hex << " pc 0x" << jit.GetPC() << " vs 0x" << interp.GetPC() << std::dec << std::endl;
+                for (unsigned reg = 0; reg < 32; ++reg)
+                {
+                    if (jit.GetReg(reg) != interp.GetReg(reg))
+                    {
+                        std::cout << "   x" << reg << std::hex << " 0x" << jit.GetReg(reg);
+                        std::cout << " vs 0x" << interp.GetReg(reg) << std::dec << std::endl;
+                    }
+                }
+                failures++;
+                break;
+            }
+        }
+
+        for (uint32_t addr = 0; addr < MEM_SIZE && failures == 0; addr += 4)
+        {
+            if (jitMem.ReadWord(addr) != interpMem.ReadWord(addr))
+            {
+                std::cout << "!! program " << n << " memory differs at address " << std::hex << addr << std::dec << std::endl;
+                failures++;
+            }
+        }
+
+        totalInstructions += jit.GetInstructionCount();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    std::cout << "Ran " << totalInstructions << " instructions, ";
+    std::cout << jit.GetCompiledBlockCount() << " blocks compiled, ";
+    std::cout << breakpointsHit << " breakpoints hit" << std::endl;
+    std::cout << "Time elapsed = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " [ms]" << std::endl;
+
+    if (jit.GetCompiledBlockCount() == 0)
+    {
+        std::cout << "!! nothing was compiled" << std::endl;
+        failures++;
+    }
+
+    if (breakpointsHit == 0)
+    {
+        std::cout << "!! no breakpoints were hit" << std::endl;
+        failures++;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
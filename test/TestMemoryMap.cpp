@@ -2,18 +2,346 @@
 #include <vector>
 #include <random>
 #include <chrono>
+#include <algorithm>
+#include <sys/mman.h>
 
 #include "memorymap.h"
 
 namespace rv = riscvdb;
 
+namespace
+{
+
+long long ElapsedMs(const std::chrono::steady_clock::time_point begin)
+{
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+}
+
+// Bulk load, byte check, random word accesses, mixed access sizes and page
+// iteration against one backend.
+// Returns the number of mismatches.
+unsigned long Run(const char* name, const rv::MemoryMap::Backend backend,
+                  const std::vector<std::byte>& testData,
+                  const uint32_t wordsBase, const std::vector<uint32_t>& wordAddresses)
+{
+    rv::MemoryMap memoryMap(0, 1024 * 1024 * 1024, backend); // start at 0, 1 GiB
+    if (memoryMap.GetBackend() != backend)
+    {
+        std::cout << name << ": backend not available, skipping" << std::endl;
+        return 0;
+    }
+
+    const rv::MemoryMap::AddrType base = 0x0100;
+    unsigned long errors = 0;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    memoryMap.Put(base, testData);
+    std::cout << name << ": put " << ElapsedMs(begin) << " [ms]" << std::endl;
+
+    begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < testData.size(); ++i)
+    {
+        std::byte b;
+        memoryMap.Get(base + i, b);
+        if (b != testData[i])
+        {
+            std::cout << "!! address " << base + i;
+            std::cout << " got " << static_cast<unsigned int>(b);
+            std::cout << " expecting " << static_cast<unsigned int>(testData[i]);
+            std::cout << std::endl;
+            errors++;
+        }
+    }
+    std::cout << name << ": get " << ElapsedMs(begin) << " [ms]" << std::endl;
+
+    // Random word accesses to memory that wasn't written before
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t address : wordAddresses)
+    {
+        memoryMap.WriteWord(address, address ^ 0x5a5a5a5a, 0xFFFFFFFF);
+    }
+    unsigned long wordErrors = 0;
+    for (uint32_t address : wordAddresses)
+    {
+        if (memoryMap.ReadWord(address) != (address ^ 0x5a5a5a5a))
+        {
+            wordErrors++;
+        }
+    }
+    std::cout << name << ": words " << ElapsedMs(begin) << " [ms]" << std::endl;
+
+    if (wordErrors != 0)
+    {
+        std::cout << "!! " << wordErrors << " words read back wrong" << std::endl;
+        errors += wordErrors;
+    }
+
+    // Each access size, aligned and straddling a block boundary
+    const rv::MemoryMap::AddrType edge = wordsBase - rv::DEFAULT_BLOCK_SIZE;
+    for (rv::MemoryMap::AddrType address = edge - 8; address < edge + 8; ++address)
+    {
+        memoryMap.WriteDoubleword(address, 0x0123456789abcdefULL);
+        memoryMap.WriteHalfword(address + 2, 0x5a5a);
+        memoryMap.WriteByte(address + 5, 0xa5);
+        if (memoryMap.ReadDoubleword(address) != 0x0123a5675a5acdefULL ||
+            memoryMap.ReadWord(address + 4) != 0x0123a567 ||
+            memoryMap.ReadHalfword(address + 1) != 0x5acd ||
+            memoryMap.ReadByte(address + 7) != 0x01)
+        {
+            std::cout << "!! access sizes at address " << address << std::endl;
+            errors++;
+        }
+    }
+
+    // A page that was only read isn't visited, and the first page still is
+    // after the host has paged it out
+    const rv::MemoryMap::AddrType readOnly = 768 * 1024 * 1024;
+    if (memoryMap.ReadWord(readOnly) != 0)
+    {
+        std::cout << "!! unwritten memory isn't zero" << std::endl;
+        errors++;
+    }
+#ifdef MADV_PAGEOUT
+    if (backend == rv::MemoryMap::BACKEND_FLAT)
+    {
+        memoryMap.ForEachPage(
+            [](const rv::MemoryMap::AddrType address, const std::byte* data, const rv::MemoryMap::AddrType size)
+            {
+                if (address == 0)
+                {
+                    madvise(const_cast<std::byte*>(data), size, MADV_PAGEOUT);
+                }
+            });
+    }
+#endif
+
+    // Backed pages come out in address order, and cover everything written
+    begin = std::chrono::steady_clock::now();
+    rv::MemoryMap::AddrType next = 0;
+    rv::MemoryMap::AddrType covered = 0;
+    unsigned long pages = 0;
+    bool ordered = true;
+    bool firstPageIntact = false;
+    bool readOnlyVisited = false;
+    memoryMap.ForEachPage(
+        [&](const rv::MemoryMap::AddrType address, const std::byte* data, const rv::MemoryMap::AddrType size)
+        {
+            ordered = ordered && address >= next;
+            next = address + size;
+            pages++;
+
+            rv::MemoryMap::AddrType start = std::max(address, base);
+            rv::MemoryMap::AddrType end = std::min(address + size, base + testData.size());
+            covered += end > start ? end - start : 0;
+
+            if (address == 0)
+            {
+                firstPageIntact = std::equal(data + base, data + size, testData.begin());
+            }
+            readOnlyVisited = readOnlyVisited || (readOnly >= address && readOnly < address + size);
+        });
+    std::cout << name << ": " << pages << " pages visited " << ElapsedMs(begin) << " [ms]" << std::endl;
+    if (!ordered || covered != testData.size() || !firstPageIntact)
+    {
+        std::cout << "!! page iteration out of order or incomplete" << std::endl;
+        errors++;
+    }
+    if (readOnlyVisited)
+    {
+        std::cout << "!! page that was only read was visited" << std::endl;
+        errors++;
+    }
+
+    if (backend == rv::MemoryMap::BACKEND_BLOCKS)
+    {
+        rv::MemoryMap::BlockCacheStats stats = memoryMap.GetBlockCacheStats();
+        std::cout << name << ": data cache " << stats.dataHits << " hits, ";
+        std::cout << stats.dataMisses << " misses" << std::endl;
+    }
+
+    // Clearing returns everything to zero
+    memoryMap.Clear();
+    std::byte b;
+    memoryMap.Get(base, b);
+    if (b != std::byte{0} || memoryMap.ReadWord(wordAddresses[0]) != 0)
+    {
+        std::cout << "!! memory not cleared" << std::endl;
+        errors++;
+    }
+
+    return errors;
+}
+
+// A device that keeps its registers in bytes, and counts its accesses
+struct TestDevice
+{
+    std::vector<uint8_t> regs;
+    unsigned long reads = 0;
+    unsigned long writes = 0;
+    unsigned int lastSize = 0;
+
+    explicit TestDevice(const rv::MemoryMap::AddrType size) : regs(size) {}
+
+    uint64_t Read(const rv::MemoryMap::AddrType offset, const unsigned int size)
+    {
+        reads++;
+        lastSize = size;
+        uint64_t value = 0;
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            value |= static_cast<uint64_t>(regs[offset + i]) << (8 * i);
+        }
+        return value;
+    }
+
+    void Write(const rv::MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+    {
+        writes++;
+        lastSize = size;
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            regs[offset + i] = static_cast<uint8_t>(data >> (8 * i));
+        }
+    }
+
+    void Add(rv::MemoryMap& memoryMap, const char* name, const rv::MemoryMap::AddrType base)
+    {
+        memoryMap.AddDevice(name, base, regs.size(),
+            [this](const rv::MemoryMap::AddrType offset, const unsigned int size)
+            {
+                return Read(offset, size);
+            },
+            [this](const rv::MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+            {
+                Write(offset, size, data);
+            });
+    }
+};
+
+long long TimeWords(rv::MemoryMap& memoryMap, const std::vector<uint32_t>& wordAddresses)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    uint32_t sum = 0;
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        for (uint32_t address : wordAddresses)
+        {
+            memoryMap.WriteWord(address, sum);
+            sum += memoryMap.ReadWord(address);
+        }
+    }
+    long long ms = ElapsedMs(begin);
+    return sum == 1 ? -1 : ms;  // keeps the loop from being optimised away
+}
+
+// Routing of accesses to devices, and to the RAM around them, and RAM access
+// times with devices mapped above it against without.
+// Returns the number of mismatches.
+unsigned long RunDevices(const char* name, const rv::MemoryMap::Backend backend,
+                         const std::vector<uint32_t>& wordAddresses)
+{
+    const rv::MemoryMap::AddrType regsBase = 0x70000000;
+    const rv::MemoryMap::AddrType bufferBase = 0x70001000;
+    rv::MemoryMap memoryMap(0, 0x80000000, backend);
+    unsigned long errors = 0;
+
+    TimeWords(memoryMap, wordAddresses);  // first touch
+    long long plainMs = TimeWords(memoryMap, wordAddresses);
+
+    TestDevice regs(0x100);
+    TestDevice buffer(0x1000);
+    regs.Add(memoryMap, "regs", regsBase);
+    buffer.Add(memoryMap, "buffer", bufferBase);
+
+    long long devicesMs = TimeWords(memoryMap, wordAddresses);
+    std::cout << name << ": words " << plainMs << " [ms] without devices, ";
+    std::cout << devicesMs << " [ms] with" << std::endl;
+
+    // Each access size goes to the device whole
+    memoryMap.WriteDoubleword(regsBase + 8, 0x0123456789abcdefULL);
+    memoryMap.WriteHalfword(regsBase + 10, 0x5a5a);
+    if (regs.lastSize != 2 || memoryMap.ReadDoubleword(regsBase + 8) != 0x012345675a5acdefULL ||
+        regs.lastSize != 8 || memoryMap.ReadByte(regsBase + 15) != 0x01 || regs.lastSize != 1 ||
+        buffer.reads != 0 || buffer.writes != 0)
+    {
+        std::cout << "!! device access sizes" << std::endl;
+        errors++;
+    }
+
+    // RAM below, between and above the devices is still RAM
+    unsigned long accesses = regs.reads + regs.writes + buffer.reads + buffer.writes;
+    for (rv::MemoryMap::AddrType address : {regsBase - 4, regsBase + 0x100, bufferBase + 0x1000})
+    {
+        memoryMap.WriteWord(address, 0xfeedf00d);
+        std::byte b;
+        memoryMap.Get(address + 3, b);
+        if (memoryMap.ReadWord(address) != 0xfeedf00d || b != std::byte{0xfe})
+        {
+            std::cout << "!! RAM at address " << address << std::endl;
+            errors++;
+        }
+    }
+    if (regs.reads + regs.writes + buffer.reads + buffer.writes != accesses)
+    {
+        std::cout << "!! RAM accesses reached a device" << std::endl;
+        errors++;
+    }
+
+    // Straddling into a device splits the access into bytes
+    memoryMap.WriteWord(bufferBase - 2, 0xa1b2c3d4);
+    if (buffer.regs[0] != 0xb2 || buffer.regs[1] != 0xa1 || buffer.lastSize != 1 ||
+        memoryMap.ReadHalfword(bufferBase - 2) != 0xc3d4 || memoryMap.ReadWord(bufferBase - 2) != 0xa1b2c3d4)
+    {
+        std::cout << "!! access straddling a device" << std::endl;
+        errors++;
+    }
+
+    // Bulk writes and atomics
+    memoryMap.Put(bufferBase - 0x10, std::vector<std::byte>(0x20, std::byte{0x11}));
+    if (buffer.regs[0xf] != 0x11 || buffer.regs[0x10] != 0 || memoryMap.ReadByte(bufferBase - 0x10) != 0x11)
+    {
+        std::cout << "!! bulk write over a device" << std::endl;
+        errors++;
+    }
+    memoryMap.WriteWord(bufferBase + 0x20, 40);
+    if (memoryMap.AtomicWord(bufferBase + 0x20, rv::MemoryMap::ATOMIC_ADD, 2) != 40 ||
+        memoryMap.AtomicLoadWord(bufferBase + 0x20) != 42 ||
+        !memoryMap.CompareExchangeWord(bufferBase + 0x20, 42, 7) || buffer.regs[0x20] != 7)
+    {
+        std::cout << "!! atomics on a device" << std::endl;
+        errors++;
+    }
+
+    // Overlapping or unaligned devices are refused
+    unsigned long refused = 0;
+    for (rv::MemoryMap::AddrType base : {regsBase + 0x80, regsBase - 0x80, bufferBase + 2})
+    {
+        try
+        {
+            memoryMap.AddDevice("bad", base, 0x100, nullptr, nullptr);
+        }
+        catch (const std::exception&)
+        {
+            refused++;
+        }
+    }
+    if (refused != 3)
+    {
+        std::cout << "!! bad device ranges accepted" << std::endl;
+        errors++;
+    }
+
+    return errors;
+}
+
+} // namespace
+
 int main(int argc, char* argv[])
 {
     (void)argc;
     (void)argv;
 
-    rv::MemoryMap memoryMap(0, 1024 * 1024 * 1024); // start at 0, 1 GiB
-
     std::default_random_engine generator;
     std::uniform_int_distribution<unsigned char> distribution(0, 255);
 
@@ -22,30 +350,22 @@ int main(int argc, char* argv[])
     {
         b = static_cast<std::byte>(distribution(generator));
     }
-    std::cout << "generated data" << std::endl;
-
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    memoryMap.Put(0x0100, testData);
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
-    std::cout << "Time elapsed = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " [ms]" << std::endl;
-
-
-    std::cout << "Checking data" << std::endl;
-    std::vector<std::byte> dataCheck(testData.size());
-    for (std::size_t i = 0x100; i < testData.size(); ++i)
+    // Word aligned, in the 64 MiB above the bulk data
+    const uint32_t wordsBase = 512 * 1024 * 1024;
+    std::uniform_int_distribution<uint32_t> addressDistribution(0, 64 * 1024 * 1024 / 4 - 1);
+    std::vector<uint32_t> wordAddresses(1024 * 1024);
+    for (uint32_t& address : wordAddresses)
     {
-        memoryMap.Get(i, dataCheck[i]);
-        if (dataCheck[i] != testData[i])
-        {
-            std::cout << "!! address " << i;
-            std::cout << " got ";
-            std::cout << static_cast<unsigned char>(dataCheck[i]);
-            std::cout << " expecting ";
-            std::cout << static_cast<unsigned char>(testData[i]);
-            std::cout << std::endl;
-        }
+        address = wordsBase + addressDistribution(generator) * 4;
     }
+    std::cout << "generated data" << std::endl;
+
+    unsigned long errors = 0;
+    errors += Run("flat", rv::MemoryMap::BACKEND_FLAT, testData, wordsBase, wordAddresses);
+    errors += Run("blocks", rv::MemoryMap::BACKEND_BLOCKS, testData, wordsBase, wordAddresses);
+    errors += RunDevices("flat", rv::MemoryMap::BACKEND_FLAT, wordAddresses);
+    errors += RunDevices("blocks", rv::MemoryMap::BACKEND_BLOCKS, wordAddresses);
 
-    return 0;
+    return errors == 0 ? 0 : 1;
 }
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <vector>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+
+// Checks M extension results against known values where the host's own
+// arithmetic would differ or trap: division by zero, INT32_MIN / -1, and the
+// high halves of products with negative and large operands. Each is run
+// single stepped, then as a block until the JIT has compiled it.
+
+namespace
+{
+
+const uint32_t MEM_SIZE = 0x10000;
+const unsigned int BLOCK_RUNS = 20;  // more than the JIT's threshold
+
+// funct3 values
+const uint32_t MUL = 0x0, MULH = 0x1, MULHSU = 0x2, MULHU = 0x3;
+const uint32_t DIV = 0x4, DIVU = 0x5, REM = 0x6, REMU = 0x7;
+
+struct Case
+{
+    const char* name;
+    uint32_t funct3;
+    uint32_t a;
+    uint32_t b;
+    uint32_t expected;
+};
+
+const std::vector<Case> CASES = {
+    {"mul INT32_MIN, -1",             MUL,    0x80000000, 0xFFFFFFFF, 0x80000000},
+    {"mul large",                     MUL,    0x12345678, 0x9ABCDEF0, 0x242D2080},
+    {"mul -1, -1",                    MUL,    0xFFFFFFFF, 0xFFFFFFFF, 0x00000001},
+    {"mulh -1, -1",                   MULH,   0xFFFFFFFF, 0xFFFFFFFF, 0x00000000},
+    {"mulh INT32_MIN, INT32_MIN",     MULH,   0x80000000, 0x80000000, 0x40000000},
+    {"mulh -2, 3",                    MULH,   0xFFFFFFFE, 0x00000003, 0xFFFFFFFF},
+    {"mulh INT32_MAX, INT32_MAX",     MULH,   0x7FFFFFFF, 0x7FFFFFFF, 0x3FFFFFFF},
+    {"mulh INT32_MIN, INT32_MAX",     MULH,   0x80000000, 0x7FFFFFFF, 0xC0000000},
+    {"mulhsu -1, 0xFFFFFFFF",         MULHSU, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF},
+    {"mulhsu INT32_MIN, 0xFFFFFFFF",  MULHSU, 0x80000000, 0xFFFFFFFF, 0x80000000},
+    {"mulhsu 2, 0xFFFFFFFF",          MULHSU, 0x00000002, 0xFFFFFFFF, 0x00000001},
+    {"mulhsu INT32_MAX, 0x80000000",  MULHSU, 0x7FFFFFFF, 0x80000000, 0x3FFFFFFF},
+    {"mulhu 0xFFFFFFFF squared",      MULHU,  0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFE},
+    {"mulhu 0x80000000, 2",           MULHU,  0x80000000, 0x00000002, 0x00000001},
+    {"mulhu large",                   MULHU,  0x12345678, 0x9ABCDEF0, 0x0B00EA4E},
+    {"div by zero",                   DIV,    0x00000007, 0x00000000, 0xFFFFFFFF},
+    {"div negative by zero",          DIV,    0xFFFFFFF9, 0x00000000, 0xFFFFFFFF},
+    {"div INT32_MIN, -1",             DIV,    0x80000000, 0xFFFFFFFF, 0x80000000},
+    {"div -7, 2",                     DIV,    0xFFFFFFF9, 0x00000002, 0xFFFFFFFD},
+    {"div 7, -2",                     DIV,    0x00000007, 0xFFFFFFFE, 0xFFFFFFFD},
+    {"divu by zero",                  DIVU,   0x00000007, 0x00000000, 0xFFFFFFFF},
+    {"divu 0x80000000, 0xFFFFFFFF",   DIVU,   0x80000000, 0xFFFFFFFF, 0x00000000},
+    {"divu 0xFFFFFFF9, 2",            DIVU,   0xFFFFFFF9, 0x00000002, 0x7FFFFFFC},
+    {"rem by zero",                   REM,    0x00000007, 0x00000000, 0x00000007},
+    {"rem negative by zero",          REM,    0xFFFFFFF9, 0x00000000, 0xFFFFFFF9},
+    {"rem INT32_MIN, -1",             REM,    0x80000000, 0xFFFFFFFF, 0x00000000},
+    {"rem -7, 2",                     REM,    0xFFFFFFF9, 0x00000002, 0xFFFFFFFF},
+    {"rem 7, -2",                     REM,    0x00000007, 0xFFFFFFFE, 0x00000001},
+    {"remu by zero",                  REMU,   0x00000007, 0x00000000, 0x00000007},
+    {"remu 0x80000000, 0xFFFFFFFF",   REMU,   0x80000000, 0xFFFFFFFF, 0x80000000},
+    {"remu 0xFFFFFFF9, 2",            REMU,   0xFFFFFFF9, 0x00000002, 0x00000001},
+};
+
+// Runs the instruction at 0 (followed by a halt) with the operands in x1
+// and x2, returning x10, or the complement of expected if it trapped
+uint32_t RunOnce(rv::RiscvProcessor& processor, const Case& c, const bool block)
+{
+    processor.SetPC(0);
+    processor.SetReg(1, c.a);
+    processor.SetReg(2, c.b);
+    processor.SetReg(10, 0);
+    if (block)
+    {
+        processor.StepBlock();
+    }
+    else
+    {
+        processor.Step();
+    }
+    return processor.GetPC() == 4 ? processor.GetReg(10) : ~c.expected;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rv::MemoryMap mem(0, MEM_SIZE);
+    rv::RiscvProcessor processor(mem);
+
+    unsigned long errors = 0;
+    for (const Case& c : CASES)
+    {
+        mem.WriteWord(0, encode::EncodeR(0x01, 2, 1, c.funct3, 10));
+        mem.WriteWord(4, encode::HALT);
+
+        uint32_t result = RunOnce(processor, c, false);
+        for (unsigned int run = 0; run < BLOCK_RUNS && result == c.expected; ++run)
+        {
+            result = RunOnce(processor, c, true);
+        }
+        if (result != c.expected)
+        {
+            std::cout << "!! " << c.name << std::hex << ": got " << result;
+            std::cout << " expecting " << c.expected << std::dec << std::endl;
+            errors++;
+        }
+    }
+
+#ifdef RISCVDB_ENABLE_JIT
+    if (processor.GetCompiledBlockCount() == 0)
+    {
+        std::cout << "!! nothing was compiled" << std::endl;
+        errors++;
+    }
+#endif
+
+    std::cout << CASES.size() << " cases, " << errors << " errors" << std::endl;
+    return errors == 0 ? 0 : 1;
+}
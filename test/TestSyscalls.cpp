@@ -0,0 +1,197 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "syscalls.h"
+#include "Encode.h"
+#include "Backends.h"
+
+namespace rv = riscvdb;
+
+// Checks the system calls made through ecall, for each memory backend, and
+// benchmarks reading and writing a large file through them against copying
+// the same bytes through the memory map one at a time.
+
+namespace
+{
+
+const uint32_t CODE_ADDR = 0x8000;
+const uint32_t TRAP_ADDR = 0x9000;
+const uint32_t PATH_ADDR = 0x2000;
+const uint32_t BUF_ADDR = 0x100000;
+const uint32_t BUF_SIZE = 16 * 1024 * 1024;
+const uint32_t MEM_SIZE = 0x4000000;
+const uint32_t HEAP_START = 0x3000000;
+
+// O_RDWR | O_CREAT | O_TRUNC, as newlib numbers them
+const uint32_t GUEST_CREATE = 0x602;
+
+const std::string FILE_PATH = "syscalls_test_file.bin";
+
+// Makes the call with the ecall at CODE_ADDR, returning a0
+int32_t Call(rv::RiscvProcessor& hart, const uint32_t number,
+             const uint32_t a0 = 0, const uint32_t a1 = 0, const uint32_t a2 = 0)
+{
+    hart.SetPC(CODE_ADDR);
+    hart.SetReg(17, number);
+    hart.SetReg(10, a0);
+    hart.SetReg(11, a1);
+    hart.SetReg(12, a2);
+    hart.Step();
+    return static_cast<int32_t>(hart.GetReg(10));
+}
+
+void WriteString(rv::MemoryMap& memoryMap, const uint32_t address, const std::string& str)
+{
+    for (size_t i = 0; i <= str.size(); ++i)
+    {
+        memoryMap.WriteByte(address + static_cast<uint32_t>(i), i < str.size() ? str[i] : 0);
+    }
+}
+
+void Run(const rv::MemoryMap::Backend backend, backends::Reporter& report)
+{
+    rv::MemoryMap memoryMap(0, MEM_SIZE, backend);
+    rv::RiscvProcessor hart(memoryMap);
+    rv::SyscallProxy syscalls(memoryMap);
+    hart.SetEcallHandler([&syscalls](rv::RiscvProcessor& caller)
+    {
+        return syscalls.Handle(caller);
+    });
+    memoryMap.WriteWord(CODE_ADDR, encode::ECALL);
+
+    std::ostringstream out;
+    std::ostringstream err;
+    syscalls.SetOutput(out, err);
+    syscalls.Reset(HEAP_START, MEM_SIZE);
+
+    // stdout, across a block boundary
+    const uint32_t textAddr = rv::DEFAULT_BLOCK_SIZE - 3;
+    WriteString(memoryMap, textAddr, "hello\n");
+    int32_t ret = Call(hart, rv::SyscallProxy::SYS_WRITE, 1, textAddr, 6);
+    if (ret != 6 || out.str() != "hello\n" || hart.GetPC() != CODE_ADDR + 4)
+    {
+        report.Error() << "write to stdout returned " << ret << ", wrote \"" << out.str() << "\"" << std::endl;
+    }
+
+    // anything outside of RAM is a fault, and a call that isn't handled traps
+    ret = Call(hart, rv::SyscallProxy::SYS_WRITE, 2, MEM_SIZE - 2, 4);
+    if (ret != -EFAULT)
+    {
+        report.Error() << "write outside memory returned " << ret << std::endl;
+    }
+    int32_t timeRet = Call(hart, rv::SyscallProxy::SYS_GETTIMEOFDAY, MEM_SIZE - 8);
+    int32_t clockRet = Call(hart, rv::SyscallProxy::SYS_CLOCK_GETTIME64, 0, MEM_SIZE - 8);
+    if (timeRet != -EFAULT || clockRet != -EFAULT)
+    {
+        report.Error() << "times outside memory returned " << timeRet << ", " << clockRet << std::endl;
+    }
+    timeRet = Call(hart, rv::SyscallProxy::SYS_GETTIMEOFDAY, BUF_ADDR);
+    clockRet = Call(hart, rv::SyscallProxy::SYS_CLOCK_GETTIME64, 0, BUF_ADDR + 16);
+    if (timeRet != 0 || clockRet != 0 || memoryMap.ReadWord(BUF_ADDR) == 0 ||
+        memoryMap.ReadWord(BUF_ADDR + 16) < memoryMap.ReadWord(BUF_ADDR))
+    {
+        report.Error() << "times returned " << timeRet << ", " << clockRet << std::endl;
+    }
+    hart.SetCSRValue(0x305, TRAP_ADDR);  // mtvec
+    Call(hart, 12345);
+    if (hart.GetPC() != TRAP_ADDR)
+    {
+        report.Error() << "unknown call didn't trap" << std::endl;
+    }
+
+    // brk only moves within the heap
+    uint32_t brk = static_cast<uint32_t>(Call(hart, rv::SyscallProxy::SYS_BRK, 0));
+    uint32_t grown = static_cast<uint32_t>(Call(hart, rv::SyscallProxy::SYS_BRK, HEAP_START + 0x10000));
+    uint32_t refused = static_cast<uint32_t>(Call(hart, rv::SyscallProxy::SYS_BRK, MEM_SIZE + 0x1000));
+    if (brk != HEAP_START || grown != HEAP_START + 0x10000 || refused != grown)
+    {
+        report.Error() << "brk gave " << std::hex << brk << ", " << grown << ", " << refused << std::dec << std::endl;
+    }
+
+    // a large file, written out and read back
+    for (uint32_t i = 0; i < BUF_SIZE; i += 4)
+    {
+        memoryMap.WriteWord(BUF_ADDR + i, i * 2654435761u);
+    }
+    WriteString(memoryMap, PATH_ADDR, FILE_PATH);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    int32_t fd = Call(hart, rv::SyscallProxy::SYS_OPEN, PATH_ADDR, GUEST_CREATE, 0644);
+    int32_t written = Call(hart, rv::SyscallProxy::SYS_WRITE, fd, BUF_ADDR, BUF_SIZE);
+    int32_t offset = Call(hart, rv::SyscallProxy::SYS_LSEEK, fd, 0, SEEK_SET);
+    int32_t read = Call(hart, rv::SyscallProxy::SYS_READ, fd, BUF_ADDR + BUF_SIZE, BUF_SIZE);
+    int32_t closed = Call(hart, rv::SyscallProxy::SYS_CLOSE, fd);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double proxySeconds = std::chrono::duration<double>(end - begin).count();
+
+    if (fd != 3 || written != static_cast<int32_t>(BUF_SIZE) || offset != 0 ||
+        read != static_cast<int32_t>(BUF_SIZE) || closed != 0)
+    {
+        report.Error() << "file calls returned " << fd << ", " << written << ", "
+                       << offset << ", " << read << ", " << closed << std::endl;
+    }
+    for (uint32_t i = 0; i < BUF_SIZE; i += 4)
+    {
+        if (memoryMap.ReadWord(BUF_ADDR + BUF_SIZE + i) != memoryMap.ReadWord(BUF_ADDR + i))
+        {
+            report.Error() << "read back differs at " << i << std::endl;
+            break;
+        }
+    }
+    if (Call(hart, rv::SyscallProxy::SYS_READ, fd, BUF_ADDR, 1) != -EBADF)
+    {
+        report.Error() << "read after close" << std::endl;
+    }
+
+    // the same bytes out and back through the memory map one at a time, as
+    // a loop in the guest would copy them
+    begin = std::chrono::steady_clock::now();
+    std::FILE* file = std::fopen(FILE_PATH.c_str(), "w+b");
+    std::vector<char> bytes(BUF_SIZE);
+    for (uint32_t i = 0; i < BUF_SIZE; ++i)
+    {
+        bytes[i] = static_cast<char>(memoryMap.ReadByte(BUF_ADDR + i));
+    }
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::rewind(file);
+    size_t bytesRead = std::fread(bytes.data(), 1, bytes.size(), file);
+    for (uint32_t i = 0; i < bytesRead; ++i)
+    {
+        memoryMap.WriteByte(BUF_ADDR + BUF_SIZE + i, static_cast<uint8_t>(bytes[i]));
+    }
+    std::fclose(file);
+    end = std::chrono::steady_clock::now();
+    double byteSeconds = std::chrono::duration<double>(end - begin).count();
+    std::remove(FILE_PATH.c_str());
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << report.Name() << ": " << 2.0 * BUF_SIZE / proxySeconds / 1e6 << " MB/s through the calls, ";
+    std::cout << 2.0 * BUF_SIZE / byteSeconds / 1e6 << " MB/s a byte at a time" << std::endl;
+
+    // exit is recorded, and Reset forgets it
+    Call(hart, rv::SyscallProxy::SYS_EXIT, 42);
+    bool exited = syscalls.Exited() && syscalls.ExitCode() == 42;
+    syscalls.Reset(HEAP_START, MEM_SIZE);
+    if (!exited || syscalls.Exited())
+    {
+        report.Error() << "exit" << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    return backends::RunEach(Run) == 0 ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+
+#include "memorymap.h"
+#include "riscv_processor.h"
+#include "clint.h"
+#include "Encode.h"
+
+namespace rv = riscvdb;
+using namespace encode;
+
+// Checks that timer interrupts from the CLINT land on the same instruction
+// whether the hart is single stepped, run a block at a time, or compiled, as
+// do mtime reads and software interrupts from the middle of a block, and
+// benchmarks a run with the timer armed against one without.
+
+namespace
+{
+
+const uint32_t LOOP_ADDR = 0x1000;
+const uint32_t HANDLER_ADDR = 0x2000;
+const uint32_t MTIME_LOOP_ADDR = 0x3000;
+const uint32_t IPI_LOOP_ADDR = 0x4000;
+const uint32_t IPI_HANDLER_ADDR = 0x5000;
+const uint32_t CLINT_ADDR = 0x10000;
+const uint32_t MEM_SIZE = 0x20000;
+
+const uint32_t PERIOD = 1000;
+const unsigned long RUN_INSTRUCTIONS = 200000;
+const unsigned long MTIME_INSTRUCTIONS = 5000;
+const unsigned long IPI_INSTRUCTIONS = 20000;
+const unsigned long BENCH_INSTRUCTIONS = 50000000;
+
+enum Mode
+{
+    MODE_STEP,
+    MODE_BLOCK,
+    MODE_JIT,
+};
+const char* MODE_NAMES[] = {"step", "block", "jit"};
+
+// x5 counts loop iterations
+const std::vector<uint32_t> LOOP_PROGRAM = {
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeJ(-4, 0),                                       // j 0b
+};
+
+// x8 counts interrupts, x10 and x11 hold the addresses of mtimecmp and mtime.
+// The handler starts the next period from mtime.
+const std::vector<uint32_t> HANDLER_PROGRAM = {
+    NOP,
+    EncodeI(1, 8, 0x0, 8, 0x13),                          // addi x8, x8, 1
+    EncodeI(rv::RiscvProcessor::csr_mepc, 0, 0x2, 6, 0x73), // csrr x6, mepc
+    EncodeI(0, 11, 0x2, 9, 0x03),                         // lw x9, 0(x11)
+    EncodeI(PERIOD, 9, 0x0, 9, 0x13),                     // addi x9, x9, PERIOD
+    EncodeS(4, 0, 10, 0x2),                               // sw x0, 4(x10)
+    EncodeS(0, 9, 10, 0x2),                               // sw x9, 0(x10)
+    MRET,
+};
+
+// x9 reads mtime after three instructions of the block, and x5 counts them
+const std::vector<uint32_t> MTIME_LOOP_PROGRAM = {
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeI(0, 11, 0x2, 9, 0x03),                         // lw x9, 0(x11)
+    EncodeJ(-16, 0),                                      // j 0b
+};
+
+// The hart interrupts itself from the middle of a block, through msip (x12,
+// with x7 = 1). Nothing after the store should run before the handler, which
+// clears msip again, counts the interrupt in x8 and notes mepc in x6.
+const std::vector<uint32_t> IPI_LOOP_PROGRAM = {
+    EncodeS(0, 7, 12, 0x2),                               // sw x7, 0(x12)
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeI(1, 5, 0x0, 5, 0x13),                          // addi x5, x5, 1
+    EncodeJ(-20, 0),                                      // j 0b
+};
+const std::vector<uint32_t> IPI_HANDLER_PROGRAM = {
+    EncodeS(0, 0, 12, 0x2),                               // sw x0, 0(x12)
+    EncodeI(1, 8, 0x0, 8, 0x13),                          // addi x8, x8, 1
+    EncodeI(rv::RiscvProcessor::csr_mepc, 0, 0x2, 6, 0x73), // csrr x6, mepc
+    MRET,
+};
+
+struct Result
+{
+    unsigned long long instructions;
+    uint32_t pc;
+    uint32_t iterations;
+    uint32_t interrupts;
+    uint32_t lastEpc;
+    uint32_t lastMtime;
+};
+
+void Setup(rv::RiscvProcessor& hart, rv::Clint& clint, const Mode mode, const bool armed,
+           const uint32_t start = LOOP_ADDR, const uint32_t handler = HANDLER_ADDR,
+           const uint32_t mie = 0x80)  // mtie
+{
+    hart.Reset();
+    hart.SetJitEnabled(mode == MODE_JIT);
+    hart.SetPC(start);
+    hart.SetReg(7, 1);
+    hart.SetReg(10, CLINT_ADDR + rv::Clint::MTIMECMP);
+    hart.SetReg(11, CLINT_ADDR + rv::Clint::MTIME);
+    hart.SetReg(12, CLINT_ADDR + rv::Clint::MSIP);
+    hart.SetCSRValue(rv::RiscvProcessor::csr_mtvec, handler);
+    hart.SetCSRValue(rv::RiscvProcessor::csr_mie, mie);
+    hart.SetCSRValue(rv::RiscvProcessor::csr_mstatus, 0x8);   // mie
+
+    // through the CLINT, as the guest would
+    clint.Write(rv::Clint::MTIMECMP, 8, armed ? PERIOD : ~0ULL);
+}
+
+void Run(rv::RiscvProcessor& hart, const Mode mode, const unsigned long instructions)
+{
+    unsigned long long end = hart.GetInstructionCount() + instructions;
+    while (hart.GetInstructionCount() < end)
+    {
+        if (mode == MODE_STEP)
+        {
+            hart.Step();
+        }
+        else
+        {
+            hart.StepBlock(end - hart.GetInstructionCount());
+        }
+    }
+}
+
+Result GetResult(rv::RiscvProcessor& hart)
+{
+    Result result;
+    result.instructions = hart.GetInstructionCount();
+    result.pc = hart.GetPC();
+    result.iterations = hart.GetReg(5);
+    result.interrupts = hart.GetReg(8);
+    result.lastEpc = hart.GetReg(6);
+    result.lastMtime = hart.GetReg(9);
+    return result;
+}
+
+// Returns the number of modes that don't agree with single stepping
+unsigned long Compare(const std::vector<Result>& results, const char* name)
+{
+    unsigned long errors = 0;
+    for (size_t i = 1; i < results.size(); ++i)
+    {
+        if (results[i].instructions != results[0].instructions || results[i].pc != results[0].pc ||
+            results[i].iterations != results[0].iterations || results[i].interrupts != results[0].interrupts ||
+            results[i].lastEpc != results[0].lastEpc || results[i].lastMtime != results[0].lastMtime)
+        {
+            std::cout << "!! " << name << ": " << MODE_NAMES[i] << " doesn't match " << MODE_NAMES[0] << std::endl;
+            errors++;
+        }
+    }
+    return errors;
+}
+
+void Load(rv::MemoryMap& memoryMap, const uint32_t address, const std::vector<uint32_t>& program)
+{
+    for (size_t i = 0; i < program.size(); ++i)
+    {
+        memoryMap.WriteWord(address + i * 4, program[i]);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rv::MemoryMap memoryMap(0, MEM_SIZE);
+    rv::RiscvProcessor hart(memoryMap, 0);
+    rv::Clint clint;
+    clint.SetHarts({&hart});
+    memoryMap.AddDevice("clint", CLINT_ADDR, rv::Clint::SIZE,
+        [&clint](const rv::MemoryMap::AddrType offset, const unsigned int size)
+        {
+            return clint.Read(offset, size);
+        },
+        [&clint](const rv::MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+        {
+            clint.Write(offset, size, data);
+        });
+
+    Load(memoryMap, LOOP_ADDR, LOOP_PROGRAM);
+    Load(memoryMap, HANDLER_ADDR, HANDLER_PROGRAM);
+    Load(memoryMap, MTIME_LOOP_ADDR, MTIME_LOOP_PROGRAM);
+    Load(memoryMap, IPI_LOOP_ADDR, IPI_LOOP_PROGRAM);
+    Load(memoryMap, IPI_HANDLER_ADDR, IPI_HANDLER_PROGRAM);
+
+    unsigned long errors = 0;
+
+    // Every mode has to agree on where each interrupt was taken
+    std::vector<Result> results;
+    for (Mode mode : {MODE_STEP, MODE_BLOCK, MODE_JIT})
+    {
+        Setup(hart, clint, mode, true);
+        Run(hart, mode, RUN_INSTRUCTIONS);
+
+        Result result = GetResult(hart);
+        results.push_back(result);
+
+        std::cout << std::setw(5) << MODE_NAMES[mode] << ": " << result.interrupts << " interrupts, ";
+        std::cout << result.iterations << " iterations" << std::endl;
+    }
+    errors += Compare(results, "timer");
+    // Roughly one interrupt per period, each spending a handler's worth of it
+    uint32_t expected = RUN_INSTRUCTIONS / (PERIOD + HANDLER_PROGRAM.size());
+    if (results[0].interrupts < expected - 1 || results[0].interrupts > expected + 1)
+    {
+        std::cout << "!! " << results[0].interrupts << " interrupts, expecting about " << expected << std::endl;
+        errors++;
+    }
+
+    // mtime as the guest sees it, and msip
+    if (clint.Read(rv::Clint::MTIME, 8) != hart.GetInstructionCount())
+    {
+        std::cout << "!! mtime is " << clint.Read(rv::Clint::MTIME, 8) << std::endl;
+        errors++;
+    }
+    hart.SetCSRValue(rv::RiscvProcessor::csr_mie, 0x8);        // msie
+    clint.Write(rv::Clint::MSIP, 4, 1);
+    hart.Step();
+    if (hart.GetCSRValue(rv::RiscvProcessor::csr_mcause) != 0x80000003 || clint.Read(rv::Clint::MSIP, 4) != 1)
+    {
+        std::cout << "!! software interrupt wasn't taken" << std::endl;
+        errors++;
+    }
+    clint.Write(rv::Clint::MSIP, 1, 0);
+
+    // mtime read in the middle of a block sees the instructions before it
+    results.clear();
+    for (Mode mode : {MODE_STEP, MODE_BLOCK, MODE_JIT})
+    {
+        Setup(hart, clint, mode, false, MTIME_LOOP_ADDR);
+        Run(hart, mode, MTIME_INSTRUCTIONS);
+        results.push_back(GetResult(hart));
+    }
+    errors += Compare(results, "mtime");
+    if (results[0].lastMtime != results[0].iterations + (results[0].iterations / 3 - 1) * 2)
+    {
+        std::cout << "!! mtime read as " << results[0].lastMtime << std::endl;
+        errors++;
+    }
+
+    // A store to the hart's own msip interrupts it before the next instruction
+    results.clear();
+    for (Mode mode : {MODE_STEP, MODE_BLOCK, MODE_JIT})
+    {
+        Setup(hart, clint, mode, false, IPI_LOOP_ADDR, IPI_HANDLER_ADDR, 0x8);  // msie
+        Run(hart, mode, IPI_INSTRUCTIONS);
+        results.push_back(GetResult(hart));
+    }
+    errors += Compare(results, "msip");
+    if (results[0].interrupts == 0 || results[0].lastEpc != IPI_LOOP_ADDR + 4)
+    {
+        std::cout << "!! software interrupts taken at 0x" << std::hex << results[0].lastEpc << std::dec << std::endl;
+        errors++;
+    }
+    clint.Write(rv::Clint::MSIP, 4, 0);
+
+    // What the timer costs a running hart
+    for (Mode mode : {MODE_BLOCK, MODE_JIT})
+    {
+        for (bool armed : {false, true})
+        {
+            Setup(hart, clint, mode, armed);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            Run(hart, mode, BENCH_INSTRUCTIONS);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - begin).count();
+
+            std::cout << std::setw(5) << MODE_NAMES[mode] << (armed ? ", timer armed: " : ", no timer:    ");
+            std::cout << std::fixed << std::setprecision(1);
+            std::cout << BENCH_INSTRUCTIONS / seconds / 1e6 << " MIPS" << std::endl;
+        }
+    }
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+
+#include "memorymap.h"
+#include "uart.h"
+
+namespace rv = riscvdb;
+
+// Checks the UART's registers, that transmitted bytes are written out a line
+// (or a buffer) at a time, and receiving from a file, and benchmarks
+// transmitting through the memory map.
+
+namespace
+{
+
+const uint32_t UART_ADDR = 0x10000;
+const uint32_t MEM_SIZE = 0x20000;
+
+const unsigned long BENCH_LINES = 200000;
+const std::string BENCH_LINE = "the quick brown fox jumps over the lazy dog, over and over again\n";
+
+// Keeps what's written to it, and counts the flushes
+class CountingBuf : public std::stringbuf
+{
+public:
+    unsigned long syncs = 0;
+
+protected:
+    int sync() override
+    {
+        syncs++;
+        return std::stringbuf::sync();
+    }
+};
+
+void Transmit(rv::MemoryMap& memoryMap, const std::string& text)
+{
+    for (char c : text)
+    {
+        // as a driver would, waiting for room first
+        while ((memoryMap.ReadByte(UART_ADDR + rv::Uart::LSR) & rv::Uart::LSR_THRE) == 0)
+        {
+        }
+        memoryMap.WriteByte(UART_ADDR + rv::Uart::RBR, static_cast<uint8_t>(c));
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    rv::MemoryMap memoryMap(0, MEM_SIZE);
+    rv::Uart uart;
+    memoryMap.AddDevice("uart", UART_ADDR, rv::Uart::SIZE,
+        [&uart](const rv::MemoryMap::AddrType offset, const unsigned int size)
+        {
+            return uart.Read(offset, size);
+        },
+        [&uart](const rv::MemoryMap::AddrType offset, const unsigned int size, const uint64_t data)
+        {
+            uart.Write(offset, size, data);
+        });
+
+    CountingBuf buf;
+    std::ostream out(&buf);
+    uart.SetOutput(out);
+
+    unsigned long errors = 0;
+
+    // Nothing goes out until the end of the line, and then all of it at once
+    Transmit(memoryMap, "hello");
+    bool heldBack = buf.str().empty();
+    Transmit(memoryMap, " world\n");
+    if (!heldBack || buf.str() != "hello world\n" || buf.syncs != 1)
+    {
+        std::cout << "!! line written as \"" << buf.str() << "\" with " << buf.syncs << " flushes" << std::endl;
+        errors++;
+    }
+
+    // A line longer than the buffer goes out as the buffer fills
+    buf.str("");
+    buf.syncs = 0;
+    Transmit(memoryMap, std::string(rv::Uart::BUFFER_SIZE + 10, 'x'));
+    bool filled = buf.str().size() == rv::Uart::BUFFER_SIZE && buf.syncs == 1;
+    uart.Flush();
+    if (!filled || buf.str().size() != rv::Uart::BUFFER_SIZE + 10)
+    {
+        std::cout << "!! long line written as " << buf.str().size() << " bytes" << std::endl;
+        errors++;
+    }
+
+    // The divisor latch hides the data registers, and the rest hold their values
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::LCR, rv::Uart::LCR_DLAB | 0x03);
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::RBR, 0x12);
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::IER, 0x34);
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::LCR, 0x03);
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::SCR, 0x5a);
+    buf.str("");
+    uart.Flush();
+    if (!buf.str().empty() || memoryMap.ReadByte(UART_ADDR + rv::Uart::IER) != 0 ||
+        memoryMap.ReadByte(UART_ADDR + rv::Uart::SCR) != 0x5a ||
+        memoryMap.ReadByte(UART_ADDR + rv::Uart::LCR) != 0x03)
+    {
+        std::cout << "!! registers" << std::endl;
+        errors++;
+    }
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::LCR, rv::Uart::LCR_DLAB);
+    if (memoryMap.ReadByte(UART_ADDR + rv::Uart::RBR) != 0x12 || memoryMap.ReadByte(UART_ADDR + rv::Uart::IER) != 0x34)
+    {
+        std::cout << "!! divisor latch" << std::endl;
+        errors++;
+    }
+    memoryMap.WriteByte(UART_ADDR + rv::Uart::LCR, 0x03);
+
+    // Receiving a file, until its end
+    std::string input(rv::Uart::BUFFER_SIZE * 2 + 100, '\0');
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        input[i] = static_cast<char>('a' + i % 26);
+    }
+    std::string inputPath = "uart_test_input.txt";
+    std::ofstream(inputPath) << input;
+    if (uart.OpenInput(inputPath) != 0)
+    {
+        std::cout << "!! can't open " << inputPath << std::endl;
+        return 1;
+    }
+    std::string received;
+    while (memoryMap.ReadByte(UART_ADDR + rv::Uart::LSR) & rv::Uart::LSR_DR)
+    {
+        received.push_back(static_cast<char>(memoryMap.ReadByte(UART_ADDR + rv::Uart::RBR)));
+    }
+    std::remove(inputPath.c_str());
+    if (received != input)
+    {
+        std::cout << "!! received " << received.size() << " bytes, expecting " << input.size() << std::endl;
+        errors++;
+    }
+
+    // Transmit throughput, flushing a line at a time
+    std::string text;
+    for (unsigned long i = 0; i < BENCH_LINES; ++i)
+    {
+        text += BENCH_LINE;
+    }
+    buf.str("");
+    buf.syncs = 0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Transmit(memoryMap, text);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "transmit: " << text.size() / seconds / 1e6 << " MB/s, ";
+    std::cout << buf.syncs << " flushes" << std::endl;
+    if (buf.str() != text || buf.syncs != BENCH_LINES)
+    {
+        std::cout << "!! transmitted text doesn't match" << std::endl;
+        errors++;
+    }
+
+    return errors == 0 ? 0 : 1;
+}